@@ -9,10 +9,16 @@ BatchedRequest::BatchedRequest(std::vector<std::shared_ptr<InferRequest>> reqs)
 
 uint32_t BatchedRequest::get_num_reqs() { return _reqs.size(); }
 
+// decode: 1 row, prefill: the current chunk (whole prompt without chunked prefill)
+uint32_t BatchedRequest::get_num_rows(Ptr<InferRequest> req) {
+    if (req->is_initiated) return 1;
+    return req->chunk_size > 0 ? req->chunk_size : req->input_size;
+}
+
 uint32_t BatchedRequest::get_num_rows() {
     uint32_t num_rows = 0;
     for (auto req : _reqs) {
-        num_rows += req->is_initiated ? 1 : req->input_size;
+        num_rows += get_num_rows(req);
     }
     return num_rows;
 }
@@ -20,7 +26,7 @@ uint32_t BatchedRequest::get_num_rows() {
 std::vector<uint32_t> BatchedRequest::get_num_rows_breakdown() {
     std::vector<uint32_t> num_rows_breakdown;
     for (auto req : _reqs) {
-        num_rows_breakdown.push_back(req->is_initiated ? 1 : req->input_size);
+        num_rows_breakdown.push_back(get_num_rows(req));
     }
     return num_rows_breakdown;
 }
@@ -7,6 +7,7 @@ class BatchedRequest {
     BatchedRequest(std::vector<std::shared_ptr<InferRequest>> reqs);
     uint32_t get_num_reqs();
     uint32_t get_num_rows();
+    static uint32_t get_num_rows(Ptr<InferRequest> req);
     std::vector<uint32_t> get_num_rows_breakdown();
 
     bool is_initiated(uint32_t index);
@@ -0,0 +1,57 @@
+#include "ClockScheduler.h"
+
+#include <algorithm>
+#include <cassert>
+
+uint32_t ClockScheduler::add_domain(std::string name, uint32_t freq_mhz) {
+    assert(freq_mhz > 0);
+    uint32_t id = _domains.size();
+    // a domain added mid-simulation starts at its first edge not before the current one
+    cycle_type cycles = 0;
+    if (!_heap.empty()) {
+        _domains.push_back(Domain{.name = name, .freq = freq_mhz, .cycles = 0});
+        cycles = cycle_at(id, _heap.front());
+        _domains.pop_back();
+    }
+    _domains.push_back(Domain{.name = name, .freq = freq_mhz, .cycles = cycles});
+    _heap.push_back(id);
+    std::push_heap(_heap.begin(), _heap.end(),
+                   [this](uint32_t a, uint32_t b) { return later(a, b); });
+    return id;
+}
+
+const std::vector<uint32_t> &ClockScheduler::next_edge() {
+    auto cmp = [this](uint32_t a, uint32_t b) { return later(a, b); };
+    _edge.clear();
+    if (_heap.empty()) return _edge;
+
+    uint32_t first = _heap.front();
+    _time_us = (double)_domains[first].cycles / _domains[first].freq;
+    while (!_heap.empty() && compare(_heap.front(), first) == 0) {
+        std::pop_heap(_heap.begin(), _heap.end(), cmp);
+        _edge.push_back(_heap.back());
+        _heap.pop_back();
+    }
+    std::sort(_edge.begin(), _edge.end());
+    for (uint32_t id : _edge) {
+        _domains[id].cycles++;
+        _heap.push_back(id);
+        std::push_heap(_heap.begin(), _heap.end(), cmp);
+    }
+    return _edge;
+}
+
+cycle_type ClockScheduler::cycle_at(uint32_t id, uint32_t other_id) {
+    // smallest k with k / f >= c / g: ceil(c * f / g)
+    unsigned __int128 numerator =
+        (unsigned __int128)_domains[other_id].cycles * _domains[id].freq;
+    uint32_t denominator = _domains[other_id].freq;
+    return (cycle_type)((numerator + denominator - 1) / denominator);
+}
+
+int ClockScheduler::compare(uint32_t a, uint32_t b) {
+    // 128-bit products: cycle counts stay exact past 2^64 / freq
+    unsigned __int128 ta = (unsigned __int128)_domains[a].cycles * _domains[b].freq;
+    unsigned __int128 tb = (unsigned __int128)_domains[b].cycles * _domains[a].freq;
+    return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
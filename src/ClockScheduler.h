@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "SimulationConfig.h"
+
+// Exact multi-clock scheduling over any number of clock domains with integer frequencies (MHz).
+// The k-th edge of a domain of frequency f is at k/f us; edges are compared by cross
+// multiplication (k_a * f_b vs k_b * f_a), so there is no floating point drift however long the
+// simulation runs and domains whose edges coincide always tick together.
+//
+// Domains sit in a min-heap on their next edge.
+class ClockScheduler {
+   public:
+    // returns the domain id, domains tick in registration order within one edge
+    uint32_t add_domain(std::string name, uint32_t freq_mhz);
+
+    // pops the earliest edge: the domains ticking at it, each of their cycle counts advanced
+    const std::vector<uint32_t> &next_edge();
+
+    // first edge of the domain at or after the next edge of another domain (cycle count)
+    cycle_type cycle_at(uint32_t id, uint32_t other_id);
+
+    cycle_type get_cycles(uint32_t id) { return _domains[id].cycles; }
+    uint32_t get_freq(uint32_t id) { return _domains[id].freq; }
+    std::string get_name(uint32_t id) { return _domains[id].name; }
+    uint32_t count_domains() { return _domains.size(); }
+    double get_time_us() { return _time_us; }  // of the last edge, for reporting only
+
+   private:
+    struct Domain {
+        std::string name;
+        uint32_t freq;
+        cycle_type cycles;  // edges fired, the next edge is at cycles / freq us
+    };
+    std::vector<Domain> _domains;
+    std::vector<uint32_t> _heap;  // domain ids, earliest next edge on top
+    std::vector<uint32_t> _edge;
+    double _time_us = 0;
+
+    // -1, 0, 1 as the next edge of a is before, with or after the next edge of b
+    int compare(uint32_t a, uint32_t b);
+    bool later(uint32_t a, uint32_t b) { return compare(a, b) > 0; }
+};
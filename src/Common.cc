@@ -1,22 +1,15 @@
 #include "Common.h"
 
-uint32_t generate_id() {
-    static uint32_t id_counter{0};
-    return id_counter++;
-}
-uint32_t generate_mem_access_id() {
-    static uint32_t id_counter{0};
-    return id_counter++;
-}
-
-namespace AddressConfig {
-addr_type alignment = Config::global_config.dram_req_size; // BL * dev width / 8 bytes
-addr_type channel_mask;                                    // not used
-addr_type channel_offset;                                  // not used
-} // namespace AddressConfig
+#include "SimContext.h"
 
-int MemoryAccess::req_count = 0;
-int MemoryAccess::pre_req_count = 0;
+AddressConfig::AddressConfig(const SimulationConfig &config)
+    : alignment(config.dram_req_size),
+      // todo: assert log2
+      channel_mask(config.dram_channels - 1),
+      // todo: magic number
+      channel_offset(10),  // 64B req_size -> 6bit + 16 groups of columns -> 4bit
+      dram_channels(config.dram_channels),
+      next_address(0) {}
 
 // FIXME: Magic Numbers
 uint32_t AddressConfig::mask_channel(addr_type address) {
@@ -52,12 +45,10 @@ addr_type AddressConfig::switch_co_ch(addr_type addr) {
 // align cachline size to 4B
 // ex) allocate 31 bytes => align to 32 bytes
 addr_type AddressConfig::allocate_address(uint32_t size) {
-    static addr_type base_addr{0};
-
-    addr_type result = base_addr;
-    base_addr += size;
-    if (base_addr & (alignment - 1)) {
-        base_addr += alignment - (base_addr & (alignment - 1));
+    addr_type result = next_address;
+    next_address += size;
+    if (next_address & (alignment - 1)) {
+        next_address += alignment - (next_address & (alignment - 1));
     }
 
     return result;
@@ -70,27 +61,27 @@ addr_type AddressConfig::align(addr_type addr) {
     return aligned_addr;
 }
 
-std::vector<MemoryAccess *> MemoryAccess::from_instruction(Instruction &inst, uint32_t id, uint32_t size,
-                                                           MemoryAccessType req_type, bool request, uint32_t core_id,
-                                                           cycle_type start_cycle, int buffer_id,
+std::vector<MemoryAccess *> MemoryAccess::from_instruction(SimContext *ctx, Instruction &inst, uint32_t id,
+                                                           uint32_t size, MemoryAccessType req_type, bool request,
+                                                           uint32_t core_id, cycle_type start_cycle, int buffer_id,
                                                            StagePlatform stage_platform) {
-    static addr_type const_addr = 0;
+    addr_type &const_addr = ctx->const_addr;
     const addr_type max_address =
-        Config::global_config.model_n_embd * Config::global_config.model_n_embd * 5 * 2 / Config::global_config.n_tp;
+        ctx->config.model_n_embd * ctx->config.model_n_embd * 5 * 2 / ctx->config.n_tp;
 
     robin_hood::unordered_set<addr_type> aligned_src_addrs;
     for (auto addr : inst.src_addrs) {
-        pre_req_count++;
+        ctx->pre_req_count++;
         const_addr += 2;
         if (const_addr >= max_address) {
             const_addr = 0;
         }
-        aligned_src_addrs.insert(AddressConfig::align(AddressConfig::switch_co_ch(const_addr)));
+        aligned_src_addrs.insert(ctx->address.align(ctx->address.switch_co_ch(const_addr)));
     }
 
     std::vector<MemoryAccess *> ret;
     for (auto &addr : aligned_src_addrs) {
-        req_count++;
+        ctx->req_count++;
 
         MemoryAccess *mem_access = new MemoryAccess{
             .id = id,
@@ -139,8 +130,6 @@ void PrintColor(Color color, std::string str) {
     std::cout << color_code << str << "\033[0m" << std::endl;
 }
 
-SimulationConfig Config::global_config;
-
 SimulationConfig initialize_config(json config) {
     SimulationConfig parsed_config;
     /* Core configs */
@@ -182,7 +171,18 @@ SimulationConfig initialize_config(json config) {
         parsed_config.core_config[core_id].scalar_mul_latency = core_config["scalar_mul_latency"];
 
         parsed_config.core_config[core_id].vector_core_count = core_config["vector_core_count"];
-        // where's a systolic_array_count?
+        parsed_config.core_config[core_id].systolic_array_count = 1;
+        if (core_config.contains("systolic_array_count"))
+            parsed_config.core_config[core_id].systolic_array_count =
+                core_config["systolic_array_count"];
+        parsed_config.core_config[core_id].spad_ports =
+            parsed_config.core_config[core_id].systolic_array_count;
+        if (core_config.contains("spad_ports"))
+            parsed_config.core_config[core_id].spad_ports = core_config["spad_ports"];
+        if (parsed_config.core_config[core_id].systolic_array_count == 0 ||
+            parsed_config.core_config[core_id].spad_ports == 0)
+            throw std::runtime_error(
+                fmt::format("{} needs at least one systolic array and SPAD port", core_id_str));
     }
 
     /* log config*/
@@ -193,6 +193,8 @@ SimulationConfig initialize_config(json config) {
         parsed_config.icnt_type = IcntType::SIMPLE;
     } else if ((std::string)config["icnt_type"] == "booksim2") {
         parsed_config.icnt_type = IcntType::BOOKSIM2;
+    } else if ((std::string)config["icnt_type"] == "noc") {
+        parsed_config.icnt_type = IcntType::NOC;
     } else {
         throw std::runtime_error(fmt::format("Not implemented icnt type {} ", (std::string)config["icnt_type"]));
     }
@@ -200,6 +202,57 @@ SimulationConfig initialize_config(json config) {
     parsed_config.icnt_freq = config["icnt_freq"];
     if (config.contains("icnt_latency"))
         parsed_config.icnt_latency = config["icnt_latency"];
+    parsed_config.icnt_buffer_size = 0;
+    if (config.contains("icnt_buffer_size"))
+        parsed_config.icnt_buffer_size = config["icnt_buffer_size"];
+    parsed_config.core_request_queue_size = 0;
+    if (config.contains("core_request_queue_size"))
+        parsed_config.core_request_queue_size = config["core_request_queue_size"];
+    parsed_config.issue_window_size = 1;
+    if (config.contains("issue_window_size"))
+        parsed_config.issue_window_size = config["issue_window_size"];
+    if (parsed_config.issue_window_size == 0)
+        throw std::runtime_error("issue_window_size must be at least 1");
+    parsed_config.per_core_tile_queues = false;
+    if (config.contains("per_core_tile_queues"))
+        parsed_config.per_core_tile_queues = config["per_core_tile_queues"];
+    parsed_config.max_inflight_operations = 1;
+    if (config.contains("max_inflight_operations"))
+        parsed_config.max_inflight_operations = config["max_inflight_operations"];
+    if (parsed_config.max_inflight_operations == 0)
+        throw std::runtime_error("max_inflight_operations must be at least 1");
+    parsed_config.operation_priority = OperationPriority::PROGRAM_ORDER;
+    if (config.contains("operation_priority")) {
+        std::string operation_priority = config["operation_priority"];
+        if (operation_priority == "program_order")
+            parsed_config.operation_priority = OperationPriority::PROGRAM_ORDER;
+        else if (operation_priority == "critical_path")
+            parsed_config.operation_priority = OperationPriority::CRITICAL_PATH;
+        else
+            throw std::runtime_error(
+                fmt::format("Not implemented operation priority {} ", operation_priority));
+    }
+
+    std::string noc_topology = "mesh";
+    if (config.contains("noc_topology")) noc_topology = config["noc_topology"];
+    if (noc_topology == "crossbar") {
+        parsed_config.noc_topology = NocTopology::CROSSBAR;
+    } else if (noc_topology == "mesh") {
+        parsed_config.noc_topology = NocTopology::MESH;
+    } else if (noc_topology == "ring") {
+        parsed_config.noc_topology = NocTopology::RING;
+    } else {
+        throw std::runtime_error(fmt::format("Not implemented noc topology {} ", noc_topology));
+    }
+    parsed_config.noc_router_latency = 2;
+    if (config.contains("noc_router_latency"))
+        parsed_config.noc_router_latency = config["noc_router_latency"];
+    parsed_config.noc_link_width = 32;
+    if (config.contains("noc_link_width")) parsed_config.noc_link_width = config["noc_link_width"];
+    parsed_config.noc_vc_depth = 8;
+    if (config.contains("noc_vc_depth")) parsed_config.noc_vc_depth = config["noc_vc_depth"];
+    parsed_config.noc_mesh_width = 0;
+    if (config.contains("noc_mesh_width")) parsed_config.noc_mesh_width = config["noc_mesh_width"];
     if (config.contains("icnt_config_path"))
         parsed_config.icnt_config_path = config["icnt_config_path"];
 
@@ -209,80 +262,279 @@ SimulationConfig initialize_config(json config) {
     return parsed_config;
 }
 
-void initialize_memory_config(std::string mem_config_path) {
-    json mem_config = load_config(mem_config_path);
+void initialize_memory_config(SimulationConfig &config, std::string mem_config_path) {
+    initialize_memory_config(config, load_config(mem_config_path));
+}
+
+void initialize_memory_config(SimulationConfig &config, json mem_config) {
     PrintColor(Color::RED, (std::string)mem_config["dram_type"]);
     /* DRAM config */
     if ((std::string)mem_config["dram_type"] == "dram")
-        Config::global_config.dram_type = DramType::DRAM;
+        config.dram_type = DramType::DRAM;
     else if ((std::string)mem_config["dram_type"] == "newton")
-        Config::global_config.dram_type = DramType::NEWTON;
+        config.dram_type = DramType::NEWTON;
     else if ((std::string)mem_config["dram_type"] == "neupims")
-        Config::global_config.dram_type = DramType::NEUPIMS;
+        config.dram_type = DramType::NEUPIMS;
     else
         throw std::runtime_error(fmt::format("Not implemented dram type {} ", (std::string)mem_config["dram_type"]));
-    Config::global_config.dram_freq = mem_config["dram_freq"];
+    config.dram_freq = mem_config["dram_freq"];
 
-    Config::global_config.dram_channels = mem_config["dram_channels"];
+    config.dram_channels = mem_config["dram_channels"];
     if (mem_config.contains("dram_req_size"))
-        Config::global_config.dram_req_size = mem_config["dram_req_size"];
+        config.dram_req_size = mem_config["dram_req_size"];
 
     /* PIM config */
     if (mem_config.contains("pim_config_path")) {
-        Config::global_config.pim_config_path = mem_config["pim_config_path"];
+        config.pim_config_path = mem_config["pim_config_path"];
         // DRAM row buffer size (in bytes)
-        Config::global_config.dram_page_size = mem_config["dram_page_size"];
-        Config::global_config.dram_banks_per_ch = mem_config["dram_banks_per_ch"];
+        config.dram_page_size = mem_config["dram_page_size"];
+        config.dram_banks_per_ch = mem_config["dram_banks_per_ch"];
         // # params per PIM_COMP command
-        Config::global_config.pim_comp_coverage = mem_config["pim_comp_coverage"];
+        config.pim_comp_coverage = mem_config["pim_comp_coverage"];
     }
 
-    Config::global_config.HBM_size = (uint64_t)(mem_config["HBM_size"])GB;
-    Config::global_config.HBM_act_buf_size = (uint64_t)(mem_config["HBM_act_buf_size"])MB;
+    config.HBM_size = (uint64_t)(mem_config["HBM_size"])GB;
+    config.HBM_act_buf_size = (uint64_t)(mem_config["HBM_act_buf_size"])MB;
 }
 
-void initialize_client_config(std::string cli_config_path) {
-    Config::global_config.request_dataset_path = cli_config_path;
+void initialize_client_config(SimulationConfig &config, std::string cli_config_path) {
+    config.request_dataset_path = cli_config_path;
 
     // json cli_config = load_config(cli_config_path);
     // /* Client config */
-    // Config::global_config.request_dataset_path = cli_config["request_dataset_path"];
-    // Config::global_config.request_input_seq_len = cli_config["request_input_seq_len"];
-    // Config::global_config.request_interval = cli_config["request_interval"];
-    // Config::global_config.request_total_cnt = cli_config["request_total_cnt"];
+    // config.request_dataset_path = cli_config["request_dataset_path"];
+    // config.request_input_seq_len = cli_config["request_input_seq_len"];
+    // config.request_interval = cli_config["request_interval"];
+    // config.request_total_cnt = cli_config["request_total_cnt"];
+}
+
+void initialize_model_config(SimulationConfig &config, std::string model_config_path) {
+    initialize_model_config(config, load_config(model_config_path));
 }
 
-void initialize_model_config(std::string model_config_path) {
-    json model_config = load_config(model_config_path);
+void initialize_model_config(SimulationConfig &config, json model_config) {
     /* GPT configs */
-    Config::global_config.model_name = model_config["model_name"];
-    Config::global_config.model_params_b = model_config["model_params_b"];
-    Config::global_config.model_vocab_size = model_config["model_vocab_size"];
-    Config::global_config.model_n_layer = model_config["model_n_layer"];
-    Config::global_config.model_n_head = model_config["model_n_head"];
-    Config::global_config.model_n_embd = model_config["model_n_embd"];
+    config.model_name = model_config["model_name"];
+    config.model_params_b = model_config["model_params_b"];
+    config.model_vocab_size = model_config["model_vocab_size"];
+    config.model_n_layer = model_config["model_n_layer"];
+    config.model_n_head = model_config["model_n_head"];
+    config.model_n_embd = model_config["model_n_embd"];
+    config.model_n_kv_head = config.model_n_head;
+    if (model_config.contains("model_n_kv_head"))
+        config.model_n_kv_head = model_config["model_n_kv_head"];
+    if (config.model_n_kv_head == 0 ||
+        config.model_n_head % config.model_n_kv_head != 0)
+        throw std::runtime_error(fmt::format("model_n_head {} is not a multiple of model_n_kv_head {}",
+                                             config.model_n_head,
+                                             config.model_n_kv_head));
     /* parallelism config */
-    Config::global_config.n_tp = model_config["n_tp"];
+    config.n_tp = model_config["n_tp"];
+    config.n_pp = 1;
+    if (model_config.contains("n_pp")) config.n_pp = model_config["n_pp"];
+    if (config.n_pp == 0) throw std::runtime_error("n_pp must be at least 1");
+}
+
+// Pipeline parallelism is simulated only with pp_accounting, otherwise the simulated device
+// runs every layer as if n_pp were 1
+bool is_pp_accounted(const SimulationConfig &config) {
+    return config.pp_accounting && config.n_pp > 1;
+}
+
+// Layers on one pipeline parallel device (the last one may hold fewer), every layer if the
+// pipeline is not accounted
+uint32_t get_layers_per_pp_device(const SimulationConfig &config) {
+    if (!is_pp_accounted(config)) return config.model_n_layer;
+    return ceil((double)config.model_n_layer / config.n_pp);
 }
-void initialize_system_config(std::string sys_config_path) {
-    json sys_config = load_config(sys_config_path);
+
+// Core cycles to send `bytes` of activations to the next pipeline device
+cycle_type get_p2p_cycles(const SimulationConfig &config, uint64_t bytes) {
+    if (!is_pp_accounted(config) || bytes == 0) return 0;
+    double time_ns = config.pp_link_latency +
+                     (double)bytes / config.pp_link_bandwidth;  // GB/s == bytes/ns
+    return ceil(time_ns * config.core_freq / 1000);             // core_freq: MHz
+}
+
+// Core cycles of an all-reduce of `bytes` over the n_tp devices, 0 unless tp_allreduce is on.
+//  ring: reduce-scatter + all-gather, 2(n-1) steps of bytes/n each
+//  tree: reduce + broadcast, 2*ceil(log2 n) steps of the whole buffer
+cycle_type get_allreduce_cycles(const SimulationConfig &config, uint64_t bytes) {
+    uint32_t n = config.n_tp;
+    if (!config.tp_allreduce || n <= 1 || bytes == 0) return 0;
+    double bandwidth = config.tp_link_bandwidth;  // GB/s == bytes/ns
+    double latency = config.tp_link_latency;
+    double time_ns;
+    if (config.tp_allreduce_alg == AllReduceAlg::RING) {
+        time_ns = 2 * (n - 1) * (latency + (double)bytes / n / bandwidth);
+    } else {
+        time_ns = 2 * ceil(log2((double)n)) * (latency + (double)bytes / bandwidth);
+    }
+    return ceil(time_ns * config.core_freq / 1000);  // core_freq: MHz
+}
+
+// Vector unit cycles of a SAMPLE on core core_id, add_tree_iter add tree passes over the logits:
+// top-k compare trees (argmax if k = 1), then softmax and a draw over the k candidates
+cycle_type get_sampling_cycles(const SimulationConfig &config, uint32_t core_id,
+                               cycle_type add_tree_iter) {
+    const CoreConfig &core = config.core_config[core_id];
+    cycle_type cycles = config.sampling_top_k * add_tree_iter * core.add_tree_latency;
+    if (config.sampling_top_k > 1)
+        cycles += config.sampling_top_k * (core.exp_latency + core.scalar_mul_latency);
+    return cycles;
+}
+
+// KV heads on one device: KV heads are split over tensor parallel devices, and replicated
+// when there are fewer KV heads than devices.
+uint32_t get_kv_heads_per_device(const SimulationConfig &config) {
+    return MAX(1, config.model_n_kv_head / config.n_tp);
+}
+void initialize_system_config(SimulationConfig &config, std::string sys_config_path) {
+    initialize_system_config(config, load_config(sys_config_path));
+}
+
+void initialize_system_config(SimulationConfig &config, json sys_config) {
     /* Batch configs */
     if ((std::string)sys_config["run_mode"] == "npu")
-        Config::global_config.run_mode = RunMode::NPU_ONLY;
+        config.run_mode = RunMode::NPU_ONLY;
     else if ((std::string)sys_config["run_mode"] == "npu+pim")
-        Config::global_config.run_mode = RunMode::NPU_PIM;
+        config.run_mode = RunMode::NPU_PIM;
     else
-        Config::global_config.run_mode = RunMode::NPU_ONLY;
-
-    Config::global_config.ch_load_balancing = sys_config["ch_load_balancing"];
-
-    Config::global_config.kernel_fusion = sys_config["kernel_fusion"];
+        config.run_mode = RunMode::NPU_ONLY;
+
+    config.ch_load_balancing = sys_config["ch_load_balancing"];
+
+    config.kernel_fusion = sys_config["kernel_fusion"];
+
+    config.max_seq_len = sys_config["max_seq_len"];
+    config.max_active_reqs = sys_config["max_active_reqs"];
+    config.max_batch_size = sys_config["max_batch_size"];
+
+    config.prefill_chunk_size = 0;
+    if (sys_config.contains("prefill_chunk_size"))
+        config.prefill_chunk_size = sys_config["prefill_chunk_size"];
+    config.prefill_attention = PrefillAttention::NPU;
+    if (sys_config.contains("prefill_attention")) {
+        std::string prefill_attention = sys_config["prefill_attention"];
+        if (prefill_attention == "npu")
+            config.prefill_attention = PrefillAttention::NPU;
+        else if (prefill_attention == "pim")
+            config.prefill_attention = PrefillAttention::PIM;
+        else
+            throw std::runtime_error(
+                fmt::format("Not implemented prefill attention {} ", prefill_attention));
+    }
 
-    Config::global_config.max_seq_len = sys_config["max_seq_len"];
-    Config::global_config.max_active_reqs = sys_config["max_active_reqs"];
-    Config::global_config.max_batch_size = sys_config["max_batch_size"];
+    config.sub_batch_mode = sys_config["sub_batch_mode"];
+
+    config.adaptive_sub_batch = false;
+    if (sys_config.contains("adaptive_sub_batch"))
+        config.adaptive_sub_batch = sys_config["adaptive_sub_batch"];
+
+    config.relaxed_stage_barriers = false;
+    if (sys_config.contains("relaxed_stage_barriers"))
+        config.relaxed_stage_barriers = sys_config["relaxed_stage_barriers"];
+
+    config.partition_alg = PartitionAlg::SIMPLE;
+    if (sys_config.contains("partition_alg")) {
+        std::string partition_alg = sys_config["partition_alg"];
+        if (partition_alg == "simple")
+            config.partition_alg = PartitionAlg::SIMPLE;
+        else if (partition_alg == "dp")
+            config.partition_alg = PartitionAlg::DP;
+        else if (partition_alg == "bitset_dp")
+            config.partition_alg = PartitionAlg::BITSET_DP;
+        else if (partition_alg == "karmarkar_karp")
+            config.partition_alg = PartitionAlg::KARMARKAR_KARP;
+        else if (partition_alg == "channel_greedy")
+            config.partition_alg = PartitionAlg::CHANNEL_GREEDY;
+        else
+            throw std::runtime_error(fmt::format("Not implemented partition algorithm {} ", partition_alg));
+    }
 
-    Config::global_config.sub_batch_mode = sys_config["sub_batch_mode"];
+    config.num_sub_batches = 1;
+    if (config.sub_batch_mode) {
+        config.num_sub_batches = 2;
+        if (sys_config.contains("sub_batches"))
+            config.num_sub_batches = sys_config["sub_batches"];
+    }
+    if (config.sub_batch_mode && sys_config.contains("stage_schedule")) {
+        // [{"name": "A", "sa": 0, "sa_ops": "qkv_gen", "pim": -1}, ...]
+        // sa_ops: qkv_gen, proj_ffns, proj_ffns+qkv_gen
+        config.stage_schedule.clear();
+        for (auto &stage : sys_config["stage_schedule"]) {
+            StageEntry entry{"", -1, false, false, -1, false};
+            entry.name = stage["name"];
+            if (stage.contains("sa")) entry.sa_sub_batch = stage["sa"];
+            if (stage.contains("pim")) entry.pim_sub_batch = stage["pim"];
+            if (entry.sa_sub_batch >= 0) {
+                std::string sa_ops = stage["sa_ops"];
+                if (sa_ops == "qkv_gen")
+                    entry.qkv_gen = true;
+                else if (sa_ops == "proj_ffns")
+                    entry.proj_ffns = true;
+                else if (sa_ops == "proj_ffns+qkv_gen")
+                    entry.proj_ffns = entry.qkv_gen = true;
+                else
+                    throw std::runtime_error(fmt::format("Not implemented sa_ops {} ", sa_ops));
+            }
+            config.stage_schedule.push_back(entry);
+        }
+    } else {
+        config.stage_schedule =
+            make_stage_schedule(config.num_sub_batches);
+    }
+    validate_stage_schedule(config.stage_schedule,
+                            config.num_sub_batches);
+
+    config.lm_head = false;
+    if (sys_config.contains("lm_head")) config.lm_head = sys_config["lm_head"];
+    config.sampling_top_k = 1;
+    if (sys_config.contains("sampling_top_k"))
+        config.sampling_top_k = sys_config["sampling_top_k"];
+    config.lm_head_pim_max_batch = 0;
+    if (sys_config.contains("lm_head_pim_max_batch"))
+        config.lm_head_pim_max_batch = sys_config["lm_head_pim_max_batch"];
+    if (config.sampling_top_k == 0)
+        throw std::runtime_error("sampling_top_k must be at least 1");
+
+    config.tp_allreduce = false;
+    if (sys_config.contains("tp_allreduce")) config.tp_allreduce = sys_config["tp_allreduce"];
+    config.tp_link_bandwidth = 64;
+    if (sys_config.contains("tp_link_bandwidth"))
+        config.tp_link_bandwidth = sys_config["tp_link_bandwidth"];
+    config.tp_link_latency = 1000;
+    if (sys_config.contains("tp_link_latency"))
+        config.tp_link_latency = sys_config["tp_link_latency"];
+    config.tp_allreduce_alg = AllReduceAlg::RING;
+    if (sys_config.contains("tp_allreduce_alg")) {
+        std::string tp_allreduce_alg = sys_config["tp_allreduce_alg"];
+        if (tp_allreduce_alg == "ring")
+            config.tp_allreduce_alg = AllReduceAlg::RING;
+        else if (tp_allreduce_alg == "tree")
+            config.tp_allreduce_alg = AllReduceAlg::TREE;
+        else
+            throw std::runtime_error(
+                fmt::format("Not implemented all-reduce algorithm {} ", tp_allreduce_alg));
+    }
+    if (config.tp_link_bandwidth <= 0)
+        throw std::runtime_error("tp_link_bandwidth must be positive");
+
+    config.pp_accounting = false;
+    if (sys_config.contains("pp_accounting")) config.pp_accounting = sys_config["pp_accounting"];
+    config.pp_link_bandwidth = 64;
+    if (sys_config.contains("pp_link_bandwidth"))
+        config.pp_link_bandwidth = sys_config["pp_link_bandwidth"];
+    config.pp_link_latency = 1000;
+    if (sys_config.contains("pp_link_latency"))
+        config.pp_link_latency = sys_config["pp_link_latency"];
+    config.pp_micro_batches = config.n_pp;
+    if (sys_config.contains("pp_micro_batches"))
+        config.pp_micro_batches = sys_config["pp_micro_batches"];
+    if (config.pp_link_bandwidth <= 0)
+        throw std::runtime_error("pp_link_bandwidth must be positive");
+    if (config.pp_micro_batches == 0)
+        throw std::runtime_error("pp_micro_batches must be at least 1");
 }
 
 json load_config(std::string config_path) {
@@ -366,6 +618,12 @@ std::string Instruction::repr() {
     case (Opcode::ADD):
         ret += "ADD";
         break;
+    case (Opcode::SAMPLE):
+        ret += "SAMPLE";
+        break;
+    case (Opcode::ALL_REDUCE):
+        ret += "ALL_REDUCE";
+        break;
     case (Opcode::DUMMY):
         ret += "DUMMY";
         break;
@@ -431,8 +689,8 @@ void ast(bool cond) {
     // exit(-1);
 }
 
-MemoryAccess *TransToMemoryAccess(Instruction &inst, uint32_t size, uint32_t core_id, cycle_type start_cycle,
-                                  int buffer_id, StagePlatform stage_platform) {
+MemoryAccess *TransToMemoryAccess(SimContext *ctx, Instruction &inst, uint32_t size, uint32_t core_id,
+                                  cycle_type start_cycle, int buffer_id, StagePlatform stage_platform) {
     MemoryAccessType req_type;
     switch (inst.opcode) {
     case Opcode::PIM_HEADER:
@@ -467,7 +725,7 @@ MemoryAccess *TransToMemoryAccess(Instruction &inst, uint32_t size, uint32_t cor
     addr_type dram_addr = *it;
 
     MemoryAccess *mem_request = new MemoryAccess{
-        .id = generate_mem_access_id(),
+        .id = ctx->generate_mem_access_id(),
         .dram_address = dram_addr,
         .spad_address = inst.dest_addr,
         .size = size,         //
@@ -500,7 +758,7 @@ uint64_t AddressConfig::make_address(int channel, int rank, int bankgroup, int b
     int rank_bits = 1;
     int bankgroup_bits = 2;
     int bank_bits = 2;
-    int channel_bits = LogBase2(Config::global_config.dram_channels);
+    int channel_bits = LogBase2(dram_channels);
     int col_bits = 4;
     int offset = 6;
 
@@ -567,14 +825,114 @@ uint64_t AddressConfig::encode_pim_comps_readres(int ch, int row, int num_comps,
 }
 
 // used for sub-batch interleaving
-std::string stageToString(Stage stage) {
-    static const std::map<Stage, std::string> stageMap = {
-        {Stage::A, "A"}, {Stage::B, "B"}, {Stage::C, "C"},           {Stage::D, "D"},
-        {Stage::E, "E"}, {Stage::F, "F"}, {Stage::Finish, "Finish"},
+// Stages are named A, B, C, ... in schedule order.
+static std::string stageName(uint32_t idx) {
+    if (idx < 26) return std::string(1, (char)('A' + idx));
+    return "S" + std::to_string(idx);
+}
+
+// Default schedule for K sub-batches. SA runs sub-batch i while PIM runs sub-batch i-1.
+// K = 2 gives the NeuPIMs table:
+// |     |     A    |     B    |         C        |         D        |     E     |     F     |
+// |-----|:--------:|:--------:|:----------------:|:----------------:|:---------:|:---------:|
+// |  SA | QKVgen#1 | QKVgen#2 | Pj/FFNs/QKVgen#1 | Pj/FFNs/QKVgen#2 | Pj/FFNs#1 | Pj/FFNs#2 |
+// | PIM |     -    |  MHA#1   | MHA#2            | MHA#1            |   MHA#2   |     -     |
+// K = 1 (sub-batch interleaving off) runs QKVgen, MHA and Pj/FFNs one after another.
+std::vector<StageEntry> make_stage_schedule(uint32_t num_sub_batches) {
+    std::vector<StageEntry> schedule;
+    int K = num_sub_batches;
+    assert(K >= 1);
+
+    if (K == 1) {
+        // names follow the 2-way table (A, B, E) so that logs are comparable
+        schedule.push_back(StageEntry{"A", 0, false, true, -1, false});
+        schedule.push_back(StageEntry{"B", -1, false, false, 0, false});
+        schedule.push_back(StageEntry{"E", 0, true, false, -1, false});
+        return schedule;
+    }
+
+    // prologue: QKVgen of every sub-batch
+    for (int i = 0; i < K; i++) {
+        schedule.push_back(StageEntry{"", i, false, true, i == 0 ? -1 : i - 1, false});
+    }
+    // steady state (repeated for the remaining layers)
+    for (int i = 0; i < K; i++) {
+        schedule.push_back(StageEntry{"", i, true, true, (i + K - 1) % K, false});
+    }
+    // epilogue: last Pj/FFNs of every sub-batch
+    for (int i = 0; i < K; i++) {
+        schedule.push_back(StageEntry{"", i, true, false, i == 0 ? K - 1 : -1, false});
+    }
+
+    for (uint32_t i = 0; i < schedule.size(); i++) {
+        schedule[i].name = stageName(i);
+    }
+    return schedule;
+}
+
+// Every sub-batch must go through QKVgen -> MHA -> (Pj/FFNs/QKVgen -> MHA)* -> Pj/FFNs.
+void validate_stage_schedule(const std::vector<StageEntry> &schedule, uint32_t num_sub_batches) {
+    enum { NEED_QKV, NEED_MHA, NEED_FFN, DONE };
+    std::vector<int> state(num_sub_batches, NEED_QKV);
+
+    auto fail = [](const StageEntry &entry, std::string reason) {
+        throw std::runtime_error(
+            fmt::format("Invalid stage schedule at stage {}: {}", entry.name, reason));
+    };
+
+    for (auto &entry : schedule) {
+        if (entry.sa_sub_batch >= (int)num_sub_batches || entry.pim_sub_batch >= (int)num_sub_batches)
+            fail(entry, "sub-batch index out of range");
+        if (entry.sa_sub_batch >= 0 && entry.sa_sub_batch == entry.pim_sub_batch)
+            fail(entry, "SA and PIM run the same sub-batch");
+
+        if (entry.sa_sub_batch >= 0) {
+            int &s = state[entry.sa_sub_batch];
+            if (entry.proj_ffns) {
+                if (s != NEED_FFN) fail(entry, "Pj/FFNs before MHA");
+                s = entry.qkv_gen ? NEED_MHA : DONE;
+            } else if (entry.qkv_gen) {
+                if (s != NEED_QKV) fail(entry, "QKVgen out of order");
+                s = NEED_MHA;
+            } else {
+                fail(entry, "SA sub-batch without operations");
+            }
+        }
+        if (entry.pim_sub_batch >= 0) {
+            int &s = state[entry.pim_sub_batch];
+            if (s != NEED_MHA) fail(entry, "MHA before QKVgen");
+            s = NEED_FFN;
+        }
+    }
+
+    for (uint32_t i = 0; i < num_sub_batches; i++) {
+        if (state[i] != DONE)
+            throw std::runtime_error(
+                fmt::format("Invalid stage schedule: sub-batch {} does not finish", i));
+    }
+}
+
+std::string partitionAlgToString(PartitionAlg alg) {
+    static const std::map<PartitionAlg, std::string> algMap = {
+        {PartitionAlg::SIMPLE, "simple"},
+        {PartitionAlg::DP, "dp"},
+        {PartitionAlg::BITSET_DP, "bitset_dp"},
+        {PartitionAlg::KARMARKAR_KARP, "karmarkar_karp"},
+        {PartitionAlg::CHANNEL_GREEDY, "channel_greedy"},
+    };
+
+    auto it = algMap.find(alg);
+    return (it != algMap.end()) ? it->second : "unknown";
+}
+
+std::string allReduceAlgToString(AllReduceAlg alg) {
+    static const std::map<AllReduceAlg, std::string> algMap = {
+        {AllReduceAlg::RING, "ring"},
+        {AllReduceAlg::TREE, "tree"},
     };
 
-    auto it = stageMap.find(stage);
-    return (it != stageMap.end()) ? it->second : "unknown";
+    auto it = algMap.find(alg);
+    return (it != algMap.end()) ? it->second : "unknown";
 }
 
 std::string stagePlatformToString(StagePlatform sp) {
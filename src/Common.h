@@ -52,21 +52,28 @@ using Ptr = std::shared_ptr<T>;
 typedef uint64_t addr_type;
 typedef uint64_t cycle_type;
 
-namespace AddressConfig {
-extern addr_type alignment;
-extern addr_type channel_mask;
-extern addr_type channel_offset;
-
-uint32_t mask_channel(addr_type address);
-addr_type allocate_address(uint32_t size);
-addr_type align(addr_type addr);
-
-uint64_t make_address(int channel, int rank, int bankgroup, int bank, int row, int col);
-uint64_t encode_pim_header(int channel, int row, bool for_gwrite, int num_comps, int num_readres);
-uint64_t encode_pim_comps_readres(int ch, int row, int num_comps, bool last_cmd);
-
-addr_type switch_co_ch(addr_type addr);
-}  // namespace AddressConfig
+// DRAM address mapping of one simulation (SimContext::address)
+struct AddressConfig {
+    AddressConfig() = default;
+    AddressConfig(const SimulationConfig &config);
+
+    addr_type alignment;       // BL * dev width / 8 bytes
+    addr_type channel_mask;
+    addr_type channel_offset;  // not used
+    uint32_t dram_channels;
+    addr_type next_address;  // allocate_address (NPU-only)
+
+    uint32_t mask_channel(addr_type address);
+    addr_type allocate_address(uint32_t size);
+    addr_type align(addr_type addr);
+
+    uint64_t make_address(int channel, int rank, int bankgroup, int bank, int row, int col);
+    uint64_t encode_pim_header(int channel, int row, bool for_gwrite, int num_comps,
+                               int num_readres);
+    uint64_t encode_pim_comps_readres(int ch, int row, int num_comps, bool last_cmd);
+
+    addr_type switch_co_ch(addr_type addr);
+};
 
 enum class Color { RED, GREEN, YELLOW, BLUE, MAGENTA, CYAN, DEFAULT };
 
@@ -83,6 +90,8 @@ enum class Opcode {
     GELU,
     SOFTMAX,
     ADD,
+    SAMPLE,
+    ALL_REDUCE,
     BAR,
     PIM_HEADER,
     PIM_GWRITE,
@@ -174,6 +183,7 @@ struct Tile {
     // populate accurate memory request when store instruction is decoded
     uint32_t remaining_accum_io;
     StagePlatform stage_platform;  // SA program / PIM program (for sub-batch interleaving)
+    std::vector<uint64_t> estimated_cycles;  // per core, by the heterogeneous core dispatcher
     std::string repr();
 };
 
@@ -182,10 +192,8 @@ enum class MemoryAccessType { READ, WRITE, GWRITE, COMP, READRES, P_HEADER, COMP
 std::string memAccessTypeString(MemoryAccessType type);
 std::string opcodeTypeString(Opcode opcode);
 
+class SimContext;
 typedef struct MemoryAccess {
-    static int req_count;
-    static int pre_req_count;
-
     uint32_t id;
     addr_type dram_address;
     addr_type spad_address;
@@ -198,30 +206,29 @@ typedef struct MemoryAccess {
     cycle_type dram_finish_cycle;
     int buffer_id;
 
-    static std::vector<MemoryAccess *> from_instruction(Instruction &inst, uint32_t id,
-                                                        uint32_t size, MemoryAccessType req_type,
-                                                        bool request, uint32_t core_id,
-                                                        cycle_type start_cycle, int buffer_id,
+    static std::vector<MemoryAccess *> from_instruction(SimContext *ctx, Instruction &inst,
+                                                        uint32_t id, uint32_t size,
+                                                        MemoryAccessType req_type, bool request,
+                                                        uint32_t core_id, cycle_type start_cycle,
+                                                        int buffer_id,
                                                         StagePlatform stage_platform);
 
     std::weak_ptr<Tile> parent_tile;
     // SA program / PIM program (for sub-batch interleaving)
     StagePlatform stage_platform;
 
-    static void log_count() {
-        spdlog::info("total pre req count {} / memory request count {}", pre_req_count, req_count);
-    }
-
 } MemoryAccess;
 
-uint32_t generate_id();
-uint32_t generate_mem_access_id();
 json load_config(std::string config_path);
 SimulationConfig initialize_config(json config);  // npu config
-void initialize_memory_config(std::string mem_config_path);
-void initialize_client_config(std::string cli_config_path);
-void initialize_model_config(std::string model_config_path);
-void initialize_system_config(std::string sys_config_path);
+void initialize_memory_config(SimulationConfig &config, std::string mem_config_path);
+void initialize_client_config(SimulationConfig &config, std::string cli_config_path);
+void initialize_model_config(SimulationConfig &config, std::string model_config_path);
+void initialize_system_config(SimulationConfig &config, std::string sys_config_path);
+// already loaded config files (sweep points override keys before parsing)
+void initialize_memory_config(SimulationConfig &config, json mem_config);
+void initialize_model_config(SimulationConfig &config, json model_config);
+void initialize_system_config(SimulationConfig &config, json sys_config);
 
 std::string to_hex(uint32_t input);
 template <typename... Args>
@@ -250,6 +257,11 @@ typedef struct {
     // request status
     bool is_initiated;   // whether initialization phase is done
     uint32_t generated;  // # tokens generated
+    // chunked prefill
+    uint32_t prefilled;          // prompt tokens already in the KV cache
+    uint32_t chunk_size;         // prompt tokens processed in the current iteration
+    cycle_type first_token_cycle;  // scheduler core cycle of the first generated token
+    cycle_type scheduled_cycle;    // scheduler core cycle the request was added at
     // mapped channel
     int channel;
 
@@ -266,31 +278,24 @@ std::vector<T> slice(std::vector<T> &inp, int start, int end) {
     return std::vector<T>(inp.begin() + start, inp.begin() + end);
 }
 
-template <typename T>
-class Singleton {
-   protected:
-    static T *instance;
-
-   public:
-    static T *GetInstance() {
-        if (instance == nullptr) instance = new T();
-
-        return instance;
-    }
-    static void Delete() { delete instance; }
-};
-template <typename T>
-T *Singleton<T>::instance = nullptr;
-
-MemoryAccess *TransToMemoryAccess(Instruction &inst, uint32_t size, uint32_t core_id,
-                                  cycle_type start_cycle, int buffer_id,
+MemoryAccess *TransToMemoryAccess(SimContext *ctx, Instruction &inst, uint32_t size,
+                                  uint32_t core_id, cycle_type start_cycle, int buffer_id,
                                   StagePlatform stage_platform);
 
 int LogBase2(int power_of_two);
 
 // for Sub-batch interleaving
-enum class Stage { A, B, C, D, E, F, Finish };
 enum class StagePlatform { SA, PIM, SIZE };
-std::string stageToString(Stage stage);
+uint32_t get_kv_heads_per_device(const SimulationConfig &config);
+cycle_type get_allreduce_cycles(const SimulationConfig &config, uint64_t bytes);
+cycle_type get_sampling_cycles(const SimulationConfig &config, uint32_t core_id,
+                               cycle_type add_tree_iter);
+bool is_pp_accounted(const SimulationConfig &config);
+uint32_t get_layers_per_pp_device(const SimulationConfig &config);
+cycle_type get_p2p_cycles(const SimulationConfig &config, uint64_t bytes);
+std::vector<StageEntry> make_stage_schedule(uint32_t num_sub_batches);
+void validate_stage_schedule(const std::vector<StageEntry> &schedule, uint32_t num_sub_batches);
 std::string stagePlatformToString(StagePlatform sp);
+std::string partitionAlgToString(PartitionAlg alg);
+std::string allReduceAlgToString(AllReduceAlg alg);
 //
\ No newline at end of file
@@ -5,9 +5,10 @@
 #include "Stat.h"
 #include "helper/HelperFunctions.h"
 
-Core::Core(uint32_t id, SimulationConfig config)
+Core::Core(uint32_t id, SimContext *ctx)
     : _id(id),
-      _config(config),
+      _ctx(ctx),
+      _config(ctx->config),
       _core_cycle(0),
       _compute_end_cycle(0),
       _stat_idle_cycle(0),
@@ -30,8 +31,8 @@ Core::Core(uint32_t id, SimulationConfig config)
       _stat_add_cycle(0),
       _stat_gelu_cycle(0),
       _stat_softmax_cycle(0),
-      _spad(Sram(config, _core_cycle, false, id)),
-      _acc_spad(Sram(config, _core_cycle, true, id)) {
+      _spad(Sram(ctx->config, _core_cycle, false, id)),
+      _acc_spad(Sram(ctx->config, _core_cycle, true, id)) {
     _waiting_write_reqs = 0;
     _running_layer = -1;
     _current_spad = 0;
@@ -215,7 +216,7 @@ bool Core::running() {
 
 // push into target channel memory request queue
 void Core::push_memory_request(MemoryAccess *request) {
-    int channel = AddressConfig::mask_channel(request->dram_address);
+    int channel = _ctx->address.mask_channel(request->dram_address);
 
     _memory_request_queues[channel].push(request);
 }
@@ -5,13 +5,14 @@
 #include <vector>
 
 #include "Dram.h"
+#include "SimContext.h"
 #include "SimulationConfig.h"
 #include "Sram.h"
 #include "Stat.h"
 
 class Core {
    public:
-    Core(uint32_t id, SimulationConfig config);
+    Core(uint32_t id, SimContext *ctx);
     virtual bool running();
     virtual bool can_issue(Tile &next_tile);
     virtual void issue(Tile &in_tile);
@@ -40,6 +41,7 @@ class Core {
     virtual cycle_type get_inst_compute_cycles(Instruction &inst) = 0;
 
     const uint32_t _id;
+    SimContext *_ctx;
     const SimulationConfig _config;
 
     cycle_type _core_cycle;
@@ -17,7 +17,7 @@ PIM::PIM(SimulationConfig config)
     _stat_interval = 1000;
     _stats.resize(config.dram_channels);
     for (size_t i = 0; i < config.dram_channels; ++i) {
-        _stats[i].push_back(MemoryIOStat(0, i, _stat_interval));
+        _stats[i].push_back(MemoryIOStat(0, i, _stat_interval, config.core_freq));
     }
 
     _config = config;
@@ -33,7 +33,7 @@ PIM::PIM(SimulationConfig config)
     int ba = 1;
     int row = 231;
     int col = 10;
-    uint64_t dram_addr = AddressConfig::make_address(ch, rank, bg, ba, row, col);
+    uint64_t dram_addr = AddressConfig(config).make_address(ch, rank, bg, ba, row, col);
     uint64_t newtonsim_addr = MakeAddress(ch, rank, bg, ba, row, col);
     assert(dram_addr == newtonsim_addr);
     spdlog::info("Newton init");
@@ -60,7 +60,7 @@ void PIM::cycle() {
     // update stats
     if (_cycles % _stat_interval == 0) {
         for (auto ch = 0; ch < _config.dram_channels; ++ch) {
-            auto stat = MemoryIOStat(_cycles, ch, _stat_interval);
+            auto stat = MemoryIOStat(_cycles, ch, _stat_interval, _config.core_freq);
             _stats[ch].push_back(stat);
         }
     }
@@ -179,8 +179,8 @@ void PIM::print_stat() {
     _mem->PrintStats();
 }
 
-void PIM::log(Stage stage) {
-    std::string fname = Config::global_config.log_dir + "/mem_io_" + stageToString(stage) + "_ch_";
+void PIM::log(std::string stage_name) {
+    std::string fname = _config.log_dir + "/mem_io_" + stage_name + "_ch_";
     for (size_t i = 0; i < _stats.size(); ++i) {
         Logger::log(_stats[i], fname + std::to_string(i));
         auto last_stat = _stats[i].back();
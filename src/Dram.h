@@ -25,7 +25,7 @@ class Dram {
     virtual double get_avg_bw_util() = 0;
     virtual uint64_t get_avg_pim_cycle() = 0;
     virtual void reset_pim_cycle() = 0;
-    virtual void log(Stage stage) = 0;
+    virtual void log(std::string stage_name) = 0;
 
    protected:
     SimulationConfig _config;
@@ -51,7 +51,7 @@ class PIM : public Dram {
     uint64_t MakeAddress(int channel, int rank, int bankgroup, int bank, int row, int col);
     uint64_t EncodePIMHeader(int channel, int row, bool for_gwrite, int num_comps, int num_readres);
     void update_stat(uint32_t cid);
-    void log(Stage stage);
+    void log(std::string stage_name);
 
     std::unique_ptr<dramsim3::NewtonSim> _mem;
     std::vector<uint64_t> _total_processed_requests;
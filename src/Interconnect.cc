@@ -1,5 +1,6 @@
 #include "Interconnect.h"
 
+#include <algorithm>
 #include <cmath>
 #include <filesystem>
 
@@ -7,9 +8,8 @@
 
 namespace fs = std::filesystem;
 
-void Interconnect::log(Stage stage) {
-    std::string fname =
-        Config::global_config.log_dir + "/memio_stage_" + stageToString(stage) + "_ch_";
+void Interconnect::log(std::string stage_name) {
+    std::string fname = _config.log_dir + "/memio_stage_" + stage_name + "_ch_";
     for (size_t i = 0; i < _stats.size(); ++i) {
         Logger::log(_stats[i], fname + std::to_string(i));
         auto last_stat = _stats[i].back();
@@ -19,8 +19,7 @@ void Interconnect::log(Stage stage) {
 }
 
 cycle_type Interconnect::get_core_cycle() {
-    return (cycle_type)((double)_cycles * (double)Config::global_config.core_freq /
-                        (double)Config::global_config.icnt_freq);
+    return (cycle_type)((double)_cycles * (double)_config.core_freq / (double)_config.icnt_freq);
 }
 
 void Interconnect::update_stat(MemoryAccess memory_access, uint64_t ch_idx) {
@@ -41,7 +40,11 @@ void Interconnect::update_stat(MemoryAccess memory_access, uint64_t ch_idx) {
     }
 }
 
-SimpleInterconnect::SimpleInterconnect(SimulationConfig config) : _latency(config.icnt_latency) {
+SimpleInterconnect::SimpleInterconnect(SimulationConfig config)
+    : _latency(config.icnt_latency),
+      _rr_start(0),
+      _buffer_size(config.icnt_buffer_size),
+      _output_stall_cycles(0) {
     spdlog::info("Initialize SimpleInterconnect");
     _cycles = 0;
     _config = config;
@@ -58,70 +61,90 @@ SimpleInterconnect::SimpleInterconnect(SimulationConfig config) : _latency(confi
     for (int node = 0; node < _n_nodes; node++) {
         _busy_node[node] = false;
     }
+    _credits.resize(_n_nodes, _buffer_size);
+    _inject_stall_cycles.resize(_n_nodes, 0);
+    _last_inject_stall.resize(_n_nodes, UINT64_MAX);
+    _active_in_buffers.resize(_n_nodes);
+    _active_out_buffers.resize(_dram_offset);
+    _active_mem_req_queues.resize(config.dram_channels);
     // TODO: make it configurable
     _mem_cycle_interval = 250;
     _stats.resize(config.dram_channels);
     for (size_t i = 0; i < config.dram_channels; ++i) {
-        _stats[i].push_back(MemoryIOStat(0, i, _mem_cycle_interval));
+        _stats[i].push_back(MemoryIOStat(0, i, _mem_cycle_interval, config.core_freq));
     }
 }
 
-bool SimpleInterconnect::running() { return false; }
+bool SimpleInterconnect::running() {
+    return !_active_in_buffers.empty() || !_active_out_buffers.empty() ||
+           !_active_mem_req_queues.empty();
+}
 
 void SimpleInterconnect::cycle() {
-    for (int node = 0; node < _n_nodes; node++) {
-        // std::cout << "in buffer " << node << " : " << _in_buffers[node].size() << std::endl;
-        // std::cout << "out buffer " << node << " : " << _out_buffers[node].size() << std::endl;
-    }
     // in_bufs -> out_bufs
     // one of core -> dram or dram -> core is possible.
-    for (int node = 0; node < _n_nodes; node++) {
-        int src_node = (_rr_start + node) % _n_nodes;
-        if (!_in_buffers[src_node].empty() &&
-            _in_buffers[src_node].front().finish_cycle <= _cycles) {
-            uint32_t dest = _in_buffers[src_node].front().dest;
-            if (!_busy_node[dest]) {
-                if (dest < _dram_offset) {
-                    _out_buffers[dest].push(_in_buffers[src_node].front().access);
-                } else {
-                    uint32_t mem_ch = dest - _dram_offset;
-                    MemoryAccess *mem_req = _in_buffers[src_node].front().access;
-                    if (!_config.sub_batch_mode) {
-                        // When single buffer PIM (Newton), there is single batch,
-                        // so use one interconnect queue.
-                        mem_req->stage_platform = StagePlatform::SA;
-                    }
-                    assert(mem_req->stage_platform == StagePlatform::SA ||
-                           mem_req->stage_platform == StagePlatform::PIM);
-                    if (mem_req->stage_platform == StagePlatform::SA)
-                        _mem_req_queue1[mem_ch].push(mem_req);
-                    else if (mem_req->stage_platform == StagePlatform::PIM)
-                        _mem_req_queue2[mem_ch].push(mem_req);
-                    else
-                        exit(-1);
-                }
-                _in_buffers[src_node].pop();
-                _busy_node[dest] = true;
-                // spdlog::_log_filece("PUSH TO OUTBUFFER {} {}", src_node, dest);
-            }
+    _active_in_buffers.for_each_from(_rr_start, [this](uint32_t src_node) {
+        if (_in_buffers[src_node].front().finish_cycle > _cycles) return;
+        uint32_t dest = _in_buffers[src_node].front().dest;
+        if (_busy_node[dest]) return;
+        if (!has_room(dest)) {
+            _output_stall_cycles++;
+            return;
         }
-    }
+        deliver(dest, _in_buffers[src_node].front().access);
+        _in_buffers[src_node].pop();
+        if (_in_buffers[src_node].empty()) _active_in_buffers.erase(src_node);
+        if (_buffer_size) _credits[src_node]++;  // credit return
+        _busy_node[dest] = true;
+        _busy_nodes.push_back(dest);
+    });
 
-    for (auto ch_idx = 0; ch_idx < _config.dram_channels; ++ch_idx) {
-        if (_stats[ch_idx].back().start_cycle + _mem_cycle_interval < get_core_cycle()) {
-            auto stat = MemoryIOStat((get_core_cycle() / _mem_cycle_interval) * _mem_cycle_interval,
-                                     ch_idx, _mem_cycle_interval);
-            _stats[ch_idx].push_back(stat);
-        }
-    }
+    update_stat_windows();
 
-    for (int node = 0; node < _n_nodes; node++) {
+    for (uint32_t node : _busy_nodes) {
         _busy_node[node] = false;
     }
+    _busy_nodes.clear();
     _rr_start = (_rr_start + 1) % _n_nodes;
     _cycles++;
 }
 
+// into the core output buffer or the channel memory request queue of dest
+void SimpleInterconnect::deliver(uint32_t dest, MemoryAccess *access) {
+    if (dest < _dram_offset) {
+        _out_buffers[dest].push(access);
+        _active_out_buffers.insert(dest);
+        return;
+    }
+    uint32_t mem_ch = dest - _dram_offset;
+    if (!_config.sub_batch_mode) {
+        // When single buffer PIM (Newton), there is single batch,
+        // so use one interconnect queue.
+        access->stage_platform = StagePlatform::SA;
+    }
+    assert(access->stage_platform == StagePlatform::SA ||
+           access->stage_platform == StagePlatform::PIM);
+    if (access->stage_platform == StagePlatform::SA)
+        _mem_req_queue1[mem_ch].push(access);
+    else if (access->stage_platform == StagePlatform::PIM)
+        _mem_req_queue2[mem_ch].push(access);
+    else
+        exit(-1);
+    _active_mem_req_queues.insert(mem_ch);
+}
+
+void SimpleInterconnect::update_stat_windows() {
+    // every channel opens a new stat window at the same core cycle
+    cycle_type core_cycle = get_core_cycle();
+    if (_stats[0].back().start_cycle + _mem_cycle_interval < core_cycle) {
+        for (auto ch_idx = 0; ch_idx < _config.dram_channels; ++ch_idx) {
+            auto stat = MemoryIOStat((core_cycle / _mem_cycle_interval) * _mem_cycle_interval,
+                                     ch_idx, _mem_cycle_interval, _config.core_freq);
+            _stats[ch_idx].push_back(stat);
+        }
+    }
+}
+
 void SimpleInterconnect::push(uint32_t src, uint32_t dest, MemoryAccess *request) {
     // -- initialize entity
     SimpleInterconnect::Entity entity;
@@ -133,12 +156,42 @@ void SimpleInterconnect::push(uint32_t src, uint32_t dest, MemoryAccess *request
     entity.access = request;
 
     // -- push to _in_buffer
+    assert(!_buffer_size || _credits[src] > 0);
+    if (_buffer_size) _credits[src]--;
     _in_buffers[src].push(entity);
+    _active_in_buffers.insert(src);
 }
 
 bool SimpleInterconnect::is_full(uint32_t nid, MemoryAccess *request) {
-    // TODO: limit buffersize
-    return false;
+    if (!_buffer_size || _credits[nid] > 0) return false;
+    if (_last_inject_stall[nid] != _cycles) {
+        _last_inject_stall[nid] = _cycles;
+        _inject_stall_cycles[nid]++;
+    }
+    return true;
+}
+
+bool SimpleInterconnect::has_room(uint32_t dest) {
+    if (!_buffer_size) return true;
+    if (dest < _dram_offset) return _out_buffers[dest].size() < _buffer_size;
+    uint32_t mem_ch = dest - _dram_offset;
+    return _mem_req_queue1[mem_ch].size() + _mem_req_queue2[mem_ch].size() < _buffer_size;
+}
+
+void SimpleInterconnect::print_stats() {
+    if (!_buffer_size) return;
+    cycle_type core_stalls = 0;
+    cycle_type dram_stalls = 0;
+    for (uint32_t node = 0; node < _n_nodes; node++) {
+        if (node < _dram_offset)
+            core_stalls += _inject_stall_cycles[node];
+        else
+            dram_stalls += _inject_stall_cycles[node];
+    }
+    spdlog::info(
+        "SimpleInterconnect : buffer size {} core port stall cycles {} dram port stall cycles {} "
+        "output stall cycles {}",
+        _buffer_size, core_stalls, dram_stalls, _output_stall_cycles);
 }
 
 bool SimpleInterconnect::is_empty(uint32_t nid) {
@@ -160,6 +213,7 @@ void SimpleInterconnect::pop(uint32_t nid) {
     if (nid < _dram_offset) update_stat(*mem_access, nid % _config.dram_channels);
 
     _out_buffers[nid].pop();
+    if (_out_buffers[nid].empty()) _active_out_buffers.erase(nid);
 }
 // below 3 method is used to send "Memory request" to "Dram" in "Interconnect"
 // - has_memreq
@@ -181,9 +235,258 @@ MemoryAccess *SimpleInterconnect::memreq_top2(uint32_t cid) {
 void SimpleInterconnect::memreq_pop1(uint32_t cid) {
     assert(has_memreq1(cid));
     _mem_req_queue1[cid].pop();
+    update_mem_req_queue(cid);
 }
 
 void SimpleInterconnect::memreq_pop2(uint32_t cid) {
     assert(has_memreq2(cid));
     _mem_req_queue2[cid].pop();
+    update_mem_req_queue(cid);
+}
+
+void SimpleInterconnect::update_mem_req_queue(uint32_t cid) {
+    if (_mem_req_queue1[cid].empty() && _mem_req_queue2[cid].empty())
+        _active_mem_req_queues.erase(cid);
+}
+
+NocInterconnect::NocInterconnect(SimulationConfig config)
+    : SimpleInterconnect(config),
+      _topology(config.noc_topology),
+      _router_latency(config.noc_router_latency),
+      _link_width(config.noc_link_width),
+      _vc_depth(config.noc_vc_depth),
+      _header_size(8),
+      _num_vcs(8),  // {request, response} x {SA, PIM} x {before, after the dateline}
+      _num_endpoint_routers(config.num_cores + config.dram_channels),
+      _mesh_width(0),
+      _packets_in_flight(0),
+      _delivered_packets(0),
+      _total_packet_latency(0),
+      _total_hops(0),
+      _link_flits(0),
+      _num_links(0),
+      _blocked_cycles(0) {
+    spdlog::info("Initialize NocInterconnect");
+    uint32_t max_flits = ceil((double)(_header_size + config.dram_req_size) / _link_width);
+    if (_vc_depth < max_flits)
+        throw std::runtime_error(fmt::format(
+            "noc_vc_depth {} cannot hold a {}-flit packet", _vc_depth, max_flits));
+
+    uint32_t num_routers = _num_endpoint_routers;
+    if (_topology == NocTopology::MESH) {
+        _mesh_width = config.noc_mesh_width ? config.noc_mesh_width
+                                            : (uint32_t)ceil(sqrt(_num_endpoint_routers));
+        uint32_t mesh_height = ceil((double)_num_endpoint_routers / _mesh_width);
+        num_routers = _mesh_width * mesh_height;  // the last row may have bare routers
+    } else if (_topology == NocTopology::CROSSBAR) {
+        num_routers = _num_endpoint_routers + 1;  // + central switch
+    }
+    _routers.resize(num_routers);
+
+    if (_topology == NocTopology::MESH) {
+        for (uint32_t r = 0; r < num_routers; r++) {
+            if ((r % _mesh_width) + 1 < _mesh_width) connect(r, r + 1);
+            if (r + _mesh_width < num_routers) connect(r, r + _mesh_width);
+        }
+    } else if (_topology == NocTopology::RING) {
+        for (uint32_t r = 0; r < num_routers; r++) {
+            uint32_t next = (r + 1) % num_routers;
+            if (next != r && !(num_routers == 2 && r == 1)) connect(r, next);
+        }
+    } else {
+        for (uint32_t r = 0; r < _num_endpoint_routers; r++) connect(r, _num_endpoint_routers);
+    }
+
+    for (auto &router : _routers) {
+        uint32_t num_ports = router.neighbors.size() + 1;
+        router.inputs.resize(num_ports * _num_vcs);
+        router.free_flits.assign(num_ports * _num_vcs, _vc_depth);
+        router.link_free_cycle.assign(num_ports, 0);
+        router.granted_cycle.assign(num_ports, UINT64_MAX);
+        router.active_inputs.resize(num_ports * _num_vcs);
+        router.rr = 0;
+        router.injected_cycle = UINT64_MAX;
+        _num_links += router.neighbors.size();
+    }
+
+    _route.resize(num_routers * num_routers, 0);
+    for (uint32_t r = 0; r < num_routers; r++) {
+        for (uint32_t dest = 0; dest < _num_endpoint_routers; dest++) {
+            if (r != dest) _route[r * num_routers + dest] = port_to(r, next_router(r, dest));
+        }
+    }
+    _active_routers.resize(num_routers);
+}
+
+void NocInterconnect::connect(uint32_t a, uint32_t b) {
+    uint32_t port_a = _routers[a].neighbors.size() + 1;
+    uint32_t port_b = _routers[b].neighbors.size() + 1;
+    _routers[a].neighbors.push_back(b);
+    _routers[a].remote_ports.push_back(port_b);
+    _routers[b].neighbors.push_back(a);
+    _routers[b].remote_ports.push_back(port_a);
+}
+
+uint32_t NocInterconnect::port_to(uint32_t router, uint32_t neighbor) {
+    auto &neighbors = _routers[router].neighbors;
+    auto it = std::find(neighbors.begin(), neighbors.end(), neighbor);
+    assert(it != neighbors.end());
+    return it - neighbors.begin() + 1;
+}
+
+uint32_t NocInterconnect::next_router(uint32_t router, uint32_t dest_router) {
+    if (_topology == NocTopology::MESH) {
+        // XY dimension order
+        uint32_t x = router % _mesh_width, y = router / _mesh_width;
+        uint32_t dest_x = dest_router % _mesh_width, dest_y = dest_router / _mesh_width;
+        if (x != dest_x) return x < dest_x ? router + 1 : router - 1;
+        return y < dest_y ? router + _mesh_width : router - _mesh_width;
+    } else if (_topology == NocTopology::RING) {
+        uint32_t num_routers = _routers.size();
+        uint32_t clockwise = (dest_router + num_routers - router) % num_routers;
+        return clockwise <= num_routers / 2 ? (router + 1) % num_routers
+                                            : (router + num_routers - 1) % num_routers;
+    }
+    // crossbar: through the central switch
+    return router == _num_endpoint_routers ? dest_router : _num_endpoint_routers;
+}
+
+bool NocInterconnect::crosses_dateline(uint32_t router, uint32_t neighbor) {
+    uint32_t last = _routers.size() - 1;
+    return _topology == NocTopology::RING && _routers.size() > 2 &&
+           ((router == last && neighbor == 0) || (router == 0 && neighbor == last));
+}
+
+uint32_t NocInterconnect::router_of(uint32_t node) {
+    if (node < _dram_offset) return node / _config.dram_channels;  // core
+    return _config.num_cores + (node - _dram_offset);                // channel
+}
+
+uint32_t NocInterconnect::packet_flits(MemoryAccess *access) {
+    bool carries_data;
+    if (access->request)
+        carries_data = access->req_type == MemoryAccessType::WRITE ||
+                       access->req_type == MemoryAccessType::GWRITE;
+    else
+        carries_data = access->req_type == MemoryAccessType::READ ||
+                       access->req_type == MemoryAccessType::READRES ||
+                       access->req_type == MemoryAccessType::COMPS_READRES;
+    uint64_t bytes = _header_size + (carries_data ? access->size : 0);
+    return (bytes + _link_width - 1) / _link_width;
+}
+
+uint32_t NocInterconnect::traffic_class(MemoryAccess *access) {
+    return (access->request ? 0 : 2) + (access->stage_platform == StagePlatform::PIM ? 1 : 0);
+}
+
+bool NocInterconnect::running() {
+    return SimpleInterconnect::running() || _packets_in_flight > 0;
+}
+
+void NocInterconnect::cycle() {
+    route_packets();
+    inject();
+    update_stat_windows();
+    _rr_start = (_rr_start + 1) % _n_nodes;
+    _cycles++;
+}
+
+// core and channel ports -> local input of their router
+void NocInterconnect::inject() {
+    _active_in_buffers.for_each_from(_rr_start, [this](uint32_t src_node) {
+        Entity &entity = _in_buffers[src_node].front();
+        if (entity.finish_cycle > _cycles) return;
+        uint32_t r = router_of(src_node);
+        Router &router = _routers[r];
+        if (router.injected_cycle == _cycles) return;
+        uint32_t input = traffic_class(entity.access) * 2;  // local port 0
+        uint32_t flits = packet_flits(entity.access);
+        if (flits > _vc_depth)
+            throw std::runtime_error(fmt::format(
+                "noc_vc_depth {} cannot hold a {}-flit packet", _vc_depth, flits));
+        if (router.free_flits[input] < flits) return;
+
+        router.free_flits[input] -= flits;
+        router.inputs[input].push_back(Packet{.access = entity.access,
+                                              .dest = entity.dest,
+                                              .dest_router = router_of(entity.dest),
+                                              .vc = input,
+                                              .flits = flits,
+                                              .hops = 0,
+                                              .inject_cycle = _cycles,
+                                              .ready_cycle = _cycles + _router_latency});
+        router.active_inputs.insert(input);
+        router.injected_cycle = _cycles;
+        _active_routers.insert(r);
+        _packets_in_flight++;
+
+        _in_buffers[src_node].pop();
+        if (_in_buffers[src_node].empty()) _active_in_buffers.erase(src_node);
+        if (_buffer_size) _credits[src_node]++;  // credit return
+    });
+}
+
+// one packet per output port per cycle, inputs granted round-robin
+void NocInterconnect::route_packets() {
+    uint32_t num_routers = _routers.size();
+    _active_routers.for_each_from(0, [this, num_routers](uint32_t r) {
+        Router &router = _routers[r];
+        router.active_inputs.for_each_from(router.rr, [&](uint32_t input) {
+            Packet &packet = router.inputs[input].front();
+            if (packet.ready_cycle > _cycles) return;
+            uint32_t port = _route[r * num_routers + packet.dest_router];
+            if (router.granted_cycle[port] == _cycles || router.link_free_cycle[port] > _cycles) {
+                _blocked_cycles++;
+                return;
+            }
+            if (port == 0) {
+                // eject into the core output buffer or channel request queue
+                if (!has_room(packet.dest)) {
+                    _output_stall_cycles++;
+                    return;
+                }
+                deliver(packet.dest, packet.access);
+                _delivered_packets++;
+                _total_packet_latency += _cycles - packet.inject_cycle;
+                _total_hops += packet.hops;
+                _packets_in_flight--;
+            } else {
+                uint32_t next = router.neighbors[port - 1];
+                Router &next_router = _routers[next];
+                uint32_t vc = packet.vc | (crosses_dateline(r, next) ? 1 : 0);
+                uint32_t next_input = router.remote_ports[port - 1] * _num_vcs + vc;
+                if (next_router.free_flits[next_input] < packet.flits) {
+                    _blocked_cycles++;
+                    return;
+                }
+                next_router.free_flits[next_input] -= packet.flits;
+                Packet moved = packet;
+                moved.vc = vc;
+                moved.hops++;
+                moved.ready_cycle = _cycles + 1 + _router_latency;
+                next_router.inputs[next_input].push_back(moved);
+                next_router.active_inputs.insert(next_input);
+                _active_routers.insert(next);
+                _link_flits += packet.flits;
+            }
+            router.link_free_cycle[port] = _cycles + packet.flits;
+            router.granted_cycle[port] = _cycles;
+            router.free_flits[input] += packet.flits;  // credit back upstream
+            router.inputs[input].pop_front();
+            if (router.inputs[input].empty()) router.active_inputs.erase(input);
+        });
+        router.rr = (router.rr + 1) % router.inputs.size();
+        if (router.active_inputs.empty()) _active_routers.erase(r);
+    });
+}
+
+void NocInterconnect::print_stats() {
+    SimpleInterconnect::print_stats();
+    double delivered = MAX(_delivered_packets, (uint64_t)1);
+    double link_util = _num_links && _cycles ? (double)_link_flits / _num_links / _cycles : 0;
+    spdlog::info(
+        "NocInterconnect : {} routers {} links, {} packets avg latency {:.2f} avg hops {:.2f} "
+        "link utilization {:.2f}% blocked cycles {}",
+        _routers.size(), _num_links, _delivered_packets, _total_packet_latency / delivered,
+        _total_hops / delivered, link_util * 100, _blocked_cycles);
 }
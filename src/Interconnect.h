@@ -1,11 +1,13 @@
 #ifndef INTERCONNECT_H
 #define INTERCONNECT_H
+#include <deque>
 #include <list>
 
 #include "Common.h"
 #include "Logger.h"
 #include "Stat.h"
 #include "booksim2/Interconnect.hpp"
+#include "helper/ActiveSet.h"
 #include "helper/HelperFunctions.h"
 
 class Interconnect {
@@ -18,6 +20,8 @@ class Interconnect {
     virtual MemoryAccess *top(uint32_t nid) = 0;
     virtual void pop(uint32_t nid) = 0;
     virtual void print_stats() = 0;
+    // nodes with a response waiting, nullptr if the interconnect does not track them
+    virtual const ActiveSet *get_active_outputs() { return nullptr; }
 
     virtual bool has_memreq1(uint32_t cid) = 0;
     virtual bool has_memreq2(uint32_t cid) = 0;
@@ -26,7 +30,7 @@ class Interconnect {
     virtual void memreq_pop1(uint32_t cid) = 0;
     virtual void memreq_pop2(uint32_t cid) = 0;
 
-    void log(Stage stage);
+    void log(std::string stage_name);
     void update_stat(MemoryAccess mem_access, uint64_t ch_idx);
     inline cycle_type get_core_cycle();
 
@@ -53,7 +57,8 @@ class SimpleInterconnect : public Interconnect {
     virtual bool is_empty(uint32_t nid) override;
     virtual MemoryAccess *top(uint32_t nid) override;
     virtual void pop(uint32_t nid) override;
-    virtual void print_stats() override {}
+    virtual void print_stats() override;
+    virtual const ActiveSet *get_active_outputs() override { return &_active_out_buffers; }
 
     virtual bool has_memreq1(uint32_t cid) override;
     virtual bool has_memreq2(uint32_t cid) override;
@@ -62,7 +67,7 @@ class SimpleInterconnect : public Interconnect {
     virtual void memreq_pop1(uint32_t cid) override;
     virtual void memreq_pop2(uint32_t cid) override;
 
-   private:
+   protected:
     uint32_t _latency;
     double _bandwidth;
     uint32_t _rr_start;
@@ -77,11 +82,100 @@ class SimpleInterconnect : public Interconnect {
     std::vector<std::queue<MemoryAccess *>> _out_buffers;  // buffer for (ICNT -> Module)
     std::vector<std::queue<Entity>> _in_buffers;           // buffer for (Module -> ICNT)
     std::vector<bool> _busy_node;
+    std::vector<uint32_t> _busy_nodes;  // set this cycle, cleared at its end
+
+    // credit-based flow control (_buffer_size entries per port, 0: unbounded): a sender holds
+    // one credit per free entry of its input buffer and gets it back when the entry moves on,
+    // which it only does while the output buffer or memory request queue has room
+    std::vector<uint32_t> _credits;
+    bool has_room(uint32_t dest);
+    void deliver(uint32_t dest, MemoryAccess *access);
+    void update_stat_windows();
+    // stats
+    std::vector<cycle_type> _inject_stall_cycles;  // per source, no credit left
+    std::vector<cycle_type> _last_inject_stall;
+    cycle_type _output_stall_cycles;  // a ready entry waited for a full destination
 
     // memory request queue
     bool _mem_sa_q_turn;  // for checking queue1, queue2 in turn
     std::vector<std::queue<MemoryAccess *>> _mem_req_queue1;
     std::vector<std::queue<MemoryAccess *>> _mem_req_queue2;
+
+    // non-empty buffers and queues, cycle() only visits these
+    ActiveSet _active_in_buffers;
+    ActiveSet _active_out_buffers;
+    ActiveSet _active_mem_req_queues;  // channel with a request in queue1 or queue2
+    void update_mem_req_queue(uint32_t cid);
+};
+
+// Cycle-level on-chip network between the cores and the memory channels. Every core and every
+// channel has a router, connected as a crossbar (through one central switch), a 2D mesh (XY
+// routing) or a bidirectional ring (shortest direction). Packets are noc_link_width-byte flits
+// and move with virtual cut-through: a packet leaves a router noc_router_latency cycles after
+// it arrived, once its output link is free and the next router's virtual channel has room for
+// all of its flits, and then holds the link one cycle per flit. Requests and responses, SA and
+// PIM traffic use separate virtual channels (two of each on the ring, split at the dateline).
+// The ports facing cores and channels, their credits and stats are SimpleInterconnect's.
+class NocInterconnect : public SimpleInterconnect {
+   public:
+    NocInterconnect(SimulationConfig config);
+    virtual bool running() override;
+    virtual void cycle() override;
+    virtual void print_stats() override;
+
+   private:
+    struct Packet {
+        MemoryAccess *access;
+        uint32_t dest;  // interconnect node
+        uint32_t dest_router;
+        uint32_t vc;
+        uint32_t flits;
+        uint32_t hops;
+        cycle_type inject_cycle;
+        cycle_type ready_cycle;  // through the router pipeline
+    };
+    struct Router {
+        std::vector<uint32_t> neighbors;          // port p > 0 is the link to neighbors[p - 1],
+        std::vector<uint32_t> remote_ports;       // arriving at its port remote_ports[p - 1]
+        std::vector<std::deque<Packet>> inputs;   // [port * _num_vcs + vc], port 0 is local
+        std::vector<uint32_t> free_flits;         // per input, the upstream router's credits
+        std::vector<cycle_type> link_free_cycle;  // per output port
+        std::vector<cycle_type> granted_cycle;    // per output port, last cycle it was used
+        ActiveSet active_inputs;
+        uint32_t rr;
+        cycle_type injected_cycle;  // local port takes one packet per cycle
+    };
+
+    NocTopology _topology;
+    uint32_t _router_latency;
+    uint32_t _link_width;  // bytes per cycle, one flit
+    uint32_t _vc_depth;    // flits
+    uint32_t _header_size;
+    uint32_t _num_vcs;
+    uint32_t _num_endpoint_routers;  // cores, then channels
+    uint32_t _mesh_width;
+    std::vector<Router> _routers;
+    std::vector<uint32_t> _route;  // output port, [router * _routers.size() + dest_router]
+    ActiveSet _active_routers;
+    uint64_t _packets_in_flight;
+
+    // stats
+    uint64_t _delivered_packets;
+    uint64_t _total_packet_latency;
+    uint64_t _total_hops;
+    uint64_t _link_flits;  // flits over router-to-router links
+    uint32_t _num_links;   // directed
+    cycle_type _blocked_cycles;  // a ready packet waited for its output link or buffer space
+
+    void connect(uint32_t a, uint32_t b);
+    uint32_t port_to(uint32_t router, uint32_t neighbor);
+    uint32_t next_router(uint32_t router, uint32_t dest_router);
+    bool crosses_dateline(uint32_t router, uint32_t neighbor);
+    uint32_t router_of(uint32_t node);
+    uint32_t packet_flits(MemoryAccess *access);
+    uint32_t traffic_class(MemoryAccess *access);
+    void inject();
+    void route_packets();
 };
 
 class Booksim2Interconnect : public Interconnect {
@@ -12,6 +12,7 @@ std::string Projection = "proj";
 std::string FullyConnected1 = "fc1";
 std::string FullyConnected2 = "fc2";
 std::string LmHead = "lmhead";
+std::string Sampling = "sampling";
 
 std::string QKVSplit = "QKVsplit";
 std::string QKMatMul = "QKmm";
@@ -19,6 +20,7 @@ std::string SoftMax = "softmax";
 std::string LsVMatMul = "LsVmm";
 std::string AReshape = "Areshape";
 std::string Residual = "res";
+std::string AllReduce = "allreduce";
 std::string Gelu = "gelu";
 std::string BatchSplit = "BSplit";
 std::string BatchConcat = "BConcat";
@@ -40,10 +42,11 @@ std::string Weight = "weight";
 std::string Bias = "bias";
 }  // namespace ParameterType
 
-Model::Model(SimulationConfig config, std::string name) {
+Model::Model(SimContext *ctx, std::string name) {
+    _ctx = ctx;
     _name = name;
-    _root_node_id = generate_id();
-    _config = config;
+    _root_node_id = _ctx->generate_id();
+    _config = _ctx->config;
 
     _num_batch = 3;
     _num_token = 13;
@@ -68,7 +71,11 @@ need for layernorm variable to be at all chip
 */
 void Model::init_params() {
     // config.model_n_layer = 1;
-    for (int i = 0; i < _config.model_n_layer; ++i) {
+    // Q for the device's query heads, K and V for its (grouped) KV heads
+    uint32_t dk = _config.model_n_embd / _config.model_n_head;
+    uint32_t qkv_dim = (_config.model_n_head / _config.n_tp + 2 * get_kv_heads_per_device(_config)) * dk;
+    // with pipeline parallelism a device holds its slice of the layers only
+    for (int i = 0; i < get_layers_per_pp_device(_config); ++i) {
         auto attn = name_gen(LAYER(i), BlockType::Attention); // layer0.attn
         
         // layer0.attn.ln
@@ -77,9 +84,8 @@ void Model::init_params() {
         create_weight(name_gen(attn, OperationType::LayerNorm, ParameterType::Bias),
                       {_config.model_n_embd});
         create_weight(name_gen(attn, OperationType::QKVGen, ParameterType::Weight),
-                      {_config.model_n_embd, 3 * _config.model_n_embd / _config.n_tp});
-        create_weight(name_gen(attn, OperationType::QKVGen, ParameterType::Bias),
-                      {3 * _config.model_n_embd / _config.n_tp});
+                      {_config.model_n_embd, qkv_dim});
+        create_weight(name_gen(attn, OperationType::QKVGen, ParameterType::Bias), {qkv_dim});
         create_weight(name_gen(attn, OperationType::Projection, ParameterType::Weight),
                       {_config.model_n_embd / _config.n_tp, _config.model_n_embd});
         create_weight(name_gen(attn, OperationType::Projection, ParameterType::Bias),
@@ -114,6 +120,25 @@ void Model::init_params() {
 
 Ptr<NPUTensor> Model::find_tensor(std::string name) { return _wgt_map[name]; }
 
+Ptr<NPUTensor> Model::get_lm_head_weight() {
+    return find_tensor(name_gen(OperationType::LmHead, ParameterType::Weight));
+}
+
+std::vector<Ptr<PIMTensor>> Model::get_lm_head_pim_weights() {
+    if (_lm_head_pim_weights.empty()) {
+        uint32_t nh = _config.model_n_head / _config.n_tp;
+        uint32_t dk = _config.model_n_embd / _config.model_n_head;
+        uint32_t vocab_per_ch = ceil((double)_config.model_vocab_size / _config.dram_channels);
+        for (uint32_t ch = 0; ch < _config.dram_channels; ch++) {
+            _lm_head_pim_weights.push_back(std::make_shared<PIMTensor>(
+                _ctx, name_gen(OperationType::LmHead, ParameterType::Weight, std::to_string(ch)), ch,
+                std::vector<uint32_t>{nh, dk, vocab_per_ch}, PIMTensorKVType::KEY, true));
+        }
+        spdlog::info("LM head weight in PIM: {} vocab entries per channel", vocab_per_ch);
+    }
+    return _lm_head_pim_weights;
+}
+
 std::vector<Ptr<NPUTensor>> Model::get_params(int layer_idx, std::string block_type,
                                               std::string operation_type) {
     std::string prefix = name_gen(LAYER(layer_idx), block_type, operation_type);
@@ -127,10 +152,10 @@ std::shared_ptr<Tensor> Model::load_cache(uint32_t layer, std::string type) {
     std::vector<uint32_t> shape;
     if (type == "key") {
         shape.assign(
-            {_config.model_n_head, _config.model_n_embd / _config.model_n_head, _num_token});
+            {_config.model_n_kv_head, _config.model_n_embd / _config.model_n_head, _num_token});
     } else if (type == "value") {
         shape.assign(
-            {_config.model_n_head, _num_token, _config.model_n_embd / _config.model_n_head});
+            {_config.model_n_kv_head, _num_token, _config.model_n_embd / _config.model_n_head});
     }
 
     return create_tensor("layer" + std::to_string(layer) + "." + type, shape);
@@ -156,6 +181,7 @@ void Model::find_executable_node(std::shared_ptr<Tensor> tensor) {
 }
 
 Model::Model(const Model &model) {
+    _ctx = model._ctx;
     _name = model._name;
     _root_node_id = _root_node_id;
     _input_tensor = _input_tensor;
@@ -203,7 +229,7 @@ std::shared_ptr<Tensor> Model::create_tensor(std::string name, std::vector<uint3
 std::shared_ptr<NPUTensor> Model::create_weight(std::string name, std::vector<uint32_t> dims) {
     // create_tensor(name, dims, TensorBufType::WGT);
     // auto tensor = std::make_shared<BatchedTensor>(name, dims, TensorBufType::WGT, true);
-    auto tensor = std::make_shared<NPUTensor>(name, dims, NPUTensorBufType::WGT, true);
+    auto tensor = std::make_shared<NPUTensor>(_ctx, name, dims, NPUTensorBufType::WGT, true);
     _wgt_map[name] = tensor;
     return tensor;
 }
@@ -275,5 +301,5 @@ uint64_t Model::get_weight_size() { return _wgt_size; }
 
 addr_type Model::get_weight_top_addr() {
     // after aligning wgt_size, add alignment
-    return AddressConfig::align(_wgt_size) + AddressConfig::alignment;
+    return _ctx->address.align(_wgt_size) + _ctx->address.alignment;
 }
\ No newline at end of file
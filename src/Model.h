@@ -6,6 +6,7 @@
 #include "Tensor.h"
 #include "helper/HelperFunctions.h"
 #include "operations/Add.h"
+#include "operations/AllReduce.h"
 #include "operations/Attention.h"
 #include "operations/Concat.h"
 #include "operations/FusedMHA.h"
@@ -20,12 +21,14 @@
 #include "operations/PIMGEMVAdd.h"
 #include "operations/PIMGEMVSoftmax.h"
 #include "operations/Reshape.h"
+#include "operations/Sampling.h"
 #include "operations/Softmax.h"
 #include "operations/Split.h"
 #include "operations/SplitDecoding.h"
 // #include "operations/SplitEncoding.h"
 #include "operations/Transpose.h"
 #include "tensor/NPUTensor.h"
+#include "tensor/PIMTensor.h"
 
 #define LAYER(i) ("layer" + std::to_string(i))
 
@@ -40,12 +43,15 @@ extern std::string QKVGen;
 extern std::string Projection;
 extern std::string FullyConnected1;
 extern std::string FullyConnected2;
+extern std::string LmHead;
+extern std::string Sampling;
 extern std::string QKVSplit;
 extern std::string QKMatMul;
 extern std::string SoftMax;
 extern std::string LsVMatMul;
 extern std::string AReshape;
 extern std::string Residual;
+extern std::string AllReduce;
 extern std::string Gelu;
 extern std::string BatchSplit;
 extern std::string BatchConcat;
@@ -71,13 +77,15 @@ extern std::string Bias;
 
 class Model {
    public:
-    Model(SimulationConfig config, std::string name);
+    Model(SimContext *ctx, std::string name);
     Model(const Model &model);
 
     void init_params();  // new
     Ptr<NPUTensor> find_tensor(std::string name);
     std::vector<Ptr<NPUTensor>> get_params(int layer_idx, std::string block_type,
                                            std::string operation_type);
+    Ptr<NPUTensor> get_lm_head_weight();
+    std::vector<Ptr<PIMTensor>> get_lm_head_pim_weights();
 
     std::shared_ptr<Tensor> get_tensor(uint32_t id);
     void add_tensor(std::shared_ptr<Tensor> tensor);
@@ -108,6 +116,7 @@ class Model {
 
     std::string get_name() { return _name; }
     uint32_t get_id() { return _root_node_id; }
+    SimContext *get_context() { return _ctx; }
     std::shared_ptr<Tensor> get_input_tensor() { return _input_tensor; }
     std::vector<std::shared_ptr<Operation>> get_executable_operations();
     bool check_finish();
@@ -116,6 +125,7 @@ class Model {
     void log_model();
 
    private:
+    SimContext *_ctx;
     std::string _name;
     std::string _input_name;
     std::vector<uint32_t> _input_dim;
@@ -129,6 +139,10 @@ class Model {
     bool _is_decode;
     uint64_t _wgt_size;  // bytes
 
+    // LM head weight resident in PIM: one vocab slice per channel, laid out like a key cache
+    // (E x slice). Allocated on first use, once the KV cache allocator is initialized.
+    std::vector<Ptr<PIMTensor>> _lm_head_pim_weights;
+
     // EE514 Note: Distribute workloads using this?
     uint32_t _target_core;
 
@@ -15,7 +15,7 @@
 #include "tensor/PIMTensor.h"
 
 ModelProgram::ModelProgram(Ptr<Model> model, Ptr<BatchedRequest> batched_request)
-    : _model(model), _breq(batched_request) {
+    : _model(model), _ctx(model->get_context()), _config(_ctx->config), _breq(batched_request) {
     this->init_program();
 }
 
@@ -24,16 +24,17 @@ void ModelProgram::init_program() {
 
     /* end-to-end GPT program */
     if (end_to_end) {
-        bool npu_program = Config::global_config.run_mode == RunMode::NPU_ONLY;
-        bool fused = Config::global_config.kernel_fusion;
+        bool npu_program = _config.run_mode == RunMode::NPU_ONLY;
+        bool fused = _config.kernel_fusion;
 
         auto N = _breq->get_num_rows();
-        auto E = Config::global_config.model_n_embd;
+        auto E = _config.model_n_embd;
 
         std::vector<uint32_t> input_dim{N, E};
-        auto input = std::make_shared<NPUTensor>("input", input_dim, NPUTensorBufType::ACT, true);
+        auto input =
+            std::make_shared<NPUTensor>(_ctx, "input", input_dim, NPUTensorBufType::ACT, true);
         std::vector<Ptr<BTensor>> inputs{input};
-        for (uint32_t layer_idx = 0; layer_idx < Config::global_config.model_n_layer; ++layer_idx) {
+        for (uint32_t layer_idx = 0; layer_idx < _config.model_n_layer; ++layer_idx) {
             if (npu_program) {
                 if (fused)
                     inputs = fused_attn_block(layer_idx, inputs);
@@ -58,16 +59,16 @@ void ModelProgram::init_program() {
         Ptr<NPUTensor> query;
         std::vector<Ptr<BTensor>> inputs;
 
-        bool npu_program = Config::global_config.run_mode == RunMode::NPU_ONLY;  //
+        bool npu_program = _config.run_mode == RunMode::NPU_ONLY;  //
         int batch_size = _breq->_reqs.size();
         spdlog::info("----------");
         spdlog::info(">>>logging<<<");
         spdlog::info("*** batch size: {}", batch_size);
         spdlog::info("*** K_cache.size(num_layers): {}", _breq->_reqs[0]->K_cache.size());
 
-        for (int i = 0; i < Config::global_config.model_n_layer; ++i) {
-            uint32_t num_heads = Config::global_config.model_n_head;
-            uint32_t dk = Config::global_config.model_n_embd / num_heads;  // 64;
+        for (int i = 0; i < _config.model_n_layer; ++i) {
+            uint32_t num_heads = _config.model_n_head;
+            uint32_t dk = _config.model_n_embd / num_heads;  // 64;
 
             std::vector<Ptr<BTensor>> querys;
             std::vector<Ptr<BTensor>> keys;
@@ -87,7 +88,8 @@ void ModelProgram::init_program() {
                 // }
 
                 query = std::make_shared<NPUTensor>(
-                    "query", std::vector<uint32_t>{num_heads, lj, dk}, NPUTensorBufType::ACT, true);
+                    _ctx, "query", std::vector<uint32_t>{num_heads, lj, dk}, NPUTensorBufType::ACT,
+                    true);
                 querys.push_back(query);
 
                 /* key/value cache */
@@ -119,6 +121,7 @@ void ModelProgram::init_program() {
                 // inputs = get_outputs(gemv_add, inputs);
 
                 auto logit_softmax = add_op(std::make_shared<NeuPIMSLogitSoftmax>(
+                    _ctx,
                     name_gen(prefix, BlockType::Attention, OperationType::NeuPIMSLogitSoftmax)));
                 inputs = get_outputs(logit_softmax, mha_pim_inputs);
 
@@ -126,7 +129,7 @@ void ModelProgram::init_program() {
                 inputs.insert(inputs.end(), values.begin(), values.end());  // logits, values
 
                 auto attend = add_op(std::make_shared<NeuPIMSAttend>(
-                    name_gen(prefix, BlockType::Attention, OperationType::NeuPIMSAttend)));
+                    _ctx, name_gen(prefix, BlockType::Attention, OperationType::NeuPIMSAttend)));
                 inputs = get_outputs(attend, inputs);
             }
         }
@@ -208,7 +211,7 @@ void ModelProgram::finish_operation_tile(Tile &tile) {
  * TODO: log file name is tentative. think of fname rule
  */
 void ModelProgram::log() {
-    std::string fname = Config::global_config.log_dir + "/tmp_log_file";
+    std::string fname = _config.log_dir + "/tmp_log_file";
     Logger::log(list_operation_stat(), fname);
 }
 
@@ -233,7 +236,7 @@ std::vector<Ptr<BTensor>> ModelProgram::fused_pim_attn_block(uint32_t layer,
     //  returns initial token length
     // (N,E) -> (t1,E),(t2,E), ..., (tn,E)
     auto num_rows_breakdown = _breq->get_num_rows_breakdown();
-    auto split = add_op(std::make_shared<Split>(name_gen(prefix, OperationType::BatchSplit),
+    auto split = add_op(std::make_shared<Split>(_ctx, name_gen(prefix, OperationType::BatchSplit),
                                                 num_rows_breakdown, 0));
     auto qkv_per_reqs = get_outputs(split, inputs);
 
@@ -255,7 +258,7 @@ std::vector<Ptr<BTensor>> ModelProgram::fused_pim_attn_block(uint32_t layer,
         // (1,3E),KeyCache(nh,dk,T),ValueCache(nh,T,dk) ->
         //  (nh,1,dk)[NPUTensor2D],(nh,dk,T+1)[NPUTensorKV],(nh,T+1,dk)[NPUTensorKV]
         auto split = add_op(std::make_shared<SplitDecoding>(
-            name_gen(prefix, OperationType::QKVSplit, std::to_string(request_index)),
+            _ctx, name_gen(prefix, OperationType::QKVSplit, std::to_string(request_index)),
             _breq->get_cache(layer, request_index), _breq->is_initiated(request_index)));
         qkv_cached = get_outputs(split, qkv);
 
@@ -271,7 +274,7 @@ std::vector<Ptr<BTensor>> ModelProgram::fused_pim_attn_block(uint32_t layer,
     // auto ls = get_outputs(gemv_softmax, querys);
 
     auto logit_softmax = add_op(std::make_shared<NeuPIMSLogitSoftmax>(
-        name_gen(prefix, BlockType::Attention, OperationType::NeuPIMSLogitSoftmax)));
+        _ctx, name_gen(prefix, BlockType::Attention, OperationType::NeuPIMSLogitSoftmax)));
     auto ls = get_outputs(logit_softmax, querys);
 
     /* pim_gemv + add */
@@ -279,15 +282,15 @@ std::vector<Ptr<BTensor>> ModelProgram::fused_pim_attn_block(uint32_t layer,
     // auto gemv_add = block_gemv_add(prefix);
     // auto a = get_outputs(gemv_add, ls);
     auto attend = add_op(std::make_shared<NeuPIMSAttend>(
-        name_gen(prefix, BlockType::Attention, OperationType::NeuPIMSAttend)));
+        _ctx, name_gen(prefix, BlockType::Attention, OperationType::NeuPIMSAttend)));
     auto a = get_outputs(attend, ls);
 
     for (int request_index = 0; request_index < num_requests; ++request_index) {
         // (nh,{1,T},dk) -> ({1,T},E)
         std::vector<uint32_t> reshape_result = {a[request_index]->get_dims()[1],
-                                                Config::global_config.model_n_embd};
+                                                _config.model_n_embd};
         auto reshape = add_op(std::make_shared<Reshape>(
-            name_gen(prefix, OperationType::AReshape, std::to_string(request_index)),
+            _ctx, name_gen(prefix, OperationType::AReshape, std::to_string(request_index)),
             reshape_result));
         auto result = get_outputs(reshape, {a[request_index]});
 
@@ -296,15 +299,16 @@ std::vector<Ptr<BTensor>> ModelProgram::fused_pim_attn_block(uint32_t layer,
 
     // collect batches
     // (T1,E),(T2,E), ... ,(Tn,E) -> (N,E)
-    auto concat = add_op(std::make_shared<Concat>(name_gen(prefix, OperationType::BatchConcat), 0));
+    auto concat = add_op(
+        std::make_shared<Concat>(_ctx, name_gen(prefix, OperationType::BatchConcat), 0));
     inputs = get_outputs(concat, qkv_results);
 
     auto projection = add_op(std::make_shared<MatMul>(
-        name_gen(prefix, OperationType::Projection),
+        _ctx, name_gen(prefix, OperationType::Projection),
         _model->get_params(layer, BlockType::Attention, OperationType::Projection)));
     inputs = get_outputs(projection, inputs);
 
-    auto residual = add_op(std::make_shared<Add>(name_gen(prefix, OperationType::Residual)));
+    auto residual = add_op(std::make_shared<Add>(_ctx, name_gen(prefix, OperationType::Residual)));
     inputs.push_back(res_buf);
     inputs = get_outputs(residual, inputs);
 
@@ -332,7 +336,7 @@ std::vector<Ptr<BTensor>> ModelProgram::pim_attn_block(uint32_t layer,
     //  returns initial token length
     // (N,E) -> (t1,E),(t2,E), ..., (tn,E)
     auto num_rows_breakdown = _breq->get_num_rows_breakdown();
-    auto split = add_op(std::make_shared<Split>(name_gen(prefix, OperationType::BatchSplit),
+    auto split = add_op(std::make_shared<Split>(_ctx, name_gen(prefix, OperationType::BatchSplit),
                                                 num_rows_breakdown, 0));
     auto qkv_per_reqs = get_outputs(split, inputs);
 
@@ -354,7 +358,7 @@ std::vector<Ptr<BTensor>> ModelProgram::pim_attn_block(uint32_t layer,
         // (1,3E),KeyCache(nh,dk,T),ValueCache(nh,T,dk) ->
         //  (nh,1,dk)[NPUTensor2D],(nh,dk,T+1)[NPUTensorKV],(nh,T+1,dk)[NPUTensorKV]
         auto split = add_op(std::make_shared<SplitDecoding>(
-            name_gen(prefix, OperationType::QKVSplit, std::to_string(request_index)),
+            _ctx, name_gen(prefix, OperationType::QKVSplit, std::to_string(request_index)),
             _breq->get_cache(layer, request_index), _breq->is_initiated(request_index)));
         qkv_cached = get_outputs(split, qkv);
 
@@ -367,13 +371,14 @@ std::vector<Ptr<BTensor>> ModelProgram::pim_attn_block(uint32_t layer,
     querys.insert(querys.end(), keys.begin(),
                   keys.end());  // querys,keys
 
-    auto pim_gemv = add_op(std::make_shared<PIMGEMV>(name_gen(prefix, OperationType::PIMGEMV)));
+    auto pim_gemv =
+        add_op(std::make_shared<PIMGEMV>(_ctx, name_gen(prefix, OperationType::PIMGEMV)));
     // auto pim_gemv = block_gemv_softmax(prefix);
     auto l = get_outputs(pim_gemv, querys);
 
     /* softmax */
     auto logit_softmax =
-        add_op(std::make_shared<Softmax>(name_gen(prefix, OperationType::SoftMax)));
+        add_op(std::make_shared<Softmax>(_ctx, name_gen(prefix, OperationType::SoftMax)));
     auto ls = get_outputs(logit_softmax, l);
 
     /* pim_gemv + add */
@@ -384,9 +389,9 @@ std::vector<Ptr<BTensor>> ModelProgram::pim_attn_block(uint32_t layer,
     for (int request_index = 0; request_index < num_requests; ++request_index) {
         // (nh,{1,T},dk) -> ({1,T},E)
         std::vector<uint32_t> reshape_result = {a[request_index]->get_dims()[1],
-                                                Config::global_config.model_n_embd};
+                                                _config.model_n_embd};
         auto reshape = add_op(std::make_shared<Reshape>(
-            name_gen(prefix, OperationType::AReshape, std::to_string(request_index)),
+            _ctx, name_gen(prefix, OperationType::AReshape, std::to_string(request_index)),
             reshape_result));
         auto result = get_outputs(reshape, {a[request_index]});
 
@@ -395,15 +400,16 @@ std::vector<Ptr<BTensor>> ModelProgram::pim_attn_block(uint32_t layer,
 
     // collect batches
     // (T1,E),(T2,E), ... ,(Tn,E) -> (N,E)
-    auto concat = add_op(std::make_shared<Concat>(name_gen(prefix, OperationType::BatchConcat), 0));
+    auto concat = add_op(
+        std::make_shared<Concat>(_ctx, name_gen(prefix, OperationType::BatchConcat), 0));
     inputs = get_outputs(concat, qkv_results);
 
     auto projection = add_op(std::make_shared<MatMul>(
-        name_gen(prefix, OperationType::Projection),
+        _ctx, name_gen(prefix, OperationType::Projection),
         _model->get_params(layer, BlockType::Attention, OperationType::Projection)));
     inputs = get_outputs(projection, inputs);
 
-    auto residual = add_op(std::make_shared<Add>(name_gen(prefix, OperationType::Residual)));
+    auto residual = add_op(std::make_shared<Add>(_ctx, name_gen(prefix, OperationType::Residual)));
     inputs.push_back(res_buf);
     inputs = get_outputs(residual, inputs);
 
@@ -439,7 +445,7 @@ std::vector<Ptr<BTensor>> ModelProgram::attn_block(uint32_t layer,
     //  returns initial token length
     // (N,E) -> (t1,E),(t2,E), ..., (tn,E)
     auto num_rows_breakdown = _breq->get_num_rows_breakdown();
-    auto split = add_op(std::make_shared<Split>(name_gen(prefix, OperationType::BatchSplit),
+    auto split = add_op(std::make_shared<Split>(_ctx, name_gen(prefix, OperationType::BatchSplit),
                                                 num_rows_breakdown, 0));
     auto qkv_per_reqs = get_outputs(split, inputs);
 
@@ -456,29 +462,29 @@ std::vector<Ptr<BTensor>> ModelProgram::attn_block(uint32_t layer,
         // (1,3E),KeyCache(nh,dk,T),ValueCache(nh,T,dk) ->
         //  (nh,1,dk)[NPUTensor2D],(nh,dk,T+1)[NPUTensorKV],(nh,T+1,dk)[NPUTensorKV]
         auto split = add_op(std::make_shared<SplitDecoding>(
-            name_gen(prefix, OperationType::QKVSplit, std::to_string(request_index)),
+            _ctx, name_gen(prefix, OperationType::QKVSplit, std::to_string(request_index)),
             _breq->get_cache(layer, request_index), _breq->is_initiated(request_index)));
         qkv_cached = get_outputs(split, qkv);
 
         // (nh,{1,T},dk)@(nh,dk,{T+1,T}) -> (nh,{1,T},{T+1,T})
         auto l_mm = add_op(std::make_shared<MatMul>(
-            name_gen(prefix, OperationType::QKMatMul, std::to_string(request_index))));
+            _ctx, name_gen(prefix, OperationType::QKMatMul, std::to_string(request_index))));
         auto l = get_outputs(l_mm, std::vector<Ptr<BTensor>>{qkv_cached[0], qkv_cached[1]});
 
         auto ls_sm = add_op(std::make_shared<Softmax>(
-            name_gen(prefix, OperationType::SoftMax, std::to_string(request_index))));
+            _ctx, name_gen(prefix, OperationType::SoftMax, std::to_string(request_index))));
         auto ls = get_outputs(ls_sm, l);
 
         // (nh,{1,T},{T+1,T})@(nh,{T+1,T},dk) -> (nh,{1,T},dk)
         auto a_mm = add_op(std::make_shared<MatMul>(
-            name_gen(prefix, OperationType::LsVMatMul, std::to_string(request_index))));
+            _ctx, name_gen(prefix, OperationType::LsVMatMul, std::to_string(request_index))));
         auto a = get_outputs(a_mm, std::vector<Ptr<BTensor>>{ls[0], qkv_cached[2]});
 
         // (nh,{1,T},dk) -> ({1,T},E)
         std::vector<uint32_t> reshape_result = {a[0]->get_dims()[1],
-                                                Config::global_config.model_n_embd};
+                                                _config.model_n_embd};
         auto reshape = add_op(std::make_shared<Reshape>(
-            name_gen(prefix, OperationType::AReshape, std::to_string(request_index)),
+            _ctx, name_gen(prefix, OperationType::AReshape, std::to_string(request_index)),
             reshape_result));
         auto result = get_outputs(reshape, a);
 
@@ -487,15 +493,16 @@ std::vector<Ptr<BTensor>> ModelProgram::attn_block(uint32_t layer,
 
     // collect batches
     // (T1,E),(T2,E), ... ,(Tn,E) -> (N,E)
-    auto concat = add_op(std::make_shared<Concat>(name_gen(prefix, OperationType::BatchConcat), 0));
+    auto concat = add_op(
+        std::make_shared<Concat>(_ctx, name_gen(prefix, OperationType::BatchConcat), 0));
     inputs = get_outputs(concat, qkv_results);
 
     auto projection = add_op(std::make_shared<MatMul>(
-        name_gen(prefix, OperationType::Projection),
+        _ctx, name_gen(prefix, OperationType::Projection),
         _model->get_params(layer, BlockType::Attention, OperationType::Projection)));
     inputs = get_outputs(projection, inputs);
 
-    auto residual = add_op(std::make_shared<Add>(name_gen(prefix, OperationType::Residual)));
+    auto residual = add_op(std::make_shared<Add>(_ctx, name_gen(prefix, OperationType::Residual)));
     inputs.push_back(res_buf);
     inputs = get_outputs(residual, inputs);
 
@@ -605,24 +612,24 @@ std::vector<Ptr<BTensor>> ModelProgram::ffn_block(uint32_t layer,
     std::string prefix = name_gen(LAYER(layer), BlockType::FeedForward);
     // create operations
     auto ln = add_op(std::make_shared<LayerNorm>(
-        name_gen(prefix, OperationType::LayerNorm),
+        _ctx, name_gen(prefix, OperationType::LayerNorm),
         _model->get_params(layer, BlockType::FeedForward, OperationType::LayerNorm)));
     inputs = get_outputs(ln, inputs);
 
     auto fc1 = add_op(std::make_shared<MatMul>(
-        name_gen(prefix, OperationType::FullyConnected1),
+        _ctx, name_gen(prefix, OperationType::FullyConnected1),
         _model->get_params(layer, BlockType::FeedForward, OperationType::FullyConnected1)));
     inputs = get_outputs(fc1, inputs);
 
-    auto gelu = add_op(std::make_shared<Gelu>(name_gen(prefix, OperationType::Gelu)));
+    auto gelu = add_op(std::make_shared<Gelu>(_ctx, name_gen(prefix, OperationType::Gelu)));
     inputs = get_outputs(gelu, inputs);
 
     auto fc2 = add_op(std::make_shared<MatMul>(
-        name_gen(prefix, OperationType::FullyConnected2),
+        _ctx, name_gen(prefix, OperationType::FullyConnected2),
         _model->get_params(layer, BlockType::FeedForward, OperationType::FullyConnected2)));
     inputs = get_outputs(fc2, inputs);
 
-    auto residual = add_op(std::make_shared<Add>(name_gen(prefix, OperationType::Residual)));
+    auto residual = add_op(std::make_shared<Add>(_ctx, name_gen(prefix, OperationType::Residual)));
     inputs.push_back(res_buf);
     inputs = get_outputs(residual, inputs);
 
@@ -631,13 +638,13 @@ std::vector<Ptr<BTensor>> ModelProgram::ffn_block(uint32_t layer,
 
 Ptr<Operation> ModelProgram::block_layer_norm(uint32_t layer) {
     return add_op(std::make_shared<LayerNorm>(
-        name_gen(LAYER(layer), BlockType::Attention, OperationType::LayerNorm),
+        _ctx, name_gen(LAYER(layer), BlockType::Attention, OperationType::LayerNorm),
         _model->get_params(layer, BlockType::Attention, OperationType::LayerNorm)));
 }
 
 Ptr<Operation> ModelProgram::block_QKV_gen(uint32_t layer) {
     return add_op(std::make_shared<MatMul>(
-        name_gen(LAYER(layer), BlockType::Attention, OperationType::QKVGen),
+        _ctx, name_gen(LAYER(layer), BlockType::Attention, OperationType::QKVGen),
         _model->get_params(layer, BlockType::Attention, OperationType::QKVGen)));
 }
 
@@ -648,18 +655,18 @@ Ptr<Operation> ModelProgram::block_QKV_split(uint32_t layer, uint32_t unit, uint
 }
 
 Ptr<Operation> ModelProgram::test_block_gelu(uint32_t layer) {
-    return add_op(
-        std::make_shared<Gelu>(name_gen(LAYER(layer), BlockType::Attention, OperationType::Gelu)));
+    return add_op(std::make_shared<Gelu>(
+        _ctx, name_gen(LAYER(layer), BlockType::Attention, OperationType::Gelu)));
 }
 
 Ptr<Operation> ModelProgram::test_block_add(uint32_t layer) {
     return add_op(std::make_shared<Add>(
-        name_gen(LAYER(layer), BlockType::Attention, OperationType::Residual)));
+        _ctx, name_gen(LAYER(layer), BlockType::Attention, OperationType::Residual)));
 }
 
 Ptr<Operation> ModelProgram::test_block_softmax(uint32_t layer) {
     return add_op(std::make_shared<Softmax>(
-        name_gen(LAYER(layer), BlockType::Attention, OperationType::SoftMax)));
+        _ctx, name_gen(LAYER(layer), BlockType::Attention, OperationType::SoftMax)));
 }
 
 // std::shared_ptr<Operation> ModelProgram::block_QKV_gen(uint32_t layer) {
@@ -676,15 +683,15 @@ Ptr<Operation> ModelProgram::test_block_softmax(uint32_t layer) {
 
 Ptr<Operation> ModelProgram::block_gemv_softmax(std::string prefix) {
     return add_op(std::make_shared<PIMGEMVSoftmax>(
-        name_gen(prefix, BlockType::Attention, OperationType::PIMGEMVSoftmax)));
+        _ctx, name_gen(prefix, BlockType::Attention, OperationType::PIMGEMVSoftmax)));
 }
 
 Ptr<Operation> ModelProgram::block_gemv_add(std::string prefix) {
     return add_op(std::make_shared<PIMGEMVAdd>(
-        name_gen(prefix, BlockType::Attention, OperationType::PIMGEMVAdd)));
+        _ctx, name_gen(prefix, BlockType::Attention, OperationType::PIMGEMVAdd)));
 }
 
 Ptr<Operation> ModelProgram::block_fused_mha(std::string prefix) {
     return add_op(std::make_shared<FusedMHA>(
-        name_gen(prefix, BlockType::Attention, OperationType::FusedMHA)));
+        _ctx, name_gen(prefix, BlockType::Attention, OperationType::FusedMHA)));
 }
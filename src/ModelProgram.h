@@ -30,6 +30,8 @@ class ModelProgram {
 
     // todo: from BatchedRequest
     std::shared_ptr<Model> _model;
+    SimContext *_ctx;  // owned by the simulator, taken from _model
+    const SimulationConfig &_config;
     std::shared_ptr<BatchedRequest> _breq;
     robin_hood::unordered_map<uint32_t, Ptr<Operation>> _op_map;
 
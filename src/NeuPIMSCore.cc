@@ -5,9 +5,10 @@
 #include "Stat.h"
 #include "helper/HelperFunctions.h"
 
-NeuPIMSCore::NeuPIMSCore(uint32_t id, SimulationConfig config)
+NeuPIMSCore::NeuPIMSCore(uint32_t id, SimContext *ctx)
     : _id(id),
-      _config(config),
+      _ctx(ctx),
+      _config(ctx->config),
       _core_cycle(0),
       _compute_end_cycle(0),
       _stat_idle_cycle(0),
@@ -30,17 +31,25 @@ NeuPIMSCore::NeuPIMSCore(uint32_t id, SimulationConfig config)
       _stat_add_cycle(0),
       _stat_gelu_cycle(0),
       _stat_softmax_cycle(0),
-      _spad(Sram(config, _core_cycle, false, id)),
-      _acc_spad(Sram(config, _core_cycle, true, id)),
-      _pim_spad(Sram(config, _core_cycle, false, id)),
-      _pim_acc_spad(Sram(config, _core_cycle, true, id)) {
+      _spad(Sram(ctx->config, _core_cycle, false, id)),
+      _acc_spad(Sram(ctx->config, _core_cycle, true, id)),
+      _pim_spad(Sram(ctx->config, _core_cycle, false, id)),
+      _pim_acc_spad(Sram(ctx->config, _core_cycle, true, id)) {
     _waiting_write_reqs = 0;
+    _queued_memory_requests1 = 0;
+    _queued_memory_requests2 = 0;
+    _request_queue_stall_cycle = 0;
+    _last_request_queue_stall = UINT64_MAX;
     _running_layer = -1;
     _current_spad = 0;
     _current_acc_spad = 0;
     _memory_request_queues1.resize(_config.dram_channels);
     _memory_request_queues2.resize(_config.dram_channels);
+    _memory_request_channels.resize(_config.dram_channels);
     _vector_pipelines.resize(_config.core_config[id].vector_core_count);
+    _compute_pipelines.resize(_config.core_config[id].systolic_array_count);
+    _spad_port_free_cycles.resize(_config.core_config[id].spad_ports, 0);
+    _stat_array_busy_cycles.resize(_config.core_config[id].systolic_array_count, 0);
 }
 bool NeuPIMSCore::can_issue_pim() { return _pim_tiles.empty(); }
 // if next_tile.accum == true
@@ -160,7 +169,7 @@ void NeuPIMSCore::issue(Tile &in_tile) {
             /* Ex inst queue */
             tile->remaining_accum_io++;
             tile->remaining_computes++;
-            _ex_inst_queue_for_sa.push(inst);
+            _ex_inst_queue_for_sa.push_back(inst);
         }
     }
     // spdlog::info("tile pushed to core._tiles {}", tile.repr());
@@ -291,7 +300,9 @@ void NeuPIMSCore::cycle() {
 bool NeuPIMSCore::running() {
     bool running = false;
     running = running || _tiles.size() > 0;
-    running = running || !_compute_pipeline.empty();
+    for (auto &compute_pipeline : _compute_pipelines) {
+        running = running || !compute_pipeline.empty();
+    }
     running = running || _waiting_write_reqs != 0;
     running = running || !_ld_inst_queue_for_sa.empty();
     running = running || !_st_inst_queue_for_sa.empty();
@@ -306,7 +317,9 @@ bool NeuPIMSCore::running() {
         spdlog::info("------Simulator Status Check------");
         spdlog::info("tiles: {}", _tiles.size() > 0);
         spdlog::info("pim_tiles: {}", _pim_tiles.size() > 0);
-        spdlog::info("_compute_pipeline: {}", !_compute_pipeline.empty());
+        for (auto &compute_pipeline : _compute_pipelines) {
+            spdlog::info("_compute_pipeline: {}", !compute_pipeline.empty());
+        }
         spdlog::info("_waiting_write_reqs: {}", _waiting_write_reqs != 0);
         spdlog::info("_ld_inst_queue_for_sa: {}", !_ld_inst_queue_for_sa.empty());
         spdlog::info("_st_inst_queue_for_sa: {}", !_st_inst_queue_for_sa.empty());
@@ -323,13 +336,39 @@ bool NeuPIMSCore::running() {
 
 // push into target channel memory request queue
 void NeuPIMSCore::push_memory_request1(MemoryAccess *request) {
-    int channel = AddressConfig::mask_channel(request->dram_address);
+    int channel = _ctx->address.mask_channel(request->dram_address);
     _memory_request_queues1[channel].push(request);
+    _memory_request_channels.insert(channel);
+    _queued_memory_requests1++;
 }
 
 void NeuPIMSCore::push_memory_request2(MemoryAccess *request) {
-    int channel = AddressConfig::mask_channel(request->dram_address);
+    int channel = _ctx->address.mask_channel(request->dram_address);
     _memory_request_queues2[channel].push(request);
+    _memory_request_channels.insert(channel);
+    _queued_memory_requests2++;
+}
+
+bool NeuPIMSCore::memory_request_queue_full1() {
+    if (!_config.core_request_queue_size ||
+        _queued_memory_requests1 < _config.core_request_queue_size)
+        return false;
+    if (_last_request_queue_stall != _core_cycle) {
+        _last_request_queue_stall = _core_cycle;
+        _request_queue_stall_cycle++;
+    }
+    return true;
+}
+
+bool NeuPIMSCore::memory_request_queue_full2() {
+    if (!_config.core_request_queue_size ||
+        _queued_memory_requests2 < _config.core_request_queue_size)
+        return false;
+    if (_last_request_queue_stall != _core_cycle) {
+        _last_request_queue_stall = _core_cycle;
+        _request_queue_stall_cycle++;
+    }
+    return true;
 }
 
 void NeuPIMSCore::push_memory_response(MemoryAccess *response) {
@@ -486,6 +525,9 @@ void NeuPIMSCore::print_stats() {
     //     "NeuPIMSCore [{}] : Vec Compute cycle {} Vec Memory Stall Cycle {} Vec Idle
     //     " "Cycle {}", _id, _stat_vec_compute_cycle, _stat_vec_memory_cycle,
     //     _stat_vec_idle_cycle);
+    if (_config.core_request_queue_size)
+        spdlog::info("NeuPIMSCore [{}] : Request queue stall cycle {}", _id,
+                     _request_queue_stall_cycle);
     spdlog::info("NeuPIMSCore [{}] : Total cycle: {}", _id, _core_cycle);
 }
 
@@ -5,13 +5,15 @@
 #include <vector>
 
 #include "Dram.h"
+#include "SimContext.h"
 #include "SimulationConfig.h"
 #include "Sram.h"
 #include "Stat.h"
+#include "helper/ActiveSet.h"
 
 class NeuPIMSCore {
    public:
-    NeuPIMSCore(uint32_t id, SimulationConfig config);
+    NeuPIMSCore(uint32_t id, SimContext *ctx);
     virtual bool running();
     virtual bool can_issue(Tile &next_tile);
     virtual bool can_issue_pim();
@@ -32,6 +34,8 @@ class NeuPIMSCore {
     virtual void pop_memory_request1(uint32_t index) {
         assert(has_memory_request1(index));
         _memory_request_queues1[index].pop();
+        _queued_memory_requests1--;
+        update_memory_request_channel(index);
     }
     virtual MemoryAccess *top_memory_request1(uint32_t index) {
         return _memory_request_queues1[index].front();
@@ -42,17 +46,26 @@ class NeuPIMSCore {
     virtual void pop_memory_request2(uint32_t index) {
         assert(has_memory_request2(index));
         _memory_request_queues2[index].pop();
+        _queued_memory_requests2--;
+        update_memory_request_channel(index);
     }
     virtual MemoryAccess *top_memory_request2(uint32_t index) {
         return _memory_request_queues2[index].front();
     }
     virtual void push_memory_request1(MemoryAccess *request);
     virtual void push_memory_request2(MemoryAccess *request);
+    // channels with a request in queue1 or queue2, the interconnect loop only visits these
+    const ActiveSet &get_memory_request_channels() { return _memory_request_channels; }
 
     virtual void push_memory_response(MemoryAccess *response);
     virtual void pim_push_memory_response(MemoryAccess *response);
     virtual void print_stats();
     virtual cycle_type get_compute_cycles() { return _stat_compute_cycle; }
+    cycle_type get_array_busy_cycles() {  // summed over the systolic arrays
+        cycle_type busy_cycles = 0;
+        for (cycle_type cycles : _stat_array_busy_cycles) busy_cycles += cycles;
+        return busy_cycles;
+    }
 
    protected:
     virtual bool can_issue_compute(Instruction &inst);
@@ -60,6 +73,7 @@ class NeuPIMSCore {
     virtual cycle_type get_inst_compute_cycles(Instruction &inst) = 0;
 
     const uint32_t _id;
+    SimContext *_ctx;
     const SimulationConfig _config;
 
     cycle_type _core_cycle;
@@ -96,13 +110,18 @@ class NeuPIMSCore {
     std::deque<std::shared_ptr<Tile>> _pim_tiles;
     std::queue<std::shared_ptr<Tile>> _finished_tiles;
 
-    std::queue<Instruction> _compute_pipeline;
+    // one pipeline per systolic array (systolic_array_count), a GEMM goes to the least busy
+    std::vector<std::queue<Instruction>> _compute_pipelines;
+    // SPAD read ports shared by the arrays (spad_ports): a GEMM streams its operand rows
+    // through one port for MAX(size, 4) cycles from its start
+    std::vector<cycle_type> _spad_port_free_cycles;
+    std::vector<cycle_type> _stat_array_busy_cycles;  // per systolic array
     std::vector<std::queue<Instruction>> _vector_pipelines;
 
     // SA Sub-batch queue
     std::queue<Instruction> _ld_inst_queue_for_sa;
     std::queue<Instruction> _st_inst_queue_for_sa;
-    std::queue<Instruction> _ex_inst_queue_for_sa;
+    std::deque<Instruction> _ex_inst_queue_for_sa;  // issued out of order within the window
 
     // PIM Sub-batch queue
     std::queue<Instruction> _ld_inst_queue_for_pim;
@@ -112,11 +131,25 @@ class NeuPIMSCore {
     // make it to vector
     std::vector<std::queue<MemoryAccess *>> _memory_request_queues1;
     std::vector<std::queue<MemoryAccess *>> _memory_request_queues2;
+    ActiveSet _memory_request_channels;
+    void update_memory_request_channel(uint32_t index) {
+        if (_memory_request_queues1[index].empty() && _memory_request_queues2[index].empty())
+            _memory_request_channels.erase(index);
+    }
 
     std::queue<MemoryAccess *> _memory_request_queue;
     std::queue<MemoryAccess *> _memory_response_queue;
     uint32_t _waiting_write_reqs;
 
+    // backpressure: while the interconnect holds requests back and core_request_queue_size
+    // of them are queued, load/store fetch stalls (an instruction's accesses go in together)
+    uint32_t _queued_memory_requests1;
+    uint32_t _queued_memory_requests2;
+    bool memory_request_queue_full1();
+    bool memory_request_queue_full2();
+    cycle_type _request_queue_stall_cycle;
+    cycle_type _last_request_queue_stall;
+
     int _current_spad;
     int _current_acc_spad;
     Sram _spad;
@@ -0,0 +1,25 @@
+#include "NeuPIMSystolicOS.h"
+
+NeuPIMSystolicOS::NeuPIMSystolicOS(uint32_t id, SimContext *ctx) : NeuPIMSystolicWS(id, ctx) {}
+
+// operands reach the last used PE tile_m + tile_n - 2 cycles after the first, each PE
+// accumulates over tile_k cycles, then tile_m rows of outputs drain out of the array.
+// GEMMs not tiled for an output-stationary core (no tile shape) occupy the whole array.
+cycle_type NeuPIMSystolicOS::get_inst_compute_cycles(Instruction &inst) {
+    uint32_t height = _config.core_config[_id].core_height;
+    uint32_t width = _config.core_config[_id].core_width;
+    cycle_type rows = inst.tile_m ? MIN(inst.tile_m, height) : height;
+    cycle_type cols = inst.tile_n ? MIN(inst.tile_n, width) : width;
+    return rows + cols - 2 + get_inst_stream_cycles(inst) + rows;
+}
+
+// the next output tile streams in behind the K extent of this one (outputs drain meanwhile);
+// an output tile larger than this array (MatMul tiles for core_0) takes several passes
+cycle_type NeuPIMSystolicOS::get_inst_stream_cycles(Instruction &inst) {
+    uint32_t height = _config.core_config[_id].core_height;
+    uint32_t width = _config.core_config[_id].core_width;
+    cycle_type depth = inst.tile_k ? inst.tile_k : height;
+    cycle_type passes = ((MAX(inst.tile_m, 1) + height - 1) / height) *
+                        ((MAX(inst.tile_n, 1) + width - 1) / width);
+    return MAX(depth, 4) * passes;
+}
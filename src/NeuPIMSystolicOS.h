@@ -0,0 +1,14 @@
+#pragma once
+#include "NeuPIMSystolicWS.h"
+
+// Output-stationary NeuPIMs core. Every PE keeps one output element while the activation rows
+// and weight columns of the whole K extent stream through it, so one GEMM covers an output L1
+// tile (MatMul tiles for it with one GEMM per output tile) and there is no weight preload.
+class NeuPIMSystolicOS : public NeuPIMSystolicWS {
+   public:
+    NeuPIMSystolicOS(uint32_t id, SimContext *ctx);
+
+   protected:
+    virtual cycle_type get_inst_compute_cycles(Instruction &inst) override;
+    virtual cycle_type get_inst_stream_cycles(Instruction &inst) override;
+};
@@ -1,12 +1,13 @@
 #include "NeuPIMSystolicWS.h"
 
-NeuPIMSystolicWS::NeuPIMSystolicWS(uint32_t id, SimulationConfig config) : NeuPIMSCore(id, config) {
+NeuPIMSystolicWS::NeuPIMSystolicWS(uint32_t id, SimContext *ctx) : NeuPIMSCore(id, ctx) {
     auto stat = NPUStat(_core_cycle);
     _stat.push_back(stat);
+    _array_weights.resize(_compute_pipelines.size());
 }
 
 void NeuPIMSystolicWS::log() {
-    std::string fname = Config::global_config.log_dir + "/npu_utilization";
+    std::string fname = _config.log_dir + "/npu_utilization";
     Logger::log(_stat, fname);
 }
 
@@ -36,8 +37,10 @@ void NeuPIMSystolicWS::cycle() {
 
 void NeuPIMSystolicWS::systolic_cycle() {
     /* Compute unit */
-    if (!_compute_pipeline.empty() && _compute_pipeline.front().finish_cycle <= _core_cycle) {
-        Instruction &inst = _compute_pipeline.front();
+    for (auto &compute_pipeline : _compute_pipelines) {
+        if (compute_pipeline.empty() || compute_pipeline.front().finish_cycle > _core_cycle)
+            continue;
+        Instruction &inst = compute_pipeline.front();
         if (inst.dest_addr >= ACCUM_SPAD_BASE) {
             // spdlog::info("calculation finished. instruction: {}, spad_id:{}", inst.repr(),
             //              inst.accum_spad_id);
@@ -51,7 +54,7 @@ void NeuPIMSystolicWS::systolic_cycle() {
         } else {
             assert(0);
         }
-        _compute_pipeline.pop();
+        compute_pipeline.pop();
         // spdlog::info("cycle: {}, pop {}", _core_cycle, inst.repr());
     }
 }
@@ -92,7 +95,7 @@ void NeuPIMSystolicWS::ld_queue_cycle() {
     // todo: ld_queue.cycle();
     std::vector<uint32_t> ch_req_dist(_config.dram_channels, 0);
     bool filled = false;
-    while (!_ld_inst_queue_for_sa.empty()) {
+    while (!_ld_inst_queue_for_sa.empty() && !memory_request_queue_full1()) {
         Instruction &front = _ld_inst_queue_for_sa.front();
         // spdlog::info("{}", front.repr());
         if (front.opcode == Opcode::MOVIN) {
@@ -110,20 +113,20 @@ void NeuPIMSystolicWS::ld_queue_cycle() {
             ast(!front.src_addrs.empty());
 
             auto accesses = MemoryAccess::from_instruction(
-                front, generate_mem_access_id(), _config.dram_req_size, MemoryAccessType::READ,
-                true, _id, _core_cycle, buffer_id, StagePlatform::SA);
+                _ctx, front, _ctx->generate_mem_access_id(), _config.dram_req_size,
+                MemoryAccessType::READ, true, _id, _core_cycle, buffer_id, StagePlatform::SA);
 
             // xxx is this right? size, count<<src_addrs size
             buffer->reserve(front.dest_addr, buffer_id, front.size, accesses.size());
             if (auto tile = front.parent_tile.lock()) {
                 tile->remaining_loads += accesses.size() - 1;
-                tile->stat.memory_reads += accesses.size() * AddressConfig::alignment;
+                tile->stat.memory_reads += accesses.size() * _ctx->address.alignment;
             } else {
                 assert(0);
             }
             for (auto access : accesses) {
                 filled = true;
-                ch_req_dist[AddressConfig::mask_channel(access->dram_address)]++;
+                ch_req_dist[_ctx->address.mask_channel(access->dram_address)]++;
                 push_memory_request1(access);
             }
             _ld_inst_queue_for_sa.pop();
@@ -144,7 +147,7 @@ void NeuPIMSystolicWS::ld_queue_cycle() {
             ast(!front.src_addrs.empty());
 
             MemoryAccess *mem_request = TransToMemoryAccess(
-                front, _config.dram_req_size, _id, _core_cycle, buffer_id, StagePlatform::SA);
+                _ctx, front, _config.dram_req_size, _id, _core_cycle, buffer_id, StagePlatform::SA);
 
             if (front.opcode == Opcode::PIM_READRES || front.opcode == Opcode::PIM_COMPS_READRES)
                 buffer->reserve(front.dest_addr, buffer_id, front.size, 1);
@@ -162,10 +165,37 @@ void NeuPIMSystolicWS::ld_queue_cycle() {
 void NeuPIMSystolicWS::pim_ld_queue_cycle() {
     /* LD instruction queue */
     // todo: ld_queue.cycle();
-    while (!_ld_inst_queue_for_pim.empty()) {
+    while (!_ld_inst_queue_for_pim.empty() && !memory_request_queue_full2()) {
         Instruction &front = _ld_inst_queue_for_pim.front();
         // spdlog::info("{}", front.repr());
-        if (front.opcode == Opcode::PIM_HEADER || front.opcode == Opcode::PIM_GWRITE ||
+        if (front.opcode == Opcode::MOVIN) {
+            // vector tiles of a PIM stage (sampling after the LM head GEMV) read plain DRAM
+            Sram *buffer;
+            int buffer_id;
+            if (front.dest_addr >= ACCUM_SPAD_BASE) {
+                buffer = &_pim_acc_spad;
+                buffer_id = front.accum_spad_id;
+            } else {
+                buffer = &_pim_spad;
+                buffer_id = front.spad_id;
+            }
+
+            ast(!front.src_addrs.empty());
+
+            auto accesses = MemoryAccess::from_instruction(
+                _ctx, front, _ctx->generate_mem_access_id(), _config.dram_req_size,
+                MemoryAccessType::READ, true, _id, _core_cycle, buffer_id, StagePlatform::PIM);
+
+            buffer->reserve(front.dest_addr, buffer_id, front.size, accesses.size());
+            if (auto tile = front.parent_tile.lock()) {
+                tile->remaining_loads += accesses.size() - 1;
+                tile->stat.memory_reads += accesses.size() * _ctx->address.alignment;
+            } else {
+                assert(0);
+            }
+            for (auto access : accesses) push_memory_request2(access);
+            _ld_inst_queue_for_pim.pop();
+        } else if (front.opcode == Opcode::PIM_HEADER || front.opcode == Opcode::PIM_GWRITE ||
             front.opcode == Opcode::PIM_COMP || front.opcode == Opcode::PIM_READRES ||
             front.opcode == Opcode::PIM_COMPS_READRES) {
             Sram *buffer;
@@ -181,7 +211,8 @@ void NeuPIMSystolicWS::pim_ld_queue_cycle() {
             ast(!front.src_addrs.empty());
 
             MemoryAccess *mem_request = TransToMemoryAccess(
-                front, _config.dram_req_size, _id, _core_cycle, buffer_id, StagePlatform::PIM);
+                _ctx, front, _config.dram_req_size, _id, _core_cycle, buffer_id,
+                StagePlatform::PIM);
 
             if (front.opcode == Opcode::PIM_READRES || front.opcode == Opcode::PIM_COMPS_READRES)
                 buffer->reserve(front.dest_addr, buffer_id, front.size, 1);
@@ -198,7 +229,7 @@ void NeuPIMSystolicWS::pim_ld_queue_cycle() {
 void NeuPIMSystolicWS::st_queue_cycle() {
     /* ST instruction queue */
     // todo: st_queue.cycle();
-    if (!_st_inst_queue_for_sa.empty()) {
+    if (!_st_inst_queue_for_sa.empty() && !memory_request_queue_full1()) {
         Instruction &front = _st_inst_queue_for_sa.front();
         Sram *buffer;
         int buffer_id;
@@ -213,11 +244,11 @@ void NeuPIMSystolicWS::st_queue_cycle() {
         if (buffer->check_hit(front.dest_addr, buffer_id) &&
             (front.opcode == Opcode::MOVOUT || front.opcode == Opcode::MOVOUT_POOL)) {
             auto accesses = MemoryAccess::from_instruction(
-                front, generate_mem_access_id(), _config.dram_req_size, MemoryAccessType::WRITE,
-                true, _id, _core_cycle, buffer_id, StagePlatform::SA);
+                _ctx, front, _ctx->generate_mem_access_id(), _config.dram_req_size,
+                MemoryAccessType::WRITE, true, _id, _core_cycle, buffer_id, StagePlatform::SA);
             if (auto tile = front.parent_tile.lock()) {
                 tile->remaining_accum_io += accesses.size() - 1;
-                tile->stat.memory_writes += accesses.size() * AddressConfig::alignment;
+                tile->stat.memory_writes += accesses.size() * _ctx->address.alignment;
             } else {
                 assert(0);
             }
@@ -233,7 +264,7 @@ void NeuPIMSystolicWS::st_queue_cycle() {
 void NeuPIMSystolicWS::pim_st_queue_cycle() {
     /* ST instruction queue */
     // todo: st_queue.cycle();
-    if (!_st_inst_queue_for_pim.empty()) {
+    if (!_st_inst_queue_for_pim.empty() && !memory_request_queue_full2()) {
         Instruction &front = _st_inst_queue_for_pim.front();
         Sram *buffer;
         int buffer_id;
@@ -248,11 +279,11 @@ void NeuPIMSystolicWS::pim_st_queue_cycle() {
         if (buffer->check_hit(front.dest_addr, buffer_id) &&
             (front.opcode == Opcode::MOVOUT || front.opcode == Opcode::MOVOUT_POOL)) {
             auto accesses = MemoryAccess::from_instruction(
-                front, generate_mem_access_id(), _config.dram_req_size, MemoryAccessType::WRITE,
-                true, _id, _core_cycle, buffer_id, StagePlatform::PIM);
+                _ctx, front, _ctx->generate_mem_access_id(), _config.dram_req_size,
+                MemoryAccessType::WRITE, true, _id, _core_cycle, buffer_id, StagePlatform::PIM);
             if (auto tile = front.parent_tile.lock()) {
                 tile->remaining_accum_io += accesses.size() - 1;
-                tile->stat.memory_writes += accesses.size() * AddressConfig::alignment;
+                tile->stat.memory_writes += accesses.size() * _ctx->address.alignment;
             } else {
                 assert(0);
             }
@@ -270,11 +301,14 @@ void NeuPIMSystolicWS::ex_queue_cycle() {
     if (!_ex_inst_queue_for_sa.empty()) {
         Instruction ready_inst = get_first_ready_ex_inst();
 
-        if (ready_inst.valid)
+        if (ready_inst.valid) {
             issue_ex_inst(ready_inst);
-        else {
+            _stat_ex_inst_issue_count++;
+        } else {
             /* Update memory stall stat */
         }
+    } else if (!_tiles.empty()) {
+        _stat_issue_stall_cycles[EMPTY]++;
     }
 }
 
@@ -297,13 +331,19 @@ void NeuPIMSystolicWS::pim_ex_queue_cycle() {
 }
 
 void NeuPIMSystolicWS::update_stats() {
-    if (!_compute_pipeline.empty()) {
-        auto parent_tile = _compute_pipeline.front().parent_tile.lock();
-        if (parent_tile == nullptr) {
-            assert(0);
+    bool is_computing = false;
+    for (uint32_t array = 0; array < _compute_pipelines.size(); array++) {
+        if (_compute_pipelines[array].empty()) continue;
+        if (!is_computing) {
+            auto parent_tile = _compute_pipelines[array].front().parent_tile.lock();
+            if (parent_tile == nullptr) {
+                assert(0);
+            }
+            parent_tile->stat.compute_cycles++;
         }
-        parent_tile->stat.compute_cycles++;
-        _stat.back().num_calculations += 128 * 8 * 2;  // apply systolic array count
+        is_computing = true;
+        _stat_array_busy_cycles[array]++;
+        _stat.back().num_calculations += 128 * 8 * 2;
     }
     for (auto &vector_pipeline : _vector_pipelines) {
         if (!vector_pipeline.empty()) {
@@ -317,7 +357,7 @@ void NeuPIMSystolicWS::update_stats() {
     }
 
     // xxx will it work well on double buffered code? no.
-    bool is_idle = _compute_pipeline.empty();
+    bool is_idle = !is_computing;
     for (auto &vector_pipeline : _vector_pipelines) {
         is_idle = is_idle && vector_pipeline.empty();
     }
@@ -347,7 +387,7 @@ void NeuPIMSystolicWS::update_stats() {
                     break;
             }
         }
-    } else if (!_compute_pipeline.empty()) {
+    } else if (is_computing) {
         _stat_matmul_cycle++;
     } else {
         // } else if (!_vector_pipeline.empty()) {
@@ -375,8 +415,21 @@ void NeuPIMSystolicWS::update_stats() {
     }
 }
 
+// weight preload and drain of the array around the streamed operands of every pass
 cycle_type NeuPIMSystolicWS::get_inst_compute_cycles(Instruction &inst) {
-    return _config.core_config[_id].core_height + _config.core_config[_id].core_width - 2 + MAX(inst.size, 4);
+    return _config.core_config[_id].core_height + _config.core_config[_id].core_width - 2 +
+           get_inst_stream_cycles(inst);
+}
+
+cycle_type NeuPIMSystolicWS::get_inst_stream_cycles(Instruction &inst) {
+    // a weight tile larger than this array (MatMul tiles for core_0) takes several passes
+    uint32_t height = _config.core_config[_id].core_height;
+    uint32_t width = _config.core_config[_id].core_width;
+    cycle_type passes = ((MAX(inst.tile_k, 1) + height - 1) / height) *
+                        ((MAX(inst.tile_n, 1) + width - 1) / width);
+    // xxx why 4?
+    // maybe pushing to the systolic array input queue. 4 cycles to start?
+    return MAX(inst.size, 4) * passes;
 }
 
 cycle_type NeuPIMSystolicWS::get_vector_compute_cycles(Instruction &inst) {
@@ -400,6 +453,12 @@ cycle_type NeuPIMSystolicWS::get_vector_compute_cycles(Instruction &inst) {
             return vec_op_iter * _config.core_config[_id].add_latency;
         case Opcode::GELU:
             return vec_op_iter * _config.core_config[_id].gelu_latency;
+        case Opcode::SAMPLE:
+            return get_sampling_cycles(_config, _id, add_tree_iter);
+        case Opcode::ALL_REDUCE:
+            // link transfer of the partial sums, the reduction adds overlap with it
+            return MAX(get_allreduce_cycles(_config, (uint64_t)inst.size * _config.precision),
+                       vec_op_iter * _config.core_config[_id].add_latency);
         case Opcode::DUMMY:
             return 1;
     }
@@ -430,39 +489,11 @@ void NeuPIMSystolicWS::issue_ex_inst(Instruction inst) {
         }
         // spdlog::info("COMPUTE Start cycle: {} inst:{}", _core_cycle, inst.repr());
         parent_tile->stat.num_calculation += inst.tile_m * inst.tile_n * inst.tile_k;
-
-        if (inst.opcode == Opcode::GEMM_PRELOAD) {
-            _stat_systolic_preload_issue_count++;
-        }
-        if (!_compute_pipeline.empty()) {
-            /* Preload can be hided */
-            uint32_t offset = _compute_pipeline.back().size;
-            // xxx why 4?
-            // maybe pushing to the systolic array input queue. 4 cycles to start?
-            offset = MAX(offset, 4);
-            if (inst.opcode == Opcode::GEMM_PRELOAD) {
-                // State mul-pre
-                parent_tile->stat.weight_load_cycles += _config.core_config[_id].core_height;
-                offset = _config.core_config[_id].core_height;
-            }
-            inst.start_cycle = _compute_pipeline.back().start_cycle + offset;
-        } else {
-            inst.start_cycle = _core_cycle;
-            /* Preload weight to systolic array*/
-            if (inst.opcode == Opcode::GEMM_PRELOAD) {
-                /* Weight preload  from buffer latecny + WEight preload
-                 * latency */
-                inst.start_cycle += _config.core_config[_id].core_height + _config.core_config[_id].core_height - 1;
-            }
-        }
-
-        inst.finish_cycle = inst.start_cycle + get_inst_compute_cycles(inst);
-        // spdlog::info("finish_cycle: {}", inst.finish_cycle);
-        _compute_pipeline.push(inst);
-        _stat_systolic_inst_issue_count++;
+        issue_gemm(inst);
     } else if (inst.opcode == Opcode::COMP || inst.opcode == Opcode::IM2COL ||
                inst.opcode == Opcode::LAYERNORM || inst.opcode == Opcode::SOFTMAX ||
                inst.opcode == Opcode::ADD || inst.opcode == Opcode::GELU ||
+               inst.opcode == Opcode::SAMPLE || inst.opcode == Opcode::ALL_REDUCE ||
                inst.opcode == Opcode::DUMMY) {  // vector unit compute
         // spdlog::info("COMPUTE Start cycle: {} inst:{}", _core_cycle, inst.repr());
         std::queue<Instruction> *least_filled_vpu;
@@ -479,7 +510,10 @@ void NeuPIMSystolicWS::issue_ex_inst(Instruction inst) {
             }
         }
         inst.start_cycle = finish_cycle;
+        if (inst.opcode == Opcode::ALL_REDUCE)
+            inst.start_cycle = MAX(inst.start_cycle, _ctx->tp_link_free_cycle);
         inst.finish_cycle = inst.start_cycle + get_vector_compute_cycles(inst);
+        if (inst.opcode == Opcode::ALL_REDUCE) _ctx->tp_link_free_cycle = inst.finish_cycle;
         least_filled_vpu->push(inst);
 
         {
@@ -494,14 +528,14 @@ void NeuPIMSystolicWS::issue_ex_inst(Instruction inst) {
         }
     }
 
-    // if dest_addr is on sram, count up. -> wait for _compute_pipeline to
+    // if dest_addr is on sram, count up. -> wait for _compute_pipelines to
     // finish calculation
     if (_acc_spad.check_allocated(inst.dest_addr, inst.accum_spad_id)) {
         // spdlog::info("allocated: {}", inst.repr());
         _acc_spad.count_up(inst.dest_addr, inst.accum_spad_id);
     }
     // if dest_addr is not on sram, initialize. -> wait for
-    // _compute_pipeline to finish calculation
+    // _compute_pipelines to finish calculation
     else {
         // spdlog::info("reserve: {}", inst.repr());
         // spdlog::info("reserve, dest_addr:{:x}, spad_id:{}, size:{}", inst.dest_addr,
@@ -510,6 +544,80 @@ void NeuPIMSystolicWS::issue_ex_inst(Instruction inst) {
     }
 }
 
+void NeuPIMSystolicWS::issue_gemm(Instruction &inst) {
+    auto parent_tile = inst.parent_tile.lock();
+    if (inst.opcode == Opcode::GEMM_PRELOAD) {
+        _stat_systolic_preload_issue_count++;
+    }
+    // only a weight-stationary array preloads weights
+    bool weight_stationary = _config.core_config[_id].core_type == CoreType::SYSTOLIC_WS;
+    bool preload = inst.opcode == Opcode::GEMM_PRELOAD && weight_stationary;
+    addr_type weight_addr = inst.src_addrs.empty() ? 0 : inst.src_addrs.back();  // {act, weight}
+    // a plain GEMM reuses the weight its preload left in an array and runs there; once another
+    // preload replaced it, the GEMM loads it again on whichever array it runs
+    int weight_array = -1;
+    if (weight_stationary && !preload) {
+        for (uint32_t array = 0; array < _array_weights.size(); array++) {
+            if (_array_weights[array].addr == weight_addr &&
+                _array_weights[array].tile.lock() == parent_tile) {
+                weight_array = array;
+                break;
+            }
+        }
+        if (weight_array < 0) {
+            preload = true;
+            _stat_weight_reload_count++;
+        }
+    }
+    // operands stream from the SPAD through one read port (get_inst_stream_cycles);
+    // ports only contend when there are fewer of them than arrays
+    bool shared_ports = _spad_port_free_cycles.size() < _compute_pipelines.size();
+    auto port = std::min_element(_spad_port_free_cycles.begin(), _spad_port_free_cycles.end());
+
+    // least busy array: the one the instruction can start on first
+    std::queue<Instruction> *least_busy_array = nullptr;
+    uint32_t chosen_array = 0;
+    for (uint32_t array = 0; array < _compute_pipelines.size(); array++) {
+        if (weight_array >= 0 && (int)array != weight_array) continue;
+        auto &compute_pipeline = _compute_pipelines[array];
+        cycle_type start_cycle;
+        if (!compute_pipeline.empty()) {
+            /* Preload can be hided */
+            cycle_type offset = get_inst_stream_cycles(compute_pipeline.back());
+            if (preload) {
+                offset = _config.core_config[_id].core_height;
+            }
+            start_cycle = compute_pipeline.back().start_cycle + offset;
+        } else {
+            start_cycle = _core_cycle;
+            /* Preload weight to systolic array*/
+            if (preload) {
+                /* Weight preload  from buffer latecny + WEight preload
+                 * latency */
+                start_cycle += _config.core_config[_id].core_height +
+                               _config.core_config[_id].core_height - 1;
+            }
+        }
+        if (shared_ports) start_cycle = MAX(start_cycle, *port);
+        if (least_busy_array == nullptr || start_cycle < inst.start_cycle) {
+            least_busy_array = &compute_pipeline;
+            chosen_array = array;
+            inst.start_cycle = start_cycle;
+        }
+    }
+    if (weight_stationary) _array_weights[chosen_array] = ArrayWeight{parent_tile, weight_addr};
+    if (shared_ports) *port = inst.start_cycle + get_inst_stream_cycles(inst);
+    if (preload && !least_busy_array->empty()) {
+        // State mul-pre
+        parent_tile->stat.weight_load_cycles += _config.core_config[_id].core_height;
+    }
+
+    inst.finish_cycle = inst.start_cycle + get_inst_compute_cycles(inst);
+    // spdlog::info("finish_cycle: {}", inst.finish_cycle);
+    least_busy_array->push(inst);
+    _stat_systolic_inst_issue_count++;
+}
+
 cycle_type NeuPIMSystolicWS::calculate_vector_op_iterations(uint32_t vector_size) {
     uint32_t calculation_unit = _config.core_config[_id].vector_core_width;
     uint32_t ret = vector_size / calculation_unit;
@@ -525,6 +633,21 @@ void NeuPIMSystolicWS::print_stats() {
                  _stat_systolic_inst_issue_count);
     spdlog::info("NeuPIMSCore [{}] : Systolic PRELOAD Issue Count : {}", _id,
                  _stat_systolic_preload_issue_count);
+    spdlog::info("NeuPIMSCore [{}] : Systolic weight reload Count : {}", _id,
+                 _stat_weight_reload_count);
+    spdlog::info("NeuPIMSCore [{}] : Ex IPC {:.3f} ({} issued, {} out of order)", _id,
+                 _core_cycle ? (double)_stat_ex_inst_issue_count / _core_cycle : 0.0,
+                 _stat_ex_inst_issue_count, _stat_out_of_order_issue_count);
+    spdlog::info(
+        "NeuPIMSCore [{}] : Issue stall cycle empty {} load {} compute {} / blocked window "
+        "entries load {} compute {} hazard {}",
+        _id, _stat_issue_stall_cycles[EMPTY], _stat_issue_stall_cycles[LOAD],
+        _stat_issue_stall_cycles[COMPUTE], _stat_blocked_entries[LOAD],
+        _stat_blocked_entries[COMPUTE], _stat_blocked_entries[HAZARD]);
+    for (uint32_t array = 0; array < _stat_array_busy_cycles.size(); array++)
+        spdlog::info("NeuPIMSCore [{}] : Systolic array {} busy cycle {} utilization {:.2f}%", _id,
+                     array, _stat_array_busy_cycles[array],
+                     _core_cycle ? 100.0 * _stat_array_busy_cycles[array] / _core_cycle : 0.0);
 }
 
 void NeuPIMSystolicWS::pim_issue_ex_inst(Instruction inst) {
@@ -538,39 +661,11 @@ void NeuPIMSystolicWS::pim_issue_ex_inst(Instruction inst) {
         }
         // spdlog::info("COMPUTE Start cycle: {} inst:{}", _core_cycle, inst.repr());
         parent_tile->stat.num_calculation += inst.tile_m * inst.tile_n * inst.tile_k;
-
-        if (inst.opcode == Opcode::GEMM_PRELOAD) {
-            _stat_systolic_preload_issue_count++;
-        }
-        if (!_compute_pipeline.empty()) {
-            /* Preload can be hided */
-            uint32_t offset = _compute_pipeline.back().size;
-            // xxx why 4?
-            // maybe pushing to the systolic array input queue. 4 cycles to start?
-            offset = MAX(offset, 4);
-            if (inst.opcode == Opcode::GEMM_PRELOAD) {
-                // State mul-pre
-                parent_tile->stat.weight_load_cycles += _config.core_config[_id].core_height;
-                offset = _config.core_config[_id].core_height;
-            }
-            inst.start_cycle = _compute_pipeline.back().start_cycle + offset;
-        } else {
-            inst.start_cycle = _core_cycle;
-            /* Preload weight to systolic array*/
-            if (inst.opcode == Opcode::GEMM_PRELOAD) {
-                /* Weight preload  from buffer latecny + WEight preload
-                 * latency */
-                inst.start_cycle += _config.core_config[_id].core_height + _config.core_config[_id].core_height - 1;
-            }
-        }
-
-        inst.finish_cycle = inst.start_cycle + get_inst_compute_cycles(inst);
-        // spdlog::info("finish_cycle: {}", inst.finish_cycle);
-        _compute_pipeline.push(inst);
-        _stat_systolic_inst_issue_count++;
+        issue_gemm(inst);
     } else if (inst.opcode == Opcode::COMP || inst.opcode == Opcode::IM2COL ||
                inst.opcode == Opcode::LAYERNORM || inst.opcode == Opcode::SOFTMAX ||
                inst.opcode == Opcode::ADD || inst.opcode == Opcode::GELU ||
+               inst.opcode == Opcode::SAMPLE || inst.opcode == Opcode::ALL_REDUCE ||
                inst.opcode == Opcode::DUMMY) {  // vector unit compute
         // spdlog::info("COMPUTE Start cycle: {} inst:{}", _core_cycle, inst.repr());
         std::queue<Instruction> *least_filled_vpu;
@@ -587,7 +682,10 @@ void NeuPIMSystolicWS::pim_issue_ex_inst(Instruction inst) {
             }
         }
         inst.start_cycle = finish_cycle;
+        if (inst.opcode == Opcode::ALL_REDUCE)
+            inst.start_cycle = MAX(inst.start_cycle, _ctx->tp_link_free_cycle);
         inst.finish_cycle = inst.start_cycle + get_vector_compute_cycles(inst);
+        if (inst.opcode == Opcode::ALL_REDUCE) _ctx->tp_link_free_cycle = inst.finish_cycle;
         least_filled_vpu->push(inst);
 
         {
@@ -602,14 +700,14 @@ void NeuPIMSystolicWS::pim_issue_ex_inst(Instruction inst) {
         }
     }
 
-    // if dest_addr is on sram, count up. -> wait for _compute_pipeline to
+    // if dest_addr is on sram, count up. -> wait for _compute_pipelines to
     // finish calculation
     if (_pim_acc_spad.check_allocated(inst.dest_addr, inst.accum_spad_id)) {
         // spdlog::info("allocated: {}", inst.repr());
         _pim_acc_spad.count_up(inst.dest_addr, inst.accum_spad_id);
     }
     // if dest_addr is not on sram, initialize. -> wait for
-    // _compute_pipeline to finish calculation
+    // _compute_pipelines to finish calculation
     else {
         // spdlog::info("reserve: {}", inst.repr());
         // spdlog::info("reserve, dest_addr:{:x}, spad_id:{}, size:{}", inst.dest_addr,
@@ -618,14 +716,61 @@ void NeuPIMSystolicWS::pim_issue_ex_inst(Instruction inst) {
     }
 }
 
+// Oldest ready instruction among the first issue_window_size of the execute queue, which holds
+// the instructions of every resident tile in order. An instruction does not pass an older one
+// it depends on: reading or writing its destination, or writing one of its sources.
 // TODO: execution instruction should need to issue multiple execution instructions for multiple
 // pipelines
 Instruction NeuPIMSystolicWS::get_first_ready_ex_inst() {
-    Instruction inst = _ex_inst_queue_for_sa.front();
-    if (can_issue_compute(inst)) {
-        _ex_inst_queue_for_sa.pop();
-        return std::move(inst);
+    // (accumulator, buffer id, address) of the older entries' operands
+    typedef std::tuple<bool, int, addr_type> Operand;
+    auto dest_of = [](Instruction &inst) {
+        bool accum = inst.dest_addr >= ACCUM_SPAD_BASE;
+        return Operand(accum, accum ? inst.accum_spad_id : inst.spad_id, inst.dest_addr);
+    };
+    auto src_of = [](Instruction &inst, addr_type addr) {
+        bool accum = inst.src_from_accum && addr >= ACCUM_SPAD_BASE;
+        return Operand(accum, accum ? inst.accum_spad_id : inst.spad_id, addr);
+    };
+    auto contains = [](std::vector<Operand> &operands, Operand operand) {
+        return std::find(operands.begin(), operands.end(), operand) != operands.end();
+    };
+    std::vector<Operand> older_dests;
+    std::vector<Operand> older_srcs;
+
+    uint32_t window = MIN(_config.issue_window_size, (uint32_t)_ex_inst_queue_for_sa.size());
+    for (uint32_t i = 0; i < window; i++) {
+        Instruction &inst = _ex_inst_queue_for_sa[i];
+        Operand dest = dest_of(inst);
+        bool hazard = contains(older_dests, dest) || contains(older_srcs, dest);
+        for (addr_type addr : inst.src_addrs) {
+            hazard = hazard || contains(older_dests, src_of(inst, addr));
+        }
+        if (!hazard && can_issue_compute(inst)) {
+            Instruction ready_inst = std::move(inst);
+            _ex_inst_queue_for_sa.erase(_ex_inst_queue_for_sa.begin() + i);
+            if (i > 0) _stat_out_of_order_issue_count++;
+            return ready_inst;
+        }
+
+        IssueStall reason = hazard ? HAZARD : operand_stall(inst);
+        _stat_blocked_entries[reason]++;
+        if (i == 0) _stat_issue_stall_cycles[reason]++;
+        older_dests.push_back(dest);
+        for (addr_type addr : inst.src_addrs) {
+            older_srcs.push_back(src_of(inst, addr));
+        }
     }
 
     return Instruction{.valid = false};
+}
+
+// an operand still to be loaded (MOVIN) or still to be computed into the accumulator
+NeuPIMSystolicWS::IssueStall NeuPIMSystolicWS::operand_stall(Instruction &inst) {
+    for (addr_type addr : inst.src_addrs) {
+        if (inst.src_from_accum && addr >= ACCUM_SPAD_BASE &&
+            !_acc_spad.check_hit(addr, inst.accum_spad_id))
+            return COMPUTE;
+    }
+    return LOAD;
 }
\ No newline at end of file
@@ -1,23 +1,45 @@
+#pragma once
 #include "NeuPIMSCore.h"
 
 class NeuPIMSystolicWS : public NeuPIMSCore {
    public:
-    NeuPIMSystolicWS(uint32_t id, SimulationConfig config);
+    NeuPIMSystolicWS(uint32_t id, SimContext *ctx);
     virtual void cycle() override;
     virtual void print_stats() override;
     virtual void log() override;
 
    protected:
     virtual cycle_type get_inst_compute_cycles(Instruction& inst) override;
+    // cycles a GEMM streams operands from the SPAD, the next GEMM on an array follows after
+    virtual cycle_type get_inst_stream_cycles(Instruction& inst);
     uint32_t _stat_systolic_inst_issue_count = 0;
     uint32_t _stat_systolic_preload_issue_count = 0;
+    uint32_t _stat_weight_reload_count = 0;  // GEMMs whose weight had left every array
     cycle_type get_vector_compute_cycles(Instruction& inst);
     cycle_type calculate_add_tree_iterations(uint32_t vector_size);
     cycle_type calculate_vector_op_iterations(uint32_t vector_size);
     void issue_ex_inst(Instruction inst);
     void pim_issue_ex_inst(Instruction inst);
+    // dispatches a GEMM to the least busy systolic array; on a weight-stationary core a plain
+    // GEMM stays on the array still holding the weight its GEMM_PRELOAD loaded
+    void issue_gemm(Instruction &inst);
+    // weight-stationary: the weight each array holds, (tile, SPAD address of the weight)
+    struct ArrayWeight {
+        std::weak_ptr<Tile> tile;
+        addr_type addr = 0;
+    };
+    std::vector<ArrayWeight> _array_weights;
     Instruction get_first_ready_ex_inst();
 
+    // why the issue window could not issue: the oldest instruction's reason per stalled cycle,
+    // every blocked entry's reason per scan
+    enum IssueStall { EMPTY, LOAD, COMPUTE, HAZARD, NUM_ISSUE_STALLS };
+    IssueStall operand_stall(Instruction& inst);
+    uint64_t _stat_ex_inst_issue_count = 0;
+    uint64_t _stat_out_of_order_issue_count = 0;
+    cycle_type _stat_issue_stall_cycles[NUM_ISSUE_STALLS] = {};
+    uint64_t _stat_blocked_entries[NUM_ISSUE_STALLS] = {};
+
     std::vector<NPUStat> _stat;
 
     // NPU SA, VU cycle
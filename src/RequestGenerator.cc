@@ -1,32 +1,26 @@
 #include "RequestGenerator.h"
 
-namespace RequestGenerator {
-uint32_t answer_index;
-uint32_t row_index;
-std::vector<std::string> columns;
-std::vector<std::vector<uint32_t>> table;
-
-void init(std::string path, uint32_t _answer_index) {
+void RequestGenerator::init(std::shared_ptr<const RequestTrace> _trace, uint32_t _answer_index) {
     row_index = 0;
 
     // todo
     // initialize answer_index depending on the file type
     answer_index = _answer_index;
 
-    parse(path);
-    spdlog::info("parsed {} lines from file {}", table.size(), path);
+    trace = _trace;
 }
-int get_total_req_cnt() { return table.size(); }
+int RequestGenerator::get_total_req_cnt() { return trace->table.size(); }
 
-bool has_data() { return row_index < table.size(); }
+bool RequestGenerator::has_data() { return row_index < trace->table.size(); }
 
-std::pair<uint32_t, uint32_t> get_qa_length() {
+std::pair<uint32_t, uint32_t> RequestGenerator::get_qa_length() {
     ast(has_data());
-    auto row = table[row_index++];
+    auto row = trace->table[row_index++];
     return std::make_pair(row[0], row[answer_index]);
 }
 
-void parse(std::string path) {
+std::shared_ptr<const RequestTrace> RequestTrace::parse(std::string path) {
+    auto trace = std::make_shared<RequestTrace>();
     std::ifstream input_file(path);
     if (!input_file.is_open()) {
         std::cout << path << std::endl;
@@ -38,7 +32,7 @@ void parse(std::string path) {
         std::istringstream iss(line);
         std::string column_name;
         while (std::getline(iss, column_name, ',')) {
-            columns.push_back(column_name);
+            trace->columns.push_back(column_name);
         }
     }
 
@@ -49,7 +43,8 @@ void parse(std::string path) {
         while (std::getline(iss, cell, ',')) {
             buffer.push_back(std::stoul(cell));
         }
-        table.push_back(buffer);
+        trace->table.push_back(buffer);
     }
+    spdlog::info("parsed {} lines from file {}", trace->table.size(), path);
+    return trace;
 }
-}  // namespace RequestGenerator
\ No newline at end of file
@@ -1,14 +1,25 @@
+#pragma once
+
 #include "Common.h"
 
-namespace RequestGenerator {
-extern uint32_t answer_index;
-extern uint32_t row_index;
-extern std::vector<std::string> columns;
-extern std::vector<std::vector<uint32_t>> table;
-
-void init(std::string path, uint32_t _answer_index);
-bool has_data();
-std::pair<uint32_t, uint32_t> get_qa_length();
-int get_total_req_cnt();
-void parse(std::string path);
-}  // namespace RequestGenerator
+// A parsed request trace (csv), immutable once parsed so Clients can share it
+struct RequestTrace {
+    std::vector<std::string> columns;
+    std::vector<std::vector<uint32_t>> table;
+
+    static std::shared_ptr<const RequestTrace> parse(std::string path);
+};
+
+// Request trace replayed by a Client, one instance per Client
+class RequestGenerator {
+   public:
+    void init(std::shared_ptr<const RequestTrace> trace, uint32_t _answer_index);
+    bool has_data();
+    std::pair<uint32_t, uint32_t> get_qa_length();
+    int get_total_req_cnt();
+
+   private:
+    uint32_t answer_index;
+    uint32_t row_index;
+    std::shared_ptr<const RequestTrace> trace;
+};
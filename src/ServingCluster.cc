@@ -0,0 +1,99 @@
+#include "ServingCluster.h"
+
+ServingCluster::ServingCluster(SimulationConfig config, uint32_t num_replicas,
+                               RouterPolicy policy)
+    : _config(config), _num_replicas(num_replicas), _policy(policy), _core_cycles(0) {
+    spdlog::info("Data parallel serving: {} replicas, router policy {}", _num_replicas,
+                 Router::policy_to_string(_policy));
+    for (uint32_t replica = 0; replica < _num_replicas; replica++) {
+        _replicas.push_back(std::make_unique<Simulator>(_config, SimulatorMode::REPLICA));
+    }
+    _router = std::make_unique<Router>(_policy, _num_replicas);
+    _router->set_kv_headroom(
+        [this](uint32_t replica) { return _replicas[replica]->get_kv_headroom(); });
+    _client = std::make_unique<Client>(_config);
+}
+
+void ServingCluster::launch_model() {
+    for (auto &replica : _replicas) {
+        replica->load_model();
+    }
+}
+
+void ServingCluster::run(std::string model_name) {
+    spdlog::info("======Start Simulation=====");
+    for (auto &replica : _replicas) {
+        replica->start();
+    }
+    spdlog::info("assign model {}", model_name);
+    cycle();
+}
+
+void ServingCluster::cycle() {
+    // every replica shares the core clock, the cluster steps them one core cycle at a time
+    while (_client->running()) {
+        _client->cycle();
+        while (_client->has_request()) {
+            std::shared_ptr<InferRequest> request = _client->pop_request();
+            uint32_t replica = _router->route(request);
+            _replicas[replica]->add_request(request);
+        }
+
+        for (uint32_t replica = 0; replica < _num_replicas; replica++) {
+            _replicas[replica]->core_cycle();
+            while (_replicas[replica]->has_completed_request()) {
+                std::shared_ptr<InferRequest> response =
+                    _replicas[replica]->pop_completed_request();
+                _router->complete(replica, response);
+                _client->receive_response(response);
+                _completed_requests.push_back(response);
+            }
+        }
+        _core_cycles++;
+    }
+
+    // like the single device run, the simulation ends with the last response
+    spdlog::info("Simulation Finished");
+    print_stat();
+}
+
+void ServingCluster::print_stat() {
+    for (uint32_t replica = 0; replica < _num_replicas; replica++) {
+        spdlog::info("========= Replica {} =========", replica);
+        _replicas[replica]->print_stats();
+    }
+
+    std::vector<cycle_type> latencies;
+    uint64_t generated_tokens = 0;
+    cycle_type last_completed_cycle = 0;
+    for (auto &request : _completed_requests) {
+        latencies.push_back(request->completed_cycle - request->arrival_cycle);
+        generated_tokens += request->generated;
+        last_completed_cycle = MAX(last_completed_cycle, (cycle_type)request->completed_cycle);
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    // nearest-rank percentile
+    auto percentile = [&latencies](double p) -> cycle_type {
+        if (latencies.empty()) return 0;
+        size_t rank = (size_t)ceil(p * latencies.size());
+        return latencies[MAX(rank, (size_t)1) - 1];
+    };
+
+    double seconds = (double)last_completed_cycle / (_config.core_freq * 1e6);
+    double token_throughput = seconds > 0 ? generated_tokens / seconds : 0;
+    double request_throughput = seconds > 0 ? latencies.size() / seconds : 0;
+
+    spdlog::info("========= Data Parallel Serving ({}) =========",
+                 Router::policy_to_string(_policy));
+    spdlog::info("Replicas: {}, requests: {}, generated tokens: {}, makespan: {} cycles",
+                 _num_replicas, latencies.size(), generated_tokens, last_completed_cycle);
+    spdlog::info("Throughput: {:.2f} tokens/s, {:.2f} requests/s", token_throughput,
+                 request_throughput);
+    spdlog::info("Latency: p50 {} cycles, p99 {} cycles, max {} cycles", percentile(0.5),
+                 percentile(0.99), latencies.empty() ? 0 : latencies.back());
+    for (uint32_t replica = 0; replica < _num_replicas; replica++) {
+        spdlog::info("Replica {}: routed {} requests, {} core cycles", replica,
+                     _router->get_num_routed(replica), _replicas[replica]->get_core_cycles());
+    }
+}
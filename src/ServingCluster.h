@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Common.h"
+#include "Model.h"
+#include "Simulator.h"
+#include "client/Client.h"
+#include "client/Router.h"
+
+// Data-parallel serving: one Client feeds M independent replicas through a Router.
+// Every replica is a whole NeuPIMs device (cores, DRAM, scheduler) running the model.
+class ServingCluster {
+   public:
+    ServingCluster(SimulationConfig config, uint32_t num_replicas, RouterPolicy policy);
+    void launch_model();  // every replica allocates its own copy of the model
+    void run(std::string model_name);
+
+   private:
+    void cycle();
+    void print_stat();
+
+    SimulationConfig _config;
+    uint32_t _num_replicas;
+    RouterPolicy _policy;
+
+    std::unique_ptr<Client> _client;
+    std::unique_ptr<Router> _router;
+    std::vector<std::unique_ptr<Simulator>> _replicas;
+
+    cycle_type _core_cycles;
+    std::vector<Ptr<InferRequest>> _completed_requests;
+};
@@ -0,0 +1,23 @@
+#include "SimContext.h"
+
+SimContext::SimContext(SimulationConfig config)
+    : config(config),
+      address(config),
+      wgt_alloc(this),
+      act_alloc(this),
+      kv_cache_alloc(this),
+      const_addr(0),
+      req_count(0),
+      pre_req_count(0),
+      tp_link_free_cycle(0),
+      _next_id(0),
+      _next_mem_access_id(0) {}
+
+void SimContext::init_allocators() {
+    act_alloc.init(wgt_alloc.get_next_aligned_addr());
+    kv_cache_alloc.init(act_alloc.get_next_aligned_addr());
+}
+
+void SimContext::log_mem_access_count() {
+    spdlog::info("total pre req count {} / memory request count {}", pre_req_count, req_count);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Common.h"
+#include "allocator/AddressAllocator.h"
+
+// Everything one simulation owns that used to be process-wide: the configuration, the address
+// mapping and allocators, the id counters and the device-wide link clocks. Simulator, Scheduler,
+// Model, StageProgram, cores, operations and tensors all reach it through the pointer they were
+// built with, so several simulations can live in one process (replicas, sweeps, library users).
+class SimContext {
+   public:
+    SimContext(SimulationConfig config);
+    SimContext(const SimContext &) = delete;
+    SimContext &operator=(const SimContext &) = delete;
+
+    SimulationConfig config;
+    AddressConfig address;
+
+    WgtAlloc wgt_alloc;
+    ActAlloc act_alloc;
+    KVCacheAlloc kv_cache_alloc;
+    void init_allocators();  // after the model weights are allocated
+
+    uint32_t generate_id() { return _next_id++; }  // tensors, operations, models
+    uint32_t generate_mem_access_id() { return _next_mem_access_id++; }
+
+    // MemoryAccess::from_instruction
+    addr_type const_addr;
+    int req_count;
+    int pre_req_count;
+    void log_mem_access_count();
+
+    // the tensor-parallel link is shared by every core of the device (ALL_REDUCE)
+    cycle_type tp_link_free_cycle;
+
+   private:
+    uint32_t _next_id;
+    uint32_t _next_mem_access_id;
+};
@@ -1,20 +1,49 @@
 #pragma once
 
+#include <memory>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <vector>
 
 using json = nlohmann::json;
 
 typedef uint64_t cycle_type;
 
+struct RequestTrace;
+
 enum class CoreType { SYSTOLIC_OS, SYSTOLIC_WS };
 
 enum class DramType { DRAM, NEWTON, NEUPIMS };
 
-enum class IcntType { SIMPLE, BOOKSIM2 };
+enum class IcntType { SIMPLE, BOOKSIM2, NOC };
+
+enum class NocTopology { CROSSBAR, MESH, RING };
 
 enum class RunMode { NPU_ONLY, NPU_PIM };
 
+// where the attention of a prefill chunk runs (chunked prefill)
+enum class PrefillAttention { NPU, PIM };
+
+enum class OperationPriority { PROGRAM_ORDER, CRITICAL_PATH };
+
+// all-reduce algorithm between tensor parallel devices
+enum class AllReduceAlg { RING, TREE };
+
+// sub-batch partitioning algorithm (for sub-batch interleaving)
+enum class PartitionAlg { SIMPLE, DP, BITSET_DP, KARMARKAR_KARP, CHANNEL_GREEDY };
+
+// One stage of the sub-batch interleaving schedule.
+// A stage runs (at most) one sub-batch on the systolic array and one on PIM,
+// and the next stage starts when both are done.
+struct StageEntry {
+    std::string name;
+    int sa_sub_batch = -1;   // -1: SA idle
+    bool proj_ffns = false;  // SA: Projection + FFN1 + FFN2
+    bool qkv_gen = false;    // SA: QKV generation
+    int pim_sub_batch = -1;  // -1: PIM idle, otherwise MHA of this sub-batch
+    bool lm_head = false;    // LM head + sampling of every request that emits a token
+};
+
 struct CoreConfig {
     CoreType core_type;   // systolic_ws
     uint32_t core_width;  // 128
@@ -42,6 +71,9 @@ struct CoreConfig {
 
     uint32_t vector_core_count; // 8
     uint32_t vector_core_width; // 8
+
+    uint32_t systolic_array_count; // 8, each core_height x core_width
+    uint32_t spad_ports;           // SPAD read ports shared by the arrays, default one each
 };
 
 struct SimulationConfig {
@@ -52,16 +84,27 @@ struct SimulationConfig {
     uint32_t model_vocab_size;
     uint32_t model_n_layer;
     uint32_t model_n_head;
+    uint32_t model_n_kv_head; // < model_n_head: grouped-query attention, 1: multi-query
     uint32_t model_n_embd;
 
     /* Custom Config */
     RunMode run_mode; // NPU
     bool sub_batch_mode;
+    bool adaptive_sub_batch; // decide split/unsplit every iteration (needs sub_batch_mode)
+    bool relaxed_stage_barriers; // a unit starts a stage once its sub-batch is ready
+    PartitionAlg partition_alg;
+    uint32_t num_sub_batches;               // 1 if sub_batch_mode is off
+    std::vector<StageEntry> stage_schedule; // default: make_stage_schedule(num_sub_batches)
     bool ch_load_balancing;
     bool kernel_fusion;
     uint32_t max_batch_size;
     uint32_t max_active_reqs; // max size of (ready_queue + running_queue) in scheduler
     uint32_t max_seq_len;
+    uint32_t prefill_chunk_size; // prompt tokens per iteration, 0: prompts are already cached
+    PrefillAttention prefill_attention;
+    bool lm_head;                   // add an LM head + sampling stage to every iteration
+    uint32_t sampling_top_k;        // 1: argmax
+    uint32_t lm_head_pim_max_batch; // LM head as PIM GEMV up to this many tokens, 0: always SA
     uint64_t HBM_size;         // HBM size in bytes
     uint64_t HBM_act_buf_size; // HBM activation buffer size in bytes
 
@@ -69,11 +112,33 @@ struct SimulationConfig {
     uint32_t num_cores;
     uint32_t core_freq;
     struct CoreConfig *core_config;
+    // memory requests a core queues before its load/store fetch stalls, 0: unbounded
+    uint32_t core_request_queue_size;
+    // oldest execute-queue entries a core scans for a ready instruction, 1: in-order issue
+    uint32_t issue_window_size;
+    // SA tiles in per-core queues (weight tile affinity) with work stealing, else one queue
+    bool per_core_tile_queues;
+    // operations of a stage program whose tiles are queued or running at once, and which of the
+    // executable operations starts next
+    uint32_t max_inflight_operations;
+    OperationPriority operation_priority;
     // CoreType core_type;   // TODO: remove
     // uint32_t core_width;  // TODO: remove
     // uint32_t core_height; // TODO: remove
 
     uint32_t n_tp;
+    /* TP link config (all-reduce after projection and FFN when tp_allreduce and n_tp > 1) */
+    bool tp_allreduce;
+    double tp_link_bandwidth;  // GB/s per device and direction
+    uint32_t tp_link_latency;  // ns per step
+    AllReduceAlg tp_allreduce_alg;
+
+    uint32_t n_pp;  // pipeline parallel devices, each holds a slice of the layers
+    /* PP link config (activations between adjacent pipeline devices when pp_accounting) */
+    bool pp_accounting;
+    double pp_link_bandwidth;   // GB/s
+    uint32_t pp_link_latency;   // ns
+    uint32_t pp_micro_batches;  // micro-batches an iteration is split into (default n_pp)
 
     // uint32_t vector_core_count; // TODO: remove
     // uint32_t vector_core_width; // TODO: remove
@@ -118,12 +183,21 @@ struct SimulationConfig {
     uint32_t request_interval;
     uint32_t request_total_cnt;
     std::string request_dataset_path;
+    // already parsed request_dataset_path, shared by the points of a sweep (null: Client parses)
+    std::shared_ptr<const RequestTrace> request_trace;
 
     /* ICNT config */
     IcntType icnt_type;
     std::string icnt_config_path;
     uint32_t icnt_freq;
     uint32_t icnt_latency;
+    uint32_t icnt_buffer_size;  // entries per port (credits), 0: unbounded
+    /* on-chip network (icnt_type noc) */
+    NocTopology noc_topology;
+    uint32_t noc_router_latency;  // icnt cycles per router
+    uint32_t noc_link_width;      // bytes per icnt cycle, one flit
+    uint32_t noc_vc_depth;        // flits per virtual channel buffer
+    uint32_t noc_mesh_width;      // routers per mesh row, 0: square
 
     /* Sheduler config */
     std::string scheduler_type;
@@ -134,7 +208,3 @@ struct SimulationConfig {
 
     uint64_t align_address(uint64_t addr) { return addr - (addr % dram_req_size); }
 };
-
-namespace Config {
-extern SimulationConfig global_config;
-}
\ No newline at end of file
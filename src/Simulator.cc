@@ -3,6 +3,7 @@
 #include <filesystem>
 #include <string>
 
+#include "NeuPIMSystolicOS.h"
 #include "NeuPIMSystolicWS.h"
 #include "SystolicOS.h"
 #include "SystolicWS.h"
@@ -11,14 +12,19 @@
 
 namespace fs = std::filesystem;
 
-Simulator::Simulator(SimulationConfig config) : _config(config), _core_cycles(0) {
+Simulator::Simulator(SimulationConfig config, SimulatorMode mode)
+    : _config(config),
+      _mode(mode),
+      _ctx(std::make_unique<SimContext>(config)),
+      _started(false),
+      _next_rid(0),
+      _injected_requests(0),
+      _finished_tiles(0),
+      _core_cycles(0) {
     // Create dram object
-    _core_period = 1.0 / ((double)config.core_freq);
-    _icnt_period = 1.0 / ((double)config.icnt_freq);
-    _dram_period = 1.0 / ((double)config.dram_freq);
-    _core_time = 0.0;
-    _dram_time = 0.0;
-    _icnt_time = 0.0;
+    _core_clock = _clock.add_domain("core", config.core_freq);
+    _dram_clock = _clock.add_domain("dram", config.dram_freq);
+    _icnt_clock = _clock.add_domain("icnt", config.icnt_freq);
 
     std::string pim_config = fs::path(__FILE__).parent_path().append(config.pim_config_path).string();
     spdlog::info("Newton config: {}", pim_config);
@@ -26,22 +32,30 @@ Simulator::Simulator(SimulationConfig config) : _config(config), _core_cycles(0)
     _dram = std::make_unique<PIM>(config);
 
     // Create interconnect object
-    _icnt = std::make_unique<SimpleInterconnect>(config);
-    // if (config.icnt_type == IcntType::SIMPLE) {
-    // } else if (config.icnt_type == IcntType::BOOKSIM2) {
-    //     _icnt = std::make_unique<Booksim2Interconnect>(config);
-    // } else {
-    //     assert(0);
-    // }
+    if (config.icnt_type == IcntType::SIMPLE) {
+        _icnt = std::make_unique<SimpleInterconnect>(config);
+    } else if (config.icnt_type == IcntType::NOC) {
+        _icnt = std::make_unique<NocInterconnect>(config);
+    } else {
+        // Booksim2Interconnect has no implementation in this tree (extern/booksim is empty)
+        throw std::runtime_error("booksim2 interconnect is not available, use simple or noc");
+    }
 
     // Create core objects
     _cores.resize(config.num_cores);
     _n_cores = config.num_cores;
+    _core_finished_tiles.assign(_n_cores, 0);
+    _tail_idle_cycles = 0;
+    _transition_idle_cycles = 0;
     _n_memories = config.dram_channels;
     for (int core_index = 0; core_index < _n_cores; core_index++) {
-        spdlog::info("initializing NeuPIM SystolicWS cores.");
-        // TODO: support OS?
-        _cores[core_index] = std::make_unique<NeuPIMSystolicWS>(core_index, _config);
+        if (config.core_config[core_index].core_type == CoreType::SYSTOLIC_OS) {
+            spdlog::info("initializing NeuPIM SystolicOS cores.");
+            _cores[core_index] = std::make_unique<NeuPIMSystolicOS>(core_index, _ctx.get());
+        } else {
+            spdlog::info("initializing NeuPIM SystolicWS cores.");
+            _cores[core_index] = std::make_unique<NeuPIMSystolicWS>(core_index, _ctx.get());
+        }
     }
 
     if (config.scheduler_type == "simple") {
@@ -56,18 +70,24 @@ Simulator::Simulator(SimulationConfig config) : _config(config), _core_cycles(0)
     //     _scheduler = std::make_unique<HalfSplitScheduler>(_config, &_core_cycles);
     // }
 
-    _client = std::make_unique<Client>(_config);
+    if (_mode == SimulatorMode::CLIENT) _client = std::make_unique<Client>(_config);
 }
 
 void Simulator::run(std::string model_name) {
     spdlog::info("======Start Simulation=====");
-    _scheduler->launch(_model);
+    start();
     spdlog::info("assign model {}", model_name);
     cycle();
 }
 
+void Simulator::start() {
+    if (_started) return;
+    _started = true;
+    _scheduler->launch(_model);
+}
+
 void Simulator::update_stage_stat() {
-    Stage done_stage = _scheduler->get_prev_stage();
+    std::string done_stage = _scheduler->get_prev_stage();
     _dram->log(done_stage);
 
     _stage_stats.push_back(StageStat{.stage = done_stage,
@@ -78,7 +98,7 @@ void Simulator::update_stage_stat() {
 }
 
 void Simulator::log_stage_stat() {
-    std::string fname = Config::global_config.log_dir + "/_summary.tsv";
+    std::string fname = _config.log_dir + "/_summary.tsv";
     std::ofstream ofile(fname);
     if (!ofile.is_open()) {
         assert(0);
@@ -99,7 +119,7 @@ void Simulator::log_stage_stat() {
 
         int total_cycle = stage_stat.done_cycle - prev_cycle;
         prev_cycle = stage_stat.done_cycle;
-        stage_row += stageToString(stage_stat.stage) + "\t";
+        stage_row += stage_stat.stage + "\t";
         stage_row += std::to_string(total_cycle) + "\t";
         stage_row += std::to_string(stage_stat.pim_cycles) + "\t";
         stage_row += std::to_string(stage_stat.mem_bw_util) + "\t";
@@ -111,16 +131,25 @@ void Simulator::log_stage_stat() {
 }
 
 void Simulator::cycle() {
-    OpStat op_stat;
-    ModelStat model_stat;
-    uint32_t tile_count;
     while (running()) {
-        int model_id = 0;
+        tick();
+    }
+    spdlog::info("Simulation Finished");
+    print_stats();
+}
+
+void Simulator::core_cycle() {
+    do {
+        tick();
+    } while (!(_cycle_mask & CORE_MASK));
+}
 
-        set_cycle_mask();
-        // Core Cycle
-        if (_cycle_mask & CORE_MASK) {
-            while (_client->has_request()) { // FIXME: change while to if
+void Simulator::tick() {
+    set_cycle_mask();
+    // Core Cycle
+    if (_cycle_mask & CORE_MASK) {
+        if (_client) {
+            while (_client->has_request()) {  // FIXME: change while to if
                 std::shared_ptr<InferRequest> infer_request = _client->pop_request();
                 _scheduler->add_request(infer_request);
             }
@@ -129,136 +158,265 @@ void Simulator::cycle() {
             while (_scheduler->has_completed_request()) {
                 std::shared_ptr<InferRequest> response = _scheduler->pop_completed_request();
                 _client->receive_response(response);
+                complete_request(response);
             }
+        }
 
-            if (_scheduler->has_stage_changed()) {
-                _scheduler->reset_has_stage_changed_status();
-                // _icnt->log(_scheduler->get_prev_stage());
-                update_stage_stat();
+        if (_scheduler->has_stage_changed()) {
+            _scheduler->reset_has_stage_changed_status();
+            // _icnt->log(_scheduler->get_prev_stage());
+            update_stage_stat();
+            if (_stage_callback) _stage_callback(_scheduler->get_prev_stage(), _core_cycles);
+        }
+        _scheduler->cycle();
+
+        for (int core_id = 0; core_id < _n_cores; core_id++) {
+            auto finished_tile = _cores[core_id]->pop_finished_tile();
+            if (finished_tile == nullptr) {
+            } else if (finished_tile->status == Tile::Status::FINISH) {
+                _scheduler->finish_tile(core_id, *finished_tile);
+                _finished_tiles++;
+                _core_finished_tiles[core_id]++;
+                if (_tile_callback) _tile_callback(core_id, *finished_tile);
             }
-            _scheduler->cycle();
 
-            for (int core_id = 0; core_id < _n_cores; core_id++) {
-                auto finished_tile = _cores[core_id]->pop_finished_tile();
-                if (finished_tile == nullptr) {
-                } else if (finished_tile->status == Tile::Status::FINISH) {
-                    _scheduler->finish_tile(core_id, *finished_tile);
-                }
-
-                // Issue new tile to core
-                if (_scheduler->empty1() && _scheduler->empty2())
-                    continue;
-
-                // >>> todo: support 2 sub-batch
-                if (!_scheduler->empty1()) {
-                    Tile &tile = _scheduler->top_tile1(core_id);
-                    if ((tile.status != Tile::Status::EMPTY) && _cores[core_id]->can_issue(tile)) {
-                        if (tile.status == Tile::Status::INITIALIZED) {
-                            assert(tile.stage_platform == StagePlatform::SA);
-                            _cores[core_id]->issue(tile);
-                            _scheduler->get_tile1(core_id);
-                        }
+            // Issue new tile to core
+            if (_scheduler->empty1() && _scheduler->empty2())
+                continue;
+
+            // >>> todo: support 2 sub-batch
+            if (!_scheduler->empty1()) {
+                Tile &tile = _scheduler->top_tile1(core_id);
+                if ((tile.status != Tile::Status::EMPTY) && _cores[core_id]->can_issue(tile)) {
+                    if (tile.status == Tile::Status::INITIALIZED) {
+                        assert(tile.stage_platform == StagePlatform::SA);
+                        _cores[core_id]->issue(tile);
+                        _scheduler->get_tile1(core_id);
                     }
                 }
-                if (!_scheduler->empty2()) {
-                    Tile &tile = _scheduler->top_tile2(core_id);
-                    if ((tile.status != Tile::Status::EMPTY) && _cores[core_id]->can_issue_pim()) {
-                        if (tile.status == Tile::Status::INITIALIZED) {
-                            assert(tile.stage_platform == StagePlatform::PIM);
-                            _cores[core_id]->issue_pim(tile);
-                            _scheduler->get_tile2(core_id);
-                        }
+            }
+            if (!_scheduler->empty2()) {
+                Tile &tile = _scheduler->top_tile2(core_id);
+                if ((tile.status != Tile::Status::EMPTY) && _cores[core_id]->can_issue_pim()) {
+                    if (tile.status == Tile::Status::INITIALIZED) {
+                        assert(tile.stage_platform == StagePlatform::PIM);
+                        _cores[core_id]->issue_pim(tile);
+                        _scheduler->get_tile2(core_id);
                     }
                 }
-                // <<< todo: support 2 sub-batch
-                _cores[core_id]->cycle();
             }
-            _core_cycles++;
+            // <<< todo: support 2 sub-batch
+            if (!_scheduler->empty1() && !_cores[core_id]->running()) {
+                if (_scheduler->sa_operation_running())
+                    _tail_idle_cycles++;
+                else
+                    _transition_idle_cycles++;
+            }
+            _cores[core_id]->cycle();
         }
+        _core_cycles++;
+    }
 
-        // DRAM cycle
-        if (_cycle_mask & DRAM_MASK) {
-            _dram->cycle();
-        }
-        // Interconnect cycle
-        if (_cycle_mask & ICNT_MASK) {
-            for (int core_id = 0; core_id < _n_cores; core_id++) {
-                for (uint32_t channel_index = 0; channel_index < _n_memories; ++channel_index) {
-                    auto core_ind = core_id * _n_cores + channel_index;
-                    // core -> ICNT (sub-batch #1)
-                    if (_cores[core_id]->has_memory_request1(channel_index)) {
-                        MemoryAccess *front = _cores[core_id]->top_memory_request1(channel_index);
-                        front->core_id = core_id;
-                        if (!_icnt->is_full(core_ind, front)) {
-                            _icnt->push(core_ind, get_dest_node(front), front);
-                            _cores[core_id]->pop_memory_request1(channel_index);
-                        }
-                    }
-                    // // core -> ICNT (sub-batch #2)
-                    if (_cores[core_id]->has_memory_request2(channel_index)) {
-                        MemoryAccess *front = _cores[core_id]->top_memory_request2(channel_index);
-                        front->core_id = core_id;
-                        if (!_icnt->is_full(core_ind, front)) {
-                            _icnt->push(core_ind, get_dest_node(front), front);
-                            _cores[core_id]->pop_memory_request2(channel_index);
-                        }
+    // DRAM cycle
+    if (_cycle_mask & DRAM_MASK) {
+        _dram->cycle();
+    }
+    // Interconnect cycle
+    if (_cycle_mask & ICNT_MASK) {
+        // core and interconnect queues of a node are independent, so requests and responses
+        // are moved in two passes, each over the non-empty queues only
+        for (int core_id = 0; core_id < _n_cores; core_id++) {
+            auto &core = _cores[core_id];
+            core->get_memory_request_channels().for_each_from(0, [&](uint32_t channel_index) {
+                auto core_ind = core_id * _n_memories + channel_index;
+                // core -> ICNT (sub-batch #1)
+                if (core->has_memory_request1(channel_index)) {
+                    MemoryAccess *front = core->top_memory_request1(channel_index);
+                    front->core_id = core_id;
+                    if (!_icnt->is_full(core_ind, front)) {
+                        _icnt->push(core_ind, get_dest_node(front), front);
+                        core->pop_memory_request1(channel_index);
                     }
-                    // ICNT -> core
-                    if (!_icnt->is_empty(core_ind)) {
-                        _cores[core_id]->push_memory_response(_icnt->top(core_ind));
-                        _icnt->pop(core_ind);
+                }
+                // // core -> ICNT (sub-batch #2)
+                if (core->has_memory_request2(channel_index)) {
+                    MemoryAccess *front = core->top_memory_request2(channel_index);
+                    front->core_id = core_id;
+                    if (!_icnt->is_full(core_ind, front)) {
+                        _icnt->push(core_ind, get_dest_node(front), front);
+                        core->pop_memory_request2(channel_index);
                     }
                 }
+            });
+        }
+        // ICNT -> core
+        uint32_t core_nodes = _n_cores * _n_memories;
+        const ActiveSet *outputs = _icnt->get_active_outputs();
+        for (uint32_t core_ind = outputs ? outputs->next(0) : 0; core_ind < core_nodes;
+             core_ind = outputs ? outputs->next(core_ind + 1) : core_ind + 1) {
+            if (!_icnt->is_empty(core_ind)) {
+                _cores[core_ind / _n_memories]->push_memory_response(_icnt->top(core_ind));
+                _icnt->pop(core_ind);
             }
+        }
 
-            for (int dram_ind = 0; dram_ind < _n_memories; dram_ind++) {
-                auto mem_ind = _n_cores * _n_memories + dram_ind;
+        for (int dram_ind = 0; dram_ind < _n_memories; dram_ind++) {
+            auto mem_ind = _n_cores * _n_memories + dram_ind;
 
-                // ICNT to memory (log write)
+            // ICNT to memory (log write)
 
-                // (Sub-batch#1 -> DRAM)
-                if (_icnt->has_memreq1(dram_ind)) {
-                    auto memreq_sa = _icnt->memreq_top1(dram_ind);
-                    if (!_dram->is_full(dram_ind, memreq_sa)) {
-                        _dram->push(dram_ind, memreq_sa);
-                        _icnt->memreq_pop1(dram_ind);
-                    }
-                }
-
-                // (Sub-batch#2 -> DRAM) // only for NeuPIMs
-                if (_icnt->has_memreq2(dram_ind)) {
-                    auto memreq_sa = _icnt->memreq_top2(dram_ind);
-                    if (!_dram->is_full(dram_ind, memreq_sa)) {
-                        _dram->push(dram_ind, memreq_sa);
-                        _icnt->memreq_pop2(dram_ind);
-                    }
+            // (Sub-batch#1 -> DRAM)
+            if (_icnt->has_memreq1(dram_ind)) {
+                auto memreq_sa = _icnt->memreq_top1(dram_ind);
+                if (!_dram->is_full(dram_ind, memreq_sa)) {
+                    _dram->push(dram_ind, memreq_sa);
+                    _icnt->memreq_pop1(dram_ind);
                 }
+            }
 
-                // Pop response to ICNT from dram (log read)
-                if (!_dram->is_empty(dram_ind) && !_icnt->is_full(mem_ind, _dram->top(dram_ind))) {
-                    _icnt->push(mem_ind, get_dest_node(_dram->top(dram_ind)), _dram->top(dram_ind));
-                    _dram->pop(dram_ind);
+            // (Sub-batch#2 -> DRAM) // only for NeuPIMs
+            if (_icnt->has_memreq2(dram_ind)) {
+                auto memreq_sa = _icnt->memreq_top2(dram_ind);
+                if (!_dram->is_full(dram_ind, memreq_sa)) {
+                    _dram->push(dram_ind, memreq_sa);
+                    _icnt->memreq_pop2(dram_ind);
                 }
             }
 
-            _icnt->cycle();
+            // Pop response to ICNT from dram (log read)
+            if (!_dram->is_empty(dram_ind) && !_icnt->is_full(mem_ind, _dram->top(dram_ind))) {
+                _icnt->push(mem_ind, get_dest_node(_dram->top(dram_ind)), _dram->top(dram_ind));
+                _dram->pop(dram_ind);
+            }
         }
+
+        _icnt->cycle();
     }
-    spdlog::info("Simulation Finished");
+}
+
+void Simulator::print_stats() {
     /* Print simulation stats */
     for (int core_id = 0; core_id < _n_cores; core_id++) {
         _cores[core_id]->print_stats();
         _cores[core_id]->log();
     }
-    // _icnt->print_stats();
+    print_core_type_stats();
+    _icnt->print_stats();
     // _icnt->log();
     _dram->print_stat();
     _scheduler->print_stat();
     log_stage_stat();
 }
 
+// cores grouped by their core_config, for heterogeneous configurations
+void Simulator::print_core_type_stats() {
+    std::map<std::string, std::vector<int>> core_types;
+    for (int core_id = 0; core_id < _n_cores; core_id++) {
+        CoreConfig &core = _config.core_config[core_id];
+        core_types[fmt::format("{} {}x{} x{}, vector {}x{}, spad {}KB",
+                               core.core_type == CoreType::SYSTOLIC_OS ? "systolic_os"
+                                                                       : "systolic_ws",
+                               core.core_height, core.core_width, core.systolic_array_count,
+                               core.vector_core_count, core.vector_core_width, core.spad_size)]
+            .push_back(core_id);
+    }
+    cycle_type core_cycles = MAX(_core_cycles * _n_cores, (cycle_type)1);
+    spdlog::info(
+        "Cores idle in operation tails {} core cycles ({:.2f}%), between operations {} core "
+        "cycles ({:.2f}%)",
+        _tail_idle_cycles, 100.0 * _tail_idle_cycles / core_cycles, _transition_idle_cycles,
+        100.0 * _transition_idle_cycles / core_cycles);
+    for (auto &[core_type, core_ids] : core_types) {
+        uint64_t tiles = 0;
+        cycle_type busy_cycles = 0;
+        cycle_type array_cycles = 0;
+        for (int core_id : core_ids) {
+            tiles += _core_finished_tiles[core_id];
+            busy_cycles += _cores[core_id]->get_array_busy_cycles();
+            array_cycles += _core_cycles * _config.core_config[core_id].systolic_array_count;
+        }
+        spdlog::info("Core type [{}] : {} cores, {} tiles, systolic array utilization {:.2f}%",
+                     core_type, core_ids.size(), tiles,
+                     array_cycles ? 100.0 * busy_cycles / array_cycles : 0.0);
+    }
+}
+
 void Simulator::launch_model(Ptr<Model> model) { _model = model; }
 
+void Simulator::load_model() {
+    auto model = std::make_shared<Model>(_ctx.get(), _config.model_name);
+    /* Allocator initialization after weight allocating */
+    _ctx->init_allocators();
+    launch_model(model);
+}
+
+uint32_t Simulator::inject_request(uint32_t input_size, uint32_t output_size, int channel) {
+    // a Client or a Router numbers the requests of the other modes
+    if (_mode != SimulatorMode::LIBRARY)
+        throw std::runtime_error("inject_request needs a Simulator in SimulatorMode::LIBRARY");
+    uint32_t rid = _next_rid++;
+    _scheduler->add_request(std::make_shared<InferRequest>(
+        InferRequest{.id = rid,
+                     .arrival_cycle = (uint32_t)_core_cycles,
+                     .completed_cycle = 0,
+                     .input_size = input_size,
+                     .output_size = output_size,
+                     .is_initiated = false,
+                     .generated = 0,
+                     .prefilled = 0,
+                     .chunk_size = 0,
+                     .first_token_cycle = 0,
+                     .scheduled_cycle = 0,
+                     .channel = channel}));
+    _injected_requests++;
+    return rid;
+}
+
+void Simulator::run_until(cycle_type cycle) {
+    start();
+    while (_core_cycles < cycle) {
+        core_cycle();
+        collect_completed_requests();
+    }
+}
+
+void Simulator::run_until_idle() {
+    start();
+    while (running()) {
+        core_cycle();
+        collect_completed_requests();
+    }
+}
+
+void Simulator::complete_request(Ptr<InferRequest> request) {
+    _completed_requests.push_back(request);
+    if (_request_callback) _request_callback(request);
+}
+
+void Simulator::collect_completed_requests() {
+    // tick hands them to the Client, a replica's Router pops them itself
+    if (_mode != SimulatorMode::LIBRARY) return;
+    while (_scheduler->has_completed_request()) {
+        Ptr<InferRequest> request = _scheduler->pop_completed_request();
+        request->completed_cycle = _core_cycles;
+        complete_request(request);
+    }
+}
+
+SimulatorStat Simulator::get_stat() {
+    uint64_t generated_tokens = 0;
+    for (auto &request : _completed_requests) generated_tokens += request->generated;
+    return SimulatorStat{
+        .core_cycles = _core_cycles,
+        .injected_requests = _injected_requests,
+        .completed_requests = (uint32_t)_completed_requests.size(),
+        .running_requests = _scheduler->count_requests(),
+        .generated_tokens = generated_tokens,
+        .finished_tiles = _finished_tiles,
+        .finished_stages = (uint32_t)_stage_stats.size(),
+        .mem_bw_util = _stage_stats.empty() ? 0 : _stage_stats.back().mem_bw_util};
+}
+
 bool Simulator::running() {
     bool running = false;
 
@@ -268,7 +426,7 @@ bool Simulator::running() {
     running = running || _icnt->running();
     running = running || _dram->running();
     running = running || _scheduler->running();
-    running = running || _client->running();
+    running = running || (_client && _client->running());
     // if (!_client->running() && _cores[0]->running()) {
     //     // for debug
     //     spdlog::info("core[1] running: {}", _cores[0]->running());
@@ -284,18 +442,10 @@ bool Simulator::running() {
 
 void Simulator::set_cycle_mask() {
     _cycle_mask = 0x0;
-    double minimum_time = MIN3(_core_time, _dram_time, _icnt_time);
-    if (_core_time <= minimum_time) {
-        _cycle_mask |= CORE_MASK;
-        _core_time += _core_period;
-    }
-    if (_dram_time <= minimum_time) {
-        _cycle_mask |= DRAM_MASK;
-        _dram_time += _dram_period;
-    }
-    if (_icnt_time <= minimum_time) {
-        _cycle_mask |= ICNT_MASK;
-        _icnt_time += _icnt_period;
+    for (uint32_t clock : _clock.next_edge()) {
+        if (clock == _core_clock) _cycle_mask |= CORE_MASK;
+        if (clock == _dram_clock) _cycle_mask |= DRAM_MASK;
+        if (clock == _icnt_clock) _cycle_mask |= ICNT_MASK;
     }
 }
 
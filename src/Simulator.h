@@ -1,5 +1,8 @@
 #pragma once
 
+#include <functional>
+
+#include "ClockScheduler.h"
 #include "Common.h"
 #include "Core.h"
 #include "Dram.h"
@@ -13,23 +16,83 @@
 #define DRAM_MASK 0x1 << 2
 #define ICNT_MASK 0x1 << 3
 
+// where the requests of a simulation come from
+enum class SimulatorMode {
+    CLIENT,   // a Client replays the request trace of the config
+    REPLICA,  // a data-parallel replica, a Router adds requests and takes the responses
+    LIBRARY,  // embedded, requests come through inject_request (see README)
+};
+
+// live stats of a simulation (Simulator::get_stat)
+struct SimulatorStat {
+    cycle_type core_cycles;
+    uint32_t injected_requests;   // through inject_request
+    uint32_t completed_requests;  // responses so far
+    uint32_t running_requests;    // queued or in a batch
+    uint64_t generated_tokens;    // of the completed requests
+    uint64_t finished_tiles;
+    uint32_t finished_stages;
+    double mem_bw_util;  // of the last finished stage
+};
+
 class Simulator {
   public:
-    Simulator(SimulationConfig config);
+    // only SimulatorMode::CLIENT creates a Client
+    Simulator(SimulationConfig config, SimulatorMode mode = SimulatorMode::CLIENT);
     void launch_model(Ptr<Model> model);
     void run(std::string model_name);
     addr_type get_addr_align() { return _dram->get_addr_align(); }
+    SimContext *get_context() { return _ctx.get(); }  // build the Model against this
+    // builds the model of the config in this simulation's context and launches it
+    void load_model();
+
+    /* for running as a data-parallel replica (see ServingCluster) */
+    void start();
+    void core_cycle();  // ticks every clock domain up to and including one core cycle
+    bool running();
+    void add_request(std::shared_ptr<InferRequest> request) { _scheduler->add_request(request); }
+    int64_t get_kv_headroom() { return _scheduler->get_kv_headroom(); }
+    bool has_completed_request() { return _scheduler->has_completed_request(); }
+    std::shared_ptr<InferRequest> pop_completed_request() {
+        return _scheduler->pop_completed_request();
+    }
+    cycle_type get_core_cycles() { return _core_cycles; }
+    // responses the Client received, in completion order
+    const std::vector<Ptr<InferRequest>> &get_completed_requests() { return _completed_requests; }
+    void print_stats();
+
+    /* library API: step and query a simulation from another program (see README) */
+    // request of input_size prompt tokens generating output_size tokens, returns its id
+    uint32_t inject_request(uint32_t input_size, uint32_t output_size, int channel = 0);
+    void run_until(cycle_type cycle);  // ticks until the core clock reaches cycle
+    void run_until_idle();                  // ticks until every request has completed
+    void on_tile_finished(std::function<void(uint32_t core_id, const Tile &tile)> callback) {
+        _tile_callback = callback;
+    }
+    void on_stage_finished(std::function<void(std::string stage, cycle_type cycle)> callback) {
+        _stage_callback = callback;
+    }
+    void on_request_completed(std::function<void(Ptr<InferRequest> request)> callback) {
+        _request_callback = callback;
+    }
+    SimulatorStat get_stat();
+
     // void run_offline(std::string model_name, uint32_t sample_count);
     // void run_multistream(std::string model_name, uint32_t sample_count,
     // uint32_t ); void run_server(std::string trace_path);
   private:
     void cycle();
-    bool running();
+    void tick();
+    void print_core_type_stats();
+    void complete_request(Ptr<InferRequest> request);
+    void collect_completed_requests();  // no Client: the simulator takes the responses
     void set_cycle_mask();
     uint32_t get_dest_node(MemoryAccess *access);
     void update_stage_stat();
     void log_stage_stat();
     SimulationConfig _config;
+    SimulatorMode _mode;
+    std::unique_ptr<SimContext> _ctx;
     uint32_t _n_cores;
     uint32_t _n_memories;
 
@@ -39,15 +102,26 @@ class Simulator {
     std::unique_ptr<Dram> _dram;
     std::unique_ptr<Scheduler> _scheduler;
     std::unique_ptr<Client> _client;
+    std::vector<Ptr<InferRequest>> _completed_requests;
+
+    bool _started;
+    uint32_t _next_rid;  // inject_request
+    uint32_t _injected_requests;
+    uint64_t _finished_tiles;
+    std::vector<uint64_t> _core_finished_tiles;
+    // core cycles a core idles while the SA program runs: during the tail of an operation
+    // (its last tiles run elsewhere) or between operations
+    cycle_type _tail_idle_cycles;
+    cycle_type _transition_idle_cycles;
+    std::function<void(uint32_t, const Tile &)> _tile_callback;
+    std::function<void(std::string, cycle_type)> _stage_callback;
+    std::function<void(Ptr<InferRequest>)> _request_callback;
 
-    // period information (us)
-    double _core_period;
-    double _icnt_period;
-    double _dram_period;
-    //
-    double _core_time;
-    double _icnt_time;
-    double _dram_time;
+    // clock domains (core, dram, interconnect), exact integer edges
+    ClockScheduler _clock;
+    uint32_t _core_clock;
+    uint32_t _dram_clock;
+    uint32_t _icnt_clock;
 
     addr_type _dram_ch_stride_size;
 
@@ -58,7 +132,7 @@ class Simulator {
     Ptr<Model> _model;
 
     struct StageStat {
-        Stage stage;
+        std::string stage;
         cycle_type done_cycle;
         cycle_type pim_cycles;
         cycle_type npu_cycles;
@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <iterator>
 #include <memory>
+#include <set>
 #include <vector>
 
 #include "Common.h"
@@ -15,22 +16,19 @@
 #include "tensor/PIMTensor.h"
 
 StageProgram::StageProgram(Ptr<Model> model, Ptr<BatchedRequest> batched_request,
-                           StagePlatform stage_platform, Stage stage)
-    : _model(model),
+                           StagePlatform stage_platform, const StageEntry &stage)
+    : _name(stagePlatformToString(stage_platform) + "_stage_" + stage.name),
+      _model(model),
+      _ctx(model->get_context()),
+      _config(_ctx->config),
       _breq(batched_request),
       _stage_platform(stage_platform),
-      _stage(stage),
-      _name(stagePlatformToString(stage_platform) + "_stage_" + stageToString(stage)) {
+      _stage(stage) {
     this->init_program();
 }
 
-// |     |     A    |     B    |         C        |         D        |     E     |     F     |
-// |-----|:--------:|:--------:|:----------------:|:----------------:|:---------:|:---------:|
-// |  SA | QKVgen#1 | QKVgen#2 | Pj/FFNs/QKVgen#1 | Pj/FFNs/QKVgen#2 | Pj/FFNs#1 | Pj/FFNs#2 |
-// | PIM |     -    |  MHA#1   | MHA#2            | MHA#1            |   MHA#2   |     -     |
-//
+// What each platform runs in a stage comes from the stage schedule (see make_stage_schedule).
 void StageProgram::init_program() {
-    assert(_stage != Stage::Finish);
 
     if (_breq->_reqs.size() == 0) {
         std::string yellow = "\033[1;33m";
@@ -39,6 +37,12 @@ void StageProgram::init_program() {
         return;
     }
 
+    if (_stage.lm_head) {
+        // the scheduler hands the batch to the unit that runs the LM head
+        lm_head_block();
+        return;
+    }
+
     if (_stage_platform == StagePlatform::PIM) {
         if (skip_pim_stage()) {
             std::string yellow = "\033[1;33m";
@@ -51,54 +55,163 @@ void StageProgram::init_program() {
         init_SA_program();
 }
 
-bool StageProgram::skip_pim_stage() { return _stage == Stage::A || _stage == Stage::F; }
+bool StageProgram::skip_pim_stage() { return _stage.pim_sub_batch < 0; }
 
-bool StageProgram::enable_proj_ffns() {
-    return _stage == Stage::C || _stage == Stage::D || _stage == Stage::E || _stage == Stage::F;
-}
+bool StageProgram::enable_proj_ffns() { return _stage.proj_ffns; }
 
-bool StageProgram::enable_qkv_gen() {
-    return _stage == Stage::A || _stage == Stage::B || _stage == Stage::C || _stage == Stage::D;
-}
+bool StageProgram::enable_qkv_gen() { return _stage.qkv_gen; }
 
 void StageProgram::init_SA_program() {
     spdlog::info(">>> Initialize SystolicArray Stage Model Program <<<");
     auto N = _breq->get_num_rows();
-    auto E = Config::global_config.model_n_embd;
+    auto E = _config.model_n_embd;
 
     bool lets_proj_ffns = enable_proj_ffns();
     bool lets_qkvgen = enable_qkv_gen();
 
     std::vector<uint32_t> input_dim{N, E};
     if (lets_proj_ffns) {
-        input_dim[1] /= Config::global_config.n_tp;
+        input_dim[1] /= _config.n_tp;
     }
-    auto input = std::make_shared<NPUTensor>("input", input_dim, NPUTensorBufType::ACT, true);
+    auto input = std::make_shared<NPUTensor>(_ctx, "input", input_dim, NPUTensorBufType::ACT, true);
     std::vector<Ptr<BTensor>> inputs{input};
 
     if (lets_proj_ffns) {
-        // >>> Stage: C/D/E/F : Projection + FFN1 + FFN2
+        // >>> Projection + FFN1 + FFN2
         inputs = projection_block(inputs);
         inputs = ffn1_block(inputs);  // FFN1 & FFN2
         std::string yellow = "\033[1;33m";
         std::string reset = "\033[0m";
         spdlog::info("{}SA : Projection + FFN1 + FFN2{}", yellow, reset);
-        // <<< Stage: C/D/E/F
+        // <<< Projection + FFN1 + FFN2
     }
 
     if (lets_qkvgen) {
-        // >>> Stage: A/B/C/D : QKVGen
+        // >>> QKVGen
         inputs = qkv_gen_block(inputs);
 
         std::string yellow = "\033[1;33m";
         std::string reset = "\033[0m";
         spdlog::info("{}SA : QKV generation{}", yellow, reset);
-        // <<< Stage:: A/B/C/D
+        // <<< QKVGen
+
+        if (_config.prefill_attention == PrefillAttention::NPU) {
+            prefill_attention_block();
+        }
     }
 
     find_executable_node(input);
 }
 
+// Attention of prefill chunks on the NPU, right after their QKV generation.
+// A chunk attends to the prompt prefix already in the KV cache and to itself.
+void StageProgram::prefill_attention_block() {
+    uint32_t num_heads = _config.model_n_head / _config.n_tp;
+    uint32_t num_kv_heads = get_kv_heads_per_device(_config);
+    uint32_t dk = _config.model_n_embd / _config.model_n_head;
+
+    std::vector<Ptr<BTensor>> querys;
+    std::vector<Ptr<BTensor>> keys;
+    std::vector<Ptr<BTensor>> values;
+    for (auto request : _breq->_reqs) {
+        if (request->is_initiated || request->chunk_size == 0) continue;
+        uint32_t q_len = request->chunk_size;
+        uint32_t kv_len = request->prefilled + request->chunk_size;
+
+        querys.push_back(std::make_shared<NPUTensor>(
+            _ctx, "query", std::vector<uint32_t>{num_heads, q_len, dk}, NPUTensorBufType::ACT,
+            true));
+        keys.push_back(std::make_shared<NPUTensor>(
+            _ctx, "key", std::vector<uint32_t>{num_kv_heads, dk, kv_len}, NPUTensorBufType::ACT,
+            true));
+        values.push_back(std::make_shared<NPUTensor>(
+            _ctx, "value", std::vector<uint32_t>{num_kv_heads, kv_len, dk}, NPUTensorBufType::ACT,
+            true));
+    }
+    if (querys.empty()) return;
+
+    std::vector<Ptr<BTensor>> mha_inputs = querys;
+    mha_inputs.insert(mha_inputs.end(), keys.begin(), keys.end());
+    mha_inputs.insert(mha_inputs.end(), values.begin(), values.end());
+
+    auto mha = add_op(std::make_shared<FusedMHA>(
+        _ctx, name_gen(LAYER(0), BlockType::Attention, OperationType::FusedMHA)));
+    get_outputs(mha, mha_inputs);
+
+    std::string yellow = "\033[1;33m";
+    std::string reset = "\033[0m";
+    spdlog::info("{}SA : Prefill attention ({} chunks){}", yellow, querys.size(), reset);
+
+    find_executable_node(querys[0]);
+}
+
+// LM head + sampling for the last token of every request in the batch.
+//  - SA : (N,E) x (E,V) -> (N,V) logits, then top-k sampling on the vector unit
+//  - PIM: GEMV of each hidden state against the vocab slice of every channel, then top-k of
+//         every slice and a merge of the slice candidates
+void StageProgram::lm_head_block() {
+    uint32_t N = _breq->_reqs.size();
+    uint32_t E = _config.model_n_embd;
+    std::string yellow = "\033[1;33m";
+    std::string reset = "\033[0m";
+
+    if (_stage_platform == StagePlatform::SA) {
+        auto input = std::make_shared<NPUTensor>(_ctx, "input", std::vector<uint32_t>{N, E},
+                                                 NPUTensorBufType::ACT, true);
+        std::vector<Ptr<BTensor>> inputs{input};
+
+        auto lm_head = add_op(
+            std::make_shared<MatMul>(_ctx, name_gen(OperationType::LmHead),
+                                     std::vector<Ptr<NPUTensor>>{_model->get_lm_head_weight()}));
+        inputs = get_outputs(lm_head, inputs);
+
+        auto sampling =
+            add_op(std::make_shared<Sampling>(_ctx, name_gen(OperationType::Sampling), 1));
+        get_outputs(sampling, inputs);
+
+        spdlog::info("{}SA : LM head + sampling ({} tokens){}", yellow, N, reset);
+        find_executable_node(input);
+        return;
+    }
+
+    uint32_t num_heads = _config.model_n_head / _config.n_tp;
+    uint32_t dk = _config.model_n_embd / _config.model_n_head;
+    auto weights = _model->get_lm_head_pim_weights();
+
+    std::vector<Ptr<BTensor>> querys;
+    std::vector<Ptr<BTensor>> keys;
+    for (auto weight : weights) weight->clear_child_nodes();  // from the last iteration
+    for (uint32_t j = 0; j < N; j++) {
+        auto hidden = std::make_shared<NPUTensor>(
+            _ctx, "hidden", std::vector<uint32_t>{num_heads, 1, dk}, NPUTensorBufType::ACT, true);
+        for (auto weight : weights) {
+            querys.push_back(hidden);
+            keys.push_back(weight);
+        }
+    }
+
+    std::vector<Ptr<BTensor>> gemv_inputs = querys;
+    gemv_inputs.insert(gemv_inputs.end(), keys.begin(), keys.end());
+
+    // GEMV without softmax, the sampling reads the raw logits
+    auto lm_head = add_op(std::make_shared<NeuPIMSLogitSoftmax>(
+        _ctx, name_gen(OperationType::LmHead, OperationType::PIMGEMV), std::vector<uint32_t>{},
+        false));
+    auto logits = get_outputs(lm_head, gemv_inputs);
+
+    // top-k of every vocab slice in its own tile, then one merge tile per token
+    auto sampling =
+        add_op(std::make_shared<Sampling>(_ctx, name_gen(OperationType::Sampling), 1));
+    auto candidates = get_outputs(sampling, logits);
+
+    auto merge = add_op(std::make_shared<Sampling>(
+        _ctx, name_gen(OperationType::Sampling, "merge"), weights.size()));
+    get_outputs(merge, candidates);
+
+    spdlog::info("{}PIM: LM head GEMV + sampling ({} tokens){}", yellow, N, reset);
+    find_executable_node(querys[0]);
+}
+
 void StageProgram::init_PIM_program() {
     spdlog::info(">>> Initialize PIM Stage Model Program <<<");
     std::string yellow = "\033[1;33m";
@@ -109,26 +222,41 @@ void StageProgram::init_PIM_program() {
 
     int sub_batch_size = _breq->_reqs.size();
 
-    uint32_t num_heads = Config::global_config.model_n_head / Config::global_config.n_tp;
-    uint32_t dk = Config::global_config.model_n_embd / Config::global_config.model_n_head;  // 64;
+    uint32_t num_heads = _config.model_n_head / _config.n_tp;
+    uint32_t dk = _config.model_n_embd / _config.model_n_head;  // 64;
 
     std::vector<Ptr<BTensor>> querys;
     std::vector<Ptr<BTensor>> keys;
     std::vector<Ptr<BTensor>> values;
+    std::vector<uint32_t> seq_lens;  // cached tokens each query attends to
 
     for (int j = 0; j < sub_batch_size; j++) {
         /* - [] todo: change query to real query from gkv gen */
         Ptr<InferRequest> request = _breq->_reqs[j];
-        int q_len = request->is_initiated ? 1 : request->input_size;
-        assert(q_len == 1);
-
-        query = std::make_shared<NPUTensor>("query", std::vector<uint32_t>{num_heads, q_len, dk},
-                                            NPUTensorBufType::ACT, true);
-        querys.push_back(query);
-
-        /* key/value cache */
-        keys.push_back(request->K_cache[0]);
-        values.push_back(request->V_cache[0]);
+        // prefill chunk: already attended on the NPU, or one PIM GEMV pass per query of the
+        // chunk over the causal prefix of the prompt up to that query (multi-query PIM path)
+        if (!request->is_initiated &&
+            _config.prefill_attention == PrefillAttention::NPU)
+            continue;
+        uint32_t num_queries = request->is_initiated ? 1 : request->chunk_size;
+        assert(num_queries >= 1);
+
+        for (uint32_t qi = 0; qi < num_queries; qi++) {
+            query = std::make_shared<NPUTensor>(
+                _ctx, "query", std::vector<uint32_t>{num_heads, 1, dk}, NPUTensorBufType::ACT,
+                true);
+            querys.push_back(query);
+
+            /* key/value cache */
+            keys.push_back(request->K_cache[0]);
+            values.push_back(request->V_cache[0]);
+            seq_lens.push_back(request->is_initiated ? request->K_cache[0]->get_dims()[2]
+                                                     : request->prefilled + qi + 1);
+        }
+    }
+    if (querys.empty()) {
+        spdlog::info("{}PIM: no decode request{}", yellow, reset);
+        return;
     }
 
     /* gemv + softmax */
@@ -137,14 +265,15 @@ void StageProgram::init_PIM_program() {
                           keys.end());  // querys, keys
 
     auto logit_softmax = add_op(std::make_shared<NeuPIMSLogitSoftmax>(
-        name_gen(LAYER(0), BlockType::Attention, OperationType::NeuPIMSLogitSoftmax)));
+        _ctx, name_gen(LAYER(0), BlockType::Attention, OperationType::NeuPIMSLogitSoftmax),
+        seq_lens));
     inputs = get_outputs(logit_softmax, mha_pim_inputs);
 
     /* pim_gemv + add */
     inputs.insert(inputs.end(), values.begin(), values.end());  // logits, values
 
     auto attend = add_op(std::make_shared<NeuPIMSAttend>(
-        name_gen(LAYER(0), BlockType::Attention, OperationType::NeuPIMSAttend)));
+        _ctx, name_gen(LAYER(0), BlockType::Attention, OperationType::NeuPIMSAttend)));
     inputs = get_outputs(attend, inputs);
 
     find_executable_node(query);
@@ -158,54 +287,82 @@ Ptr<Operation> StageProgram::add_op(std::shared_ptr<Operation> op) {
 
 std::vector<Ptr<BTensor>> StageProgram::get_outputs(Ptr<Operation> op,
                                                     std::vector<Ptr<BTensor>> inputs) {
-    return op->get_outputs(inputs);
+    auto outputs = op->get_outputs(inputs);
+    std::set<BTensor *> pending;
+    for (auto input : op->get_inputs()) {
+        if (!input->get_produced()) pending.insert(input.get());
+    }
+    _pending_inputs[op->get_id()] = pending.size();
+    return outputs;
 }
 
 void StageProgram::find_executable_node(Ptr<BTensor> tensor) {
     for (auto op : tensor->get_child_nodes()) {
         // spdlog::info("initializing operation {} ...", op->get_name());
-        if (op->check_executable()) {
-            _executable_operations.push_back(op);
+        if (_pending_inputs[op->get_id()] == 0 && !op->check_finish() &&
+            !check_exist_in_executable(op->get_id())) {
+            _executable_index[op->get_id()] =
+                _executable_operations.insert(_executable_operations.end(), op);
         }
     }
 }
 
 bool StageProgram::check_exist_in_executable(uint32_t op_id) {
-    for (auto iter = _executable_operations.begin(); iter != _executable_operations.end(); iter++) {
-        if (op_id == (*iter)->get_id()) {
-            return true;
-        }
-    }
-    return false;
+    return _executable_index.find(op_id) != _executable_index.end();
 }
 
 void StageProgram::finish_operation(uint32_t id) {
-    _op_map[id]->set_finish();
-    for (auto iter = _executable_operations.begin(); iter != _executable_operations.end(); iter++) {
-        // spdlog::info("iterating operation: {}", (*iter)->get_name());
-        if (id == (*iter)->get_id()) {
-            // spdlog::info("erasing operation: {}", (*iter)->get_name());
-            _executable_operations.erase(iter);
-            break;
-        }
+    Ptr<Operation> finished = _op_map[id];
+    if (finished->check_finish()) return;
+
+    // the outputs this finish produces, each consumer waits for one input less
+    std::vector<Ptr<BTensor>> produced;
+    for (auto output : finished->get_output_tensors()) {
+        if (!output->get_produced()) produced.push_back(output);
+    }
+    finished->set_finish();
+    _finished_operations++;
+
+    auto iter = _executable_index.find(id);
+    if (iter != _executable_index.end()) {
+        _executable_operations.erase(iter->second);
+        _executable_index.erase(iter);
     }
 
-    for (auto op : _op_map[id]->get_child_nodes()) {
+    for (auto output : produced) {
+        std::set<uint32_t> consumers;
+        for (auto op : output->get_child_nodes()) {
+            // tensors such as the KV cache are shared with the other platform's program
+            if (_op_map.find(op->get_id()) == _op_map.end()) continue;
+            if (consumers.insert(op->get_id()).second) _pending_inputs[op->get_id()]--;
+        }
+    }
+    for (auto op : finished->get_child_nodes()) {
         // spdlog::info("finding operation: {} / {} ", op->get_name(), op->get_id());
-        if (op->check_executable() && !check_exist_in_executable(op->get_id())) {
+        if (_op_map.find(op->get_id()) == _op_map.end()) continue;
+        if (_pending_inputs[op->get_id()] == 0 && !check_exist_in_executable(op->get_id())) {
             // spdlog::info("found operation: {}", op->get_name());
-            _executable_operations.push_back(op);
+            _executable_index[op->get_id()] =
+                _executable_operations.insert(_executable_operations.end(), op);
         }
     }
 }
 
-bool StageProgram::check_finish() {
-    bool finish = true;
-    for (auto const &[key, val] : _op_map) {
-        finish = finish && val->check_finish();
-    }
+bool StageProgram::check_finish() { return _finished_operations == _op_map.size(); }
+
+uint64_t StageProgram::critical_path(Ptr<Operation> op) {
+    auto it = _critical_paths.find(op->get_id());
+    if (it != _critical_paths.end()) return it->second;
 
-    return finish;
+    uint64_t longest_child = 0;
+    for (auto child : op->get_child_nodes()) {
+        // tensors such as the KV cache are shared with the other platform's program
+        if (_op_map.find(child->get_id()) == _op_map.end()) continue;
+        longest_child = MAX(longest_child, critical_path(child));
+    }
+    uint64_t path = op->num_tiles() + longest_child;
+    _critical_paths[op->get_id()] = path;
+    return path;
 }
 
 std::vector<OperationStat> StageProgram::list_operation_stat() {
@@ -226,29 +383,30 @@ void StageProgram::finish_operation_tile(Tile &tile) {
  * TODO: log file name is tentative. think of fname rule
  */
 void StageProgram::log() {
-    std::string fname = Config::global_config.log_dir + "/" + _name;
+    std::string fname = _config.log_dir + "/" + _name;
     Logger::log(list_operation_stat(), fname);
 }
 
 std::vector<Ptr<BTensor>> StageProgram::projection_block(std::vector<Ptr<BTensor>> inputs) {
     auto N = _breq->get_num_rows();
-    auto E = Config::global_config.model_n_embd;
+    auto E = _config.model_n_embd;
 
     std::vector<uint32_t> input_dim{N, E};
-    auto res_buf =
-        std::make_shared<NPUTensor>("residual_buffer", input_dim, NPUTensorBufType::ACT, true);
+    auto res_buf = std::make_shared<NPUTensor>(_ctx, "residual_buffer", input_dim,
+                                               NPUTensorBufType::ACT, true);
 
     int layer = 0;
     auto prefix = name_gen(LAYER(0), BlockType::Attention);
     // auto res_buf = inputs[0];
 
     auto projection = add_op(std::make_shared<MatMul>(
-        name_gen(prefix, OperationType::Projection),
+        _ctx, name_gen(prefix, OperationType::Projection),
         _model->get_params(layer, BlockType::Attention, OperationType::Projection)));
     inputs = get_outputs(projection, inputs);
+    inputs = all_reduce_block(prefix, inputs);
 
     // fixme: residual is not with this tensor.
-    auto residual = add_op(std::make_shared<Add>(name_gen(prefix, OperationType::Residual)));
+    auto residual = add_op(std::make_shared<Add>(_ctx, name_gen(prefix, OperationType::Residual)));
     inputs.push_back(res_buf);
     inputs = get_outputs(residual, inputs);
     return inputs;
@@ -259,28 +417,39 @@ std::vector<Ptr<BTensor>> StageProgram::ffn1_block(std::vector<Ptr<BTensor>> inp
     std::string prefix = name_gen(LAYER(layer), BlockType::FeedForward);
     // create operations
     auto ln = add_op(std::make_shared<LayerNorm>(
-        name_gen(prefix, OperationType::LayerNorm),
+        _ctx, name_gen(prefix, OperationType::LayerNorm),
         _model->get_params(layer, BlockType::FeedForward, OperationType::LayerNorm)));
     inputs = get_outputs(ln, inputs);
 
     auto fc1 = add_op(std::make_shared<MatMul>(
-        name_gen(prefix, OperationType::FullyConnected1),
+        _ctx, name_gen(prefix, OperationType::FullyConnected1),
         _model->get_params(layer, BlockType::FeedForward, OperationType::FullyConnected1)));
     inputs = get_outputs(fc1, inputs);
 
-    auto gelu = add_op(std::make_shared<Gelu>(name_gen(prefix, OperationType::Gelu)));
+    auto gelu = add_op(std::make_shared<Gelu>(_ctx, name_gen(prefix, OperationType::Gelu)));
     inputs = get_outputs(gelu, inputs);
 
     auto fc2 = add_op(std::make_shared<MatMul>(
-        name_gen(prefix, OperationType::FullyConnected2),
+        _ctx, name_gen(prefix, OperationType::FullyConnected2),
         _model->get_params(layer, BlockType::FeedForward, OperationType::FullyConnected2)));
     inputs = get_outputs(fc2, inputs);
+    inputs = all_reduce_block(prefix, inputs);
 
-    auto residual = add_op(std::make_shared<Add>(name_gen(prefix, OperationType::Residual)));
+    auto residual = add_op(std::make_shared<Add>(_ctx, name_gen(prefix, OperationType::Residual)));
     inputs.push_back(res_buf);
     inputs = get_outputs(residual, inputs);
     return inputs;
 }
+// Projection and FC2 outputs are partial sums over the n_tp devices (row-parallel weights)
+std::vector<Ptr<BTensor>> StageProgram::all_reduce_block(std::string prefix,
+                                                         std::vector<Ptr<BTensor>> inputs) {
+    if (!_config.tp_allreduce || _config.n_tp <= 1) return inputs;
+
+    auto all_reduce =
+        add_op(std::make_shared<AllReduce>(_ctx, name_gen(prefix, OperationType::AllReduce)));
+    return get_outputs(all_reduce, inputs);
+}
+
 std::vector<Ptr<BTensor>> StageProgram::ffn2_block(std::vector<Ptr<BTensor>> inputs) {
     // ffn1_block includes ffn2
     return inputs;
@@ -292,13 +461,13 @@ std::vector<Ptr<BTensor>> StageProgram::qkv_gen_block(std::vector<Ptr<BTensor>>
 
     // (N,E) -> (N,E)
     auto ln1 = add_op(std::make_shared<LayerNorm>(
-        name_gen(prefix, OperationType::LayerNorm),
+        _ctx, name_gen(prefix, OperationType::LayerNorm),
         _model->get_params(layer, BlockType::Attention, OperationType::LayerNorm)));
     inputs = get_outputs(ln1, inputs);
 
-    // (N,E) x (E,3E)
+    // (N,E) x (E,(nh+2*nkvh)*dk), K and V shrink with grouped-query attention
     auto qkv_gen = add_op(std::make_shared<MatMul>(
-        name_gen(prefix, OperationType::QKVGen),
+        _ctx, name_gen(prefix, OperationType::QKVGen),
         _model->get_params(layer, BlockType::Attention, OperationType::QKVGen)));
     inputs = get_outputs(qkv_gen, inputs);
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <list>
 #include <vector>
 
 #include "BatchedRequest.h"
@@ -13,7 +14,7 @@
 class StageProgram {
    public:
     StageProgram(std::shared_ptr<Model> model, Ptr<BatchedRequest> batched_request,
-                 StagePlatform stage_type, Stage stage);
+                 StagePlatform stage_type, const StageEntry &stage);
     void init_program();
     Ptr<Operation> add_op(Ptr<Operation> op);
     std::vector<Ptr<BTensor>> get_outputs(Ptr<Operation> op, std::vector<Ptr<BTensor>> inputs);
@@ -21,10 +22,12 @@ class StageProgram {
     bool check_exist_in_executable(uint32_t op_id);
     void finish_operation(uint32_t id);
     void find_executable_node(Ptr<BTensor> tensor);
-    std::vector<std::shared_ptr<Operation>> get_executable_operations() {
+    const std::list<Ptr<Operation>> &get_executable_operations() {
         return _executable_operations;
     }
     bool check_finish();
+    // tiles on the longest dependency chain from the operation to the end of the program
+    uint64_t critical_path(Ptr<Operation> op);
     std::vector<OperationStat> list_operation_stat();
     void finish_operation_tile(Tile& tile);
     void log();
@@ -33,17 +36,26 @@ class StageProgram {
 
     // todo: from BatchedRequest
     std::shared_ptr<Model> _model;
+    SimContext *_ctx;  // owned by the simulator, taken from _model
+    const SimulationConfig &_config;
     std::shared_ptr<BatchedRequest> _breq;
     robin_hood::unordered_map<uint32_t, Ptr<Operation>> _op_map;
 
     // todo: Constructor
     // std::map<uint32_t, Ptr<Operation>> _operation_map;
     std::map<uint32_t, Ptr<BTensor>> _tensor_map;
-    std::vector<std::shared_ptr<Operation>> _executable_operations;
+    // Readiness is tracked incrementally: every operation counts the input tensors not produced
+    // yet, finish_operation decrements the counts of the consumers of its outputs, and an
+    // operation becomes executable when its count reaches zero.
+    std::list<Ptr<Operation>> _executable_operations;  // in the order they became executable
+    robin_hood::unordered_map<uint32_t, std::list<Ptr<Operation>>::iterator> _executable_index;
+    robin_hood::unordered_map<uint32_t, uint32_t> _pending_inputs;
+    uint32_t _finished_operations = 0;
+    std::map<uint32_t, uint64_t> _critical_paths;  // memo of critical_path by op id
 
     // Sub-batch interleaving
     StagePlatform _stage_platform;
-    Stage _stage;
+    StageEntry _stage;
 
     void init_SA_program();
     void init_PIM_program();
@@ -57,4 +69,8 @@ class StageProgram {
     std::vector<Ptr<BTensor>> ffn1_block(std::vector<Ptr<BTensor>> inputs);
     std::vector<Ptr<BTensor>> ffn2_block(std::vector<Ptr<BTensor>> inputs);
     std::vector<Ptr<BTensor>> qkv_gen_block(std::vector<Ptr<BTensor>> inputs);
+    std::vector<Ptr<BTensor>> all_reduce_block(std::string prefix,
+                                               std::vector<Ptr<BTensor>> inputs);
+    void prefill_attention_block();
+    void lm_head_block();
 };
\ No newline at end of file
@@ -44,8 +44,6 @@ typedef struct NPUStat {
     }
 
     std::string get_by_enum(StatType stat_type) {
-        uint64_t core_cycle = Config::global_config.core_freq * 1000000;  // Mhz
-
         switch (stat_type) {
             case StatType::StartCycle:
                 return std::to_string(start_cycle);
@@ -79,13 +77,15 @@ typedef struct NPUStat {
 // memory_reads, memory_writes: bytes
 typedef struct MemoryIOStat {
     MemoryIOStat() = default;
-    MemoryIOStat(uint64_t core_cycle_, uint64_t channel_id_, uint64_t num_cycles_)
+    MemoryIOStat(uint64_t core_cycle_, uint64_t channel_id_, uint64_t num_cycles_,
+                 uint32_t core_freq_)
         : start_cycle(core_cycle_),
           channel_id(channel_id_),
           num_cycles(num_cycles_),
           memory_reads(0),
           memory_writes(0),
-          pim_reads(0) {}
+          pim_reads(0),
+          core_freq(core_freq_) {}
 
     uint64_t start_cycle;
     uint64_t channel_id;
@@ -93,6 +93,7 @@ typedef struct MemoryIOStat {
     uint64_t memory_reads;
     uint64_t memory_writes;
     uint64_t pim_reads;
+    uint32_t core_freq;  // MHz
 
     enum class StatType {
         StartCycle,
@@ -137,7 +138,7 @@ typedef struct MemoryIOStat {
     }
 
     std::string get_by_enum(StatType stat_type) {
-        uint64_t core_cycle = Config::global_config.core_freq * 1000000;  // Mhz
+        uint64_t core_cycle = (uint64_t)core_freq * 1000000;  // Mhz
 
         switch (stat_type) {
             case StatType::StartCycle:
@@ -217,7 +218,7 @@ typedef struct TileStat {
 
 typedef struct OperationStat {
     OperationStat() = default;
-    OperationStat(std::string name)
+    OperationStat(std::string name, const SimulationConfig &config)
         : op_name(name),
           start_cycle(-1),
           end_cycle(0),
@@ -229,7 +230,10 @@ typedef struct OperationStat {
           memory_writes(0),
           sram_reads(0),
           sram_writes(0),
-          num_calculation(0) {}
+          num_calculation(0),
+          core_freq(config.core_freq),
+          core_width(config.core_config[0].core_width),
+          core_height(config.core_config[0].core_height) {}
 
     void update_stat(TileStat tile_stat) {
         std::cout << "tile stat: " << repr() << std::endl;
@@ -322,7 +326,7 @@ typedef struct OperationStat {
     std::string get_by_enum(StatType stat_type) {
         double npu_util;
         uint64_t total_cycle = end_cycle - start_cycle;
-        uint64_t core_cycle = Config::global_config.core_freq * 1000000;
+        uint64_t core_cycle = (uint64_t)core_freq * 1000000;
 
         switch (stat_type) {
             case StatType::OpName:
@@ -354,10 +358,8 @@ typedef struct OperationStat {
             case StatType::NumCalculation:
                 return std::to_string(num_calculation);
             case StatType::NpuUtilization:
-            // TODO: core_config[0] -> core_config[core_id]
                 npu_util = (double)num_calculation /
-                           (double)(compute_cycles * Config::global_config.core_config[0].core_width *
-                                    Config::global_config.core_config[0].core_height);
+                           (double)(compute_cycles * core_width * core_height);
                 return std::to_string(npu_util);
             default:
                 assert(0);
@@ -404,6 +406,11 @@ typedef struct OperationStat {
     uint64_t num_calculation;
 
     uint64_t dependency_stall;
+
+    // TODO: core_config[0] -> core_config[core_id]
+    uint32_t core_freq;  // MHz
+    uint32_t core_width;
+    uint32_t core_height;
 } OperationStat;
 
 // xxx not used
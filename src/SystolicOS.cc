@@ -1,6 +1,6 @@
 #include "SystolicOS.h"
 
-SystolicOS::SystolicOS(uint32_t id, SimulationConfig config) : Core(id, config) {}
+SystolicOS::SystolicOS(uint32_t id, SimContext *ctx) : Core(id, ctx) {}
 
 void SystolicOS::cycle() {
     // Todo: Impement this;
@@ -2,7 +2,7 @@
 
 class SystolicOS : public Core {
    public:
-    SystolicOS(uint32_t id, SimulationConfig config);
+    SystolicOS(uint32_t id, SimContext *ctx);
     virtual void cycle() override;
 
    protected:
@@ -1,6 +1,6 @@
 #include "SystolicWS.h"
 
-SystolicWS::SystolicWS(uint32_t id, SimulationConfig config) : Core(id, config) {}
+SystolicWS::SystolicWS(uint32_t id, SimContext *ctx) : Core(id, ctx) {}
 
 void SystolicWS::cycle() {
     /* Compute unit */
@@ -73,15 +73,15 @@ void SystolicWS::cycle() {
             ast(!front.src_addrs.empty());
 
             auto accesses = MemoryAccess::from_instruction(
-                front, generate_mem_access_id(), _config.dram_req_size, MemoryAccessType::READ,
-                true, _id, _core_cycle, buffer_id,
+                _ctx, front, _ctx->generate_mem_access_id(), _config.dram_req_size,
+                MemoryAccessType::READ, true, _id, _core_cycle, buffer_id,
                 StagePlatform::SA);  // todo: change platform to proper
 
             // xxx is this right? size, count<<src_addrs size
             buffer->reserve(front.dest_addr, buffer_id, front.size, accesses.size());
             if (auto tile = front.parent_tile.lock()) {
                 tile->remaining_loads += accesses.size() - 1;
-                tile->stat.memory_reads += accesses.size() * AddressConfig::alignment;
+                tile->stat.memory_reads += accesses.size() * _ctx->address.alignment;
             } else {
                 assert(0);
             }
@@ -105,7 +105,7 @@ void SystolicWS::cycle() {
             ast(!front.src_addrs.empty());
 
             MemoryAccess *mem_request = TransToMemoryAccess(
-                front, _config.dram_req_size, _id, _core_cycle, buffer_id, StagePlatform::SA);
+                _ctx, front, _config.dram_req_size, _id, _core_cycle, buffer_id, StagePlatform::SA);
 
             if (front.opcode == Opcode::PIM_READRES || front.opcode == Opcode::PIM_COMPS_READRES)
                 buffer->reserve(front.dest_addr, buffer_id, front.size, 1);
@@ -135,11 +135,11 @@ void SystolicWS::cycle() {
         if (buffer->check_hit(front.dest_addr, buffer_id) &&
             (front.opcode == Opcode::MOVOUT || front.opcode == Opcode::MOVOUT_POOL)) {
             auto accesses = MemoryAccess::from_instruction(
-                front, generate_mem_access_id(), _config.dram_req_size, MemoryAccessType::WRITE,
-                true, _id, _core_cycle, buffer_id, StagePlatform::SA);
+                _ctx, front, _ctx->generate_mem_access_id(), _config.dram_req_size,
+                MemoryAccessType::WRITE, true, _id, _core_cycle, buffer_id, StagePlatform::SA);
             if (auto tile = front.parent_tile.lock()) {
                 tile->remaining_accum_io += accesses.size() - 1;
-                tile->stat.memory_writes += accesses.size() * AddressConfig::alignment;
+                tile->stat.memory_writes += accesses.size() * _ctx->address.alignment;
             } else {
                 assert(0);
             }
@@ -288,6 +288,12 @@ cycle_type SystolicWS::get_vector_compute_cycles(Instruction &inst) {
             return vec_op_iter * _config.core_config[_id].add_latency;
         case Opcode::GELU:
             return vec_op_iter * _config.core_config[_id].gelu_latency;
+        case Opcode::SAMPLE:
+            return get_sampling_cycles(_config, _id, add_tree_iter);
+        case Opcode::ALL_REDUCE:
+            // link transfer of the partial sums, the reduction adds overlap with it
+            return MAX(get_allreduce_cycles(_config, (uint64_t)inst.size * _config.precision),
+                       vec_op_iter * _config.core_config[_id].add_latency);
         case Opcode::DUMMY:
             return 1;
     }
@@ -368,6 +374,7 @@ void SystolicWS::issue_ex_inst(Instruction inst) {
     } else if (inst.opcode == Opcode::COMP || inst.opcode == Opcode::IM2COL ||
                inst.opcode == Opcode::LAYERNORM || inst.opcode == Opcode::SOFTMAX ||
                inst.opcode == Opcode::ADD || inst.opcode == Opcode::GELU ||
+               inst.opcode == Opcode::SAMPLE || inst.opcode == Opcode::ALL_REDUCE ||
                inst.opcode == Opcode::DUMMY) {  // vector unit compute
         spdlog::info("COMPUTE Start cycle: {} inst:{}", _core_cycle, inst.repr());
         std::queue<Instruction> *least_filled_vpu;
@@ -384,7 +391,10 @@ void SystolicWS::issue_ex_inst(Instruction inst) {
             }
         }
         inst.start_cycle = finish_cycle;
+        if (inst.opcode == Opcode::ALL_REDUCE)
+            inst.start_cycle = MAX(inst.start_cycle, _ctx->tp_link_free_cycle);
         inst.finish_cycle = inst.start_cycle + get_vector_compute_cycles(inst);
+        if (inst.opcode == Opcode::ALL_REDUCE) _ctx->tp_link_free_cycle = inst.finish_cycle;
         least_filled_vpu->push(inst);
 
         {
@@ -2,7 +2,7 @@
 
 class SystolicWS : public Core {
    public:
-    SystolicWS(uint32_t id, SimulationConfig config);
+    SystolicWS(uint32_t id, SimContext *ctx);
     virtual void cycle() override;
     virtual void print_stats() override;
 
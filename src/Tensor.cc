@@ -5,19 +5,22 @@
 #include "allocator/AddressAllocator.h"
 #include "operations/Operation.h"
 
-Tensor::Tensor(std::string name, std::vector<uint32_t> dims, bool produced = false) {
-    _id = generate_id();
+Tensor::Tensor(SimContext *ctx, std::string name, std::vector<uint32_t> dims,
+               bool produced = false) {
+    _ctx = ctx;
+    _id = _ctx->generate_id();
     _name = name;
     for (int dim : dims) {
         _dims.push_back(dim);
     }
     spdlog::trace("Tensor: {} {}", _name, dims);
-    _precision = Config::global_config.precision;
+    _precision = _ctx->config.precision;
     reserve_address();
     _produced = produced;
 }
 
 Tensor::Tensor(const Tensor &tensor) {
+    _ctx = tensor._ctx;
     _produced = tensor._produced;
     _id = tensor._id;
     _name = tensor._name;
@@ -34,7 +37,7 @@ void Tensor::reserve_address() {
     for (auto dim : _dims) {
         _size *= dim;
     }
-    _address = AddressConfig::allocate_address(_size);
+    _address = _ctx->address.allocate_address(_size);
     // spdlog::info("{} allocated, dims: {} / size: {} / precision: {} / dram
     // address: {:x}", get_name(), _dims, _size, _precision, _address);
 }
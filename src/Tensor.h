@@ -1,12 +1,13 @@
 #pragma once
 #include "Common.h"
+#include "SimContext.h"
 
 class Model;
 class Operation;
 
 class Tensor {
   public:
-    Tensor(std::string name, std::vector<uint32_t> dims, bool produced);
+    Tensor(SimContext *ctx, std::string name, std::vector<uint32_t> dims, bool produced);
     Tensor(const Tensor &tensor);
 
     void add_child_node(std::shared_ptr<Operation> op);
@@ -30,6 +31,7 @@ class Tensor {
     uint32_t get_size() { return _size; }
 
   private:
+    SimContext *_ctx;
     bool _produced;
     uint32_t _id;
     std::string _name;
@@ -1,14 +1,14 @@
 #pragma once
 #include "../Common.h"
 
-// Used in NPU + PIM to allocate weights, and in NPU only to allocate all tensors.
-class WgtAlloc : public Singleton<WgtAlloc> {
-   private:
-    friend class Singleton;
-    WgtAlloc();
-    ~WgtAlloc() = default;
+class SimContext;
 
+// Used in NPU + PIM to allocate weights, and in NPU only to allocate all tensors.
+class WgtAlloc {
    public:
+    WgtAlloc(SimContext *ctx);
+
+    SimContext *_ctx;
     addr_type _base_addr;
     uint64_t _top_addr;
 
@@ -16,13 +16,11 @@ class WgtAlloc : public Singleton<WgtAlloc> {
     addr_type get_next_aligned_addr();
 };
 
-class ActAlloc : public Singleton<ActAlloc> {
-   private:
-    friend class Singleton;
-    ActAlloc();
-    ~ActAlloc() = default;
-
+class ActAlloc {
    public:
+    ActAlloc(SimContext *ctx);
+
+    SimContext *_ctx;
     addr_type _base_addr;
     addr_type _top_addr;
     uint64_t _act_buf_size;   // fixed.
@@ -34,13 +32,11 @@ class ActAlloc : public Singleton<ActAlloc> {
     void flush();
 };
 
-class KVCacheAlloc : public Singleton<KVCacheAlloc> {
-   private:
-    friend class Singleton;
-    KVCacheAlloc();
-    ~KVCacheAlloc() = default;
-
+class KVCacheAlloc {
    public:
+    KVCacheAlloc(SimContext *ctx);
+
+    SimContext *_ctx;
     RunMode _mode;
     addr_type _base_addr;
 
@@ -65,4 +61,6 @@ class KVCacheAlloc : public Singleton<KVCacheAlloc> {
     addr_type allocate(uint64_t ch);
     void free(addr_type addr);
     void free(uint32_t ch, uint64_t row);
+    uint64_t get_free_pages();             // free cache entries (NPU) or rows of every channel (PIM)
+    uint64_t get_pages(uint32_t seq_len);  // entries or rows the K and V cache of seq_len take
 };
\ No newline at end of file
@@ -1,10 +1,17 @@
 #include "AddressAllocator.h"
 
-KVCacheAlloc::KVCacheAlloc()
-    : _kv_cache_size(0), _kv_cache_limit(0), _kv_cache_entry_size(0), _base_addr(0), _base_row(0) {}
+#include "../SimContext.h"
+
+KVCacheAlloc::KVCacheAlloc(SimContext *ctx)
+    : _ctx(ctx),
+      _kv_cache_size(0),
+      _kv_cache_limit(0),
+      _kv_cache_entry_size(0),
+      _base_addr(0),
+      _base_row(0) {}
 
 void KVCacheAlloc::init(addr_type base_addr) {
-    _mode = Config::global_config.run_mode;
+    _mode = _ctx->config.run_mode;
     if (_mode == RunMode::NPU_ONLY) {  // NPU only mode
         init_npu_layout(base_addr);
     } else if (_mode == RunMode::NPU_PIM) {
@@ -24,16 +31,16 @@ void KVCacheAlloc::init(addr_type base_addr) {
  * so adjacent latent vector at certain head should be loaded faster.
  */
 void KVCacheAlloc::init_npu_layout(addr_type base_addr) {
-    uint32_t max_active_reqs = Config::global_config.max_active_reqs;
-    uint32_t max_seq_len = Config::global_config.max_seq_len;
-    uint32_t h = Config::global_config.model_n_head / Config::global_config.n_tp;
-    uint32_t d_k = Config::global_config.model_n_embd / Config::global_config.model_n_head;
-    uint32_t precision = Config::global_config.precision;
+    uint32_t max_active_reqs = _ctx->config.max_active_reqs;
+    uint32_t max_seq_len = _ctx->config.max_seq_len;
+    uint32_t h = get_kv_heads_per_device(_ctx->config);
+    uint32_t d_k = _ctx->config.model_n_embd / _ctx->config.model_n_head;
+    uint32_t precision = _ctx->config.precision;
 
     _base_addr = base_addr;
     _kv_cache_entry_size = 32;  // allocate once per seq_len 32
     _kv_cache_size = max_active_reqs * max_seq_len * h * d_k * precision;
-    ast(_base_addr + _kv_cache_size < Config::global_config.HBM_size);
+    ast(_base_addr + _kv_cache_size < _ctx->config.HBM_size);
 
     addr_type next_addr = _base_addr;
     // The number of sequence lengths that can be stored per block / sequence length per block
@@ -53,10 +60,10 @@ void KVCacheAlloc::init_pim_layout(addr_type base_addr) {
     // byte offset X  // rank bit, bg bit, bank bit, ch bit, col bit = 1 + 2 + 2 + 5 + 10
     constexpr uint32_t row_offset = 20;
     constexpr uint64_t mask = ~((1 << row_offset) - 1);     // 0x1111(64-21)0000(21)
-    _dram_row_size = Config::global_config.dram_page_size;  // 1024
-    _num_ele_per_row = _dram_row_size / Config::global_config.precision;  // 512
-    _bank_per_ch = Config::global_config.dram_banks_per_ch;
-    _dram_channels = Config::global_config.dram_channels;
+    _dram_row_size = _ctx->config.dram_page_size;                // 1024
+    _num_ele_per_row = _dram_row_size / _ctx->config.precision;  // 512
+    _bank_per_ch = _ctx->config.dram_banks_per_ch;
+    _dram_channels = _ctx->config.dram_channels;
 
     base_addr = base_addr & mask;  // get last row index using
     base_addr = base_addr + (1 << row_offset);  // move to next row index
@@ -100,4 +107,26 @@ void KVCacheAlloc::free(addr_type addr) {
 void KVCacheAlloc::free(uint32_t ch, uint64_t row) {
     ast(_mode == RunMode::NPU_PIM);
     _rows[ch]->push_back(row);
-}
\ No newline at end of file
+}
+
+uint64_t KVCacheAlloc::get_free_pages() {
+    if (_mode == RunMode::NPU_ONLY) return _kv_cache.size();
+    uint64_t free_rows = 0;
+    for (auto &rows : _rows) free_rows += rows->size();
+    return free_rows;
+}
+
+// same rounding as NPUTensorKV (h tensors of 32 token entries) and PIMTensor
+uint64_t KVCacheAlloc::get_pages(uint32_t seq_len) {
+    uint32_t h = get_kv_heads_per_device(_ctx->config);
+    uint32_t d_k = _ctx->config.model_n_embd / _ctx->config.model_n_head;
+    if (_mode == RunMode::NPU_ONLY)
+        return 2 * h * (uint64_t)ceil((double)seq_len / (double)_kv_cache_entry_size);
+
+    uint32_t E = h * d_k;
+    uint64_t key_rows = ceil((double)E / (double)_num_ele_per_row) *
+                        ceil((double)seq_len / (double)_bank_per_ch);
+    uint64_t value_rows = ceil((double)E / (double)_bank_per_ch) *
+                          ceil((double)seq_len / (double)_num_ele_per_row);
+    return key_rows + value_rows;
+}
@@ -1,9 +1,11 @@
 #include "AddressAllocator.h"
 
-WgtAlloc::WgtAlloc() : _base_addr(0), _top_addr(0) {}
+#include "../SimContext.h"
+
+WgtAlloc::WgtAlloc(SimContext *ctx) : _ctx(ctx), _base_addr(0), _top_addr(0) {}
 
 addr_type WgtAlloc::allocate(uint64_t size) {
-    addr_type unit = Config::global_config.dram_req_size * Config::global_config.dram_channels;
+    addr_type unit = _ctx->config.dram_req_size * _ctx->config.dram_channels;
     addr_type result = _top_addr;
     _top_addr += (size + unit - 1) / unit;
     // if (_top_addr & (AddressConfig::alignment - 1)) {
@@ -15,5 +17,5 @@ addr_type WgtAlloc::allocate(uint64_t size) {
 
 addr_type WgtAlloc::get_next_aligned_addr() {
     ast(_top_addr > 0);
-    return AddressConfig::align(_top_addr) + AddressConfig::alignment;
+    return _ctx->address.align(_top_addr) + _ctx->address.alignment;
 }
\ No newline at end of file
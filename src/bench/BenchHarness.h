@@ -0,0 +1,39 @@
+#pragma once
+#include <chrono>
+
+#include "../Common.h"
+#include "../helper/CommandLineParser.h"
+#include "../helper/ConfigOptions.h"
+
+// Scaffolding shared by the micro-benchmarks in src/bench. Each benchmark defines a result
+// derived from BenchResult, a run_bench that fills it for one shape, and a main that registers
+// its options, calls parse_bench_options and prints one tab-separated row per shape.
+
+// Wall time of the measured section of one run_bench call
+struct BenchResult {
+    double seconds = 0;
+};
+
+inline double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Parse errors are logged and rethrown, simulator logs below warnings are dropped
+inline void parse_bench_options(CommandLineParser &cmd_parser, int argc, char **argv) {
+    try {
+        cmd_parser.parse(argc, argv);
+    } catch (const CommandLineParser::ParsingError &e) {
+        spdlog::error("Command line argument parrsing error captured. Error message: {}", e.what());
+        throw(e);
+    }
+    spdlog::set_level(spdlog::level::warn);
+}
+
+// The one value given on the command line, otherwise the default sweep
+inline std::vector<uint32_t> get_sweep_option(CommandLineParser &cmd_parser, const char *name,
+                                              std::vector<uint32_t> defaults) {
+    std::string option;
+    cmd_parser.set_if_defined(name, &option);
+    if (option.empty()) return defaults;
+    return {(uint32_t)std::stoul(option)};
+}
@@ -0,0 +1,140 @@
+#include <deque>
+#include <random>
+
+#include "../Interconnect.h"
+#include "BenchHarness.h"
+
+// Interconnect micro-benchmark: the interconnect alone, driven by synthetic traffic the way
+// Simulator::tick drives it. Every core issues a read to a random channel with probability
+// --load per interconnect cycle, a channel answers after a fixed latency. Reports interconnect
+// cycles per wall-clock second for 4 and 8 cores at 32 and 64 channels (or the given shape),
+// and the mean request round trip. SimpleInterconnect by default, --topology runs the NoC.
+
+struct IcntResult : BenchResult {
+    uint64_t requests = 0;
+    uint64_t responses = 0;
+    uint64_t total_round_trip = 0;
+};
+
+IcntResult run_bench(uint32_t num_cores, uint32_t channels, double load, uint64_t cycles,
+                     std::string topology) {
+    SimulationConfig config;
+    config.num_cores = num_cores;
+    config.dram_channels = channels;
+    config.dram_req_size = 64;
+    config.core_freq = 1000;
+    config.icnt_freq = 2000;
+    config.icnt_latency = 7;
+    config.icnt_buffer_size = 0;
+    config.sub_batch_mode = true;
+    config.noc_topology = topology == "crossbar" ? NocTopology::CROSSBAR
+                          : topology == "ring"   ? NocTopology::RING
+                                                 : NocTopology::MESH;
+    config.noc_router_latency = 2;
+    config.noc_link_width = 32;
+    config.noc_vc_depth = 8;
+    config.noc_mesh_width = 0;
+    std::unique_ptr<Interconnect> icnt;
+    if (topology.empty())
+        icnt = std::make_unique<SimpleInterconnect>(config);
+    else
+        icnt = std::make_unique<NocInterconnect>(config);
+
+    const uint32_t dram_latency = 100;  // interconnect cycles
+    std::mt19937 rng(0);
+    std::bernoulli_distribution issue(load);
+    std::uniform_int_distribution<uint32_t> pick_channel(0, channels - 1);
+    std::vector<std::deque<std::pair<uint64_t, MemoryAccess *>>> dram(channels);
+    std::deque<MemoryAccess> accesses;
+    IcntResult result;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t cycle = 0; cycle < cycles; cycle++) {
+        for (uint32_t core_id = 0; core_id < num_cores; core_id++) {
+            // core -> ICNT
+            if (issue(rng)) {
+                uint32_t ch = pick_channel(rng);
+                accesses.push_back(MemoryAccess{.id = (uint32_t)result.requests,
+                                                .dram_address = ch,
+                                                .spad_address = 0,
+                                                .size = 64,
+                                                .req_type = MemoryAccessType::READ,
+                                                .request = true,
+                                                .core_id = core_id,
+                                                .start_cycle = cycle,
+                                                .dram_enter_cycle = 0,
+                                                .dram_finish_cycle = 0,
+                                                .buffer_id = 0,
+                                                .parent_tile = {},
+                                                .stage_platform = StagePlatform::SA});
+                icnt->push(core_id * channels + ch, num_cores * channels + ch, &accesses.back());
+                result.requests++;
+            }
+            // ICNT -> core
+            for (uint32_t ch = 0; ch < channels; ch++) {
+                uint32_t nid = core_id * channels + ch;
+                if (!icnt->is_empty(nid)) {
+                    result.total_round_trip += cycle - icnt->top(nid)->start_cycle;
+                    icnt->pop(nid);
+                    result.responses++;
+                }
+            }
+        }
+        for (uint32_t ch = 0; ch < channels; ch++) {
+            // ICNT -> memory
+            if (icnt->has_memreq1(ch)) {
+                MemoryAccess *access = icnt->memreq_top1(ch);
+                icnt->memreq_pop1(ch);
+                access->request = false;
+                dram[ch].push_back({cycle + dram_latency, access});
+            }
+            // memory -> ICNT
+            if (!dram[ch].empty() && dram[ch].front().first <= cycle) {
+                MemoryAccess *access = dram[ch].front().second;
+                dram[ch].pop_front();
+                icnt->push(num_cores * channels + ch, access->core_id * channels + ch, access);
+            }
+        }
+        icnt->cycle();
+    }
+    result.seconds = seconds_since(start);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    CommandLineParser cmd_parser = CommandLineParser();
+    cmd_parser.add_command_line_option<std::string>(
+        "cores", "Number of cores, default = 4 and 8");
+    cmd_parser.add_command_line_option<std::string>(
+        "channels", "Number of dram channels, default = 32 and 64");
+    cmd_parser.add_command_line_option<std::string>(
+        "load", "Requests per core per interconnect cycle, default = 0.05");
+    cmd_parser.add_command_line_option<std::string>(
+        "cycles", "Interconnect cycles per run, default = 2000000");
+    cmd_parser.add_command_line_option<std::string>(
+        "topology", "Run the NoC with this topology [crossbar, mesh, ring]");
+    parse_bench_options(cmd_parser, argc, argv);
+
+    std::vector<uint32_t> cores = get_sweep_option(cmd_parser, "cores", {4, 8});
+    std::vector<uint32_t> channels = get_sweep_option(cmd_parser, "channels", {32, 64});
+    std::string load = "0.05";
+    cmd_parser.set_if_defined("load", &load);
+    std::string cycles = "2000000";
+    cmd_parser.set_if_defined("cycles", &cycles);
+    std::string topology;
+    cmd_parser.set_if_defined("topology", &topology);
+
+    fmt::print(
+        "cores\tchannels\tload\tcycles\trequests\tresponses\tround_trip\twall_s\tcycles_per_s\n");
+    for (uint32_t num_cores : cores) {
+        for (uint32_t num_channels : channels) {
+            IcntResult result =
+                run_bench(num_cores, num_channels, std::stod(load), std::stoull(cycles), topology);
+            fmt::print("{}\t{}\t{}\t{}\t{}\t{}\t{:.1f}\t{:.3f}\t{:.0f}\n", num_cores,
+                       num_channels, load, cycles, result.requests, result.responses,
+                       (double)result.total_round_trip / MAX(result.responses, (uint64_t)1),
+                       result.seconds, std::stoull(cycles) / result.seconds);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <random>
+
+#include "../scheduler/Scheduler.h"
+#include "BenchHarness.h"
+
+// Sub-batch partition check: builds a skewed channel assignment (channel 0 holds the long
+// requests, its load falls off over the other channels) and splits it with the channel-aware
+// greedy. Reports the runtime, the MHA stage load of every sub-batch and the max per-channel
+// imbalance. Exits with 1 if the split does not end balanced: the slowest sub-batch stage must
+// stay within one request of the per-channel lower bound, and of the fastest sub-batch stage.
+
+struct PartitionResult : BenchResult {
+    uint64_t max_stage = 0;      // max over sub-batches of the max channel load
+    uint64_t min_stage = 0;      // min over sub-batches of the max channel load
+    uint64_t max_imbalance = 0;  // max over channels of (max_sb - min_sb)
+    uint64_t lower_bound = 0;    // max over channels of the channel load / sub-batches
+    uint64_t max_latency = 0;    // longest single request
+};
+
+PartitionResult run_bench(uint32_t channels, uint32_t requests, uint32_t sub_batches,
+                          uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<std::vector<uint32_t>> latency_queues(channels);
+    PartitionResult result;
+    for (uint32_t ch = 0; ch < channels; ch++) {
+        // channel ch holds about requests / (ch + 1) requests up to 4096 / (ch + 1) cycles
+        std::uniform_int_distribution<uint32_t> latency(16, 4096 / (ch + 1));
+        uint32_t count = MAX(requests / (ch + 1), (uint32_t)1) + rng() % 3;
+        uint64_t channel_load = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            latency_queues[ch].push_back(latency(rng));
+            channel_load += latency_queues[ch].back();
+            result.max_latency = MAX(result.max_latency, (uint64_t)latency_queues[ch].back());
+        }
+        result.lower_bound =
+            MAX(result.lower_bound, (channel_load + sub_batches - 1) / sub_batches);
+    }
+
+    std::vector<std::vector<uint64_t>> sb_latencies(sub_batches,
+                                                    std::vector<uint64_t>(channels, 0));
+    auto start = std::chrono::steady_clock::now();
+    Scheduler::partition_channel_greedy(latency_queues, std::vector<uint32_t>(sub_batches, 0),
+                                        sb_latencies);
+    result.seconds = seconds_since(start);
+
+    result.min_stage = UINT64_MAX;
+    for (auto &loads : sb_latencies) {
+        uint64_t stage = *std::max_element(loads.begin(), loads.end());
+        result.max_stage = MAX(result.max_stage, stage);
+        result.min_stage = MIN(result.min_stage, stage);
+    }
+    for (uint32_t ch = 0; ch < channels; ch++) {
+        uint64_t max_load = 0;
+        uint64_t min_load = UINT64_MAX;
+        for (auto &loads : sb_latencies) {
+            max_load = MAX(max_load, loads[ch]);
+            min_load = MIN(min_load, loads[ch]);
+        }
+        result.max_imbalance = MAX(result.max_imbalance, max_load - min_load);
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    CommandLineParser cmd_parser = CommandLineParser();
+    cmd_parser.add_command_line_option<std::string>("channels", "DRAM channels, default = 32");
+    cmd_parser.add_command_line_option<std::string>(
+        "requests", "Requests of the most loaded channel, default = 64");
+    cmd_parser.add_command_line_option<std::string>("sub_batches",
+                                                    "Sub-batches, default = 2 and 3");
+    parse_bench_options(cmd_parser, argc, argv);
+
+    std::string channels = "32";
+    std::string requests = "64";
+    cmd_parser.set_if_defined("channels", &channels);
+    cmd_parser.set_if_defined("requests", &requests);
+    std::vector<uint32_t> sub_batches = get_sweep_option(cmd_parser, "sub_batches", {2, 3});
+
+    bool balanced = true;
+    fmt::print("sub_batches\tseed\truntime_us\tmax_stage\tmin_stage\tlower_bound\tmax_imbalance\n");
+    for (uint32_t num_sub_batches : sub_batches) {
+        for (uint32_t seed = 0; seed < 8; seed++) {
+            PartitionResult result =
+                run_bench(std::stoi(channels), std::stoi(requests), num_sub_batches, seed);
+            fmt::print("{}\t{}\t{:.1f}\t{}\t{}\t{}\t{}\n", num_sub_batches, seed,
+                       result.seconds * 1e6, result.max_stage, result.min_stage,
+                       result.lower_bound, result.max_imbalance);
+            balanced = balanced &&
+                       result.max_stage <= result.lower_bound + result.max_latency &&
+                       result.max_stage - result.min_stage <= result.max_latency;
+        }
+    }
+    if (!balanced) {
+        spdlog::error("partition bench: skewed channels did not end balanced");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "../client/Router.h"
+#include "BenchHarness.h"
+
+// KV-aware routing check: requests of equal size go to replicas whose KV headroom differs, the
+// way ServingCluster feeds them. A routed request takes its pages from the replica's headroom as
+// if it were admitted at once. Reports the routing runtime and the headroom spread left over the
+// replicas. Exits with 1 if a request does not go to the replica with the most free KV pages.
+
+struct RouterResult : BenchResult {
+    uint32_t misrouted = 0;     // requests not sent to the replica with the most headroom
+    int64_t max_headroom = 0;   // after routing every request
+    int64_t min_headroom = 0;
+};
+
+RouterResult run_bench(uint32_t replicas, uint32_t requests, int64_t pages_per_request) {
+    // room for every request, plus a distinct extra per replica (3 is coprime to a power of two
+    // replica count) that less than half of the requests level out
+    int64_t pages = pages_per_request * requests / replicas;
+    std::vector<int64_t> headroom(replicas);
+    for (uint32_t r = 0; r < replicas; r++)
+        headroom[r] = pages + r * 3 % replicas * pages / replicas;
+
+    Router router(RouterPolicy::KV_AWARE, replicas);
+    router.set_kv_headroom([&headroom](uint32_t replica) { return headroom[replica]; });
+
+    RouterResult result;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < requests; i++) {
+        auto request = std::make_shared<InferRequest>(InferRequest{.id = i,
+                                                                   .arrival_cycle = 0,
+                                                                   .completed_cycle = 0,
+                                                                   .input_size = 128,
+                                                                   .output_size = 16,
+                                                                   .is_initiated = false,
+                                                                   .generated = 0,
+                                                                   .prefilled = 0,
+                                                                   .chunk_size = 0,
+                                                                   .first_token_cycle = 0,
+                                                                   .scheduled_cycle = 0,
+                                                                   .channel = 0});
+        uint32_t expected = std::max_element(headroom.begin(), headroom.end()) - headroom.begin();
+        uint32_t replica = router.route(request);
+        if (headroom[replica] != headroom[expected]) result.misrouted++;
+        headroom[replica] -= pages_per_request;
+    }
+    result.seconds = seconds_since(start);
+
+    result.max_headroom = *std::max_element(headroom.begin(), headroom.end());
+    result.min_headroom = *std::min_element(headroom.begin(), headroom.end());
+    return result;
+}
+
+int main(int argc, char **argv) {
+    CommandLineParser cmd_parser = CommandLineParser();
+    cmd_parser.add_command_line_option<std::string>("replicas",
+                                                    "Replicas, default = 2, 4 and 8");
+    cmd_parser.add_command_line_option<std::string>("requests",
+                                                    "Requests routed, default = 256");
+    parse_bench_options(cmd_parser, argc, argv);
+
+    std::string requests = "256";
+    cmd_parser.set_if_defined("requests", &requests);
+    std::vector<uint32_t> replicas = get_sweep_option(cmd_parser, "replicas", {2, 4, 8});
+    const int64_t pages_per_request = 64;
+
+    bool routed = true;
+    fmt::print("replicas\trequests\truntime_us\tmisrouted\tmax_headroom\tmin_headroom\n");
+    for (uint32_t num_replicas : replicas) {
+        RouterResult result = run_bench(num_replicas, std::stoi(requests), pages_per_request);
+        fmt::print("{}\t{}\t{:.1f}\t{}\t{}\t{}\n", num_replicas, requests, result.seconds * 1e6,
+                   result.misrouted, result.max_headroom, result.min_headroom);
+        // always the replica with the most pages left, so they end within one request
+        routed = routed && result.misrouted == 0 &&
+                 result.max_headroom - result.min_headroom <= pages_per_request;
+    }
+    if (!routed) {
+        spdlog::error("router bench: kv_aware did not follow the free KV pages");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "../StageProgram.h"
+#include "../tensor/NPUTensor.h"
+#include "BenchHarness.h"
+
+// Stage program micro-benchmark: builds an SA stage program of projection + FFN layers for a
+// batch of decode requests, then drains it the way the scheduler does, finishing the first
+// executable operation until the program is done. Reports build and drain wall time and the
+// drain cost per operation for 1, 8 and 32 layers (or --layers), which stays flat as the
+// program grows when finishing an operation does not rescan the graph.
+
+// seconds: drain wall time
+struct StageProgramResult : BenchResult {
+    uint32_t operations = 0;
+    double build_seconds = 0;
+};
+
+StageProgramResult run_bench(SimulationConfig config, uint32_t layers, uint32_t batch) {
+    auto ctx = std::make_unique<SimContext>(config);
+    auto model = std::make_shared<Model>(ctx.get(), config.model_name);
+    ctx->init_allocators();
+
+    std::vector<Ptr<InferRequest>> reqs;
+    for (uint32_t id = 0; id < batch; id++) {
+        reqs.push_back(std::make_shared<InferRequest>(InferRequest{.id = id,
+                                                                   .arrival_cycle = 0,
+                                                                   .completed_cycle = 0,
+                                                                   .input_size = 128,
+                                                                   .output_size = 2,
+                                                                   .is_initiated = true,
+                                                                   .generated = 1,
+                                                                   .prefilled = 128,
+                                                                   .chunk_size = 0,
+                                                                   .first_token_cycle = 0,
+                                                                   .scheduled_cycle = 0,
+                                                                   .channel = 0,
+                                                                   .K_cache = {},
+                                                                   .V_cache = {}}));
+    }
+    auto breq = std::make_shared<BatchedRequest>(reqs);
+    // an SA stage with no blocks of its own, the layers are appended below
+    StageEntry stage{.name = "bench",
+                     .sa_sub_batch = 0,
+                     .proj_ffns = false,
+                     .qkv_gen = false,
+                     .pim_sub_batch = -1,
+                     .lm_head = false};
+    StageProgramResult result;
+
+    auto start = std::chrono::steady_clock::now();
+    StageProgram program(model, breq, StagePlatform::SA, stage);
+    // the projection of every layer reads that layer's attention output (E / n_tp wide, the
+    // FFN output is E wide), so each layer starts from its own input tensor
+    std::vector<uint32_t> input_dim{breq->get_num_rows(), config.model_n_embd / config.n_tp};
+    std::vector<Ptr<BTensor>> layer_inputs;
+    for (uint32_t layer = 0; layer < layers; layer++) {
+        layer_inputs.push_back(std::make_shared<NPUTensor>(ctx.get(), "input", input_dim,
+                                                           NPUTensorBufType::ACT, true));
+        std::vector<Ptr<BTensor>> inputs{layer_inputs.back()};
+        inputs = program.projection_block(inputs);
+        program.ffn1_block(inputs);
+    }
+    for (auto input : layer_inputs) program.find_executable_node(input);
+    result.operations = program._op_map.size();
+    result.build_seconds = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    while (!program.check_finish()) {
+        assert(!program.get_executable_operations().empty());
+        program.finish_operation(program.get_executable_operations().front()->get_id());
+    }
+    result.seconds = seconds_since(start);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    CommandLineParser cmd_parser = CommandLineParser();
+    add_config_options(cmd_parser);
+    cmd_parser.add_command_line_option<std::string>("layers", "Layers, default = 1, 8 and 32");
+    cmd_parser.add_command_line_option<std::string>("batch", "Requests in the batch, default = 64");
+    parse_bench_options(cmd_parser, argc, argv);
+
+    SimulationConfig config = load_config_options(cmd_parser);
+    std::vector<uint32_t> layers = get_sweep_option(cmd_parser, "layers", {1, 8, 32});
+    std::string batch = "64";
+    cmd_parser.set_if_defined("batch", &batch);
+
+    fmt::print("layers\tbatch\toperations\tbuild_s\tdrain_s\tdrain_ns_per_op\n");
+    for (uint32_t num_layers : layers) {
+        StageProgramResult result = run_bench(config, num_layers, std::stoi(batch));
+        fmt::print("{}\t{}\t{}\t{:.3f}\t{:.6f}\t{:.0f}\n", num_layers, batch, result.operations,
+                   result.build_seconds, result.seconds,
+                   result.seconds * 1e9 / MAX(result.operations, (uint32_t)1));
+    }
+    return 0;
+}
@@ -4,9 +4,10 @@ Client::Client(SimulationConfig config)
     : _config(config),
       _cycles(0),
       _last_request_cycle(0),
+      _need_wait_cycles(0),  // 30
       _issued_cnt(0),
       _completed_cnt(0),
-      _need_wait_cycles(0) {  // 30
+      _next_rid(0) {
     // arguments:
     // - request_interval (mean),
     // - total number of requests
@@ -23,10 +24,12 @@ Client::Client(SimulationConfig config)
     _omax = 4;
 
     uint32_t answer_index = 1;
-    RequestGenerator::init(config.request_dataset_path, answer_index);
+    auto trace = config.request_trace ? config.request_trace
+                                      : RequestTrace::parse(config.request_dataset_path);
+    _request_generator.init(trace, answer_index);
 
     // _total_cnt = _config.request_total_cnt;
-    _total_cnt = RequestGenerator::get_total_req_cnt();
+    _total_cnt = _request_generator.get_total_req_cnt();
     spdlog::info("Client total request cnt: {}", _total_cnt);
     _request_interval = _config.request_interval;
 
@@ -44,14 +47,14 @@ void Client::cycle() {
     // FIXME: change while to if
     while (!_touch) {
         // todo: send request to scheduler
-        uint32_t rid = generate_rid();
+        uint32_t rid = _next_rid++;
 
         // TODO: from benchmark dataset
         // uint32_t input_size = rand_input_size();  // 10;
         // uint32_t output_size = rand_output_size();  // 2;
         std::pair<uint32_t, uint32_t> input_output_size;
-        if (RequestGenerator::has_data()) {
-            input_output_size = RequestGenerator::get_qa_length();
+        if (_request_generator.has_data()) {
+            input_output_size = _request_generator.get_qa_length();
         } else {
             spdlog::info("RequestGenerator has no data!");
             _touch = true;
@@ -69,7 +72,11 @@ void Client::cycle() {
                                                         .output_size = output_size,
                                                         .is_initiated = false,
                                                         .generated = 0,
-                                                        .channel = channel});
+                                                        .prefilled = 0,
+                                                        .chunk_size = 0,
+                                                        .first_token_cycle = 0,
+                                                        .scheduled_cycle = 0,
+                                                        .channel = (int)channel});
         _waiting_queue.push(request);
 
         _issued_cnt++;
@@ -87,11 +94,6 @@ void Client::cycle() {
     }
 
     _cycles++;
-
-    if (_completed_cnt == _total_cnt) {
-        spdlog::info("Client completed!");
-        exit(-1);
-    }
 }
 
 bool Client::running() {
@@ -112,6 +114,8 @@ void Client::receive_response(std::shared_ptr<InferRequest> response) {
 
     response->completed_cycle = _cycles;
     _completed_cnt++;
+    // the simulator keeps ticking until the cores, interconnect and dram drain
+    if (_completed_cnt == _total_cnt) spdlog::info("Client completed!");
 
     // spdlog::info("Receive response! spend_cycles: {}",
     //              response->completed_cycle - response->arrival_cycle);
@@ -119,8 +123,3 @@ void Client::receive_response(std::shared_ptr<InferRequest> response) {
     // todo stat.
     // delete response;
 }
-
-uint32_t generate_rid() {
-    static uint32_t rid{0};
-    return rid++;
-}
@@ -7,7 +7,6 @@
 #include "../Common.h"
 #include "../RequestGenerator.h"
 
-uint32_t generate_rid();
 class Client {
    public:
     Client(SimulationConfig config);
@@ -27,6 +26,9 @@ class Client {
     uint32_t _total_cnt;
     uint32_t _issued_cnt;
     uint32_t _completed_cnt;
+    uint32_t _next_rid;
+
+    RequestGenerator _request_generator;
 
     uint32_t _request_interval;  // send a request per (core_freq/qps) cycles
     std::queue<std::shared_ptr<InferRequest>> _waiting_queue;
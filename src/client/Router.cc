@@ -0,0 +1,91 @@
+#include "Router.h"
+
+#include <limits>
+
+Router::Router(RouterPolicy policy, uint32_t num_replicas)
+    : _policy(policy), _num_replicas(num_replicas), _next_replica(0) {
+    ast(num_replicas > 0);
+    _outstanding.resize(num_replicas);
+    _num_routed.assign(num_replicas, 0);
+}
+
+uint32_t Router::route(Ptr<InferRequest> request) {
+    uint32_t replica = 0;
+    switch (_policy) {
+        case RouterPolicy::ROUND_ROBIN:
+            replica = _next_replica;
+            _next_replica = (_next_replica + 1) % _num_replicas;
+            break;
+        case RouterPolicy::LEAST_OUTSTANDING_TOKENS: {
+            uint64_t min_tokens = std::numeric_limits<uint64_t>::max();
+            for (uint32_t r = 0; r < _num_replicas; r++) {
+                uint64_t tokens = outstanding_tokens(r);
+                if (tokens < min_tokens) {
+                    min_tokens = tokens;
+                    replica = r;
+                }
+            }
+            break;
+        }
+        case RouterPolicy::KV_AWARE: {
+            // most free KV pages in the replica's allocator, ties go to less work
+            ast(_kv_headroom != nullptr);
+            int64_t max_headroom = std::numeric_limits<int64_t>::min();
+            uint64_t min_tokens = std::numeric_limits<uint64_t>::max();
+            for (uint32_t r = 0; r < _num_replicas; r++) {
+                int64_t headroom = _kv_headroom(r);
+                uint64_t tokens = outstanding_tokens(r);
+                if (headroom > max_headroom || (headroom == max_headroom && tokens < min_tokens)) {
+                    max_headroom = headroom;
+                    min_tokens = tokens;
+                    replica = r;
+                }
+            }
+            break;
+        }
+    }
+
+    _outstanding[replica].push_back(request);
+    _num_routed[replica]++;
+    spdlog::info("Router ({}): request#{} -> replica {}", policy_to_string(_policy), request->id,
+                 replica);
+    return replica;
+}
+
+void Router::complete(uint32_t replica, Ptr<InferRequest> request) {
+    auto &outstanding = _outstanding[replica];
+    for (auto it = outstanding.begin(); it != outstanding.end(); it++) {
+        if ((*it)->id == request->id) {
+            outstanding.erase(it);
+            return;
+        }
+    }
+    ast(0);
+}
+
+uint64_t Router::outstanding_tokens(uint32_t replica) {
+    uint64_t tokens = 0;
+    for (auto &request : _outstanding[replica]) {
+        if (!request->is_initiated) tokens += request->input_size - request->prefilled;
+        tokens += request->output_size - request->generated;
+    }
+    return tokens;
+}
+
+RouterPolicy Router::parse_policy(std::string policy) {
+    if (policy == "round_robin") return RouterPolicy::ROUND_ROBIN;
+    if (policy == "least_tokens") return RouterPolicy::LEAST_OUTSTANDING_TOKENS;
+    if (policy == "kv_aware") return RouterPolicy::KV_AWARE;
+    throw std::runtime_error(fmt::format("Not implemented router policy {} ", policy));
+}
+
+std::string Router::policy_to_string(RouterPolicy policy) {
+    static const std::map<RouterPolicy, std::string> policyMap = {
+        {RouterPolicy::ROUND_ROBIN, "round_robin"},
+        {RouterPolicy::LEAST_OUTSTANDING_TOKENS, "least_tokens"},
+        {RouterPolicy::KV_AWARE, "kv_aware"},
+    };
+
+    auto it = policyMap.find(policy);
+    return (it != policyMap.end()) ? it->second : "unknown";
+}
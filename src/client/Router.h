@@ -0,0 +1,39 @@
+#pragma once
+#include <functional>
+#include <vector>
+
+#include "../Common.h"
+
+// data-parallel replica selection
+enum class RouterPolicy { ROUND_ROBIN, LEAST_OUTSTANDING_TOKENS, KV_AWARE };
+
+// Routes every request of the Client to one of the data-parallel replicas.
+// Requests stay outstanding on their replica until the replica completes them.
+class Router {
+   public:
+    Router(RouterPolicy policy, uint32_t num_replicas);
+
+    uint32_t route(Ptr<InferRequest> request);
+    void complete(uint32_t replica, Ptr<InferRequest> request);
+    // KV pages a replica has left once its queued requests are admitted (kv_aware only)
+    void set_kv_headroom(std::function<int64_t(uint32_t replica)> kv_headroom) {
+        _kv_headroom = kv_headroom;
+    }
+
+    uint32_t get_num_routed(uint32_t replica) { return _num_routed[replica]; }
+    uint32_t get_num_outstanding(uint32_t replica) { return _outstanding[replica].size(); }
+
+    static RouterPolicy parse_policy(std::string policy);
+    static std::string policy_to_string(RouterPolicy policy);
+
+   private:
+    RouterPolicy _policy;
+    uint32_t _num_replicas;
+    uint32_t _next_replica;  // round robin
+    std::vector<std::vector<Ptr<InferRequest>>> _outstanding;
+    std::vector<uint32_t> _num_routed;
+    std::function<int64_t(uint32_t replica)> _kv_headroom;
+
+    // prompt tokens not prefilled yet + tokens still to generate
+    uint64_t outstanding_tokens(uint32_t replica);
+};
@@ -0,0 +1,62 @@
+#include "../Simulator.h"
+#include "../helper/ConfigOptions.h"
+
+// Library API example: embeds a Simulator in SimulatorMode::LIBRARY, injects requests without a
+// Client or a request trace, counts tiles, stages and requests through the callbacks, steps the
+// simulation with run_until and drains it with run_until_idle. Exits with 1 if a request is lost
+// or a callback count disagrees with get_stat.
+
+int main(int argc, char **argv) {
+    CommandLineParser cmd_parser = CommandLineParser();
+    add_config_options(cmd_parser);
+    cmd_parser.add_command_line_option<std::string>("requests",
+                                                    "Requests injected per wave, default = 8");
+    try {
+        cmd_parser.parse(argc, argv);
+    } catch (const CommandLineParser::ParsingError &e) {
+        spdlog::error("Command line argument parrsing error captured. Error message: {}", e.what());
+        throw(e);
+    }
+    spdlog::set_level(spdlog::level::warn);
+
+    SimulationConfig config = load_config_options(cmd_parser);
+    std::string requests = "8";
+    cmd_parser.set_if_defined("requests", &requests);
+    uint32_t wave = std::stoi(requests);
+
+    Simulator simulator(config, SimulatorMode::LIBRARY);
+    simulator.load_model();
+
+    uint64_t tiles = 0;
+    uint32_t stages = 0;
+    std::vector<Ptr<InferRequest>> completed;
+    simulator.on_tile_finished([&tiles](uint32_t, const Tile &) { tiles++; });
+    simulator.on_stage_finished([&stages](std::string, cycle_type) { stages++; });
+    simulator.on_request_completed(
+        [&completed](Ptr<InferRequest> request) { completed.push_back(request); });
+
+    // a first wave, a look at the live stats after a while, then a second wave
+    for (uint32_t i = 0; i < wave; i++) simulator.inject_request(128, 4, i % config.dram_channels);
+    simulator.run_until(100000);
+    SimulatorStat stat = simulator.get_stat();
+    fmt::print("cycle {}: {} of {} requests completed, {} running, {} tiles, {} stages\n",
+               stat.core_cycles, stat.completed_requests, stat.injected_requests,
+               stat.running_requests, stat.finished_tiles, stat.finished_stages);
+
+    for (uint32_t i = 0; i < wave; i++) simulator.inject_request(256, 2, i % config.dram_channels);
+    simulator.run_until_idle();
+    stat = simulator.get_stat();
+    fmt::print("cycle {}: {} of {} requests completed, {} tokens, {} tiles, {} stages\n",
+               stat.core_cycles, stat.completed_requests, stat.injected_requests,
+               stat.generated_tokens, stat.finished_tiles, stat.finished_stages);
+
+    bool ok = completed.size() == 2 * wave && stat.completed_requests == 2 * wave &&
+              stat.running_requests == 0 && stat.finished_tiles == tiles &&
+              stat.finished_stages == stages;
+    for (auto &request : completed) ok = ok && request->generated == request->output_size;
+    if (!ok) {
+        spdlog::error("library example: callbacks and get_stat disagree");
+        return 1;
+    }
+    return 0;
+}
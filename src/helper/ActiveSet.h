@@ -0,0 +1,59 @@
+#ifndef ACTIVE_SET_H
+#define ACTIVE_SET_H
+
+#include <cstdint>
+#include <vector>
+
+// Bitmap of the non-empty queues of a queue array, so a per-cycle loop visits only those.
+class ActiveSet {
+   public:
+    ActiveSet(uint32_t size = 0) { resize(size); }
+    void resize(uint32_t size) {
+        _size = size;
+        _count = 0;
+        _words.assign((size + 63) / 64, 0);
+    }
+
+    void insert(uint32_t i) {
+        uint64_t bit = 1ull << (i % 64);
+        if (_words[i / 64] & bit) return;
+        _words[i / 64] |= bit;
+        _count++;
+    }
+    void erase(uint32_t i) {
+        uint64_t bit = 1ull << (i % 64);
+        if (!(_words[i / 64] & bit)) return;
+        _words[i / 64] &= ~bit;
+        _count--;
+    }
+    bool contains(uint32_t i) const { return _words[i / 64] & (1ull << (i % 64)); }
+    bool empty() const { return _count == 0; }
+    uint32_t count() const { return _count; }
+
+    // first member >= i, or the size of the set if there is none
+    uint32_t next(uint32_t i) const {
+        if (i >= _size) return _size;
+        uint32_t w = i / 64;
+        uint64_t word = _words[w] & (~0ull << (i % 64));
+        while (!word) {
+            if (++w == _words.size()) return _size;
+            word = _words[w];
+        }
+        return w * 64 + __builtin_ctzll(word);
+    }
+
+    // visits every member once in the round-robin order start, start + 1, ..., start - 1;
+    // func may erase the member it is given
+    template <typename Func>
+    void for_each_from(uint32_t start, Func func) const {
+        for (uint32_t i = next(start); i < _size; i = next(i + 1)) func(i);
+        for (uint32_t i = next(0); i < start; i = next(i + 1)) func(i);
+    }
+
+   private:
+    uint32_t _size;
+    uint32_t _count;
+    std::vector<uint64_t> _words;
+};
+
+#endif
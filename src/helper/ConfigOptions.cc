@@ -0,0 +1,38 @@
+#include "ConfigOptions.h"
+
+void add_config_options(CommandLineParser &cmd_parser) {
+    cmd_parser.add_command_line_option<std::string>(
+        "config", "Path for hardware configuration file, default = "
+                  "configs/systolic_ws_128x128_dev.json");
+    cmd_parser.add_command_line_option<std::string>(
+        "mem_config", "Path for memory configuration file, default = "
+                      "configs/memory_configs/neupims.json");
+    cmd_parser.add_command_line_option<std::string>(
+        "model_config", "Path for model configuration file, default = "
+                        "configs/model_configs/gpt3-7B.json");
+    cmd_parser.add_command_line_option<std::string>(
+        "sys_config", "Path for system configuration file, default = "
+                      "configs/system_configs/sub-batch-off.json");
+    cmd_parser.add_command_line_option<std::string>(
+        "log_dir", "Path for experiment result log directory, default = .");
+}
+
+SimulationConfig load_config_options(const CommandLineParser &cmd_parser) {
+    std::string config_path = "configs/systolic_ws_128x128_dev.json";
+    std::string mem_config_path = "configs/memory_configs/neupims.json";
+    std::string model_config_path = "configs/model_configs/gpt3-7B.json";
+    std::string sys_config_path = "configs/system_configs/sub-batch-off.json";
+    std::string log_dir = ".";
+    cmd_parser.set_if_defined("config", &config_path);
+    cmd_parser.set_if_defined("mem_config", &mem_config_path);
+    cmd_parser.set_if_defined("model_config", &model_config_path);
+    cmd_parser.set_if_defined("sys_config", &sys_config_path);
+    cmd_parser.set_if_defined("log_dir", &log_dir);
+
+    SimulationConfig config = initialize_config(load_config(config_path));
+    initialize_memory_config(config, mem_config_path);
+    initialize_model_config(config, model_config_path);
+    initialize_system_config(config, sys_config_path);
+    config.log_dir = log_dir;
+    return config;
+}
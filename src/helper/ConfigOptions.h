@@ -0,0 +1,15 @@
+#ifndef CONFIG_OPTIONS_H
+#define CONFIG_OPTIONS_H
+
+#include "../Common.h"
+#include "CommandLineParser.h"
+
+// Command line options of the config files, shared by the simulator, the benchmarks and the
+// examples: --config, --mem_config, --model_config, --sys_config and --log_dir.
+void add_config_options(CommandLineParser &cmd_parser);
+
+// Loads the hardware, memory, model and system configs named on the command line, the dev SA,
+// NeuPIM memory, GPT-3 7B and sub-batch-off files where an option is not given.
+SimulationConfig load_config_options(const CommandLineParser &cmd_parser);
+
+#endif
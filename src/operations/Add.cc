@@ -1,6 +1,6 @@
 #include "Add.h"
 
-Add::Add(std::string name) : Operation(name) { _inputs.resize(2); }
+Add::Add(SimContext *ctx, std::string name) : Operation(ctx, name) { _inputs.resize(2); }
 
 std::vector<Ptr<BTensor>> Add::get_outputs(std::vector<Ptr<BTensor>> inputs) {
     set_as_parent_tensor(inputs);
@@ -17,8 +17,8 @@ std::vector<Ptr<BTensor>> Add::get_outputs(std::vector<Ptr<BTensor>> inputs) {
     spdlog::info("_input_dim:{}, _inputs[1]->get_dims():{}", _input_dim, _inputs[1]->get_dims());
     assert(_inputs[1]->get_dims() == _input_dim);
 
-    _outputs[0] =
-        std::make_shared<NPUTensor>(_name + "_output", _input_dim, NPUTensorBufType::ACT, false);
+    _outputs[0] = std::make_shared<NPUTensor>(
+        _ctx, _name + "_output", _input_dim, NPUTensorBufType::ACT, false);
 
     calculate_loops();
     initialize_tiles();
@@ -4,7 +4,7 @@
 
 class Add : public Operation {
    public:
-    Add(std::string name);
+    Add(SimContext *ctx, std::string name);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs);
 
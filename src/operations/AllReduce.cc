@@ -0,0 +1,120 @@
+#include "AllReduce.h"
+
+AllReduce::AllReduce(SimContext *ctx, std::string name) : Operation(ctx, name) {}
+
+std::vector<Ptr<BTensor>> AllReduce::get_outputs(std::vector<Ptr<BTensor>> inputs) {
+    set_as_parent_tensor(inputs);
+
+    _outputs.resize(1);
+
+    assert(inputs.size() == 1);
+    _inputs.assign(inputs.begin(), inputs.end());
+
+    _input_dim = _inputs[0]->get_dims();
+
+    _outputs[0] = std::make_shared<NPUTensor>(
+        _ctx, _name + "_output", _input_dim, NPUTensorBufType::ACT, false);
+
+    calculate_loops();
+    initialize_tiles();
+
+    spdlog::info("AllReduce {}: {} over {} devices ({})", _name, _input_dim, _config.n_tp,
+                 allReduceAlgToString(_config.tp_allreduce_alg));
+
+    return _outputs;
+}
+
+void AllReduce::initialize_tiles() {
+    for (uint32_t N = 0; N < _outer_loop[0]; ++N) {
+        uint32_t n_outer_offset = _inner_loop[0] * N;
+        if (n_outer_offset >= _prod_batches) break;
+        _tiles.push_back(initialize_instructions(N));
+    }
+}
+
+// all-reduce : rows of a block are gathered in the scratchpad and sent in one transfer
+//  input      : n_inner rows
+//  all-reduce : n_inner rows (accumulation buffer)
+Tile AllReduce::initialize_instructions(uint32_t N) {
+    auto tile = Tile{
+        .status = Tile::Status::INITIALIZED,
+        .optype = get_name(),
+        .operation_id = _id,
+        .batch = N,
+        .K = 0,
+        .accum = false,
+    };
+
+    uint32_t row_size = _input_dim.back();
+    auto n_outer_offset = _inner_loop[0] * N;
+    auto n_inner = MIN(_inner_loop[0], _prod_batches - n_outer_offset);
+
+    addr_type sram_activation_base = SPAD_BASE;
+    addr_type sram_accumulation_base = ACCUM_SPAD_BASE;
+
+    auto activation_tensor = std::static_pointer_cast<NPUTensor>(_inputs[0]);
+    auto output_tensor = std::static_pointer_cast<NPUTensor>(_outputs[0]);
+
+    // -- activation --
+    std::vector<addr_type> sram_row_addrs;
+    std::vector<addr_type> output_addrs;
+    for (uint32_t n_inner_offset = 0; n_inner_offset < n_inner; ++n_inner_offset) {
+        addr_type sram_activation_offset =
+            sram_activation_base + n_inner_offset * row_size * _config.precision;
+
+        auto activation_addrs = activation_tensor->get_row_addrs(n_outer_offset + n_inner_offset);
+        tile.instructions.push_back(Instruction{
+            .opcode = Opcode::MOVIN,
+            .dest_addr = sram_activation_offset,
+            .size = (uint32_t)activation_addrs.size() * _config.precision,
+            .src_addrs = std::move(activation_addrs),
+            .operand_id = _INPUT_OPERAND,
+        });
+        sram_row_addrs.push_back(sram_activation_offset);
+
+        auto row_output_addrs = output_tensor->get_row_addrs(n_outer_offset + n_inner_offset);
+        output_addrs.insert(output_addrs.end(), row_output_addrs.begin(), row_output_addrs.end());
+    }
+
+    // -- compute --
+    tile.instructions.push_back(Instruction{
+        .opcode = Opcode::ALL_REDUCE,
+        .dest_addr = sram_accumulation_base,
+        .size = n_inner * row_size,
+        .src_addrs = std::move(sram_row_addrs),
+    });
+
+    // -- save outputs --
+    tile.instructions.push_back(Instruction{
+        .opcode = Opcode::MOVOUT,
+        .dest_addr = sram_accumulation_base,
+        .size = (uint32_t)output_addrs.size() * _config.precision,
+        .src_addrs = std::move(output_addrs),
+        .operand_id = _OUTPUT_OPERAND,
+    });
+
+    return tile;
+}
+
+void AllReduce::calculate_loops() {
+    _inner_loop.resize(1);
+    _outer_loop.assign(1, 1);
+
+    _prod_batches = 1;
+    for (size_t i = 0; i + 1 < _input_dim.size(); i++) {
+        _prod_batches *= _input_dim[i];
+    }
+    _inner_loop[0] = _prod_batches;
+
+    while (sram_size_needed() > _config.core_config[target_core].spad_size KB / 2) {
+        _outer_loop[0] *= 2;
+        _inner_loop[0] = (_inner_loop[0] & 1) + (_inner_loop[0] >> 1);
+    }
+}
+
+uint32_t AllReduce::sram_size_needed() {
+    auto n = _inner_loop[0];
+    auto k = _input_dim.back();
+
+    return 2 * n * k * _config.precision;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "../tensor/NPUTensor.h"
+#include "Operation.h"
+
+// All-reduce of the (N, E) partial sums of the n_tp tensor parallel devices over the TP link.
+// Rows are reduced in blocks that fit the scratchpad, one ALL_REDUCE per block.
+class AllReduce : public Operation {
+   public:
+    AllReduce(SimContext *ctx, std::string name);
+
+    std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs);
+
+   private:
+    uint32_t _prod_batches;
+
+    std::vector<uint32_t> _input_dim;
+
+    std::vector<uint32_t> _inner_loop;
+    std::vector<uint32_t> _outer_loop;
+
+    void calculate_loops();
+    void initialize_tiles();
+    Tile initialize_instructions(uint32_t N);
+    uint32_t sram_size_needed();
+};
@@ -1,6 +1,7 @@
 #include "Attention.h"
 // Fused Operations QKV gen + Multi-head Attention
-Attention::Attention(std::string name, std::shared_ptr<BatchedRequest> breq) : Operation(name) {
+Attention::Attention(SimContext *ctx, std::string name, std::shared_ptr<BatchedRequest> breq)
+    : Operation(ctx, name) {
     // requests
     _breq = breq;
     _N = _breq->get_num_rows();
@@ -6,7 +6,7 @@
 
 class Attention : public Operation {
    public:
-    Attention(std::string name, std::shared_ptr<BatchedRequest> breq);
+    Attention(SimContext *ctx, std::string name, std::shared_ptr<BatchedRequest> breq);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs) override;
 
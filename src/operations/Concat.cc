@@ -1,6 +1,8 @@
 #include "Concat.h"
 
-Concat::Concat(std::string name, uint32_t dim) : Operation(name) { _dim = dim; }
+Concat::Concat(SimContext *ctx, std::string name, uint32_t dim) : Operation(ctx, name) {
+    _dim = dim;
+}
 
 std::vector<Ptr<BTensor>> Concat::get_outputs(std::vector<Ptr<BTensor>> inputs) {
     set_as_parent_tensor(inputs);
@@ -20,8 +22,8 @@ std::vector<Ptr<BTensor>> Concat::get_outputs(std::vector<Ptr<BTensor>> inputs)
         }
     }
 
-    _outputs[0] =
-        std::make_shared<NPUTensor>(_name + "_output", output_dim, NPUTensorBufType::ACT, false);
+    _outputs[0] = std::make_shared<NPUTensor>(
+        _ctx, _name + "_output", output_dim, NPUTensorBufType::ACT, false);
 
     _tiles.push_back(Tile{
         .status = Tile::Status::INITIALIZED,
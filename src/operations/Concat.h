@@ -4,7 +4,7 @@
 
 class Concat : public Operation {
    public:
-    Concat(std::string name, uint32_t dim);
+    Concat(SimContext *ctx, std::string name, uint32_t dim);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs);
 
@@ -2,7 +2,7 @@
 
 #include "FusedMHA.h"
 
-FusedMHA::FusedMHA(std::string name) : Operation(name) {}
+FusedMHA::FusedMHA(SimContext *ctx, std::string name) : Operation(ctx, name) {}
 
 /**
  * MHA not including QKV generation and projection layer.
@@ -23,7 +23,7 @@ std::vector<Ptr<BTensor>> FusedMHA::get_outputs(std::vector<Ptr<BTensor>> inputs
     _batch_size = inputs.size() / 3;
     uint32_t i = 0;
 
-    // * q = seq_len or 1
+    // * q = seq_len, 1, or a prefill chunk attending to (prefilled + chunk) keys
     // query [h, q, dk]
     // key [h, dk, seq_len]
     // value [h, seq_len, dk]
@@ -44,23 +44,25 @@ std::vector<Ptr<BTensor>> FusedMHA::get_outputs(std::vector<Ptr<BTensor>> inputs
     _nh = _query[0]->get_dims()[0];
     _dk = _query[0]->get_dims()[2];
 
-    ast(_nh == Config::global_config.model_n_head / Config::global_config.n_tp);
-    ast(_dk == Config::global_config.model_n_embd / Config::global_config.model_n_head);
+    ast(_nh == _config.model_n_head / _config.n_tp);
+    ast(_dk == _config.model_n_embd / _config.model_n_head);
+    ast(_nh % _key[0]->get_dims()[0] == 0);
+    _group = _nh / _key[0]->get_dims()[0];
 
     for (int i = 0; i < _batch_size; ++i) {
         auto q = _query[i];  // [h, q, dk]
-        auto k = _key[i];    // [h, dk, seq_len]
-        auto v = _value[i];  // [h, seq_len, dk]
+        auto k = _key[i];    // [h_kv, dk, seq_len]
+        auto v = _value[i];  // [h_kv, seq_len, dk]
 
         // seq_len of key == seq_len of value
         assert(k->get_dims()[2] == v->get_dims()[1]);
-        uint32_t q_len = q->get_dims()[1];  // seq_len or 1
-        assert(q_len == 1 || q_len == k->get_dims()[2]);
+        uint32_t q_len = q->get_dims()[1];  // seq_len, 1 or chunk size
+        assert(q_len <= k->get_dims()[2]);
         // xxx
         std::vector<uint32_t> mha_output_dim{_nh, q_len, _dk};
         // std::vector<uint32_t> mha_output_dim{q_len, _dk * _nh};
         spdlog::info("FusedMHA Q:{}, K:{}, V:{}", q->get_dims(), k->get_dims(), v->get_dims());
-        _outputs[i] = std::make_shared<NPUTensor>(_name + "_output", mha_output_dim,
+        _outputs[i] = std::make_shared<NPUTensor>(_ctx, _name + "_output", mha_output_dim,
                                                   NPUTensorBufType::ACT, false);
     }
 
@@ -76,20 +78,24 @@ std::vector<Ptr<BTensor>> FusedMHA::get_outputs(std::vector<Ptr<BTensor>> inputs
 void FusedMHA::initialize_tiles() {
     for (int req_idx = 0; req_idx < _batch_size; req_idx++) {
         int heads_per_tile = _heads_per_tile[req_idx];
-        int head_idx = 0;
-
-        auto tile = Tile{
-            .status = Tile::Status::INITIALIZED,
-            .optype = get_name(),
-            .operation_id = _id,
-            .batch = 0,
-            .K = 0,
-            .accum = false,
-        };
-
-        initialize_instructions(tile, req_idx, 0, heads_per_tile);
-
-        _tiles.push_back(tile);
+        ast(heads_per_tile > 0);
+
+        // long prefill chunks may not fit every head in SRAM at once
+        for (int head_idx = 0; head_idx < _nh; head_idx += heads_per_tile) {
+            auto tile = Tile{
+                .status = Tile::Status::INITIALIZED,
+                .optype = get_name(),
+                .operation_id = _id,
+                .batch = 0,
+                .K = 0,
+                .accum = false,
+            };
+
+            initialize_instructions(tile, req_idx, head_idx,
+                                    MIN(heads_per_tile, (int)_nh - head_idx));
+
+            _tiles.push_back(tile);
+        }
     }
 }
 
@@ -109,10 +115,14 @@ void FusedMHA::initialize_instructions(Tile &tile, int req_idx, int head_idx, in
 
     for (int h_ofs = 0; h_ofs < num_heads; h_ofs++) {
         int h_idx = head_idx + h_ofs;
+        // KV head of this query head, loaded once for the query heads of its group in the tile
+        int kv_idx = h_idx / _group;
+        int kv_ofs = kv_idx - head_idx / _group;
+        bool load_kv = h_ofs == 0 || h_idx % _group == 0;
 
         addr_type sram_q_ofs = sram_query_base + h_ofs * (q_len * _dk) * _config.precision;
-        addr_type sram_k_ofs = sram_key_base + h_ofs * (_dk * seq_len) * _config.precision;
-        addr_type sram_v_ofs = sram_value_base + h_ofs * (_dk * seq_len) * _config.precision;
+        addr_type sram_k_ofs = sram_key_base + kv_ofs * (_dk * seq_len) * _config.precision;
+        addr_type sram_v_ofs = sram_value_base + kv_ofs * (_dk * seq_len) * _config.precision;
         addr_type sram_l_ofs = sram_logit_base + h_ofs * (q_len * seq_len) * _config.precision;
         addr_type sram_acc_ofs = sram_accumulation_base + h_ofs * (q_len * _dk) * _config.precision;
 
@@ -124,13 +134,13 @@ void FusedMHA::initialize_instructions(Tile &tile, int req_idx, int head_idx, in
             for (int seq_idx = 0; seq_idx < seq_len; seq_idx++) {
                 // key:  h, d_k, seq_len
                 dram_key_addrs.push_back(
-                    _key[req_idx]->get_addr(std::vector<uint32_t>{h_idx, i, seq_idx}));
+                    _key[req_idx]->get_addr(std::vector<uint32_t>{kv_idx, i, seq_idx}));
 
                 // value: h, seq_len, d_k
                 dram_value_addrs.push_back(
-                    _value[req_idx]->get_addr(std::vector<uint32_t>{h_idx, seq_idx, i}));
+                    _value[req_idx]->get_addr(std::vector<uint32_t>{kv_idx, seq_idx, i}));
 
-                if (q_len == 1 && seq_idx > 0) continue;
+                if (seq_idx >= q_len) continue;
                 dram_query_addrs.push_back(_query[req_idx]->get_addr(
                     std::vector<uint32_t>{h_idx, seq_idx, i}));  /// num_heads, 1, dk
             }
@@ -156,20 +166,22 @@ void FusedMHA::initialize_instructions(Tile &tile, int req_idx, int head_idx, in
             .src_addrs = std::move(dram_query_addrs),
             .operand_id = _INPUT_OPERAND,  // query
         });
-        tile.instructions.push_back(Instruction{
-            .opcode = Opcode::MOVIN,
-            .dest_addr = sram_k_ofs,
-            .size = (seq_len * _dk) * _config.precision,
-            .src_addrs = std::move(dram_key_addrs),
-            .operand_id = _INPUT_OPERAND + 1,  // key
-        });
-        tile.instructions.push_back(Instruction{
-            .opcode = Opcode::MOVIN,
-            .dest_addr = sram_v_ofs,
-            .size = (seq_len * _dk) * _config.precision,
-            .src_addrs = std::move(dram_value_addrs),
-            .operand_id = _INPUT_OPERAND + 2,  // value
-        });
+        if (load_kv) {
+            tile.instructions.push_back(Instruction{
+                .opcode = Opcode::MOVIN,
+                .dest_addr = sram_k_ofs,
+                .size = (seq_len * _dk) * _config.precision,
+                .src_addrs = std::move(dram_key_addrs),
+                .operand_id = _INPUT_OPERAND + 1,  // key
+            });
+            tile.instructions.push_back(Instruction{
+                .opcode = Opcode::MOVIN,
+                .dest_addr = sram_v_ofs,
+                .size = (seq_len * _dk) * _config.precision,
+                .src_addrs = std::move(dram_value_addrs),
+                .operand_id = _INPUT_OPERAND + 2,  // value
+            });
+        }
 
         // -- compute --
         // GEMM (q*k -> l)
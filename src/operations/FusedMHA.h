@@ -4,7 +4,7 @@
 
 class FusedMHA : public Operation {
    public:
-    FusedMHA(std::string name);
+    FusedMHA(SimContext *ctx, std::string name);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs) override;
 
@@ -14,6 +14,7 @@ class FusedMHA : public Operation {
     std::vector<Ptr<NPUTensor>> _value;
 
     uint32_t _nh;
+    uint32_t _group;  // query heads sharing a KV head (GQA), 1 for MHA
     uint32_t _dk;
 
     std::vector<uint32_t> _heads_per_tile;
@@ -1,6 +1,6 @@
 #include "Gelu.h"
 
-Gelu::Gelu(std::string name) : Operation(name) { _inputs.resize(1); }
+Gelu::Gelu(SimContext *ctx, std::string name) : Operation(ctx, name) { _inputs.resize(1); }
 
 // Gelu does not change shapes.
 std::vector<Ptr<BTensor>> Gelu::get_outputs(std::vector<Ptr<BTensor>> inputs) {
@@ -12,8 +12,8 @@ std::vector<Ptr<BTensor>> Gelu::get_outputs(std::vector<Ptr<BTensor>> inputs) {
     _inputs[0] = inputs[0];
 
     _input_dim = inputs[0]->get_dims();
-    _outputs[0] =
-        std::make_shared<NPUTensor>(_name + "_output", _input_dim, NPUTensorBufType::ACT, false);
+    _outputs[0] = std::make_shared<NPUTensor>(
+        _ctx, _name + "_output", _input_dim, NPUTensorBufType::ACT, false);
 
     calculate_loops();
     initialize_tiles();
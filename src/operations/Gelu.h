@@ -4,7 +4,7 @@
 
 class Gelu : public Operation {
    public:
-    Gelu(std::string name);
+    Gelu(SimContext *ctx, std::string name);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs);
 
@@ -2,7 +2,8 @@
 
 #include "../tensor/NPUTensor.h"
 
-LayerNorm::LayerNorm(std::string name, std::vector<Ptr<NPUTensor>> weights) : Operation(name) {
+LayerNorm::LayerNorm(SimContext *ctx, std::string name, std::vector<Ptr<NPUTensor>> weights)
+    : Operation(ctx, name) {
     assert(weights.size() == 2);
     _inputs.resize(3);
 
@@ -35,8 +36,8 @@ std::vector<Ptr<BTensor>> LayerNorm::get_outputs(std::vector<Ptr<BTensor>> input
         assert(input_dim_riter != input_dims.rend());
         input_dim_riter++;
     }
-    _outputs[0] =
-        std::make_shared<NPUTensor>(_name + "_output", input_dims, NPUTensorBufType::ACT, false);
+    _outputs[0] = std::make_shared<NPUTensor>(
+        _ctx, _name + "_output", input_dims, NPUTensorBufType::ACT, false);
 
     calculate_loops();
     initialize_tiles();
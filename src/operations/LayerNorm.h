@@ -5,7 +5,7 @@
 class LayerNorm : public Operation {
    public:
     // LayerNorm(std::string name, std::vector<uint32_t> weight_dim);
-    LayerNorm(std::string name, std::vector<Ptr<NPUTensor>> weights);
+    LayerNorm(SimContext *ctx, std::string name, std::vector<Ptr<NPUTensor>> weights);
     // LayerNorm(SimulationConfig config,
     //                      std::string name,
     //                      std::vector<uint32_t> weight_tensors);
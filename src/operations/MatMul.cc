@@ -16,7 +16,8 @@
  *  - else if one -> resize input to 2 but not the case in GPT2
  *  - Case where MatMul doesn't have weight, it is initialized only with name. (Below Constructor)
  */
-MatMul::MatMul(std::string name, std::vector<Ptr<NPUTensor>> weights) : Operation(name) {
+MatMul::MatMul(SimContext *ctx, std::string name, std::vector<Ptr<NPUTensor>> weights)
+    : Operation(ctx, name) {
     ast(weights.size() == 2 || weights.size() == 1);
     if (weights.size() == 2) {
         // assert(weights.size() == 2);
@@ -33,7 +34,7 @@ MatMul::MatMul(std::string name, std::vector<Ptr<NPUTensor>> weights) : Operatio
     _is_transposed = true;
 }
 
-MatMul::MatMul(std::string name) : Operation(name) { _inputs.resize(2); }
+MatMul::MatMul(SimContext *ctx, std::string name) : Operation(ctx, name) { _inputs.resize(2); }
 
 /**
  * function executing MatMul
@@ -71,8 +72,8 @@ std::vector<Ptr<BTensor>> MatMul::get_outputs(std::vector<Ptr<BTensor>> inputs)
     *output_dims.rbegin() = *input1_dims.rbegin();  // Set (x, N) in matmul (M, K) x (K, N)
     spdlog::info("MatMul output sz: {}", output_dims);
 
-    _outputs[0] =
-        std::make_shared<NPUTensor>(_name + "_output", output_dims, NPUTensorBufType::ACT, false);
+    _outputs[0] = std::make_shared<NPUTensor>(
+        _ctx, _name + "_output", output_dims, NPUTensorBufType::ACT, false);
 
     // spdlog::info("[{}] input0 : {}  / input1: {}", _name, input0_dims, input1_dims);
 
@@ -155,6 +156,13 @@ Tile MatMul::initialize_instructions(uint32_t B, uint32_t M, uint32_t K, uint32_
     uint32_t tile_k;
     uint32_t tile_n;
 
+    // An output-stationary core keeps an output L1 tile in the array over the whole K extent:
+    // one GEMM per output L1 tile after its last K step, reading every K step's operands.
+    bool output_stationary =
+        _config.core_config[target_core].core_type == CoreType::SYSTOLIC_OS;
+    std::vector<std::vector<addr_type>> os_src_addrs((m_inner + loop_size - 1) / loop_size);
+    std::vector<uint32_t> os_tile_k(os_src_addrs.size(), 0);
+
     // -- bias --
     // if      input size is 2, no need for bias initialization
     //         (_inputs[2] x)
@@ -312,21 +320,43 @@ Tile MatMul::initialize_instructions(uint32_t B, uint32_t M, uint32_t K, uint32_
                 //           << n_inner_offset << std::endl;
                 // std::cout << "tile " << tile_m << " " << tile_n << " " << tile_k << std::endl;
                 // -- compute --
-                // in case of 1st L1 tile execution, execute GEMM_PRELOAD instruction
-                tile.instructions.push_back(Instruction{
-                    .opcode = (m_inner_offset == 0 ? Opcode::GEMM_PRELOAD : Opcode::GEMM),
-                    .dest_addr = sram_accumulation_offset,
-                    // xxx : fixed to systolic array size 8
-                    .size = loop_size / 8,
-                    // what does src_addrs do in computation instructions?
-                    // read Core::can_issue_compute.
-                    // checks if it's loaded to sram.
-                    .src_addrs = std::vector<addr_type>{sram_activation_offset, sram_weight_offset},
-
-                    .tile_m = tile_m,
-                    .tile_k = tile_k,
-                    .tile_n = tile_n,
-                });
+                if (output_stationary) {
+                    uint32_t m_block = m_inner_offset / loop_size;
+                    os_src_addrs[m_block].push_back(sram_activation_offset);
+                    os_src_addrs[m_block].push_back(sram_weight_offset);
+                    os_tile_k[m_block] += MIN(loop_size, k_inner - k_inner_offset);
+                    if (k_inner_offset + loop_size >= k_inner) {
+                        tile.instructions.push_back(Instruction{
+                            .opcode = Opcode::GEMM,
+                            .dest_addr = sram_accumulation_offset,
+                            .size = loop_size / 8,
+                            .src_addrs = std::move(os_src_addrs[m_block]),
+
+                            .tile_m = MIN(loop_size, m_inner - m_inner_offset),
+                            .tile_k = os_tile_k[m_block],
+                            .tile_n = MIN(loop_size, n_inner - n_inner_offset),
+                        });
+                        os_src_addrs[m_block].clear();
+                        os_tile_k[m_block] = 0;
+                    }
+                } else {
+                    // in case of 1st L1 tile execution, execute GEMM_PRELOAD instruction
+                    tile.instructions.push_back(Instruction{
+                        .opcode = (m_inner_offset == 0 ? Opcode::GEMM_PRELOAD : Opcode::GEMM),
+                        .dest_addr = sram_accumulation_offset,
+                        // xxx : fixed to systolic array size 8
+                        .size = loop_size / 8,
+                        // what does src_addrs do in computation instructions?
+                        // read Core::can_issue_compute.
+                        // checks if it's loaded to sram.
+                        .src_addrs =
+                            std::vector<addr_type>{sram_activation_offset, sram_weight_offset},
+
+                        .tile_m = tile_m,
+                        .tile_k = tile_k,
+                        .tile_n = tile_n,
+                    });
+                }
                 // -- store --
                 // when iterating inner_loop k times,
                 // store L1 tile to output
@@ -5,8 +5,8 @@
 class MatMul : public Operation {
    public:
     // MatMul(std::string name, std::vector<uint32_t> weight_dim);
-    MatMul(std::string name, std::vector<Ptr<NPUTensor>> weights);
-    MatMul(std::string name);
+    MatMul(SimContext *ctx, std::string name, std::vector<Ptr<NPUTensor>> weights);
+    MatMul(SimContext *ctx, std::string name);
 
     // MatMul(std::string name,
     //                std::vector<uint32_t> weight_tensors);
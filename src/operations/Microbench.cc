@@ -1,6 +1,8 @@
 #include "Microbench.h"
 
-Microbench::Microbench(std::string name) : Operation(name) { _inputs.resize(1); }
+Microbench::Microbench(SimContext *ctx, std::string name) : Operation(ctx, name) {
+    _inputs.resize(1);
+}
 
 // Microbench does not change shapes.
 std::vector<Ptr<BTensor>> Microbench::get_outputs(std::vector<Ptr<BTensor>> inputs) {
@@ -11,8 +13,8 @@ std::vector<Ptr<BTensor>> Microbench::get_outputs(std::vector<Ptr<BTensor>> inpu
     _inputs[0] = inputs[0];
 
     _input_dim = inputs[0]->get_dims();
-    _outputs[0] =
-        std::make_shared<NPUTensor>(_name + "_output", _input_dim, NPUTensorBufType::ACT, false);
+    _outputs[0] = std::make_shared<NPUTensor>(
+        _ctx, _name + "_output", _input_dim, NPUTensorBufType::ACT, false);
 
     calculate_loops();
     initialize_tiles();
@@ -51,7 +53,7 @@ Tile Microbench::initialize_instructions() {
             // if (i == 0) break;
             int pim_row = 100 + i * num_gemvs + gemv_idx;
             uint32_t p_header_addr =
-                AddressConfig::encode_pim_header(ch, pim_row, false, num_comps, num_readres);
+                _ctx->address.encode_pim_header(ch, pim_row, false, num_comps, num_readres);
             auto sram_header_entry = allocate_sram_addr(0, false);
 
             tile.instructions.push_back(Instruction{
@@ -63,7 +65,7 @@ Tile Microbench::initialize_instructions() {
             });
 
             for (int r_id = 0; r_id < num_readres; r_id++) {
-                uint64_t dram_addr = AddressConfig::encode_pim_comps_readres(
+                uint64_t dram_addr = _ctx->address.encode_pim_comps_readres(
                     ch, pim_row, num_comps_per_readres, false);
                 auto sram_gemv_entry = allocate_sram_addr(banks_per_channel, false);
                 sram_gemv_addrs.push_back(sram_gemv_entry.first);
@@ -86,7 +88,7 @@ Tile Microbench::initialize_instructions() {
                     });
                 } else if (_config.dram_type == DramType::NEUPIMS) {
                     if (r_id == num_readres - 1)
-                        dram_addr = AddressConfig::encode_pim_comps_readres(
+                        dram_addr = _ctx->address.encode_pim_comps_readres(
                             ch, pim_row, num_comps_per_readres, true);
                     tile.instructions.push_back(Instruction{
                         .opcode = Opcode::PIM_COMPS_READRES,
@@ -113,7 +115,7 @@ Tile Microbench::initialize_instructions() {
                 int col = j + load_idx;
 
                 uint32_t dram_addr =
-                    AddressConfig::make_address(ch, rank, bankgroup, bank, dram_row, col);
+                    _ctx->address.make_address(ch, rank, bankgroup, bank, dram_row, col);
                 activation_addrs.push_back(dram_addr);
             }
             auto sram_load_entry = allocate_sram_addr(activation_addrs.size(), false);
@@ -141,7 +143,7 @@ Tile Microbench::initialize_instructions() {
             .tile_n = 32,
         });
 
-        uint32_t movout_addr = AddressConfig::make_address(ch, 0, 0, 0, 0, 0);
+        uint32_t movout_addr = _ctx->address.make_address(ch, 0, 0, 0, 0, 0);
         tile.instructions.push_back(Instruction{
             .opcode = Opcode::MOVOUT,
             .dest_addr = sram_accum_entry.first,
@@ -161,7 +163,7 @@ Tile Microbench::initialize_instructions() {
             .tile_n = 32,
         });
 
-        uint32_t gemv_movout_addr = AddressConfig::make_address(ch, 1, 0, 0, 0, 0);
+        uint32_t gemv_movout_addr = _ctx->address.make_address(ch, 1, 0, 0, 0, 0);
         tile.instructions.push_back(Instruction{
             .opcode = Opcode::MOVOUT,
             .dest_addr = sram_gemv_accum_entry.first,
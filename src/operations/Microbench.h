@@ -4,7 +4,7 @@
 
 class Microbench : public Operation {
    public:
-    Microbench(std::string name);
+    Microbench(SimContext *ctx, std::string name);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs);
 
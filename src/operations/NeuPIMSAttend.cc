@@ -1,6 +1,6 @@
 #include "NeuPIMSAttend.h"
 
-NeuPIMSAttend::NeuPIMSAttend(std::string name) : Operation(name) {}
+NeuPIMSAttend::NeuPIMSAttend(SimContext *ctx, std::string name) : Operation(ctx, name) {}
 
 std::vector<Ptr<BTensor>> NeuPIMSAttend::get_outputs(std::vector<Ptr<BTensor>> inputs) {
     set_as_parent_tensor(inputs);
@@ -21,8 +21,11 @@ std::vector<Ptr<BTensor>> NeuPIMSAttend::get_outputs(std::vector<Ptr<BTensor>> i
 
     _outputs.resize(_batch_size);
 
-    _nh = _vs[0]->get_dims()[0];
+    _nh = _logits[0]->get_dims()[0];
+    _nkvh = _vs[0]->get_dims()[0];
     _dk = _vs[0]->get_dims()[2];
+    assert(_nh % _nkvh == 0);
+    _group = _nh / _nkvh;
 
     // assert(inputs.size() == 2);
     for (int i = 0; i < _batch_size; ++i) {
@@ -30,15 +33,15 @@ std::vector<Ptr<BTensor>> NeuPIMSAttend::get_outputs(std::vector<Ptr<BTensor>> i
         auto V = _vs[i];      // [h, seq_len, dk]
 
         // spdlog::info("(NeuPIMSAttend) L: {}, V: {}", L->get_dims(), V->get_dims());
-        // seq_len of L == seq_len of V
-        assert(L->get_dims()[2] == V->get_dims()[1]);
-        // nh of L == nh of V
-        assert(L->get_dims()[0] == V->get_dims()[0]);
+        // seq_len of L <= seq_len of V, a query may attend to a prefix of the cache
+        assert(L->get_dims()[2] <= V->get_dims()[1]);
+        // nh of L == group * nh of V
+        assert(L->get_dims()[0] == _group * V->get_dims()[0]);
 
         uint32_t l = L->get_dims()[1];
         std::vector<uint32_t> attend_output_dim{_nh, l, _dk};
 
-        _outputs[i] = std::make_shared<NPUTensor>(_name + "_output", attend_output_dim,
+        _outputs[i] = std::make_shared<NPUTensor>(_ctx, _name + "_output", attend_output_dim,
                                                   NPUTensorBufType::ACT, false);
     }
 
@@ -77,7 +80,7 @@ Tile NeuPIMSAttend::initialize_instructions(int start, int end) {
         auto logit = _logits[i];
         auto value = _vs[i];
 
-        uint32_t seq_len = value->get_dims()[1];
+        uint32_t seq_len = logit->get_dims()[2];  // values the logits weight
         uint32_t ch = value->get_channel();
         uint32_t chunks = ceil((double)seq_len / _page_size);
         // spdlog::info("seq_len: {}", seq_len);
@@ -93,8 +96,8 @@ Tile NeuPIMSAttend::initialize_instructions(int start, int end) {
 
                 for (int dk_idx = 0; dk_idx < _dk; dk_idx++) {
                     for (int seq_idx = 0; seq_idx < seq_len; seq_idx++) {
-                        dram_value_addrs.push_back(
-                            value->get_addr(std::vector<uint32_t>{h_idx, seq_idx, dk_idx}));
+                        dram_value_addrs.push_back(value->get_addr(
+                            std::vector<uint32_t>{h_idx / _group, seq_idx, dk_idx}));
 
                         for (int sseq_idx = 0; sseq_idx < seq_len; sseq_idx++) {
                             dram_logit_addrs.push_back(logit->get_addr({h_idx, seq_idx, sseq_idx}));
@@ -149,12 +152,14 @@ Tile NeuPIMSAttend::initialize_instructions(int start, int end) {
             continue;
         }
 
+        // query heads of a group are consecutive, so they sweep the rows of their shared value
+        // head back to back
         for (int hi = 0; hi < _nh; hi++) {
             std::map<uint32_t, std::vector<addr_type>> sram_readres_addrs;
             for (int ci = 0; ci < chunks; ci++) {
                 uint64_t logit_row = 0;  // FIXME: decode row index from dram address
                 uint64_t p_header_addr =
-                    AddressConfig::encode_pim_header(ch, logit_row, true, 0, 0);
+                    _ctx->address.encode_pim_header(ch, logit_row, true, 0, 0);
 
                 addr_type sram_addr_gw = allocate_sram_addr(0, false).first;
 
@@ -187,7 +192,7 @@ Tile NeuPIMSAttend::initialize_instructions(int start, int end) {
 
                     uint32_t DRAM_row = value->_rows[ti * chunks + ci];
                     p_header_addr =
-                        AddressConfig::encode_pim_header(ch, DRAM_row, false, decoded_num_comps, 1);
+                        _ctx->address.encode_pim_header(ch, DRAM_row, false, decoded_num_comps, 1);
                     // P_HEADER (num_comps, num_readres)
                     tile.instructions.push_back(Instruction{
                         .opcode = Opcode::PIM_HEADER,
@@ -199,7 +204,7 @@ Tile NeuPIMSAttend::initialize_instructions(int start, int end) {
                     std::string cmds = "P_HEADER ";
 
                     uint64_t dram_addr =
-                        AddressConfig::encode_pim_comps_readres(ch, DRAM_row, num_comps, true);
+                        _ctx->address.encode_pim_comps_readres(ch, DRAM_row, num_comps, true);
 
                     if (_config.dram_type == DramType::NEWTON) {
                         Instruction comp_inst = Instruction{
@@ -292,7 +297,7 @@ void NeuPIMSAttend::calculate_loops() {
         auto V = _vs[i];      // [h, seq_len, dk]
 
         uint32_t q_len = L->get_dims()[1];
-        uint32_t seq_len = V->get_dims()[2];
+        uint32_t seq_len = L->get_dims()[2];
 
         int need_sram_for_req = 0;
 
@@ -6,7 +6,7 @@
 
 class NeuPIMSAttend : public Operation {
    public:
-    NeuPIMSAttend(std::string name);
+    NeuPIMSAttend(SimContext *ctx, std::string name);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs) override;
 
@@ -19,6 +19,8 @@ class NeuPIMSAttend : public Operation {
 
     // model spec
     uint32_t _nh;
+    uint32_t _nkvh;   // value heads, _nh for MHA
+    uint32_t _group;  // query heads sharing a value head
     uint32_t _dk;
 
     // memory spec
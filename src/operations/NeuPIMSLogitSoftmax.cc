@@ -1,6 +1,8 @@
 #include "NeuPIMSLogitSoftmax.h"
 
-NeuPIMSLogitSoftmax::NeuPIMSLogitSoftmax(std::string name) : Operation(name) {}
+NeuPIMSLogitSoftmax::NeuPIMSLogitSoftmax(SimContext *ctx, std::string name,
+                                         std::vector<uint32_t> seq_lens, bool softmax)
+    : Operation(ctx, name), _seq_lens(seq_lens), _softmax(softmax) {}
 
 std::vector<Ptr<BTensor>> NeuPIMSLogitSoftmax::get_outputs(std::vector<Ptr<BTensor>> inputs) {
     set_as_parent_tensor(inputs);
@@ -22,24 +24,32 @@ std::vector<Ptr<BTensor>> NeuPIMSLogitSoftmax::get_outputs(std::vector<Ptr<BTens
     }
 
     _outputs.resize(_batch_size);
+    if (_seq_lens.empty()) {
+        for (auto K : _ks) _seq_lens.push_back(K->get_dims()[2]);
+    }
+    assert(_seq_lens.size() == _batch_size);
 
     _nh = _qs[0]->get_dims()[0];
+    _nkvh = _ks[0]->get_dims()[0];
     _dk = _qs[0]->get_dims()[2];
-    _E = _nh * _dk;
-    spdlog::info("(NeuPIMSLogitSoftmax) nh:{}, dk:{}", _nh, _dk);
+    _E = _nkvh * _dk;
+    assert(_nh % _nkvh == 0);
+    _group = _nh / _nkvh;
+    spdlog::info("(NeuPIMSLogitSoftmax) nh:{}, nkvh:{}, dk:{}", _nh, _nkvh, _dk);
 
     // assert(inputs.size() == 2);
     for (int i = 0; i < _batch_size; ++i) {
         auto Q = _qs[i];  // [h, l, d_k]
         auto K = _ks[i];  // [h, d_k, seq_len]
 
-        uint32_t seq_len = K->get_dims()[2];
+        uint32_t seq_len = _seq_lens[i];
+        assert(seq_len <= K->get_dims()[2]);
 
         // d_k of Q == d_k of K^T
-        // nh of Q == nh of K^T
+        // nh of Q == group * nh of K^T
         // spdlog::info("Q: {}, K: {}", Q->get_dims(), K->get_dims());
 
-        assert(Q->get_dims()[0] == K->get_dims()[0]);
+        assert(Q->get_dims()[0] == _group * K->get_dims()[0]);
         assert(Q->get_dims()[2] == K->get_dims()[1]);
 
         uint32_t l = Q->get_dims()[1];
@@ -47,7 +57,7 @@ std::vector<Ptr<BTensor>> NeuPIMSLogitSoftmax::get_outputs(std::vector<Ptr<BTens
 
         std::vector<uint32_t> logit_output_dim{_nh, l, seq_len};
 
-        _outputs[i] = std::make_shared<NPUTensor>(_name + "_output", logit_output_dim,
+        _outputs[i] = std::make_shared<NPUTensor>(_ctx, _name + "_output", logit_output_dim,
                                                   NPUTensorBufType::ACT, false);
     }
 
@@ -108,8 +118,8 @@ Tile NeuPIMSLogitSoftmax::initialize_instructions(int start, int end) {
                     for (int seq_idx = 0; seq_idx < seq_len; seq_idx++) {
                         dram_query_addrs.push_back(
                             query->get_addr(std::vector<uint32_t>{h_idx, seq_idx, dk_idx}));
-                        dram_key_addrs.push_back(
-                            key->get_addr(std::vector<uint32_t>{h_idx, dk_idx, seq_idx}));
+                        dram_key_addrs.push_back(key->get_addr(
+                            std::vector<uint32_t>{h_idx / _group, dk_idx, seq_idx}));
                     }
                 }
                 auto sram_q_entry = allocate_sram_addr(seq_len * _dk, false);
@@ -174,17 +184,22 @@ Tile NeuPIMSLogitSoftmax::initialize_instructions(int start, int end) {
         uint32_t ch = key->get_channel();
         std::map<uint32_t, std::vector<addr_type>> sram_readres_addrs;
 
-        uint32_t tiles_per_chunk =
-            key->get_allocated_seq_len() / banks_per_channel;  // number of comp-readres kernel
+        // number of comp-readres kernel, over the rows holding the first seq_len keys
+        uint32_t seq_len = _seq_lens[i];
+        uint32_t tiles_per_chunk = ceil((double)seq_len / banks_per_channel);
 
+        // a key row holds _heads_per_tile KV heads. With grouped-query attention the query heads
+        // of a group share one GWRITE and one P_HEADER per row: each key row is opened once and
+        // every query head of the group computes against it.
         for (int chunk = 0; chunk < _chunks; chunk++) {
             // uint64_t make_address(channel, rank, bankgroup, bank, row, col);
-            // uint64_t encode_pim_header(channel, row, bool for_gwrite, num_comps, num_readres);
+            // uint64_t encode_pim_header(channel, row, bool for_gwrite, num_comps,
+            // num_readres);
 
             uint64_t query_row = 0;  // FIXME: decode row index from dram address
             std::pair<addr_type, uint32_t> sram_entry_for_gw = allocate_sram_addr(0, false);
-            uint64_t gwrite_addr =
-                AddressConfig::make_address(ch, 0, 0, 0, query_row, 0);  // FIXME: real gwrite addr
+            uint64_t gwrite_addr = _ctx->address.make_address(ch, 0, 0, 0, query_row,
+                                                              0);  // FIXME: real gwrite addr
             tile.instructions.push_back(Instruction{
                 .opcode = Opcode::PIM_GWRITE,
                 .dest_addr = sram_entry_for_gw.first,
@@ -201,14 +216,14 @@ Tile NeuPIMSLogitSoftmax::initialize_instructions(int start, int end) {
                     (chunk == _chunks - 1) ? _heads_in_last_chunk : _heads_per_tile;
 
                 uint32_t DRAM_row = key->_rows[ti * _chunks + chunk];
-                int num_comps = _comps_per_head * num_head_in_tile;
-                int num_readres = num_head_in_tile;
+                int num_comps = _comps_per_head * num_head_in_tile * _group;
+                int num_readres = num_head_in_tile * _group;
                 if (num_head_in_tile == 0) {
                     spdlog::info("num_head_in_tile must be greater than 0!!!");
                     exit(-1);
                 }
-                uint32_t p_header_addr =
-                    AddressConfig::encode_pim_header(ch, DRAM_row, false, num_comps, num_readres);
+                uint32_t p_header_addr = _ctx->address.encode_pim_header(
+                    ch, DRAM_row, false, num_comps, num_readres);
                 // P_HEADER (num_comps = comps_per_head * num_heads, num_readres
                 tile.instructions.push_back(Instruction{
                     .opcode = Opcode::PIM_HEADER,
@@ -221,62 +236,67 @@ Tile NeuPIMSLogitSoftmax::initialize_instructions(int start, int end) {
                 std::string cmds = "P_HEADER ";
 
                 for (int head = 0; head < num_head_in_tile; head++) {
-                    int hi = _heads_per_tile * chunk + head;
-
-                    uint64_t dram_addr = AddressConfig::encode_pim_comps_readres(
-                        ch, DRAM_row, _comps_per_head, head == num_head_in_tile - 1);
-
-                    auto sram_entry = allocate_sram_addr(banks_per_channel, false);
-                    addr_type sram_addr = sram_entry.first;
-                    if (_config.dram_type == DramType::NEWTON) {
-                        Instruction comp_inst = Instruction{
-                            .opcode = Opcode::PIM_COMP,
-                            .dest_addr = sram_addr,
-                            .size = 0,
-                            .src_addrs = std::vector<addr_type>{dram_addr},
-                            .operand_id = _INPUT_OPERAND,
-                        };
-                        // spdlog::info("comps:{}", _comps_per_head);
-                        for (int j = 0; j < _comps_per_head; j++) {
-                            // COMP * comps_per_head (channnel, row)
-                            tile.instructions.push_back(comp_inst);
-                            cmds += "COMP ";
+                    for (int g = 0; g < _group; g++) {
+                        // query head g of the group of KV head (_heads_per_tile * chunk + head)
+                        int hi = (_heads_per_tile * chunk + head) * _group + g;
+                        bool last_cmd = head == num_head_in_tile - 1 && g == _group - 1;
+
+                        uint64_t dram_addr = _ctx->address.encode_pim_comps_readres(
+                            ch, DRAM_row, _comps_per_head, last_cmd);
+
+                        auto sram_entry = allocate_sram_addr(banks_per_channel, false);
+                        addr_type sram_addr = sram_entry.first;
+                        if (_config.dram_type == DramType::NEWTON) {
+                            Instruction comp_inst = Instruction{
+                                .opcode = Opcode::PIM_COMP,
+                                .dest_addr = sram_addr,
+                                .size = 0,
+                                .src_addrs = std::vector<addr_type>{dram_addr},
+                                .operand_id = _INPUT_OPERAND,
+                            };
+                            // spdlog::info("comps:{}", _comps_per_head);
+                            for (int j = 0; j < _comps_per_head; j++) {
+                                // COMP * comps_per_head (channnel, row)
+                                tile.instructions.push_back(comp_inst);
+                                cmds += "COMP ";
+                            }
+                            tile.instructions.push_back(Instruction{
+                                .opcode = Opcode::PIM_READRES,
+                                .dest_addr = sram_addr,
+                                .size = sram_entry.second,
+                                .src_addrs = std::vector<addr_type>{dram_addr},
+                                .operand_id = _INPUT_OPERAND,
+                            });
+                            cmds += "READRES ";
+                        } else {
+                            tile.instructions.push_back(Instruction{
+                                .opcode = Opcode::PIM_COMPS_READRES,
+                                .dest_addr = sram_addr,
+                                .size = sram_entry.second,
+                                .src_addrs = std::vector<addr_type>{dram_addr},
+                                .operand_id = _INPUT_OPERAND,
+                            });
+                            cmds += "GEMV(" + std::to_string(_comps_per_head) + ") ";
                         }
-                        tile.instructions.push_back(Instruction{
-                            .opcode = Opcode::PIM_READRES,
-                            .dest_addr = sram_addr,
-                            .size = sram_entry.second,
-                            .src_addrs = std::vector<addr_type>{dram_addr},
-                            .operand_id = _INPUT_OPERAND,
-                        });
-                        cmds += "READRES ";
-                    } else {
-                        tile.instructions.push_back(Instruction{
-                            .opcode = Opcode::PIM_COMPS_READRES,
-                            .dest_addr = sram_addr,
-                            .size = sram_entry.second,
-                            .src_addrs = std::vector<addr_type>{dram_addr},
-                            .operand_id = _INPUT_OPERAND,
-                        });
-                        cmds += "GEMV(" + std::to_string(_comps_per_head) + ") ";
+                        // spdlog::info("tile_idx:{}, head_idx: {}", ti, hi);
+                        if (sram_readres_addrs.find(hi) == sram_readres_addrs.end())  // not exists
+                            sram_readres_addrs[hi] = std::vector<addr_type>{sram_addr};
+                        else
+                            sram_readres_addrs[hi].push_back(sram_addr);
                     }
-                    // spdlog::info("tile_idx:{}, head_idx: {}", ti, hi);
-                    if (sram_readres_addrs.find(hi) == sram_readres_addrs.end())  // not exists
-                        sram_readres_addrs[hi] = std::vector<addr_type>{sram_addr};
-                    else
-                        sram_readres_addrs[hi].push_back(sram_addr);
                 }
                 // spdlog::info("(LogitSoftmax) cmd: {}", cmds);
             }
         }
         for (int hi = 0; hi < _nh; hi++) {
             assert(sram_readres_addrs[hi].size() == tiles_per_chunk);
-            uint32_t column_height = key->_seq_len;  // tiles_per_chunk * banks_per_channel;
+            uint32_t column_height = seq_len;  // tiles_per_chunk * banks_per_channel;
             std::pair<addr_type, uint32_t> sram_acc_entry = allocate_sram_addr(column_height, true);
 
             // spdlog::info("col height: {}, seq_len: {}", column_height, key->_seq_len);
+            // DUMMY only gathers the readres results (buffer.check_hit) for the MOVOUT
             tile.instructions.push_back(Instruction{
-                .opcode = Opcode::SOFTMAX,
+                .opcode = _softmax ? Opcode::SOFTMAX : Opcode::DUMMY,
                 .dest_addr = sram_acc_entry.first,
                 .size = sram_acc_entry.second,
                 .src_addrs = sram_readres_addrs[hi],
@@ -303,7 +323,7 @@ Tile NeuPIMSLogitSoftmax::initialize_instructions(int start, int end) {
 void NeuPIMSLogitSoftmax::calculate_loops() {
     assert(sram_size_needed() < _config.core_config[target_core].spad_size KB / 2);
 
-    uint32_t E = _config.model_n_embd / _config.n_tp;
+    uint32_t E = _E;  // key row width: KV heads only
     // dram row capacity (unit: number of parameter)
     uint32_t page_size = _config.dram_page_size / _config.precision;
     uint32_t banks_per_channel = _config.dram_banks_per_ch;
@@ -341,7 +361,7 @@ uint32_t NeuPIMSLogitSoftmax::sram_size_needed() {
         auto Q = _qs[i];  // [h, q_len, d_k]
         auto K = _ks[i];  // [h, d_k, seq_len]
 
-        uint32_t seq_len = K->get_dims()[2];
+        uint32_t seq_len = _seq_lens[i];
         uint32_t q_len = Q->get_dims()[1];
         int need_sram_for_req = 0;
 
@@ -5,20 +5,27 @@
 
 class NeuPIMSLogitSoftmax : public Operation {
    public:
-    NeuPIMSLogitSoftmax(std::string name);
+    // seq_lens: keys each query attends to (a causal prefix of its cache), all keys if empty.
+    // Without softmax it is a plain GEMV, the raw dot products are written out (LM head).
+    NeuPIMSLogitSoftmax(SimContext *ctx, std::string name, std::vector<uint32_t> seq_lens = {},
+                        bool softmax = true);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs) override;
 
     uint32_t _batch_size;
     std::vector<Ptr<NPUTensor>> _qs;
     std::vector<Ptr<PIMTensor>> _ks;
+    std::vector<uint32_t> _seq_lens;
+    bool _softmax;
 
     std::vector<uint32_t> _inner_loop;
     std::vector<uint32_t> _outer_loop;
 
     uint32_t _nh;
+    uint32_t _nkvh;   // KV heads, _nh for MHA
+    uint32_t _group;  // query heads sharing a KV head
     uint32_t _dk;
-    uint32_t _E;
+    uint32_t _E;      // _nkvh * _dk, width of a key row
     uint32_t _chunks;
     uint32_t _heads_per_tile;
     uint32_t _heads_in_last_chunk;
@@ -2,10 +2,9 @@
 
 #include <memory>
 
-SimulationConfig Operation::_config;
-
-Operation::Operation(MappingTable mapping_table) {
-    _id = generate_id();
+Operation::Operation(SimContext *ctx, MappingTable mapping_table)
+    : _ctx(ctx), _config(ctx->config) {
+    _id = _ctx->generate_id();
     _finish = false;
     spdlog::trace("Node {} op_type {}", _name.c_str(), _optype.c_str());
     if (_config.layout == "NCHW") {
@@ -25,15 +24,15 @@ Operation::Operation(MappingTable mapping_table) {
     Rdim = 3;
 }
 
-Operation::Operation(std::string name) {
-    _id = generate_id();
+Operation::Operation(SimContext *ctx, std::string name) : _ctx(ctx), _config(ctx->config) {
+    _id = _ctx->generate_id();
     _optype = name;
     _name = name;
     _finish = false;
 
     // spdlog::info("operation {} generated", name);
 
-    _stat = OperationStat(_name);
+    _stat = OperationStat(_name, _config);
     _acc_spad_addr = ACCUM_SPAD_BASE;
     _spad_addr = SPAD_BASE;
 }
@@ -74,7 +73,8 @@ void Operation::reduce_tile(Tile &tile) {
 //     return _stat.repr();
 // }
 
-Operation::Operation(const Operation &operation) {
+Operation::Operation(const Operation &operation)
+    : _ctx(operation._ctx), _config(operation._config) {
     _id = operation._id;
     _optype = operation._optype;
     _name = operation._name;
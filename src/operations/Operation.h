@@ -2,6 +2,7 @@
 
 #include "../Common.h"
 #include "../Mapping.h"
+#include "../SimContext.h"
 #include "../Tensor.h"
 #include "../tensor/BTensor.h"
 
@@ -28,12 +29,10 @@ enum class Ops {
 // Graph Node
 class Operation : public std::enable_shared_from_this<Operation> {
    public:
-    Operation(MappingTable mapping_table);
-    Operation(std::string name);
+    Operation(SimContext *ctx, MappingTable mapping_table);
+    Operation(SimContext *ctx, std::string name);
     Operation(const Operation &operation);
 
-    static void initialize(SimulationConfig config) { _config = config; }
-
     virtual void set_finish();
 
     virtual std::string get_name() { return _name; }
@@ -42,8 +41,10 @@ class Operation : public std::enable_shared_from_this<Operation> {
     virtual uint32_t num_inputs() { return _inputs.size(); }
     virtual std::vector<std::shared_ptr<BTensor>> get_inputs() { return _inputs; }
     virtual uint32_t num_outputs() { return _outputs.size(); }
+    std::vector<Ptr<BTensor>> get_output_tensors() { return _outputs; }
     virtual std::vector<std::shared_ptr<Operation>> get_child_nodes();
     virtual std::deque<Tile> get_tiles();
+    uint32_t num_tiles() { return _tiles.size(); }
     virtual bool check_executable();
     virtual std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs);
 
@@ -65,7 +66,8 @@ class Operation : public std::enable_shared_from_this<Operation> {
     uint32_t _id;
     std::string _name;
     std::string _optype;
-    static SimulationConfig _config;
+    SimContext *_ctx;
+    const SimulationConfig &_config;  // _ctx->config
     std::vector<Ptr<BTensor>> _inputs;
     std::vector<Ptr<BTensor>> _outputs;
     std::map<std::string, std::string> _attributes;
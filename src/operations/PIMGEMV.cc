@@ -2,7 +2,7 @@
 
 #include "PIMGEMV.h"
 
-PIMGEMV::PIMGEMV(std::string name) : Operation(name) {}
+PIMGEMV::PIMGEMV(SimContext *ctx, std::string name) : Operation(ctx, name) {}
 
 std::vector<Ptr<BTensor>> PIMGEMV::get_outputs(std::vector<Ptr<BTensor>> inputs) {
     set_as_parent_tensor(inputs);
@@ -40,7 +40,7 @@ std::vector<Ptr<BTensor>> PIMGEMV::get_outputs(std::vector<Ptr<BTensor>> inputs)
         assert(Q->get_dims()[2] == K->get_dims()[1]);
         std::vector<uint32_t> gemv_output_dim{_nh, 1, seq_len};
 
-        _outputs[i] = std::make_shared<NPUTensor>(_name + "_output", gemv_output_dim,
+        _outputs[i] = std::make_shared<NPUTensor>(_ctx, _name + "_output", gemv_output_dim,
                                                   NPUTensorBufType::ACT, false);
     }
 
@@ -90,7 +90,7 @@ Tile PIMGEMV::initialize_instructions() {
             // uint64_t encode_pim_header(channel, row, bool for_gwrite, num_comps, num_readres);
 
             uint64_t query_row = 0;  // FIXME: decode row index from dram address
-            uint64_t p_header_addr = AddressConfig::encode_pim_header(ch, query_row, true, 0, 0);
+            uint64_t p_header_addr = _ctx->address.encode_pim_header(ch, query_row, true, 0, 0);
             //  P_HEADER (for_gwrite=true)
             tile.instructions.push_back(Instruction{
                 .opcode = Opcode::PIM_HEADER,
@@ -115,7 +115,7 @@ Tile PIMGEMV::initialize_instructions() {
                 int num_comps = _comps_per_head * num_head_in_tile;
                 int num_readres = num_head_in_tile;
                 p_header_addr =
-                    AddressConfig::encode_pim_header(ch, DRAM_row, false, num_comps, num_readres);
+                    _ctx->address.encode_pim_header(ch, DRAM_row, false, num_comps, num_readres);
                 // P_HEADER (num_comps = comps_per_head * num_heads, num_readres
                 tile.instructions.push_back(Instruction{
                     .opcode = Opcode::PIM_HEADER,
@@ -129,7 +129,7 @@ Tile PIMGEMV::initialize_instructions() {
 
                 for (int head = 0; head < num_head_in_tile; head++) {
                     int hi = _heads_per_tile * chunk + head;
-                    uint64_t dram_addr = AddressConfig::encode_pim_comps_readres(
+                    uint64_t dram_addr = _ctx->address.encode_pim_comps_readres(
                         ch, DRAM_row, _comps_per_head, head == num_head_in_tile - 1);
 
                     if (_config.dram_type == DramType::NEWTON) {
@@ -5,7 +5,7 @@
 
 class PIMGEMV : public Operation {
    public:
-    PIMGEMV(std::string name);
+    PIMGEMV(SimContext *ctx, std::string name);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs) override;
 
@@ -1,6 +1,6 @@
 #include "PIMGEMVAdd.h"
 
-PIMGEMVAdd::PIMGEMVAdd(std::string name) : Operation(name) {}
+PIMGEMVAdd::PIMGEMVAdd(SimContext *ctx, std::string name) : Operation(ctx, name) {}
 
 std::vector<Ptr<BTensor>> PIMGEMVAdd::get_outputs(std::vector<Ptr<BTensor>> inputs) {
     set_as_parent_tensor(inputs);
@@ -34,7 +34,7 @@ std::vector<Ptr<BTensor>> PIMGEMVAdd::get_outputs(std::vector<Ptr<BTensor>> inpu
         assert(L->get_dims()[2] == V->get_dims()[1]);
         std::vector<uint32_t> gemv_output_dim{_nh, 1, _dk};
 
-        _outputs[i] = std::make_shared<NPUTensor>(_name + "_output", gemv_output_dim,
+        _outputs[i] = std::make_shared<NPUTensor>(_ctx, _name + "_output", gemv_output_dim,
                                                   NPUTensorBufType::ACT, false);
     }
 
@@ -77,7 +77,7 @@ Tile PIMGEMVAdd::initialize_instructions() {
             for (int ci = 0; ci < chunks; ci++) {
                 uint64_t logit_row = 0;  // FIXME: decode row index from dram address
                 uint64_t p_header_addr =
-                    AddressConfig::encode_pim_header(ch, logit_row, true, 0, 0);
+                    _ctx->address.encode_pim_header(ch, logit_row, true, 0, 0);
                 //  P_HEADER (for_gwrite=true)
                 // tile.instructions.push_back(Instruction{
                 //     .opcode = Opcode::PIM_HEADER,
@@ -116,7 +116,7 @@ Tile PIMGEMVAdd::initialize_instructions() {
                     uint32_t DRAM_row =
                         value->_rows[ti * chunks + ci];
                     p_header_addr =
-                        AddressConfig::encode_pim_header(ch, DRAM_row, false, decoded_num_comps, 1);
+                        _ctx->address.encode_pim_header(ch, DRAM_row, false, decoded_num_comps, 1);
                     // P_HEADER (num_comps, num_readres)
                     tile.instructions.push_back(Instruction{
                         .opcode = Opcode::PIM_HEADER,
@@ -127,7 +127,7 @@ Tile PIMGEMVAdd::initialize_instructions() {
                     });
                     std::string cmds = "P_HEADER ";
 
-                    uint64_t dram_addr = AddressConfig::make_address(ch, 0, 0, 0, DRAM_row, 0);
+                    uint64_t dram_addr = _ctx->address.make_address(ch, 0, 0, 0, DRAM_row, 0);
                     Instruction comp_inst = Instruction{
                         .opcode = Opcode::PIM_COMP,
                         .dest_addr = sram_addr,
@@ -5,7 +5,7 @@
 
 class PIMGEMVAdd : public Operation {
    public:
-    PIMGEMVAdd(std::string name);
+    PIMGEMVAdd(SimContext *ctx, std::string name);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs) override;
 
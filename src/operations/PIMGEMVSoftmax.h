@@ -5,7 +5,7 @@
 
 class PIMGEMVSoftmax : public Operation {
    public:
-    PIMGEMVSoftmax(std::string name);
+    PIMGEMVSoftmax(SimContext *ctx, std::string name);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs) override;
 
@@ -1,6 +1,7 @@
 #include "Reshape.h"
 
-Reshape::Reshape(std::string name, std::vector<uint32_t> shape) : Operation(name) {
+Reshape::Reshape(SimContext *ctx, std::string name, std::vector<uint32_t> shape)
+    : Operation(ctx, name) {
     _inputs.resize(1);
 
     _shape.assign(shape.begin(), shape.end());
@@ -30,7 +31,7 @@ std::vector<Ptr<BTensor>> Reshape::get_outputs(std::vector<Ptr<BTensor>> inputs)
     assert(acc_in == acc_out);
 
     _outputs[0] =
-        std::make_shared<NPUTensor>(_name + "_output", _shape, NPUTensorBufType::ACT, false);
+        std::make_shared<NPUTensor>(_ctx, _name + "_output", _shape, NPUTensorBufType::ACT, false);
 
     _tiles.push_back(Tile{
         .status = Tile::Status::INITIALIZED,
@@ -4,7 +4,7 @@
 
 class Reshape : public Operation {
    public:
-    Reshape(std::string name, std::vector<uint32_t> shape);
+    Reshape(SimContext *ctx, std::string name, std::vector<uint32_t> shape);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs);
 
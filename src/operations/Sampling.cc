@@ -0,0 +1,147 @@
+#include "Sampling.h"
+
+Sampling::Sampling(SimContext *ctx, std::string name, uint32_t slices_per_request)
+    : Operation(ctx, name), _slices_per_request(slices_per_request) {
+    _top_k = _config.sampling_top_k;
+}
+
+/**
+ * inputs:
+ *  - LM head on SA : a single (N, vocab) logit tensor, one row per request
+ *  - LM head on PIM: (nh, 1, vocab slice) partial logits, one request per slice
+ *  - merge         : (1, top_k) candidates, _slices_per_request per request
+ * outputs: (1, top_k) candidates of every request
+ */
+std::vector<Ptr<BTensor>> Sampling::get_outputs(std::vector<Ptr<BTensor>> inputs) {
+    set_as_parent_tensor(inputs);
+
+    _inputs = inputs;
+
+    if (_slices_per_request == 1 && inputs.size() == 1)
+        _num_requests = inputs[0]->get_dims()[0];
+    else
+        _num_requests = inputs.size() / _slices_per_request;
+    assert(_num_requests > 0);
+
+    _outputs.resize(_num_requests);
+    for (uint32_t i = 0; i < _num_requests; i++) {
+        _outputs[i] = std::make_shared<NPUTensor>(
+            _ctx, _name + "_output", std::vector<uint32_t>{1, _top_k}, NPUTensorBufType::ACT,
+            false);
+    }
+    spdlog::info("Sampling (batch size): {}, top-k: {}, merged slices: {}", _num_requests, _top_k,
+                 _slices_per_request);
+
+    initialize_tiles();
+
+    return _outputs;
+}
+
+std::tuple<uint32_t, uint32_t, uint32_t> Sampling::get_rows(uint32_t req_idx) {
+    if (_inputs.size() == 1) return {0, req_idx, 1};
+    auto dims = _inputs[req_idx]->get_dims();
+    uint32_t num_rows = 1;
+    for (size_t i = 0; i + 1 < dims.size(); i++) num_rows *= dims[i];
+    return {req_idx, 0, num_rows};
+}
+
+void Sampling::initialize_tiles() {
+    for (uint32_t req_idx = 0; req_idx < _num_requests; req_idx++) {
+        assert(sram_size_needed(req_idx) < _config.core_config[target_core].spad_size KB / 2);
+        _tiles.push_back(initialize_instructions(req_idx));
+    }
+}
+
+//  sample : MOVIN logit rows, ADD (rows > 1), SAMPLE (vocab -> top_k), MOVOUT top_k
+//  merge  : MOVIN top_k per slice, SAMPLE (top_k * slices -> top_k), MOVOUT top_k
+Tile Sampling::initialize_instructions(uint32_t req_idx) {
+    auto tile = Tile{
+        .status = Tile::Status::INITIALIZED,
+        .optype = get_name(),
+        .operation_id = _id,
+        .batch = req_idx,
+        .K = 0,
+        .accum = false,
+    };
+
+    addr_type sram_activation_offset = SPAD_BASE;
+    addr_type sram_accumulation_offset = ACCUM_SPAD_BASE;
+
+    // -- load logits or candidates --
+    std::vector<addr_type> sram_row_addrs;
+    auto load_row = [&](Ptr<NPUTensor> tensor, uint32_t row) {
+        auto row_addrs = tensor->get_row_addrs(row);
+        uint32_t size = row_addrs.size() * _config.precision;
+        tile.instructions.push_back(Instruction{
+            .opcode = Opcode::MOVIN,
+            .dest_addr = sram_activation_offset,
+            .size = size,
+            .src_addrs = std::move(row_addrs),
+            .operand_id = _INPUT_OPERAND,
+        });
+        sram_row_addrs.push_back(sram_activation_offset);
+        sram_activation_offset += size;
+    };
+
+    uint32_t sample_size;
+    uint32_t num_rows = 1;
+    if (_slices_per_request > 1) {
+        for (uint32_t s = 0; s < _slices_per_request; s++)
+            load_row(std::static_pointer_cast<NPUTensor>(
+                         _inputs[req_idx * _slices_per_request + s]),
+                     0);
+        sample_size = _top_k * _slices_per_request;
+    } else {
+        auto [input_idx, first_row, rows] = get_rows(req_idx);
+        auto logit_tensor = std::static_pointer_cast<NPUTensor>(_inputs[input_idx]);
+        for (uint32_t row = first_row; row < first_row + rows; row++)
+            load_row(logit_tensor, row);
+        sample_size = logit_tensor->get_dims().back();
+        num_rows = rows;
+    }
+
+    // -- compute --
+    // sum the per-head partial logits
+    std::vector<addr_type> sample_src_addrs = sram_row_addrs;
+    bool src_from_accum = false;
+    if (num_rows > 1) {
+        tile.instructions.push_back(Instruction{
+            .opcode = Opcode::ADD,
+            .dest_addr = sram_accumulation_offset,
+            .size = sample_size * (num_rows - 1),
+            .src_addrs = sram_row_addrs,
+        });
+        sample_src_addrs = std::vector<addr_type>{sram_accumulation_offset};
+        src_from_accum = true;
+        sram_accumulation_offset += sample_size * _config.precision;
+    }
+    tile.instructions.push_back(Instruction{
+        .opcode = Opcode::SAMPLE,
+        .dest_addr = sram_accumulation_offset,
+        .size = sample_size,
+        .src_addrs = sample_src_addrs,
+        .src_from_accum = src_from_accum,
+    });
+
+    // -- save outputs --
+    auto output_addrs = std::static_pointer_cast<NPUTensor>(_outputs[req_idx])->get_row_addrs(0);
+    uint32_t output_size = output_addrs.size() * _config.precision;
+    tile.instructions.push_back(Instruction{
+        .opcode = Opcode::MOVOUT,
+        .dest_addr = sram_accumulation_offset,
+        .size = output_size,
+        .src_addrs = std::move(output_addrs),
+        .operand_id = _OUTPUT_OPERAND,
+    });
+
+    return tile;
+}
+
+// sample: logit rows + partial sum + top_k, merge: top_k per slice + top_k
+uint32_t Sampling::sram_size_needed(uint32_t req_idx) {
+    if (_slices_per_request > 1)
+        return (_slices_per_request + 1) * _top_k * _config.precision;
+    auto [input_idx, first_row, num_rows] = get_rows(req_idx);
+    uint32_t vocab = _inputs[input_idx]->get_dims().back();
+    return ((num_rows + 1) * vocab + _top_k) * _config.precision;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <tuple>
+
+#include "../tensor/NPUTensor.h"
+#include "Operation.h"
+
+// Token sampling on the vector unit: top-k (argmax if k = 1) over the logits of each request.
+// With the LM head on PIM a request comes as one vocab slice per channel, holding per-head
+// partial logits. One Sampling (slices_per_request = 1) sums and samples every slice in its own
+// tile, a second one (slices_per_request = channels) merges the top_k candidates of the slices.
+class Sampling : public Operation {
+   public:
+    Sampling(SimContext *ctx, std::string name, uint32_t slices_per_request);
+
+    std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs);
+
+   private:
+    uint32_t _slices_per_request;
+    uint32_t _num_requests;
+    uint32_t _top_k;
+
+    void initialize_tiles();
+    Tile initialize_instructions(uint32_t req_idx);
+    uint32_t sram_size_needed(uint32_t req_idx);
+    // (input index, first row, number of rows) of the logits of a request, no merge only
+    std::tuple<uint32_t, uint32_t, uint32_t> get_rows(uint32_t req_idx);
+};
@@ -1,6 +1,6 @@
 #include "Softmax.h"
 
-Softmax::Softmax(std::string name) : Operation(name) {
+Softmax::Softmax(SimContext *ctx, std::string name) : Operation(ctx, name) {
     // assume as dim = -1
     // _inputs.resize(1);
 }
@@ -17,8 +17,8 @@ std::vector<Ptr<BTensor>> Softmax::get_outputs(std::vector<Ptr<BTensor>> inputs)
     for (int i = 0; i < _batch_size; i++) {
         std::vector<uint32_t> input_dim = inputs[i]->get_dims();
 
-        _outputs[i] =
-            std::make_shared<NPUTensor>(_name + "_output", input_dim, NPUTensorBufType::ACT, false);
+        _outputs[i] = std::make_shared<NPUTensor>(
+            _ctx, _name + "_output", input_dim, NPUTensorBufType::ACT, false);
     }
     spdlog::info("softmax batch_size: {}", _batch_size);
 
@@ -4,7 +4,7 @@
 
 class Softmax : public Operation {
    public:
-    Softmax(std::string name);
+    Softmax(SimContext *ctx, std::string name);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs);
 
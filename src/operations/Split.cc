@@ -3,8 +3,8 @@
 
 // n,e -> n (1(unit),e) => _inputs.size() == 1, _outputs.size() == n
 // Split(1, 0) => n (1,e)
-Split::Split(std::string name, std::vector<uint32_t> units, uint32_t dim)
-    : Operation(name), _units(units), _dim(dim), _sum(0) {
+Split::Split(SimContext *ctx, std::string name, std::vector<uint32_t> units, uint32_t dim)
+    : Operation(ctx, name), _units(units), _dim(dim), _sum(0) {
     _inputs.resize(1);
     for (auto d : _units) {
         _sum += d;
@@ -39,7 +39,7 @@ std::vector<Ptr<BTensor>> Split::get_outputs(std::vector<Ptr<BTensor>> inputs) {
         auto output_dim_buf = output_dim;
         output_dim_buf[_dim] = _units[i];
         spdlog::info("Split output dim: {}", output_dim_buf);
-        _outputs[i] = std::make_shared<NPUTensor>(_name + "_output" + std::to_string(i),
+        _outputs[i] = std::make_shared<NPUTensor>(_ctx, _name + "_output" + std::to_string(i),
                                                   output_dim_buf, NPUTensorBufType::ACT, false);
     }
     
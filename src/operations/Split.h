@@ -5,7 +5,7 @@
 // split input tensor to three
 class Split : public Operation {
    public:
-    Split(std::string name, std::vector<uint32_t> units, uint32_t dim);
+    Split(SimContext *ctx, std::string name, std::vector<uint32_t> units, uint32_t dim);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs);
 
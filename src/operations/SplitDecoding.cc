@@ -1,9 +1,9 @@
 #include "SplitDecoding.h"
 
 // split and concat 1,3E to nh,1,dk(2D) / nh,dk,T+1 (tp,KV) / nh,T+1,dk (KV)
-SplitDecoding::SplitDecoding(std::string name, std::pair<Ptr<BTensor>, Ptr<BTensor>> kv_cache,
-                             bool is_initiated)
-    : Operation(name) {
+SplitDecoding::SplitDecoding(SimContext *ctx, std::string name,
+                             std::pair<Ptr<BTensor>, Ptr<BTensor>> kv_cache, bool is_initiated)
+    : Operation(ctx, name) {
     _inputs.resize(3);
     _inputs[1] = kv_cache.first;
     _inputs[2] = kv_cache.second;
@@ -28,9 +28,9 @@ std::vector<Ptr<BTensor>> SplitDecoding::get_outputs(std::vector<Ptr<BTensor>> i
 
     Ptr<NPUTensor> input = std::static_pointer_cast<NPUTensor>(_inputs[0]);
 
-    uint32_t nh = Config::global_config.model_n_head / Config::global_config.n_tp;
-    uint32_t E = Config::global_config.model_n_embd;
-    uint32_t dk = Config::global_config.model_n_embd / Config::global_config.model_n_head;
+    uint32_t nh = _config.model_n_head / _config.n_tp;
+    uint32_t E = _config.model_n_embd;
+    uint32_t dk = _config.model_n_embd / _config.model_n_head;
 
     // Perform write operations based on the DRAM addresses received from split and concat breq->req->cacheload.
     // _inputs[1]->add_token(); 
@@ -41,8 +41,8 @@ std::vector<Ptr<BTensor>> SplitDecoding::get_outputs(std::vector<Ptr<BTensor>> i
 
     uint32_t l = _is_initiated ? 1 : _inputs[0]->get_dims()[0];
     std::vector<uint32_t> output_dim = {nh, l, dk};
-    _outputs[0] =
-        std::make_shared<NPUTensor>(_name + "_output", output_dim, NPUTensorBufType::ACT, false);
+    _outputs[0] = std::make_shared<NPUTensor>(
+        _ctx, _name + "_output", output_dim, NPUTensorBufType::ACT, false);
 
     _outputs[1] = _inputs[1];
     _outputs[2] = _inputs[2];
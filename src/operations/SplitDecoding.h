@@ -5,8 +5,8 @@
 // split input tensor to three
 class SplitDecoding : public Operation {
    public:
-    SplitDecoding(std::string name, std::pair<Ptr<BTensor>, Ptr<BTensor>> kv_cache,
-                  bool is_initiated);
+    SplitDecoding(SimContext *ctx, std::string name,
+                  std::pair<Ptr<BTensor>, Ptr<BTensor>> kv_cache, bool is_initiated);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs);
     void calculate_loops();
@@ -1,7 +1,9 @@
 #include "SplitEncoding.h"
 
 // Not used anymore
-SplitEncoding::SplitEncoding(std::string name) : Operation(name) { _inputs.resize(1); }
+SplitEncoding::SplitEncoding(SimContext *ctx, std::string name) : Operation(ctx, name) {
+    _inputs.resize(1);
+}
 
 /**
  * QKVSplit function called at initialization phase
@@ -19,9 +21,9 @@ std::vector<Ptr<BTensor>> SplitEncoding::get_outputs(std::vector<Ptr<BTensor>> i
     Ptr<NPUTensor> input = std::static_pointer_cast<NPUTensor>(_inputs[0]);
 
     auto input_dim = input->get_dims();
-    auto nh = Config::global_config.model_n_head;
+    auto nh = _config.model_n_head;
     auto l = input_dim[0];
-    auto dk = Config::global_config.model_n_embd / Config::global_config.model_n_head;
+    auto dk = _config.model_n_embd / _config.model_n_head;
     ast((*input_dim.rbegin()) == 3 * nh * dk);
     spdlog::info("SplitEnc input dim : {}", input_dim);
 
@@ -30,12 +32,12 @@ std::vector<Ptr<BTensor>> SplitEncoding::get_outputs(std::vector<Ptr<BTensor>> i
     std::vector<uint32_t> output_dim0 = {nh, l, dk};
     std::vector<uint32_t> output_dim1 = {nh, dk, l};
 
-    _outputs[0] = std::make_shared<NPUTensor>(_name + "_output" + std::to_string(0), output_dim0,
-                                              NPUTensorBufType::ACT, false);
-    _outputs[1] = std::make_shared<NPUTensor>(_name + "_output" + std::to_string(1), output_dim1,
-                                              NPUTensorKVType::KEY, false);
-    _outputs[2] = std::make_shared<NPUTensor>(_name + "_output" + std::to_string(2), output_dim0,
-                                              NPUTensorKVType::VALUE, false);
+    _outputs[0] = std::make_shared<NPUTensor>(
+        _ctx, _name + "_output" + std::to_string(0), output_dim0, NPUTensorBufType::ACT, false);
+    _outputs[1] = std::make_shared<NPUTensor>(
+        _ctx, _name + "_output" + std::to_string(1), output_dim1, NPUTensorKVType::KEY, false);
+    _outputs[2] = std::make_shared<NPUTensor>(
+        _ctx, _name + "_output" + std::to_string(2), output_dim0, NPUTensorKVType::VALUE, false);
 
     spdlog::info("SplitEnc ouput dim 0,2 : {} / output dim 1 : {}", output_dim0, output_dim1);
 
@@ -5,7 +5,7 @@
 // split input tensor to three
 class SplitEncoding : public Operation {
    public:
-    SplitEncoding(std::string name);
+    SplitEncoding(SimContext *ctx, std::string name);
 
     std::vector<Ptr<BTensor>> get_outputs(std::vector<Ptr<BTensor>> inputs);
 
@@ -1,6 +1,10 @@
 #include "Scheduler.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <numeric>
+#include <tuple>
 
 #include "../tensor/NPUTensor.h"
 #include "../tensor/PIMTensor.h"
@@ -17,25 +21,90 @@ Scheduler::Scheduler(SimulationConfig config, const cycle_type* core_cycle)
     _nh = _config.model_n_head / _config.n_tp;
     _dk = _config.model_n_embd / _config.model_n_head;
     _effective_e = _nh * _dk;
+    _nkvh = get_kv_heads_per_device(_config);
+    _kv_e = _nkvh * _dk;
 
     // Memory spec init
     _dram_channels = _config.dram_channels;
     _dram_page_size = _config.dram_page_size / _config.precision;
     _dram_banks_per_ch = _config.dram_banks_per_ch;
 
+    // Heterogeneous cores
+    _heterogeneous_cores = false;
+    for (uint32_t core_id = 1; core_id < _config.num_cores; core_id++) {
+        CoreConfig &core = _config.core_config[core_id];
+        CoreConfig &first = _config.core_config[0];
+        _heterogeneous_cores =
+            _heterogeneous_cores || core.core_type != first.core_type ||
+            core.core_height != first.core_height || core.core_width != first.core_width ||
+            core.systolic_array_count != first.systolic_array_count ||
+            core.vector_core_count != first.vector_core_count ||
+            core.vector_core_width != first.vector_core_width ||
+            core.spad_size != first.spad_size;
+    }
+    _dispatch_index1.assign(_config.num_cores, 0);
+    _out_of_order_dispatches = 0;
+    _core_tile_queues1.resize(_config.num_cores);
+    _stolen_tiles = 0;
+    _concurrent_launches = 0;
+    _max_inflight_seen = 0;
+
     // 1: Systolic Array Program
     // 2: PIM Program
     _model_program1 = nullptr;
     _model_program2 = nullptr;
 
-    _init_stage = Stage::A;
-    // _init_stage = Stage::C;
+    // Sub-batch interleaving schedule
+    _num_sub_batches = _config.num_sub_batches;
+    _breqs.resize(_num_sub_batches);
+    _stage_schedule = _config.stage_schedule;
+    if (_config.lm_head) _stage_schedule.push_back(lm_head_stage());
+    spdlog::info("Sub-batches: {}, stages: {}", _num_sub_batches, _stage_schedule.size());
+    for (auto &entry : _stage_schedule) {
+        if (entry.lm_head) {
+            spdlog::info("Stage {} : LM head + sampling (top-k: {}, on PIM up to {} tokens)",
+                         entry.name, _config.sampling_top_k, _config.lm_head_pim_max_batch);
+            continue;
+        }
+        spdlog::info("Stage {} : SA #{}{}{} / PIM #{}", entry.name, entry.sa_sub_batch + 1,
+                     entry.proj_ffns ? " Pj/FFNs" : "", entry.qkv_gen ? " QKVgen" : "",
+                     entry.pim_sub_batch + 1);
+    }
+    _lm_head_pim_iterations = 0;
+
+    _init_stage = 0;
     _stage = _init_stage;
+    _sa_stage = _init_stage;
+    _pim_stage = _init_stage;
+    _stage_done_cycle = 0;
+    _barrier_stat = BarrierStat{0, 0, 0, 0};
+    _prev_stage = _stage_schedule[_init_stage].name;
     _just_one_stage = false;
 
+    _adaptive_sub_batch = _config.sub_batch_mode && _config.adaptive_sub_batch;
+    _split_schedule = _stage_schedule;
+    _unsplit_schedule = make_stage_schedule(1);
+    if (_config.lm_head) _unsplit_schedule.push_back(lm_head_stage());
+    _iteration = 0;
+    _iteration_first_stage_stat = 0;
+    _split_iterations = 0;
+    _unsplit_iterations = 0;
+
     _has_stage_changed = false;
 
-    _partition_alg_simple = true;
+    _partition_alg = config.partition_alg;
+    _bitset_dp_max_bits = (uint64_t)1 << 27;  // 16MB of reachability bits
+    _partition_stat = PartitionStat{0, 0, 0, 0, 0};
+    _overhead_stat = OverheadStat{0, 0, 0, 0};
+
+    _pipeline_stat = PipelineStat{0, 0, 0, 0, 0};
+    if (is_pp_accounted(_config)) {
+        spdlog::info("Pipeline parallel: {} devices, {} layers per device, {} micro-batches, "
+                     "p2p link {} GB/s, {} ns",
+                     _config.n_pp, get_layers_per_pp_device(_config), _config.pp_micro_batches,
+                     _config.pp_link_bandwidth, _config.pp_link_latency);
+    }
+    spdlog::info("Sub-batch partition algorithm: {}", partitionAlgToString(_partition_alg));
 
     // Request queue for channel
     for (int i = 0; i < _dram_channels; i++) {
@@ -49,9 +118,11 @@ Scheduler::Scheduler(SimulationConfig config, const cycle_type* core_cycle)
     }
 
     // KV allocate by pim tile
-    int model_weight = _config.model_params_b * _config.precision / _config.n_tp;  // GB
-    int memory_capacity = _dram_channels;                                          // GB
-    int available_for_kv = memory_capacity - model_weight;                         // GB
+    // the weights are split over the pipeline devices even if the pipeline is not accounted
+    int model_weight =
+        _config.model_params_b * _config.precision / (_config.n_tp * _config.n_pp);  // GB
+    int memory_capacity = _dram_channels;                                            // GB
+    int available_for_kv = memory_capacity - model_weight;                           // GB
     int pim_tile_size = _config.dram_page_size * _dram_banks_per_ch;               // B
     _total_tiles = floor((double)available_for_kv GB / pim_tile_size);
     _total_available_tiles = _total_tiles;
@@ -70,18 +141,33 @@ Scheduler::Scheduler(SimulationConfig config, const cycle_type* core_cycle)
     _value_period = _dram_page_size;
 
     // how many PIM tiles compose a page.
-    _key_page_size = ceil((double)_effective_e / _value_period);
-    _value_page_size = ceil((double)_effective_e / _key_period);
+    // pages hold the KV heads only, grouped-query attention shrinks them by _nh / _nkvh
+    _key_page_size = ceil((double)_kv_e / _value_period);
+    _value_page_size = ceil((double)_kv_e / _key_period);
 
     spdlog::info("_key_period: {}", _key_period);
     spdlog::info("_key_page_size: {}", _key_page_size);
     spdlog::info("_value_period: {}", _value_period);
     spdlog::info("_value_page_size: {}", _value_page_size);
     spdlog::info("Effective E(_nh * _dk):{}", _nh * _dk);
+    spdlog::info("KV heads: {} (group {}), KV cache per token per layer: {} bytes", _nkvh,
+                 _nh / _nkvh, 2 * _kv_e * _config.precision);
+    if (_config.tp_allreduce && _config.n_tp > 1) {
+        spdlog::info("TP all-reduce: {} devices, {} ({} GB/s, {} ns), {} cycles per token",
+                     _config.n_tp, allReduceAlgToString(_config.tp_allreduce_alg), _config.tp_link_bandwidth,
+                     _config.tp_link_latency,
+                     get_allreduce_cycles(_config,
+                                          (uint64_t)_config.model_n_embd * _config.precision));
+    }
 
     // PIM GEMV latency
     _gwrite_latency = 100;
     _gemv_latency = 184;
+
+    // chunked prefill
+    _prefill_chunk_size = _config.prefill_chunk_size;
+    _ttft_sum = 0;
+    _ttft_count = 0;
 }
 
 void Scheduler::launch(Ptr<Model> model) {
@@ -168,7 +254,8 @@ int Scheduler::allocate_pim_tile(uint32_t seq_len) {
 }
 
 void Scheduler::allocate_requests() {
-    uint32_t batch_size = 0;
+    // running requests stay in the batch, waiting ones are admitted in arrival order
+    uint32_t batch_size = _running_requests.size();
 
     // if (_ch_load_balancing) {
     //     // sort request_queue by sequence length
@@ -179,49 +266,70 @@ void Scheduler::allocate_requests() {
     //                   return compare_by_seqlen(a, b);
     //               });
     // }
-    for (auto it = _request_queue.begin(); it != _request_queue.end(); it++) {
-        if (batch_size == _max_batch_size) break;
-        Ptr<InferRequest> request = *it;
+    for (auto it = _waiting_requests.begin(); it != _waiting_requests.end();) {
+        if (batch_size >= _max_batch_size) break;
+        Ptr<InferRequest> request = _request_table[*it++].request;
         assert(request->output_size > request->generated);
-
-        if (!request->is_initiated) {
-            int ch = request->channel;
-            assert(ch < _dram_channels);
-            spdlog::info("request#{} seq_len:{} channel:{}", request->id, request->input_size,
-                         request->channel);
-            // allocate_pim_tile(request->input_size);
-            if (ch == -1) continue;
-
-            uint32_t seq_len = request->input_size;
-
-            std::vector<uint32_t> dim_key{_nh, _dk, seq_len};
-            std::vector<uint32_t> dim_value{_nh, seq_len, _dk};
-
-            if (_active_reqs >= _max_active_reqs) continue;
-            _active_reqs++;
-            // spdlog::info("Scheduler allocate request#{}(seq_len:{}) to channel {}<<",
-            //              request->id, seq_len, ch);
-            auto k = std::make_shared<PIMTensor>(
-                name_gen(std::to_string(request->id), "KEY", std::to_string(0)), ch, dim_key,
-                PIMTensorKVType::KEY, true);
-            auto v = std::make_shared<PIMTensor>(
-                name_gen(std::to_string(request->id), "VALUE", std::to_string(0)), ch, dim_value,
-                PIMTensorKVType::VALUE, true);
-            request->K_cache.push_back(k);
-            request->V_cache.push_back(v);
-
-            _active_request_queues[ch].push_back(request);
-            uint32_t mha_latency = estimate_mha_latency(request);
-            _active_request_latency_queues[ch].push_back(mha_latency);
-            // todo: when return req, decrease accum latency
-            _active_request_accum_latencys[ch] += mha_latency;
-
-            request->is_initiated = true;
-        }
+        assert(request->K_cache.empty());
+
+        int ch = request->channel;
+        assert(ch < _dram_channels);
+        spdlog::info("request#{} seq_len:{} channel:{}", request->id, request->input_size,
+                     request->channel);
+        // allocate_pim_tile(request->input_size);
+        if (ch == -1) continue;
+
+        uint32_t seq_len = request->input_size;
+
+        std::vector<uint32_t> dim_key{_nkvh, _dk, seq_len};
+        std::vector<uint32_t> dim_value{_nkvh, seq_len, _dk};
+
+        if (_active_reqs >= _max_active_reqs) break;
+        _active_reqs++;
+        move_request(request->id, RequestState::RUNNING);
+        // spdlog::info("Scheduler allocate request#{}(seq_len:{}) to channel {}<<",
+        //              request->id, seq_len, ch);
+        auto k = std::make_shared<PIMTensor>(
+            _model->get_context(), name_gen(std::to_string(request->id), "KEY", std::to_string(0)),
+            ch, dim_key, PIMTensorKVType::KEY, true);
+        auto v = std::make_shared<PIMTensor>(
+            _model->get_context(),
+            name_gen(std::to_string(request->id), "VALUE", std::to_string(0)), ch, dim_value,
+            PIMTensorKVType::VALUE, true);
+        request->K_cache.push_back(k);
+        request->V_cache.push_back(v);
+
+        _active_request_queues[ch].push_back(request);
+        uint32_t mha_latency = estimate_mha_latency(request);
+        _active_request_latency_queues[ch].push_back(mha_latency);
+        // todo: when return req, decrease accum latency
+        _active_request_accum_latencys[ch] += mha_latency;
+
+        // without chunked prefill, the prompt is assumed to be in the KV cache already
+        request->is_initiated = _prefill_chunk_size == 0;
 
         batch_size++;
     }
 
+    if (_prefill_chunk_size > 0) {
+        // >>> chunked prefill: next prompt chunk of every request still in prefill,
+        // MHA latency estimate changes with the chunk
+        for (int ch = 0; ch < _dram_channels; ch++) {
+            auto &req_queue = _active_request_queues[ch];
+            _active_request_accum_latencys[ch] = 0;
+            for (int i = 0; i < req_queue.size(); i++) {
+                Ptr<InferRequest> request = req_queue[i];
+                if (!request->is_initiated) {
+                    request->chunk_size =
+                        MIN(_prefill_chunk_size, request->input_size - request->prefilled);
+                }
+                _active_request_latency_queues[ch][i] = estimate_mha_latency(request);
+                _active_request_accum_latencys[ch] += _active_request_latency_queues[ch][i];
+            }
+        }
+        // <<< chunked prefill
+    }
+
     // >>> load balancing check
     // spdlog::info("---------");
     // int min_latency = 9000000;
@@ -241,39 +349,115 @@ void Scheduler::allocate_requests() {
     // exit(-1);
 }
 
-void Scheduler::make_program() {
-    std::shared_ptr<BatchedRequest> sub_batch_on_sa;
-    std::shared_ptr<BatchedRequest> sub_batch_on_pim;
-    if (static_cast<int>(_stage) % 2 == 0) {
-        sub_batch_on_sa = std::make_shared<BatchedRequest>(_breq1);
-        sub_batch_on_pim = std::make_shared<BatchedRequest>(_breq2);
-    } else {
-        sub_batch_on_sa = std::make_shared<BatchedRequest>(_breq2);
-        sub_batch_on_pim = std::make_shared<BatchedRequest>(_breq1);
+// LM head + sampling after the last layer of every sub-batch
+StageEntry Scheduler::lm_head_stage() {
+    return StageEntry{"LM", -1, false, false, -1, true};
+}
+
+// a request emits a token this iteration unless it is in the middle of its prompt
+bool Scheduler::emits_token(Ptr<InferRequest> request) {
+    return request->is_initiated || request->prefilled + request->chunk_size >= request->input_size;
+}
+
+// The requests the unit works on in the stage. The LM head runs as PIM GEMV when few tokens
+// are sampled, otherwise as GEMM on SA.
+std::vector<Ptr<InferRequest>> Scheduler::stage_requests(StagePlatform platform, uint32_t stage) {
+    const StageEntry &entry = _stage_schedule[stage];
+    std::vector<Ptr<InferRequest>> idle;
+
+    if (entry.lm_head) {
+        std::vector<Ptr<InferRequest>> tokens;
+        for (auto &breq : _breqs) {
+            for (auto &request : breq) {
+                if (emits_token(request)) tokens.push_back(request);
+            }
+        }
+        bool on_pim = _config.run_mode == RunMode::NPU_PIM && !tokens.empty() &&
+                      tokens.size() <= _config.lm_head_pim_max_batch;
+        return on_pim == (platform == StagePlatform::PIM) ? tokens : idle;
     }
 
-    spdlog::info("New Program for SA  (sub-batch.size: {})", sub_batch_on_sa->_reqs.size());
-    spdlog::info("New Program for PIM (sub-batch.size: {})", sub_batch_on_pim->_reqs.size());
+    int sub_batch = platform == StagePlatform::SA ? entry.sa_sub_batch : entry.pim_sub_batch;
+    return sub_batch >= 0 ? _breqs[sub_batch] : idle;
+}
 
-    _model_program1 =
-        std::make_unique<StageProgram>(_model, sub_batch_on_sa, StagePlatform::SA, _stage);
-    _model_program2 =
-        std::make_unique<StageProgram>(_model, sub_batch_on_pim, StagePlatform::PIM, _stage);
+// Stages the other unit must have finished before the unit may start the stage. With stage
+// barriers that is every earlier stage. With relaxed_stage_barriers it is only the earlier
+// stages in which the other unit works on the same sub-batch: the MHA of a sub-batch reads its
+// QKV generation, its Pj/FFNs read its MHA. The LM head stage samples every sub-batch and
+// stays a barrier.
+uint32_t Scheduler::stage_dependency(StagePlatform platform, uint32_t stage) {
+    const StageEntry &entry = _stage_schedule[stage];
+    if (!_config.relaxed_stage_barriers || entry.lm_head) return stage;
+
+    int sub_batch = platform == StagePlatform::SA ? entry.sa_sub_batch : entry.pim_sub_batch;
+    if (sub_batch < 0) return 0;  // idle
+    for (uint32_t prev = stage; prev-- > 0;) {
+        const StageEntry &other = _stage_schedule[prev];
+        int other_sub_batch =
+            platform == StagePlatform::SA ? other.pim_sub_batch : other.sa_sub_batch;
+        if (other.lm_head || other_sub_batch == sub_batch) return prev + 1;
+    }
+    return 0;
+}
 
+bool Scheduler::stage_ready(StagePlatform platform) {
+    uint32_t stage = platform == StagePlatform::SA ? _sa_stage : _pim_stage;
+    uint32_t other_finished = platform == StagePlatform::SA ? _pim_stage : _sa_stage;
+    if (stage >= _stage_schedule.size()) return false;
+    return other_finished >= stage_dependency(platform, stage);
+}
+
+void Scheduler::make_program1() {
+    const StageEntry &entry = _stage_schedule[_sa_stage];
+    auto sub_batch_on_sa =
+        std::make_shared<BatchedRequest>(stage_requests(StagePlatform::SA, _sa_stage));
+    spdlog::info("New Program for SA  (stage {}, sub-batch.size: {})", entry.name,
+                 sub_batch_on_sa->_reqs.size());
+
+    _sa_cycles[_sa_stage] = UnitCycles{*_core_cycle, *_core_cycle};
+    _model_program1 =
+        std::make_unique<StageProgram>(_model, sub_batch_on_sa, StagePlatform::SA, entry);
     refresh_status1();
+}
+
+void Scheduler::make_program2() {
+    const StageEntry &entry = _stage_schedule[_pim_stage];
+    auto sub_batch_on_pim =
+        std::make_shared<BatchedRequest>(stage_requests(StagePlatform::PIM, _pim_stage));
+    spdlog::info("New Program for PIM (stage {}, sub-batch.size: {})", entry.name,
+                 sub_batch_on_pim->_reqs.size());
+    if (entry.lm_head && !sub_batch_on_pim->_reqs.empty()) _lm_head_pim_iterations++;
+
+    _pim_cycles[_pim_stage] = UnitCycles{*_core_cycle, *_core_cycle};
+    _model_program2 =
+        std::make_unique<StageProgram>(_model, sub_batch_on_pim, StagePlatform::PIM, entry);
     refresh_status2();
 }
 
 int Scheduler::estimate_mha_latency(Ptr<InferRequest> request) {
-    // calculate MHA latency with sequence length
+    if (request->is_initiated || _prefill_chunk_size == 0)
+        return estimate_mha_latency(request->input_size);
+
+    // prefill chunk: NPU attention does not use PIM, PIM attention runs one GEMV per query
+    // over the causal prefix of the prompt up to and including that query
+    if (_config.prefill_attention == PrefillAttention::NPU) return 0;
+    int latency = 0;
+    for (uint32_t qi = 0; qi < request->chunk_size; qi++)
+        latency += estimate_mha_latency(request->prefilled + qi + 1);
+    return latency;
+}
+
+// PIM MHA latency of one query over seq_len cached keys and values
+int Scheduler::estimate_mha_latency(uint32_t seq_len) {
     int latency = 0;
-    int seq_len = request->input_size;
 
-    // key * query
-    int chunks = ceil((double)_effective_e / _dram_page_size);
+    // key * query, the query heads of a group share the GWRITE of their KV head and all
+    // compute against its key rows
+    int chunks = ceil((double)_kv_e / _dram_page_size);
     int tiles = ceil((double)seq_len / _dram_banks_per_ch);
     latency += chunks * _gwrite_latency;
-    latency += chunks * tiles * _gemv_latency;
+    latency += chunks * tiles * _gemv_latency * (_nh / _nkvh);
 
     // logit * value
     chunks = ceil((double)seq_len / _dram_page_size) * _nh;
@@ -284,6 +468,124 @@ int Scheduler::estimate_mha_latency(Ptr<InferRequest> request) {
     return latency;
 }
 
+// Analytical latency of an (M x K) x (K x N) MatMul on the systolic arrays.
+// Weight tiles of core_height x core_width are spread over the cores, each costs
+// core_height + core_width - 2 + M cycles (same as NeuPIMSystolicWS). On output-stationary
+// cores the output tiles are spread instead, each costs K plus the skew and drain of its rows
+// and columns (same as NeuPIMSystolicOS). The whole MatMul can not be faster than streaming its
+// weights from DRAM.
+uint64_t Scheduler::estimate_matmul_latency(uint32_t M, uint32_t K, uint32_t N) {
+    uint32_t height = _config.core_config[0].core_height;
+    uint32_t width = _config.core_config[0].core_width;
+
+    uint64_t compute_latency;
+    if (_config.core_config[0].core_type == CoreType::SYSTOLIC_OS) {
+        uint64_t tiles = (uint64_t)ceil((double)M / height) * ceil((double)N / width);
+        uint64_t tiles_per_core = ceil((double)tiles / _config.num_cores);
+        uint32_t rows = MIN(M, height);
+        compute_latency = tiles_per_core * (rows + MIN(N, width) - 2 + MAX(K, 4) + rows);
+    } else {
+        uint64_t tiles = (uint64_t)ceil((double)K / height) * ceil((double)N / width);
+        uint64_t tiles_per_core = ceil((double)tiles / _config.num_cores);
+        compute_latency = tiles_per_core * (height + width - 2 + MAX(M, 4));
+    }
+
+    // one dram_req_size burst per channel per DRAM cycle
+    double bytes_per_core_cycle = (double)_config.dram_channels * _config.dram_req_size *
+                                  _config.dram_freq / _config.core_freq;
+    uint64_t weight_bytes = (uint64_t)K * N * _config.precision;
+    uint64_t load_latency = ceil(weight_bytes / bytes_per_core_cycle);
+
+    return MAX(compute_latency, load_latency);
+}
+
+uint64_t Scheduler::estimate_sa_latency(uint32_t num_rows, bool proj_ffns, bool qkv_gen) {
+    if (num_rows == 0) return 0;
+    uint32_t E = _config.model_n_embd;
+    uint32_t tp = _config.n_tp;
+
+    uint64_t latency = 0;
+    if (proj_ffns) {
+        latency += estimate_matmul_latency(num_rows, E / tp, E);      // projection
+        latency += estimate_matmul_latency(num_rows, E, 4 * E / tp);  // fc1
+        latency += estimate_matmul_latency(num_rows, 4 * E / tp, E);  // fc2
+        latency +=
+            2 * get_allreduce_cycles(_config, (uint64_t)num_rows * E * _config.precision);
+    }
+    if (qkv_gen) {
+        latency += estimate_matmul_latency(num_rows, E, _effective_e + 2 * _kv_e);
+    }
+    return latency;
+}
+
+// Estimated latency of one steady-state layer under a stage schedule. A stage takes as long
+// as the slower of SA and PIM. Steady-state stages are the ones whose SA runs
+// Pj/FFNs + QKVgen; a schedule without them (1 sub-batch) counts all of its stages.
+uint64_t Scheduler::estimate_layer_latency(const std::vector<StageEntry> &schedule,
+                                           std::vector<uint32_t> sb_rows,
+                                           std::vector<uint64_t> sb_mha_latencies) {
+    bool has_steady = false;
+    for (auto &entry : schedule) has_steady = has_steady || (entry.proj_ffns && entry.qkv_gen);
+
+    uint64_t latency = 0;
+    for (auto &entry : schedule) {
+        if (has_steady && !(entry.proj_ffns && entry.qkv_gen)) continue;
+        uint64_t sa_latency = 0;
+        uint64_t pim_latency = 0;
+        if (entry.sa_sub_batch >= 0)
+            sa_latency =
+                estimate_sa_latency(sb_rows[entry.sa_sub_batch], entry.proj_ffns, entry.qkv_gen);
+        if (entry.pim_sub_batch >= 0) pim_latency = sb_mha_latencies[entry.pim_sub_batch];
+        latency += MAX(sa_latency, pim_latency);
+    }
+    return latency;
+}
+
+// Called once per iteration after the sub-batches are grouped.
+// sb_mha_latencies[i]: estimated MHA latency of sub-batch i (slowest channel)
+void Scheduler::decide_sub_batch_split(std::vector<uint64_t> sb_mha_latencies) {
+    _iteration++;
+
+    std::vector<uint32_t> sb_rows;
+    uint32_t total_rows = 0;
+    for (auto &breq : _breqs) {
+        uint32_t rows = BatchedRequest(breq).get_num_rows();
+        sb_rows.push_back(rows);
+        total_rows += rows;
+    }
+
+    // unsplit: every channel runs all of its requests back to back
+    uint64_t unsplit_mha_latency = 0;
+    for (int ch = 0; ch < _dram_channels; ch++) {
+        uint64_t channel_latency = 0;
+        for (auto latency : _active_request_latency_queues[ch]) channel_latency += latency;
+        unsplit_mha_latency = MAX(unsplit_mha_latency, channel_latency);
+    }
+
+    uint64_t split_latency = estimate_layer_latency(_split_schedule, sb_rows, sb_mha_latencies);
+    uint64_t unsplit_latency =
+        estimate_layer_latency(_unsplit_schedule, {total_rows}, {unsplit_mha_latency});
+    bool split = split_latency <= unsplit_latency;
+
+    std::string blue = "\033[1;34m";
+    std::string reset = "\033[0m";
+    spdlog::info("{}Iteration {} (batch {}): split {} cycles/layer, unsplit {} cycles/layer -> {}{}",
+                 blue, _iteration, total_rows, split_latency, unsplit_latency,
+                 split ? "split" : "unsplit", reset);
+
+    if (split) {
+        _split_iterations++;
+        _stage_schedule = _split_schedule;
+    } else {
+        _unsplit_iterations++;
+        _stage_schedule = _unsplit_schedule;
+        for (uint32_t sb = 1; sb < _num_sub_batches; sb++) {
+            _breqs[0].insert(_breqs[0].end(), _breqs[sb].begin(), _breqs[sb].end());
+            _breqs[sb].clear();
+        }
+    }
+}
+
 void Scheduler::group_sub_batches() {
     if (!_config.sub_batch_mode) {
         //>>>
@@ -292,77 +594,133 @@ void Scheduler::group_sub_batches() {
             auto req_queue = _active_request_queues[ch];
             for (auto it = req_queue.begin(); it != req_queue.end(); it++) {
                 Ptr<InferRequest> request = *it;
-                _breq1.push_back(request);
+                _breqs[0].push_back(request);
             }
         }
         return;
         //<<<
     }
 
-    bool ceil_turn = true;
-    for (int ch = 0; ch < _dram_channels; ch++) {
-        auto req_queue = _active_request_queues[ch];
-        auto latency_queue = _active_request_latency_queues[ch];
-        assert(req_queue.size() == latency_queue.size());
-
-        if (_partition_alg_simple) {
-            size_t sb1_size = req_queue.size() / 2;
-
-            if (req_queue.size() % 2 != 0) {
-                if (ceil_turn)
-                    sb1_size = ceil((double)req_queue.size() / 2);
-                else
-                    sb1_size = floor((double)req_queue.size() / 2);
-
-                ceil_turn = !ceil_turn;
-            }
-
-            for (int i = 0; i < req_queue.size(); i++) {
-                Ptr<InferRequest> request = req_queue[i];
-                if (i < sb1_size)
-                    _breq1.push_back(request);
-                else
-                    _breq2.push_back(request);
+    bool has_request = false;
+    for (auto &req_queue : _active_request_queues) has_request = has_request || !req_queue.empty();
+    if (!has_request) return;
+
+    auto start_time = std::chrono::steady_clock::now();
+    // sb_latencies[sub-batch][channel]: MHA latency of the sub-batch in the channel
+    std::vector<std::vector<uint64_t>> sb_latencies(_num_sub_batches,
+                                                    std::vector<uint64_t>(_dram_channels, 0));
+
+    uint32_t next_larger = 0;  // sub-batch that takes the next remainder request
+    if (_partition_alg == PartitionAlg::CHANNEL_GREEDY) {
+        // one greedy over all channels, the partitioners below see a single channel each
+        std::vector<uint32_t> sb_sizes;
+        for (auto &breq : _breqs) sb_sizes.push_back(breq.size());
+        auto assignment =
+            partition_channel_greedy(_active_request_latency_queues, sb_sizes, sb_latencies);
+        for (int ch = 0; ch < _dram_channels; ch++) {
+            for (uint32_t i = 0; i < assignment[ch].size(); i++)
+                _breqs[assignment[ch][i]].push_back(_active_request_queues[ch][i]);
+        }
+    } else {
+        for (int ch = 0; ch < _dram_channels; ch++) {
+            auto req_queue = _active_request_queues[ch];
+            auto latency_queue = _active_request_latency_queues[ch];
+            assert(req_queue.size() == latency_queue.size());
+
+            std::vector<std::vector<int>> index_lists(_num_sub_batches);
+            if (_partition_alg == PartitionAlg::SIMPLE) {
+                // split in order, remainder requests rotate over sub-batches
+                uint32_t base = req_queue.size() / _num_sub_batches;
+                uint32_t remainder = req_queue.size() % _num_sub_batches;
+                std::vector<uint32_t> sizes(_num_sub_batches, base);
+                for (uint32_t i = 0; i < remainder; i++) {
+                    sizes[(next_larger + i) % _num_sub_batches]++;
+                }
+                next_larger = (next_larger + remainder) % _num_sub_batches;
+                int idx = 0;
+                for (uint32_t sb = 0; sb < _num_sub_batches; sb++) {
+                    for (uint32_t i = 0; i < sizes[sb]; i++) {
+                        index_lists[sb].push_back(idx++);
+                    }
+                }
+            } else if (_num_sub_batches == 2) {
+                std::pair<std::vector<int>, std::vector<int>> two_lists;
+                switch (_partition_alg) {
+                    case PartitionAlg::DP:
+                        two_lists = partition_lists_dp(latency_queue);
+                        break;
+                    case PartitionAlg::BITSET_DP:
+                        two_lists = partition_lists_bitset_dp(latency_queue);
+                        break;
+                    case PartitionAlg::KARMARKAR_KARP:
+                        two_lists = partition_lists_karmarkar_karp(latency_queue);
+                        break;
+                    default:
+                        assert(0);
+                }
+                index_lists[0] = two_lists.first;
+                index_lists[1] = two_lists.second;
+            } else {
+                // 2-way partitioners do not generalize, balance K sub-batches greedily
+                std::vector<uint32_t> sb_sizes;
+                for (auto &breq : _breqs) sb_sizes.push_back(breq.size());
+                index_lists = partition_lists_multiway(latency_queue, sb_sizes);
             }
 
-        } else {
-            auto index_lists = partition_lists_dp(latency_queue);
-            std::vector<int> list1 = index_lists.first;
-            std::vector<int> list2 = index_lists.second;
-
-            int sum_list1_latencies = 0;
-            int sum_list2_latencies = 0;
-            std::string list1_str = "";
-            std::string list2_str = "";
-            std::string time1_str = "";
-            std::string time2_str = "";
-            for (auto it = list1.begin(); it != list1.end(); it++) {
-                int req_id = *it;
-                Ptr<InferRequest> request = req_queue[req_id];
-                sum_list1_latencies += latency_queue[req_id];
-                _breq1.push_back(request);
-                list1_str += std::to_string(req_id) + ", ";
-                time1_str += std::to_string(latency_queue[req_id]) + ", ";
-            }
-            for (auto it = list2.begin(); it != list2.end(); it++) {
-                int req_id = *it;
-                Ptr<InferRequest> request = req_queue[req_id];
-                sum_list2_latencies += latency_queue[req_id];
-                _breq2.push_back(request);
-                list2_str += std::to_string(req_id) + ", ";
-                time2_str += std::to_string(latency_queue[req_id]) + ", ";
+            for (uint32_t sb = 0; sb < _num_sub_batches; sb++) {
+                for (int req_id : index_lists[sb]) {
+                    _breqs[sb].push_back(req_queue[req_id]);
+                    sb_latencies[sb][ch] += latency_queue[req_id];
+                }
             }
-            // spdlog::info("====Channel {}====", ch);
-            // spdlog::info("#1 sum:{:2d}, idx:[{}], time:[{}]", sum_list1_latencies, list1_str,
-            //              time1_str);
-            // spdlog::info("#2 sum:{:2d}, idx:[{}], time:[{}]", sum_list2_latencies, list2_str,
-            //              time2_str);
-            // spdlog::info("req_q.size:{}, latency_q.size:{}", req_queue.size(),
-            // latency_queue.size());
         }
     }
 
-    spdlog::info("total batch_size: {}", _breq1.size() + _breq2.size());
+    // >>> partition stat
+    // imbalance: the slowest sub-batch of each channel decides when the PIM stage ends there
+    double runtime_us = std::chrono::duration<double, std::micro>(
+                            std::chrono::steady_clock::now() - start_time)
+                            .count();
+    uint64_t max_imbalance = 0;
+    for (int ch = 0; ch < _dram_channels; ch++) {
+        uint64_t max_latency = 0;
+        uint64_t min_latency = UINT64_MAX;
+        for (uint32_t sb = 0; sb < _num_sub_batches; sb++) {
+            max_latency = MAX(max_latency, sb_latencies[sb][ch]);
+            min_latency = MIN(min_latency, sb_latencies[sb][ch]);
+        }
+        max_imbalance = MAX(max_imbalance, max_latency - min_latency);
+    }
+    std::vector<uint64_t> sb_stage_latencies(_num_sub_batches, 0);
+    std::string stage_latency_str = "";
+    std::string size_str = "";
+    for (uint32_t sb = 0; sb < _num_sub_batches; sb++) {
+        for (int ch = 0; ch < _dram_channels; ch++) {
+            sb_stage_latencies[sb] = MAX(sb_stage_latencies[sb], sb_latencies[sb][ch]);
+        }
+        stage_latency_str += fmt::format("MHA#{} {} ", sb + 1, sb_stage_latencies[sb]);
+        size_str += fmt::format("{} ", _breqs[sb].size());
+    }
+    uint64_t stage_gap = *std::max_element(sb_stage_latencies.begin(), sb_stage_latencies.end()) -
+                         *std::min_element(sb_stage_latencies.begin(), sb_stage_latencies.end());
+
+    _partition_stat.calls++;
+    _partition_stat.total_runtime_us += runtime_us;
+    _partition_stat.max_runtime_us = MAX(_partition_stat.max_runtime_us, runtime_us);
+    _partition_stat.total_imbalance += max_imbalance;
+    _partition_stat.total_stage_gap += stage_gap;
+
+    spdlog::info("Sub-batch partition ({}): runtime {:.1f} us, max channel imbalance {} cycles",
+                 partitionAlgToString(_partition_alg), runtime_us, max_imbalance);
+    spdlog::info("Sub-batch partition ({}): {}cycles (sizes {})",
+                 partitionAlgToString(_partition_alg), stage_latency_str, size_str);
+    // <<< partition stat
+
+    if (_adaptive_sub_batch) decide_sub_batch_split(sb_stage_latencies);
+
+    uint32_t total_batch_size = 0;
+    for (auto &breq : _breqs) total_batch_size += breq.size();
+    spdlog::info("total batch_size: {}", total_batch_size);
 }
 
 // Called exactly once
@@ -373,71 +731,127 @@ void Scheduler::init_batches() {
 
 void Scheduler::cycle() {
     bool step_next_stage = _model_program1 == nullptr && _model_program2 == nullptr;
+    bool iteration_start = _sa_stage == _init_stage && _pim_stage == _init_stage;
 
-    if (step_next_stage && _stage == _init_stage && !_request_queue.empty()) {
+    if (step_next_stage && iteration_start && count_requests() > 0) {
+        auto start_time = std::chrono::steady_clock::now();
         init_batches();
+        _sa_cycles.assign(_stage_schedule.size(), UnitCycles{0, 0});
+        _pim_cycles.assign(_stage_schedule.size(), UnitCycles{0, 0});
+        _overhead_stat.iteration_us += std::chrono::duration<double, std::micro>(
+                                           std::chrono::steady_clock::now() - start_time)
+                                           .count();
         // exit(-1);
     }
 
     _cycles++;
 
-    if (_config.sub_batch_mode) {
-        bool lets_make_program1 = _model_program1 == nullptr && _breq1.size() > 0;
-        bool lets_make_program2 = _model_program2 == nullptr && _breq2.size() > 0;
-
-        if (lets_make_program1 && lets_make_program2) {
-            if (_stage == Stage::Finish) {
-                cleanup_sub_batch(_breq1);
-                cleanup_sub_batch(_breq2);
-                _breq1.clear();
-                _breq2.clear();
-                return;
-            } else {
-                std::string red = "\033[1;31m";
-                std::string reset = "\033[0m";
-                spdlog::info("{}----------Stage {}----------{}", red, stageToString(_stage), reset);
-                make_program();
-            }
+    bool exist_request = false;
+    for (auto &breq : _breqs) exist_request = exist_request || breq.size() > 0;
+
+    if (!exist_request) return;
+
+    if (step_next_stage && is_finish_stage()) {
+        if (is_pp_accounted(_config)) account_pipeline_iteration();
+        auto start_time = std::chrono::steady_clock::now();
+        for (auto &breq : _breqs) {
+            cleanup_sub_batch(breq);
+            breq.clear();
         }
-    } else {
-        bool both_program_none = _model_program1 == nullptr && _model_program2 == nullptr;
-        bool exist_request = _breq2.size() > 0 || _breq1.size() > 0;
-        if (both_program_none && exist_request) {
-            if (_stage == Stage::Finish) {
-                cleanup_sub_batch(_breq1);
-                cleanup_sub_batch(_breq2);
-                _breq1.clear();
-                _breq2.clear();
-                return;
-            } else {
-                std::string red = "\033[1;31m";
-                std::string reset = "\033[0m";
-                spdlog::info("{}----------Stage {}----------{}", red, stageToString(_stage), reset);
-                make_program();
-            }
+        _overhead_stat.iteration_us += std::chrono::duration<double, std::micro>(
+                                           std::chrono::steady_clock::now() - start_time)
+                                           .count();
+        _overhead_stat.iterations++;
+        _overhead_stat.total_us += _overhead_stat.iteration_us;
+        _overhead_stat.max_us = MAX(_overhead_stat.max_us, _overhead_stat.iteration_us);
+        _overhead_stat.iteration_us = 0;
+        // next iteration for the requests still generating
+        _stage = _init_stage;
+        _sa_stage = _init_stage;
+        _pim_stage = _init_stage;
+        return;
+    }
+
+    if (_model_program1 == nullptr && stage_ready(StagePlatform::SA)) {
+        if (_pim_stage < _sa_stage || (_pim_stage == _sa_stage && _model_program2 == nullptr)) {
+            std::string red = "\033[1;31m";
+            std::string reset = "\033[0m";
+            spdlog::info("{}----------Stage {}----------{}", red,
+                         _stage_schedule[_sa_stage].name, reset);
+        }
+        make_program1();
+    }
+    if (_model_program2 == nullptr && stage_ready(StagePlatform::PIM)) {
+        if (_sa_stage < _pim_stage || (_sa_stage == _pim_stage && _model_program1 == nullptr)) {
+            std::string red = "\033[1;31m";
+            std::string reset = "\033[0m";
+            spdlog::info("{}----------Stage {}----------{}", red,
+                         _stage_schedule[_pim_stage].name, reset);
         }
+        make_program2();
     }
+
+    // a unit without a program while stages are left waits for the other unit
+    if (_model_program1 == nullptr && _sa_stage < _stage_schedule.size())
+        _barrier_stat.sa_wait_cycles++;
+    if (_model_program2 == nullptr && _pim_stage < _stage_schedule.size())
+        _barrier_stat.pim_wait_cycles++;
 }
 
 void Scheduler::add_request(std::shared_ptr<InferRequest> request) {
-    _request_queue.push_back(request);
+    assert(_request_table.find(request->id) == _request_table.end());
+    request->scheduled_cycle = *_core_cycle;
+    auto pos = _waiting_requests.insert(_waiting_requests.end(), request->id);
+    _request_table[request->id] = RequestEntry{request, RequestState::WAITING, pos};
 }
 
-bool Scheduler::has_completed_request() { return !_completed_request_queue.empty(); }
+int64_t Scheduler::get_kv_headroom() {
+    auto &alloc = _model->get_context()->kv_cache_alloc;
+    int64_t headroom = alloc.get_free_pages();
+    for (uint32_t id : _waiting_requests)
+        headroom -= alloc.get_pages(_request_table[id].request->input_size);
+    return headroom;
+}
+
+bool Scheduler::has_completed_request() { return !_finished_requests.empty(); }
 
 std::shared_ptr<InferRequest> Scheduler::pop_completed_request() {
     // spdlog::info("Scheduler::pop_completed_request()");
-    auto completed_req = _completed_request_queue.front();
-    _completed_request_queue.pop();
+    uint32_t id = _finished_requests.front();
+    auto completed_req = _request_table[id].request;
+    _finished_requests.pop_front();
+    _request_table.erase(id);
     return completed_req;
 }
 
+std::list<uint32_t> &Scheduler::request_list(RequestState state) {
+    switch (state) {
+        case RequestState::WAITING:
+            return _waiting_requests;
+        case RequestState::RUNNING:
+            return _running_requests;
+        case RequestState::FINISHED:
+            return _finished_requests;
+    }
+    assert(0);
+    return _waiting_requests;
+}
+
+// Relinks the request at the end of the list of the new state, its list node is kept.
+void Scheduler::move_request(uint32_t id, RequestState state) {
+    RequestEntry &entry = _request_table[id];
+    request_list(state).splice(request_list(state).end(), request_list(entry.state), entry.pos);
+    entry.state = state;
+}
+
 Tile& Scheduler::top_tile1(uint32_t core_id) {
     static Tile empty_tile = Tile{.status = Tile::Status::EMPTY};
-    if (_executable_tile_queue1.empty()) {
+    std::deque<Tile>& queue = tile_queue1(core_id);
+    if (_config.per_core_tile_queues && queue.empty()) steal_tile1(core_id);
+    if (queue.empty() || !select_tile1(core_id)) {
         return empty_tile;
     } else {
-        Tile& tile = _executable_tile_queue1.front();
+        Tile& tile = queue[_dispatch_index1[core_id]];
         if (tile.status == Tile::Status::BAR) {
             return empty_tile;
         } else {
@@ -462,25 +876,175 @@ Tile& Scheduler::top_tile2(uint32_t core_id) {
     }
 }
 
+// Tiles up to the next barrier are independent. With heterogeneous cores a core picks, among
+// the first of them, the one with the lowest ratio of its estimated cycles to the fastest
+// core's (earliest on ties): every core keeps taking work, but each tile shape goes to the
+// cores it runs comparatively fastest on. False if none of them fits the core's scratchpad.
+bool Scheduler::select_tile1(uint32_t core_id) {
+    const uint32_t dispatch_window = 16;
+    _dispatch_index1[core_id] = 0;
+    if (!_heterogeneous_cores) return true;
+
+    bool found = false;
+    double best_ratio = 0;
+    std::deque<Tile>& queue = tile_queue1(core_id);
+    uint32_t window = MIN(dispatch_window, (uint32_t)queue.size());
+    for (uint32_t index = 0; index < window; index++) {
+        Tile& tile = queue[index];
+        if (tile.status == Tile::Status::BAR) {
+            // the barrier itself is handed out in order
+            if (index == 0) return true;
+            break;
+        }
+        if (tile.estimated_cycles.empty()) {
+            for (uint32_t core = 0; core < _config.num_cores; core++)
+                tile.estimated_cycles.push_back(estimate_tile_cycles(core, tile));
+        }
+        uint64_t cycles = tile.estimated_cycles[core_id];
+        if (cycles == UINT64_MAX) continue;
+        uint64_t fastest =
+            *std::min_element(tile.estimated_cycles.begin(), tile.estimated_cycles.end());
+        double ratio = (double)cycles / MAX(fastest, (uint64_t)1);
+        if (!found || ratio < best_ratio) {
+            found = true;
+            best_ratio = ratio;
+            _dispatch_index1[core_id] = index;
+        }
+    }
+    return found;
+}
+
+// Compute cycles of a tile on a core, the cost model of the heterogeneous core dispatcher.
+// GEMMs stream as in NeuPIMSystolicWS / NeuPIMSystolicOS (several passes when the tile was
+// sized for a larger array), spread over the core's systolic arrays, plus one pipeline fill;
+// vector instructions take size / vector_core_width iterations spread over the vector units.
+// Loads and stores cost the same on every core and are left out. UINT64_MAX if the operands
+// do not fit the core's scratchpad.
+uint64_t Scheduler::estimate_tile_cycles(uint32_t core_id, Tile& tile) {
+    CoreConfig& core = _config.core_config[core_id];
+    bool output_stationary = core.core_type == CoreType::SYSTOLIC_OS;
+    uint64_t spad_bytes = 0;
+    uint64_t gemm_cycles = 0;
+    uint64_t vector_cycles = 0;
+    bool preload = false;
+    for (auto& inst : tile.instructions) {
+        if (inst.opcode == Opcode::MOVIN && inst.dest_addr < ACCUM_SPAD_BASE) {
+            spad_bytes += inst.size;
+        } else if (inst.opcode == Opcode::GEMM || inst.opcode == Opcode::GEMM_PRELOAD) {
+            uint32_t rows = output_stationary ? inst.tile_m : inst.tile_k;
+            uint64_t passes = ((MAX(rows, 1) + core.core_height - 1) / core.core_height) *
+                              ((MAX(inst.tile_n, 1) + core.core_width - 1) / core.core_width);
+            uint32_t stream = output_stationary ? (inst.tile_k ? inst.tile_k : core.core_height)
+                                                : inst.size;
+            gemm_cycles += MAX(stream, 4) * passes;
+            preload = preload || (inst.opcode == Opcode::GEMM_PRELOAD && !output_stationary);
+        } else if (inst.opcode != Opcode::MOVOUT && inst.opcode != Opcode::MOVOUT_POOL &&
+                   inst.opcode != Opcode::MOVIN) {
+            vector_cycles += (inst.size + core.vector_core_width - 1) / core.vector_core_width;
+        }
+    }
+    if (spad_bytes > core.spad_size KB / 2) return UINT64_MAX;
+
+    uint64_t cycles = vector_cycles / MAX(core.vector_core_count, 1);
+    if (gemm_cycles > 0) {
+        cycles += gemm_cycles / core.systolic_array_count + core.core_height + core.core_width - 2;
+        if (preload) cycles += 2 * core.core_height - 1;
+    }
+    return cycles;
+}
+
+std::deque<Tile>& Scheduler::tile_queue1(uint32_t core_id) {
+    return _config.per_core_tile_queues ? _core_tile_queues1[core_id] : _executable_tile_queue1;
+}
+
+// Tiles sharing a weight tile (same batch, K and N, e.g. a MatMul's M tiles) go to one core.
+// Each group goes, in order of appearance, to the core with the least queued work: estimated
+// cycles when the cores differ, tiles otherwise.
+void Scheduler::distribute_tiles1() {
+    std::map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t> group_cores;
+    // tiles of operations started earlier may still be queued
+    std::vector<uint64_t> queued_work(_config.num_cores, 0);
+    for (uint32_t core = 0; core < _config.num_cores; core++) {
+        if (!_heterogeneous_cores) {
+            queued_work[core] = _core_tile_queues1[core].size();
+            continue;
+        }
+        for (auto& tile : _core_tile_queues1[core]) {
+            if (tile.estimated_cycles[core] != UINT64_MAX)
+                queued_work[core] += tile.estimated_cycles[core];
+        }
+    }
+    for (auto& tile : _executable_tile_queue1) {
+        if (_heterogeneous_cores && tile.estimated_cycles.empty()) {
+            for (uint32_t core = 0; core < _config.num_cores; core++)
+                tile.estimated_cycles.push_back(estimate_tile_cycles(core, tile));
+        }
+        auto work = [&](uint32_t core) -> uint64_t {
+            return _heterogeneous_cores ? tile.estimated_cycles[core] : 1;
+        };
+        auto group = std::make_tuple(tile.batch, tile.K, tile.N);
+        if (group_cores.find(group) == group_cores.end()) {
+            uint32_t home = 0;
+            for (uint32_t core = 1; core < _config.num_cores; core++) {
+                if (work(core) == UINT64_MAX) continue;
+                if (work(home) == UINT64_MAX ||
+                    queued_work[core] + work(core) < queued_work[home] + work(home))
+                    home = core;
+            }
+            group_cores[group] = home;
+        }
+        uint32_t home = group_cores[group];
+        if (work(home) != UINT64_MAX) queued_work[home] += work(home);
+        _core_tile_queues1[home].push_back(std::move(tile));
+    }
+    _executable_tile_queue1.clear();
+}
+
+// A core without queued tiles takes the last tile of the core with the most queued tiles. The
+// victim keeps its next tile, otherwise two idle cores would pass a single tile back and forth.
+bool Scheduler::steal_tile1(uint32_t core_id) {
+    uint32_t victim = core_id;
+    for (uint32_t core = 0; core < _config.num_cores; core++) {
+        if (_core_tile_queues1[core].size() > _core_tile_queues1[victim].size()) victim = core;
+    }
+    if (_core_tile_queues1[victim].size() < 2) return false;
+    Tile& tile = _core_tile_queues1[victim].back();
+    if (!tile.estimated_cycles.empty() && tile.estimated_cycles[core_id] == UINT64_MAX)
+        return false;  // does not fit this core's scratchpad
+    _core_tile_queues1[core_id].push_back(std::move(tile));
+    _core_tile_queues1[victim].pop_back();
+    _stolen_tiles++;
+    return true;
+}
+
+bool Scheduler::sa_operation_running() {
+    for (uint32_t id : _inflight_operations1) {
+        if (_active_operation_stats.find(id) != _active_operation_stats.end()) return true;
+    }
+    return false;
+}
+
 // ??: Add base address for each addr in tiles / XXX: < necessary comment?
 // ??: something wrong with functionality. seems it's not a necessary function
 void Scheduler::get_tile1(uint32_t core_id) {
-    if (_executable_tile_queue1.empty()) {
+    std::deque<Tile>& queue = tile_queue1(core_id);
+    if (queue.empty()) {
         return;
     } else {
-        Tile& tile = _executable_tile_queue1.front();
+        Tile& tile = queue[_dispatch_index1[core_id]];
         if (tile.status == Tile::Status::BAR) {
             RunningOperationStat stat = _finished_operation_stats[tile.operation_id];
             if (stat.launched_tiles + stat.remain_tiles == stat.total_tiles) {
                 /* POP only if all lauched tiles are finished */
-                _executable_tile_queue1.pop_front();
+                queue.pop_front();
                 _finished_operation_stats[tile.operation_id].launched_tiles++;
                 _finished_operation_stats[tile.operation_id].remain_tiles--;
             }
             return;
         } else {
             _active_operation_stats[tile.operation_id].launched_tiles++;
-            _executable_tile_queue1.pop_front();
+            if (_dispatch_index1[core_id] > 0) _out_of_order_dispatches++;
+            queue.erase(queue.begin() + _dispatch_index1[core_id]);
             spdlog::debug("Operation {} Core {} Get Tile at {}", tile.optype, core_id,
                           *_core_cycle);
             return;
@@ -556,7 +1120,7 @@ bool Scheduler::finish_tile(uint32_t core_id, Tile& tile) {
 bool Scheduler::empty1() { return _model_program1 == nullptr; }
 bool Scheduler::empty2() { return _model_program2 == nullptr; }
 
-bool Scheduler::running() { return !_request_queue.empty() || !_completed_request_queue.empty(); }
+bool Scheduler::running() { return !_request_table.empty(); }
 
 void Scheduler::cleanup_sub_batch(std::vector<Ptr<InferRequest>> sub_batch) {
     // < todos when the model program has finished >
@@ -565,61 +1129,144 @@ void Scheduler::cleanup_sub_batch(std::vector<Ptr<InferRequest>> sub_batch) {
     for (auto it = sub_batch.begin(); it != sub_batch.end(); it++) {
         Ptr<InferRequest> request = *it;
 
+        // clear child operations of Key/Value tensor
+        request->K_cache[0]->clear_child_nodes();
+        request->V_cache[0]->clear_child_nodes();
+
         // iteration done -> update request stat in batch
+        if (!request->is_initiated) {
+            request->prefilled += request->chunk_size;
+            request->chunk_size = 0;
+            if (request->prefilled < request->input_size) continue;  // more prompt chunks
+        }
         request->is_initiated = true;
         request->generated++;
 
-        // clear child operations of Key/Value tensor
-        request->K_cache[0]->clear_child_nodes();
-        request->V_cache[0]->clear_child_nodes();
+        if (request->generated == 1) {
+            // TTFT on the scheduler clock, from the cycle the request reached this scheduler
+            request->first_token_cycle = *_core_cycle;
+            _ttft_sum += request->first_token_cycle - request->scheduled_cycle;
+            _ttft_count++;
+            spdlog::info("request#{} first token at {} (TTFT {} cycles)", request->id,
+                         request->first_token_cycle,
+                         request->first_token_cycle - request->scheduled_cycle);
+        }
 
         if (request->output_size == request->generated) {
             assert(request->is_initiated);
             // spdlog::info("Scheduler::return request_id: {}", request->id);
-            _completed_request_queue.push(request);
-
-            // when completed, free KV cache
-            for (auto itr = _request_queue.begin(); itr != _request_queue.end();) {
-                Ptr<InferRequest> cur = *itr;
-                if (cur->id == request->id) {
-                    itr = _request_queue.erase(itr);
-                    _active_reqs--;
-                    // spdlog::info("Scheduler::request {} done!", request->id);
-                } else {
-                    itr++;
+
+            // remove from the channel queue so that later iterations do not batch it
+            auto &req_queue = _active_request_queues[request->channel];
+            auto &latency_queue = _active_request_latency_queues[request->channel];
+            for (int i = 0; i < req_queue.size(); i++) {
+                if (req_queue[i]->id == request->id) {
+                    _active_request_accum_latencys[request->channel] -= latency_queue[i];
+                    req_queue.erase(req_queue.begin() + i);
+                    latency_queue.erase(latency_queue.begin() + i);
+                    break;
                 }
             }
+
+            // when completed, free KV cache and return it to the client
+            move_request(request->id, RequestState::FINISHED);
+            _active_reqs--;
         }
     }
 }
 
+// Pipeline parallelism: the simulated device stands for every pipeline device, each running
+// its layer slice. The iteration is split into M micro-batches (GPipe style), a micro-batch
+// takes 1/M of the device time plus the activation transfer to the next device, and the
+// iteration drains through P devices in (M + P - 1) micro-batch slots. Every device idles
+// for P - 1 of them (bubble). The LM head runs once on the last device. Only the pipeline stat
+// sees this time, request completion and TTFT follow the clock of the simulated device.
+void Scheduler::account_pipeline_iteration() {
+    uint32_t num_rows = 0;
+    for (auto &breq : _breqs) num_rows += BatchedRequest(breq).get_num_rows();
+    if (num_rows == 0) return;
+
+    cycle_type device_cycles = 0;
+    cycle_type lm_head_cycles = 0;
+    for (size_t i = _iteration_first_stage_stat; i < _stage_stats.size(); i++) {
+        auto &stage_stat = _stage_stats[i];
+        auto exec_cycles = stage_stat.done_cycle - stage_stat.start_cycle;
+        if (stage_stat.lm_head)
+            lm_head_cycles += exec_cycles;
+        else
+            device_cycles += exec_cycles * stage_stat.layers;
+    }
+    _iteration_first_stage_stat = _stage_stats.size();
+
+    uint32_t P = _config.n_pp;
+    uint32_t M = MIN(_config.pp_micro_batches, num_rows);
+    uint32_t rows_per_micro_batch = ceil((double)num_rows / M);
+    cycle_type p2p_cycles = get_p2p_cycles(
+        _config, (uint64_t)rows_per_micro_batch * _config.model_n_embd * _config.precision);
+    cycle_type slot_cycles = ceil((double)device_cycles / M) + p2p_cycles;
+
+    _pipeline_stat.iterations++;
+    _pipeline_stat.device_cycles += device_cycles;
+    _pipeline_stat.total_cycles += (M + P - 1) * slot_cycles + lm_head_cycles;
+    _pipeline_stat.bubble_cycles += (P - 1) * slot_cycles;
+    _pipeline_stat.p2p_cycles += M * p2p_cycles;
+}
+
+// A stage is done once both units have finished it. Stages are accounted back to back: a
+// stage starts when its first program starts, but not before the previous stage is done.
 void Scheduler::refresh_stage() {
-    bool stage_done = _model_program1 == nullptr && _model_program2 == nullptr;
-    if (stage_done) {
+    while (_stage < MIN(_sa_stage, _pim_stage) && _stage < _stage_schedule.size()) {
         std::string red = "\033[1;31m";
         std::string reset = "\033[0m";
-        std::string stage_name = stageToString(_stage);
+        const StageEntry &entry = _stage_schedule[_stage];
+        std::string stage_name = entry.name;
         spdlog::info("{}------- Stage {} Done -------{}", red, stage_name, reset);
 
+        // steady stages repeat for the remaining layers (every layer stage if there are none)
+        bool has_steady = false;
+        for (auto &e : _stage_schedule) has_steady = has_steady || (e.proj_ffns && e.qkv_gen);
+        uint32_t layers = 1;
+        if (!entry.lm_head) {
+            if (!has_steady)
+                layers = get_layers_per_pp_device(_config);
+            else if (entry.proj_ffns && entry.qkv_gen)
+                layers = get_layers_per_pp_device(_config) - 1;
+        }
+
+        UnitCycles sa = _sa_cycles[_stage];
+        UnitCycles pim = _pim_cycles[_stage];
+        cycle_type start_cycle = MAX(MIN(sa.start, pim.start), _stage_done_cycle);
+        cycle_type done_cycle = MAX(sa.done, pim.done);
+        if (_config.relaxed_stage_barriers) {
+            cycle_type sa_cycles = sa.done - sa.start;
+            cycle_type pim_cycles = pim.done - pim.start;
+            _barrier_stat.sa_barrier_idle += MAX(sa_cycles, pim_cycles) - sa_cycles;
+            _barrier_stat.pim_barrier_idle += MAX(sa_cycles, pim_cycles) - pim_cycles;
+        }
+
         // Update stat
-        _stage_stats.push_back(std::make_pair(stage_name, _cycles));
+        _stage_stats.push_back(StageStat{.name = stage_name,
+                                         .start_cycle = start_cycle,
+                                         .sa_done_cycle = MAX(sa.done, start_cycle),
+                                         .pim_done_cycle = MAX(pim.done, start_cycle),
+                                         .done_cycle = done_cycle,
+                                         .layers = layers,
+                                         .lm_head = entry.lm_head});
+        _stage_done_cycle = done_cycle;
 
-        _prev_stage = _stage;
+        _prev_stage = stage_name;
 
         // Update stage
-        int stageValue = static_cast<int>(_stage);
-        stageValue++;
-        _stage = static_cast<Stage>(stageValue);
+        _stage++;
 
         _has_stage_changed = true;
 
-        if (!_config.sub_batch_mode) {
-            // >> newton
-            if (_stage == Stage::C) _stage = Stage::E;
-            if (_stage == Stage::F) _stage = Stage::Finish;
-            // << newton
+        if (_just_one_stage) {
+            // force to execute just one stage
+            _stage = _stage_schedule.size();
+            _sa_stage = _stage;
+            _pim_stage = _stage;
         }
-        if (_just_one_stage) _stage = Stage::Finish;  // force to execute just one stage
     }
 }
 
@@ -627,22 +1274,20 @@ void Scheduler::finish_program1() {
     spdlog::info("Model finish at {}", *_core_cycle);
     _model_program1->log();
 
+    _sa_cycles[_sa_stage].done = *_core_cycle;
+    _sa_stage++;
     _model_program1 = nullptr;
     refresh_stage();
-
-    // cleanup_sub_batch(_breq1);
-    // _breq1.clear();
 }
 
 void Scheduler::finish_program2() {
     spdlog::info("Model finish at {}", *_core_cycle);
     _model_program2->log();
 
+    _pim_cycles[_pim_stage].done = *_core_cycle;
+    _pim_stage++;
     _model_program2 = nullptr;
     refresh_stage();
-
-    // cleanup_sub_batch(_breq2);
-    // _breq2.clear();
 }
 
 void Scheduler::refresh_status1() {
@@ -653,41 +1298,10 @@ void Scheduler::refresh_status1() {
         }
     }
     // initiate operation
-    // xxx is count_active_operations() == 0 necessary?
-    if (_model_program1 != nullptr && _executable_tile_queue1.empty()) {
-        // spdlog::info("executable operation count {}",
-        //              _model_program1->get_executable_operations().size());
-        auto op = _model_program1->get_executable_operations().front();
-        spdlog::info("Start operation {}", op->get_name());
-        if (count_active_operations()) {
-            // for (auto& op_stat : _active_operation_stats) {
-            //     spdlog::info("op stat currently in is {}", op_stat.second.name);
-            // }
-            if (_active_operation_stats.find(op->get_id()) != _active_operation_stats.end()) {
-                return;
-            }
-        }
-
-        assert(op->get_tiles().size());
-        _executable_tile_queue1 = op->get_tiles();
-        _active_operation_stats[op->get_id()] = RunningOperationStat{
-            .id = op->get_id(),
-            .name = op->get_name(),
-            // xxx necessary?
-            // .launched = true,
-            .start_cycle = *_core_cycle,
-            .total_tiles = (uint32_t)_executable_tile_queue1.size(),
-            .remain_tiles = (uint32_t)_executable_tile_queue1.size(),
-            .launched_tiles = 0,
-        };
-    } else {
-        // spdlog::info("is model null {} / is executable tile queue empty {} / count active ops
-        // {}",
-        //              _model_program1 == nullptr, _executable_tile_queue1.empty(),
-        //              count_active_operations());
-        // for (auto& op_stat : _active_operation_stats) {
-        //     spdlog::info("op stat currently in is {}", op_stat.second.name);
-        // }
+    if (_model_program1 != nullptr &&
+        launch_operations(_model_program1.get(), _inflight_operations1,
+                          _executable_tile_queue1)) {
+        if (_config.per_core_tile_queues) distribute_tiles1();
     }
 }
 
@@ -699,33 +1313,67 @@ void Scheduler::refresh_status2() {
         }
     }
     // initiate operation
-    // xxx is count_active_operations() == 0 necessary?
-    if (_model_program2 != nullptr && _executable_tile_queue2.empty()
-        //  && count_active_operations() == 0) {
-    ) {
-        // spdlog::info("executable operation count {}",
-        //              _model_program2->get_executable_operations().size());
-        auto op = _model_program2->get_executable_operations().front();
+    if (_model_program2 != nullptr) {
+        launch_operations(_model_program2.get(), _inflight_operations2, _executable_tile_queue2);
+    }
+}
+
+// Starts executable operations while fewer than max_inflight_operations of the program are in
+// flight, appending their tiles to the queue. With one in flight an operation starts only once
+// the previous one has finished. Returns whether any operation started.
+bool Scheduler::launch_operations(StageProgram *program, std::vector<uint32_t> &inflight,
+                                  std::deque<Tile> &queue) {
+    inflight.erase(std::remove_if(inflight.begin(), inflight.end(),
+                                  [this](uint32_t id) {
+                                      return _active_operation_stats.find(id) ==
+                                             _active_operation_stats.end();
+                                  }),
+                   inflight.end());
+
+    bool launched = false;
+    while (inflight.size() < _config.max_inflight_operations) {
+        auto op = next_operation(program, inflight);
+        if (op == nullptr) break;
         spdlog::info("Start operation {}", op->get_name());
-        if (count_active_operations()) {
-            if (_active_operation_stats.find(op->get_id()) != _active_operation_stats.end()) {
-                return;
-            }
-        }
 
-        assert(op->get_tiles().size());
-        _executable_tile_queue2 = op->get_tiles();
+        auto tiles = op->get_tiles();
+        assert(tiles.size());
         _active_operation_stats[op->get_id()] = RunningOperationStat{
             .id = op->get_id(),
             .name = op->get_name(),
             // xxx necessary?
             // .launched = true,
             .start_cycle = *_core_cycle,
-            .total_tiles = (uint32_t)_executable_tile_queue2.size(),
-            .remain_tiles = (uint32_t)_executable_tile_queue2.size(),
+            .total_tiles = (uint32_t)tiles.size(),
+            .remain_tiles = (uint32_t)tiles.size(),
             .launched_tiles = 0,
         };
+        for (auto &tile : tiles) queue.push_back(std::move(tile));
+
+        if (!inflight.empty()) _concurrent_launches++;
+        inflight.push_back(op->get_id());
+        _max_inflight_seen = MAX(_max_inflight_seen, (uint32_t)inflight.size());
+        launched = true;
+    }
+    return launched;
+}
+
+// The executable operation that is not in flight yet and comes first in the program, or with
+// critical_path priority has the most tiles on its longest dependency chain (program order on
+// ties). Null if there is none.
+Ptr<Operation> Scheduler::next_operation(StageProgram *program, std::vector<uint32_t> &inflight) {
+    Ptr<Operation> next = nullptr;
+    uint64_t next_path = 0;
+    for (auto &op : program->get_executable_operations()) {
+        if (std::find(inflight.begin(), inflight.end(), op->get_id()) != inflight.end()) continue;
+        if (_config.operation_priority == OperationPriority::PROGRAM_ORDER) return op;
+        uint64_t path = program->critical_path(op);
+        if (next == nullptr || path > next_path) {
+            next = op;
+            next_path = path;
+        }
     }
+    return next;
 }
 
 uint32_t Scheduler::count_active_operations() { return _active_operation_stats.size(); }
@@ -815,15 +1463,335 @@ std::pair<std::vector<int>, std::vector<int>> Scheduler::partition_lists_dp(
     return std::make_pair(list1, list2);
 }
 
+// Same subset-sum as partition_lists_dp, but one row of reachable sums is a packed bitset,
+// so each request costs (sum / 2) / 64 word operations instead of (sum / 2) bool operations.
+// Latencies are coarsened by a power of two when the table would exceed _bitset_dp_max_bits.
+std::pair<std::vector<int>, std::vector<int>> Scheduler::partition_lists_bitset_dp(
+    std::vector<uint32_t> inputList) {
+    int n = inputList.size();
+    uint64_t totalSum = 0;
+    for (uint32_t num : inputList) {
+        totalSum += num;
+    }
+
+    uint64_t unit = 1;
+    while ((uint64_t)(n + 1) * (totalSum / unit / 2 + 1) > _bitset_dp_max_bits) {
+        unit *= 2;
+    }
+
+    std::vector<uint64_t> weights(n);
+    uint64_t scaledSum = 0;
+    for (int i = 0; i < n; ++i) {
+        weights[i] = (inputList[i] + unit / 2) / unit;
+        scaledSum += weights[i];
+    }
+    uint64_t targetSum = scaledSum / 2;
+    size_t words = targetSum / 64 + 1;
+    uint64_t last_word_mask =
+        (targetSum % 64 == 63) ? ~(uint64_t)0 : (((uint64_t)1 << (targetSum % 64 + 1)) - 1);
+
+    auto test = [](const std::vector<uint64_t> &row, uint64_t sum) {
+        return ((row[sum / 64] >> (sum % 64)) & 1) != 0;
+    };
+
+    // reach[i]: sums reachable with the first i requests (bit j <=> sum j)
+    std::vector<std::vector<uint64_t>> reach(n + 1, std::vector<uint64_t>(words, 0));
+    reach[0][0] = 1;
+    for (int i = 1; i <= n; ++i) {
+        const std::vector<uint64_t> &prev = reach[i - 1];
+        std::vector<uint64_t> &cur = reach[i];
+        cur = prev;
+
+        size_t word_shift = weights[i - 1] / 64;
+        uint32_t bit_shift = weights[i - 1] % 64;
+        for (size_t w = words; w-- > word_shift;) {
+            size_t src = w - word_shift;
+            uint64_t shifted = prev[src] << bit_shift;
+            if (bit_shift != 0 && src > 0) {
+                shifted |= prev[src - 1] >> (64 - bit_shift);
+            }
+            cur[w] |= shifted;
+        }
+        cur[words - 1] &= last_word_mask;
+    }
+
+    // Find the maximum sum that can be achieved
+    uint64_t maxSum = 0;
+    for (uint64_t j = targetSum + 1; j-- > 0;) {
+        if (test(reach[n], j)) {
+            maxSum = j;
+            break;
+        }
+    }
+
+    // Reconstruct the two lists
+    std::vector<int> list1, list2;
+    uint64_t j = maxSum;
+    for (int i = n; i > 0; --i) {
+        if (j >= weights[i - 1] && !test(reach[i - 1], j)) {
+            list1.push_back(i - 1);
+            j -= weights[i - 1];
+        } else {
+            list2.push_back(i - 1);
+        }
+    }
+    assert(j == 0);
+
+    return std::make_pair(list1, list2);
+}
+
+// Karmarkar-Karp largest differencing method, O(n log n).
+// Repeatedly replaces the two largest partial partitions by their difference,
+// placing them on opposite sides.
+std::pair<std::vector<int>, std::vector<int>> Scheduler::partition_lists_karmarkar_karp(
+    std::vector<uint32_t> inputList) {
+    struct Node {
+        uint64_t diff;
+        std::vector<int> larger;   // indices on the heavier side
+        std::vector<int> smaller;  // indices on the lighter side
+    };
+    auto cmp = [](const Node &a, const Node &b) { return a.diff < b.diff; };
+
+    if (inputList.empty()) {
+        return std::make_pair(std::vector<int>(), std::vector<int>());
+    }
+
+    std::vector<Node> heap;
+    heap.reserve(inputList.size());
+    for (int i = 0; i < inputList.size(); ++i) {
+        heap.push_back(Node{inputList[i], {i}, {}});
+    }
+    std::make_heap(heap.begin(), heap.end(), cmp);
+
+    auto append = [](std::vector<int> &dst, std::vector<int> &src) {
+        if (dst.size() < src.size()) std::swap(dst, src);
+        dst.insert(dst.end(), src.begin(), src.end());
+    };
+
+    while (heap.size() > 1) {
+        std::pop_heap(heap.begin(), heap.end(), cmp);
+        Node a = std::move(heap.back());
+        heap.pop_back();
+        std::pop_heap(heap.begin(), heap.end(), cmp);
+        Node b = std::move(heap.back());
+        heap.pop_back();
+
+        // a.diff >= b.diff: put b's heavier side together with a's lighter side
+        Node merged;
+        merged.diff = a.diff - b.diff;
+        merged.larger = std::move(a.larger);
+        append(merged.larger, b.smaller);
+        merged.smaller = std::move(a.smaller);
+        append(merged.smaller, b.larger);
+
+        heap.push_back(std::move(merged));
+        std::push_heap(heap.begin(), heap.end(), cmp);
+    }
+
+    return std::make_pair(heap.front().larger, heap.front().smaller);
+}
+
+// Longest-processing-time greedy over (channel, request) pairs of all channels.
+// A sub-batch's MHA stage ends with its slowest channel, so the key of a sub-batch is the max
+// load over its channels after adding the request there: the smallest key keeps the max load
+// over every (sub-batch, channel) lowest. Ties go to the lighter channel load, then to the
+// smaller sub-batch, which keeps the SA stage (proportional to sub-batch size) balanced as
+// well. A final pass moves single requests to another sub-batch while that lowers the max
+// stage load of the two.
+std::vector<std::vector<uint32_t>> Scheduler::partition_channel_greedy(
+    const std::vector<std::vector<uint32_t>> &latency_queues, std::vector<uint32_t> sb_sizes,
+    std::vector<std::vector<uint64_t>> &sb_latencies) {
+    uint32_t num_sub_batches = sb_sizes.size();
+    std::vector<std::pair<uint32_t, uint32_t>> order;  // (channel, index in channel)
+    for (uint32_t ch = 0; ch < latency_queues.size(); ch++) {
+        for (uint32_t i = 0; i < latency_queues[ch].size(); i++) order.push_back({ch, i});
+    }
+    auto latency = [&latency_queues](std::pair<uint32_t, uint32_t> req) -> uint64_t {
+        return latency_queues[req.first][req.second];
+    };
+    std::stable_sort(order.begin(), order.end(),
+                     [&latency](auto a, auto b) { return latency(a) > latency(b); });
+
+    // stage_loads[sb]: max over channels of sb_latencies[sb][ch]
+    auto stage_load = [&sb_latencies](uint32_t sb) {
+        return *std::max_element(sb_latencies[sb].begin(), sb_latencies[sb].end());
+    };
+    std::vector<uint64_t> stage_loads(num_sub_batches);
+    for (uint32_t sb = 0; sb < num_sub_batches; sb++) stage_loads[sb] = stage_load(sb);
+
+    std::vector<std::vector<uint32_t>> assignment(latency_queues.size());
+    for (uint32_t ch = 0; ch < latency_queues.size(); ch++)
+        assignment[ch].resize(latency_queues[ch].size());
+    for (auto req : order) {
+        uint32_t ch = req.first;
+        uint32_t target = 0;
+        std::tuple<uint64_t, uint64_t, uint32_t> best_key{UINT64_MAX, UINT64_MAX, UINT32_MAX};
+        for (uint32_t sb = 0; sb < num_sub_batches; sb++) {
+            uint64_t load = sb_latencies[sb][ch] + latency(req);
+            std::tuple<uint64_t, uint64_t, uint32_t> key{MAX(stage_loads[sb], load), load,
+                                                         sb_sizes[sb]};
+            if (key < best_key) {
+                best_key = key;
+                target = sb;
+            }
+        }
+        assignment[ch][req.second] = target;
+        sb_latencies[target][ch] += latency(req);
+        stage_loads[target] = MAX(stage_loads[target], sb_latencies[target][ch]);
+        sb_sizes[target]++;
+    }
+
+    // refinement: move a request from sb to other when max(stage(sb), stage(other)) drops
+    for (auto req : order) {
+        uint32_t ch = req.first;
+        uint32_t from = assignment[ch][req.second];
+        for (uint32_t to = 0; to < num_sub_batches; to++) {
+            if (to == from) continue;
+            uint64_t before = MAX(stage_loads[from], stage_loads[to]);
+            sb_latencies[from][ch] -= latency(req);
+            uint64_t from_load = stage_load(from);
+            uint64_t to_load = MAX(stage_loads[to], sb_latencies[to][ch] + latency(req));
+            if (MAX(from_load, to_load) < before) {
+                sb_latencies[to][ch] += latency(req);
+                stage_loads[from] = from_load;
+                stage_loads[to] = to_load;
+                sb_sizes[from]--;
+                sb_sizes[to]++;
+                assignment[ch][req.second] = to;
+                break;
+            }
+            sb_latencies[from][ch] += latency(req);
+        }
+    }
+    return assignment;
+}
+
+// K-way longest-processing-time greedy on one channel: the longest request goes to the
+// sub-batch with the lightest channel load, ties go to the globally smallest sub-batch.
+std::vector<std::vector<int>> Scheduler::partition_lists_multiway(
+    std::vector<uint32_t> inputList, std::vector<uint32_t> sb_sizes) {
+    std::vector<int> order(inputList.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&inputList](int a, int b) { return inputList[a] > inputList[b]; });
+
+    std::vector<std::vector<int>> lists(sb_sizes.size());
+    std::vector<uint64_t> loads(sb_sizes.size(), 0);
+    for (int idx : order) {
+        int target = 0;
+        for (int sb = 1; sb < sb_sizes.size(); sb++) {
+            if (loads[sb] < loads[target] ||
+                (loads[sb] == loads[target] && sb_sizes[sb] < sb_sizes[target]))
+                target = sb;
+        }
+        lists[target].push_back(idx);
+        loads[target] += inputList[idx];
+        sb_sizes[target]++;
+    }
+    return lists;
+}
+
 void Scheduler::print_stat() {
-    int prev_cycles = 0;
-    for (auto stage_stat : _stage_stats) {
-        auto stage_name = stage_stat.first;
-        auto stage_cycles = stage_stat.second;
-        auto exec_cycles = stage_cycles - prev_cycles;
+    cycle_type total_cycles = 0;
+    cycle_type total_sa_idle = 0;
+    cycle_type total_pim_idle = 0;
+    for (auto &stage_stat : _stage_stats) {
+        auto exec_cycles = stage_stat.done_cycle - stage_stat.start_cycle;
+        auto sa_idle = stage_stat.done_cycle - stage_stat.sa_done_cycle;
+        auto pim_idle = stage_stat.done_cycle - stage_stat.pim_done_cycle;
+
+        spdlog::info("Stage {} : {} cycles (SA idle {} cycles, PIM idle {} cycles)",
+                     stage_stat.name, exec_cycles, sa_idle, pim_idle);
+
+        total_cycles += exec_cycles;
+        total_sa_idle += sa_idle;
+        total_pim_idle += pim_idle;
+    }
+    if (_heterogeneous_cores)
+        spdlog::info("Heterogeneous cores : {} SA tiles dispatched out of order",
+                     _out_of_order_dispatches);
+    if (_config.per_core_tile_queues)
+        spdlog::info("Per-core tile queues : {} SA tiles stolen", _stolen_tiles);
+    if (_config.max_inflight_operations > 1)
+        spdlog::info("Concurrent dispatch : {} operations started while another was in flight, "
+                     "up to {} in flight",
+                     _concurrent_launches, _max_inflight_seen);
+    if (total_cycles > 0) {
+        spdlog::info("Stages total : {} cycles, SA idle {} cycles ({:.2f}%), PIM idle {} cycles "
+                     "({:.2f}%)",
+                     total_cycles, total_sa_idle, (double)total_sa_idle / total_cycles * 100,
+                     total_pim_idle, (double)total_pim_idle / total_cycles * 100);
+    }
+    spdlog::info("Stage barriers : SA waited {} cycles, PIM waited {} cycles for the other unit",
+                 _barrier_stat.sa_wait_cycles, _barrier_stat.pim_wait_cycles);
+    if (_config.relaxed_stage_barriers) {
+        cycle_type sa_recovered =
+            _barrier_stat.sa_barrier_idle > _barrier_stat.sa_wait_cycles
+                ? _barrier_stat.sa_barrier_idle - _barrier_stat.sa_wait_cycles
+                : 0;
+        cycle_type pim_recovered =
+            _barrier_stat.pim_barrier_idle > _barrier_stat.pim_wait_cycles
+                ? _barrier_stat.pim_barrier_idle - _barrier_stat.pim_wait_cycles
+                : 0;
+        spdlog::info("Relaxed stage barriers : SA {} of {} barrier idle cycles recovered, PIM {} "
+                     "of {}",
+                     sa_recovered, _barrier_stat.sa_barrier_idle, pim_recovered,
+                     _barrier_stat.pim_barrier_idle);
+    }
+
+    if (_config.lm_head) {
+        // iteration time with every stage scaled to the layers it stands for
+        cycle_type model_cycles = 0;
+        cycle_type lm_head_cycles = 0;
+        for (auto &stage_stat : _stage_stats) {
+            auto exec_cycles = stage_stat.done_cycle - stage_stat.start_cycle;
+            model_cycles += exec_cycles * stage_stat.layers;
+            if (stage_stat.lm_head) lm_head_cycles += exec_cycles;
+        }
+        if (model_cycles > 0) {
+            spdlog::info("LM head + sampling : {} cycles, {:.2f}% of {} cycles over {} layers "
+                         "({} iterations on PIM)",
+                         lm_head_cycles, (double)lm_head_cycles / model_cycles * 100,
+                         model_cycles, get_layers_per_pp_device(_config),
+                         _lm_head_pim_iterations);
+        }
+    }
+
+    if (_pipeline_stat.iterations > 0) {
+        spdlog::info("Pipeline parallel ({} devices, {} micro-batches) : avg iteration {} cycles, "
+                     "bubble {:.2f}%, p2p {} cycles per device",
+                     _config.n_pp, _config.pp_micro_batches,
+                     _pipeline_stat.total_cycles / _pipeline_stat.iterations,
+                     (double)_pipeline_stat.bubble_cycles / _pipeline_stat.total_cycles * 100,
+                     _pipeline_stat.p2p_cycles / _pipeline_stat.iterations);
+    }
+
+    if (_ttft_count > 0) {
+        spdlog::info("Average TTFT : {} cycles ({} requests)", _ttft_sum / _ttft_count,
+                     _ttft_count);
+    }
+
+    if (_adaptive_sub_batch) {
+        spdlog::info("Adaptive sub-batch : {} iterations split, {} iterations unsplit",
+                     _split_iterations, _unsplit_iterations);
+    }
 
-        spdlog::info("Stage {} : {} cycles", stage_name, exec_cycles);
+    if (_overhead_stat.iterations > 0) {
+        spdlog::info("Scheduler overhead : avg {:.1f} us, max {:.1f} us per iteration ({} "
+                     "iterations)",
+                     _overhead_stat.total_us / _overhead_stat.iterations, _overhead_stat.max_us,
+                     _overhead_stat.iterations);
+    }
 
-        prev_cycles = stage_cycles;
+    if (_partition_stat.calls > 0) {
+        spdlog::info("Sub-batch partition ({}) : {} calls, avg runtime {:.1f} us, max runtime {:.1f} us",
+                     partitionAlgToString(_partition_alg), _partition_stat.calls,
+                     _partition_stat.total_runtime_us / _partition_stat.calls,
+                     _partition_stat.max_runtime_us);
+        spdlog::info("Sub-batch partition ({}) : avg max channel imbalance {} cycles, "
+                     "avg MHA stage gap {} cycles",
+                     partitionAlgToString(_partition_alg),
+                     _partition_stat.total_imbalance / _partition_stat.calls,
+                     _partition_stat.total_stage_gap / _partition_stat.calls);
     }
 }
\ No newline at end of file
@@ -1,4 +1,6 @@
 #pragma once
+#include <list>
+
 #include "../Common.h"
 #include "../Model.h"
 #include "../ModelProgram.h"
@@ -16,20 +18,34 @@ class Scheduler {
     bool finish_tile(uint32_t core_id, Tile &tile);
     bool empty1();
     bool empty2();
+    bool sa_operation_running();  // tiles of an SA operation are queued or running
     bool running();
+    uint32_t count_requests() {  // queued or in a batch
+        return _waiting_requests.size() + _running_requests.size();
+    }
 
     void print_stat();
 
     bool has_stage_changed() { return _has_stage_changed; }
-    Stage get_prev_stage() { return _prev_stage; }
+    std::string get_prev_stage() { return _prev_stage; }
     void reset_has_stage_changed_status() { _has_stage_changed = false; }
 
     /* for communicating inference request & response with Client */
     virtual void cycle();
     void add_request(std::shared_ptr<InferRequest> request);
+    // free KV cache pages once the waiting requests are admitted with their prompt
+    int64_t get_kv_headroom();
     bool has_completed_request();
     std::shared_ptr<InferRequest> pop_completed_request();
 
+    // Channel-aware greedy over the requests of every channel at once.
+    // latency_queues[ch][i]: MHA latency of the i-th request of channel ch, sb_sizes: requests
+    // already in each sub-batch. Returns the sub-batch of every request ([ch][i]) and adds the
+    // loads to sb_latencies[sub-batch][channel].
+    static std::vector<std::vector<uint32_t>> partition_channel_greedy(
+        const std::vector<std::vector<uint32_t>> &latency_queues, std::vector<uint32_t> sb_sizes,
+        std::vector<std::vector<uint64_t>> &sb_latencies);
+
    protected:
     // xxx think of better way to check lifetime of operation.
     // maybe operation stat is not the name you want.
@@ -53,30 +69,80 @@ class Scheduler {
     std::deque<Tile> _executable_tile_queue1;
     std::deque<Tile> _executable_tile_queue2;
 
+    // heterogeneous cores (core_config entries differ): a core takes, among the first
+    // independent SA tiles, the one it runs best relative to the fastest core for it
+    bool _heterogeneous_cores;
+    std::vector<uint32_t> _dispatch_index1;  // per core, the tile top_tile1 handed out
+    uint64_t _out_of_order_dispatches;
+    bool select_tile1(uint32_t core_id);
+    uint64_t estimate_tile_cycles(uint32_t core_id, Tile &tile);
+
+    // per_core_tile_queues: an SA operation's tiles are spread over per-core queues, the tiles
+    // sharing a weight tile on one core, and a core that runs out steals from the fullest queue
+    std::vector<std::deque<Tile>> _core_tile_queues1;
+    uint64_t _stolen_tiles;
+    std::deque<Tile> &tile_queue1(uint32_t core_id);
+    void distribute_tiles1();
+    bool steal_tile1(uint32_t core_id);
+
     SimulationConfig _config;
     // xxx necessary?
     robin_hood::unordered_map<uint32_t, RunningOperationStat> _finished_operation_stats;
     robin_hood::unordered_map<uint32_t, RunningOperationStat> _active_operation_stats;
 
-    Stage _prev_stage;  // for stat
+    std::string _prev_stage;  // for stat
     bool _has_stage_changed;
 
     virtual void refresh_status1();
     virtual void refresh_status2();
 
+    // up to max_inflight_operations operations per program have their tiles queued or running,
+    // independent operations share the tile queue in the order they were started
+    std::vector<uint32_t> _inflight_operations1;
+    std::vector<uint32_t> _inflight_operations2;
+    uint64_t _concurrent_launches;  // operations started while another one was in flight
+    uint32_t _max_inflight_seen;
+    bool launch_operations(StageProgram *program, std::vector<uint32_t> &inflight,
+                           std::deque<Tile> &queue);
+    Ptr<Operation> next_operation(StageProgram *program, std::vector<uint32_t> &inflight);
+
     uint32_t count_active_operations();
 
     uint32_t _cycles;
-    std::deque<std::shared_ptr<InferRequest>> _request_queue;
-    std::queue<std::shared_ptr<InferRequest>> _completed_request_queue;
+
+    // request table: every request by id, linked into the list of its state in arrival order.
+    // waiting: not admitted yet, running: holds a KV cache, finished: completed and not popped
+    // by the client yet. Admission, completion and pop move a request in O(1).
+    enum class RequestState { WAITING, RUNNING, FINISHED };
+    struct RequestEntry {
+        Ptr<InferRequest> request;
+        RequestState state;
+        std::list<uint32_t>::iterator pos;  // in the list of its state
+    };
+    robin_hood::unordered_map<uint32_t, RequestEntry> _request_table;
+    std::list<uint32_t> _waiting_requests;
+    std::list<uint32_t> _running_requests;
+    std::list<uint32_t> _finished_requests;
+    std::list<uint32_t> &request_list(RequestState state);
+    void move_request(uint32_t id, RequestState state);
+
+    // wall time spent admitting, grouping and retiring requests (allocate_requests,
+    // group_sub_batches, cleanup_sub_batch), accumulated per iteration
+    struct OverheadStat {
+        uint32_t iterations;
+        double iteration_us;  // current iteration so far
+        double total_us;
+        double max_us;
+    } _overhead_stat;
     std::vector<std::vector<Ptr<InferRequest>>> _active_request_queues;
     std::vector<std::vector<uint32_t>> _active_request_latency_queues;
     std::vector<uint32_t> _active_request_accum_latencys;
     uint32_t _max_batch_size;
     uint32_t _max_active_reqs;
 
-    std::vector<Ptr<InferRequest>> _breq1;
-    std::vector<Ptr<InferRequest>> _breq2;
+    // sub-batches, _breqs[i] is sub-batch #i+1 of the stage schedule
+    uint32_t _num_sub_batches;
+    std::vector<std::vector<Ptr<InferRequest>>> _breqs;
 
     // channel load balancing
     bool _ch_load_balancing;
@@ -87,8 +153,10 @@ class Scheduler {
 
     // model dimension
     uint32_t _nh;
+    uint32_t _nkvh;  // KV heads per device (grouped-query attention if < _nh)
     uint32_t _dk;
     uint32_t _effective_e;
+    uint32_t _kv_e;  // _nkvh * _dk
 
     // memory spec
     uint32_t _dram_channels;
@@ -97,20 +165,85 @@ class Scheduler {
     uint32_t _gwrite_latency;
     uint32_t _gemv_latency;
 
+    // chunked prefill (0: off)
+    uint32_t _prefill_chunk_size;
+    cycle_type _ttft_sum;
+    uint32_t _ttft_count;
+
     void init_batches();
     void allocate_requests();  // allocate channel & assign kv cache
     void group_sub_batches();  // sub-batch interleaving algorithm
     int estimate_mha_latency(Ptr<InferRequest> request);
+    int estimate_mha_latency(uint32_t seq_len);
+    uint64_t estimate_matmul_latency(uint32_t M, uint32_t K, uint32_t N);
+    uint64_t estimate_sa_latency(uint32_t num_rows, bool proj_ffns, bool qkv_gen);
+    uint64_t estimate_layer_latency(const std::vector<StageEntry> &schedule,
+                                    std::vector<uint32_t> sb_rows,
+                                    std::vector<uint64_t> sb_mha_latencies);
 
     int allocate_pim_tile(uint32_t seq_len);
 
-    bool _partition_alg_simple;
+    PartitionAlg _partition_alg;
     std::pair<std::vector<int>, std::vector<int>> partition_lists_dp(
         std::vector<uint32_t> latency_list);
     std::pair<std::vector<int>, std::vector<int>> partition_lists_simple(
         std::vector<uint32_t> latency_list);
+    std::pair<std::vector<int>, std::vector<int>> partition_lists_bitset_dp(
+        std::vector<uint32_t> latency_list);
+    std::pair<std::vector<int>, std::vector<int>> partition_lists_karmarkar_karp(
+        std::vector<uint32_t> latency_list);
+    std::vector<std::vector<int>> partition_lists_multiway(std::vector<uint32_t> latency_list,
+                                                           std::vector<uint32_t> sb_sizes);
+
+    // bitset dp keeps (n+1) rows of (sum/2+1) bits, coarsen latencies above this budget
+    uint64_t _bitset_dp_max_bits;
+
+    // partitioning stat (accumulated over every group_sub_batches call)
+    struct PartitionStat {
+        uint32_t calls;
+        double total_runtime_us;
+        double max_runtime_us;
+        uint64_t total_imbalance;  // sum over calls of max channel (max_sb - min_sb) (cycles)
+        uint64_t total_stage_gap;  // sum over calls of max_sb(max_ch) - min_sb(max_ch) (cycles)
+    } _partition_stat;
+
+    // adaptive sub-batch interleaving: each iteration runs the split schedule or the
+    // unsplit (1 sub-batch) one, whichever is estimated to be faster
+    bool _adaptive_sub_batch;
+    std::vector<StageEntry> _split_schedule;
+    std::vector<StageEntry> _unsplit_schedule;
+    uint32_t _iteration;
+    uint32_t _split_iterations;
+    uint32_t _unsplit_iterations;
+    void decide_sub_batch_split(std::vector<uint64_t> sb_mha_latencies);
+
+    // LM head + sampling stage appended to every iteration (lm_head config)
+    StageEntry lm_head_stage();
+    bool emits_token(Ptr<InferRequest> request);
+    uint32_t _lm_head_pim_iterations;
 
-    void make_program();
+    // pipeline parallelism (pp_accounting, n_pp > 1), accounted analytically once per iteration
+    struct PipelineStat {
+        uint32_t iterations;
+        cycle_type device_cycles;  // one device, its layer slice, whole batch
+        cycle_type total_cycles;   // iteration through every pipeline device
+        cycle_type bubble_cycles;  // per device
+        cycle_type p2p_cycles;     // per device
+    } _pipeline_stat;
+    size_t _iteration_first_stage_stat;  // first _stage_stats entry of the current iteration
+    void account_pipeline_iteration();
+
+    // Every unit walks the stage schedule on its own: _sa_stage / _pim_stage count the stages
+    // the unit has finished this iteration (the one it runs or waits for next), _stage those
+    // both have finished. A unit starts a stage once the other unit has finished
+    // stage_dependency of them (see there), so with stage barriers both start stage t together.
+    uint32_t _sa_stage;
+    uint32_t _pim_stage;
+    uint32_t stage_dependency(StagePlatform platform, uint32_t stage);
+    bool stage_ready(StagePlatform platform);
+    std::vector<Ptr<InferRequest>> stage_requests(StagePlatform platform, uint32_t stage);
+    void make_program1();
+    void make_program2();
 
     void refresh_stage();
     void finish_program1();
@@ -120,9 +253,12 @@ class Scheduler {
 
     uint32_t _active_reqs;
 
-    Stage _stage;
-    Stage _init_stage;     // default A, if you want to start from other stage, set it
+    // index into _stage_schedule, _stage_schedule.size() means the iteration is finished
+    std::vector<StageEntry> _stage_schedule;
+    uint32_t _stage;
+    uint32_t _init_stage;  // default 0, if you want to start from other stage, set it
     bool _just_one_stage;  // default false, if you want to run just one stage, set it
+    bool is_finish_stage() { return _stage >= _stage_schedule.size(); }
 
     uint32_t _total_tiles;
     uint32_t _total_available_tiles;
@@ -133,7 +269,7 @@ class Scheduler {
     uint32_t _key_page_size;  // # of pim tile in page (related to available_tiles)
     uint32_t _value_page_size;
 
-    // explanation on Stage
+    // explanation on Stage (default 2 sub-batch schedule, see make_stage_schedule)
     //
     // |     |     A    |     B    |         C        |         D        |     E     |     F     |
     // |-----|:--------:|:--------:|:----------------:|:----------------:|:---------:|:---------:|
@@ -143,6 +279,35 @@ class Scheduler {
     // number of layers (variable): N
     // Total execution time: A + B + (C+D)*(N-1) + E + F
     //
+    // With K sub-batches there are K prologue, K steady and K epilogue stages.
+
+    // per-stage stat: a unit is idle from its program's finish until the stage ends
+    struct StageStat {
+        std::string name;
+        cycle_type start_cycle;
+        cycle_type sa_done_cycle;
+        cycle_type pim_done_cycle;
+        cycle_type done_cycle;
+        uint32_t layers;  // layers of the model this stage stands for
+        bool lm_head;
+    };
+    std::vector<StageStat> _stage_stats;
+    // per stage of the current iteration, when each unit started and finished its program
+    struct UnitCycles {
+        cycle_type start;
+        cycle_type done;
+    };
+    std::vector<UnitCycles> _sa_cycles;
+    std::vector<UnitCycles> _pim_cycles;
+    cycle_type _stage_done_cycle;  // the last stage both units finished
 
-    std::vector<std::pair<std::string, uint32_t>> _stage_stats;
+    // cycles a unit had no program while its next stage waited for the other unit, and, with
+    // relaxed_stage_barriers, what it would have idled had every stage been a barrier
+    // (the longer program of each stage minus its own)
+    struct BarrierStat {
+        cycle_type sa_wait_cycles;
+        cycle_type pim_wait_cycles;
+        cycle_type sa_barrier_idle;
+        cycle_type pim_barrier_idle;
+    } _barrier_stat;
 };
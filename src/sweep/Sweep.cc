@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <map>
+#include <thread>
+
+#include "../RequestGenerator.h"
+#include "../Simulator.h"
+#include "../helper/CommandLineParser.h"
+
+namespace fs = std::filesystem;
+
+// Design-space sweep: every point of a configuration grid runs as its own Simulator on a
+// thread pool inside one process. Config files and request traces are parsed once and shared
+// read-only by every point, and all points end up in one results table.
+//
+// The grid is a json object of axes, e.g. {"max_batch_size": [128, 256], "sub_batch_mode":
+// [false, true], "mem_config": ["a.json", "b.json"]}. An axis is either one of the config file
+// options (config, mem_config, model_config, sys_config, cli_config) or a config key; a key
+// overrides the hardware, memory or model config that has it, any other key the system config.
+
+static const std::vector<std::string> config_file_options = {"config", "mem_config",
+                                                              "model_config", "sys_config",
+                                                              "cli_config"};
+
+struct SweepAxis {
+    std::string key;
+    std::vector<json> values;
+};
+
+// immutable inputs shared by every point
+struct SweepInputs {
+    std::map<std::string, std::string> base_paths;  // config file option -> path
+    std::map<std::string, json> configs;            // path -> parsed config file
+    std::map<std::string, std::shared_ptr<const RequestTrace>> traces;  // path -> trace
+};
+
+struct SweepResult {
+    bool ok;
+    std::string error;
+    cycle_type core_cycles;
+    uint32_t requests;
+    uint64_t generated_tokens;
+    double token_throughput;    // tokens/s
+    double request_throughput;  // requests/s
+    cycle_type p50_latency;
+    cycle_type p99_latency;
+    double wall_seconds;
+};
+
+bool is_config_file_option(std::string key) {
+    return std::find(config_file_options.begin(), config_file_options.end(), key) !=
+           config_file_options.end();
+}
+
+std::string value_to_string(const json &value) {
+    return value.is_string() ? value.get<std::string>() : value.dump();
+}
+
+std::vector<SweepAxis> parse_grid(json grid) {
+    std::vector<SweepAxis> axes;
+    for (auto &item : grid.items()) {
+        std::string key = item.key();
+        json values = item.value();
+        if (!values.is_array() || values.empty())
+            throw std::runtime_error(fmt::format("Sweep axis {} needs a non-empty list", key));
+        SweepAxis axis{.key = key};
+        for (auto &value : values) {
+            if (is_config_file_option(key) && !value.is_string())
+                throw std::runtime_error(fmt::format("Sweep axis {} takes file paths", key));
+            axis.values.push_back(value);
+        }
+        axes.push_back(axis);
+    }
+    return axes;
+}
+
+// cartesian product, the last axis varies fastest
+std::vector<std::vector<uint32_t>> make_points(const std::vector<SweepAxis> &axes) {
+    std::vector<std::vector<uint32_t>> points = {{}};
+    for (auto &axis : axes) {
+        std::vector<std::vector<uint32_t>> next_points;
+        for (auto &point : points) {
+            for (uint32_t i = 0; i < axis.values.size(); i++) {
+                next_points.push_back(point);
+                next_points.back().push_back(i);
+            }
+        }
+        points = next_points;
+    }
+    return points;
+}
+
+SweepInputs load_inputs(std::map<std::string, std::string> base_paths,
+                        const std::vector<SweepAxis> &axes) {
+    SweepInputs inputs{.base_paths = base_paths};
+    auto load = [&inputs](std::string option, std::string path) {
+        if (option == "cli_config") {
+            if (!inputs.traces.count(path)) inputs.traces[path] = RequestTrace::parse(path);
+        } else if (!inputs.configs.count(path)) {
+            inputs.configs[path] = load_config(path);
+        }
+    };
+    for (auto &[option, path] : base_paths) load(option, path);
+    for (auto &axis : axes) {
+        if (!is_config_file_option(axis.key)) continue;
+        for (auto &value : axis.values) load(axis.key, value.get<std::string>());
+    }
+    return inputs;
+}
+
+SweepResult run_point(const SweepInputs &inputs, const std::vector<SweepAxis> &axes,
+                      const std::vector<uint32_t> &point, std::string log_dir) {
+    SweepResult result{};
+    auto start = std::chrono::steady_clock::now();
+    try {
+        std::map<std::string, std::string> paths = inputs.base_paths;
+        for (size_t i = 0; i < axes.size(); i++) {
+            if (is_config_file_option(axes[i].key))
+                paths[axes[i].key] = axes[i].values[point[i]].get<std::string>();
+        }
+        json npu_config = inputs.configs.at(paths["config"]);
+        json mem_config = inputs.configs.at(paths["mem_config"]);
+        json model_config = inputs.configs.at(paths["model_config"]);
+        json sys_config = inputs.configs.at(paths["sys_config"]);
+        for (size_t i = 0; i < axes.size(); i++) {
+            std::string key = axes[i].key;
+            if (is_config_file_option(key)) continue;
+            json &target = npu_config.contains(key)     ? npu_config
+                           : mem_config.contains(key)   ? mem_config
+                           : model_config.contains(key) ? model_config
+                                                        : sys_config;
+            target[key] = axes[i].values[point[i]];
+        }
+
+        SimulationConfig config = initialize_config(npu_config);
+        initialize_memory_config(config, mem_config);
+        initialize_client_config(config, paths["cli_config"]);
+        config.request_trace = inputs.traces.at(paths["cli_config"]);
+        initialize_model_config(config, model_config);
+        initialize_system_config(config, sys_config);
+        config.log_dir = log_dir;
+        fs::create_directories(log_dir);
+
+        Simulator simulator(config);
+        simulator.load_model();
+        simulator.run(config.model_name);
+
+        std::vector<cycle_type> latencies;
+        for (auto &request : simulator.get_completed_requests()) {
+            latencies.push_back(request->completed_cycle - request->arrival_cycle);
+            result.generated_tokens += request->generated;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        // nearest-rank percentile
+        auto percentile = [&latencies](double p) -> cycle_type {
+            if (latencies.empty()) return 0;
+            size_t rank = (size_t)ceil(p * latencies.size());
+            return latencies[MAX(rank, (size_t)1) - 1];
+        };
+
+        double seconds = (double)simulator.get_core_cycles() / (config.core_freq * 1e6);
+        result.ok = true;
+        result.core_cycles = simulator.get_core_cycles();
+        result.requests = latencies.size();
+        result.token_throughput = seconds > 0 ? result.generated_tokens / seconds : 0;
+        result.request_throughput = seconds > 0 ? latencies.size() / seconds : 0;
+        result.p50_latency = percentile(0.5);
+        result.p99_latency = percentile(0.99);
+    } catch (const std::exception &e) {
+        result.ok = false;
+        result.error = e.what();
+    }
+    result.wall_seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void write_results(std::string fname, const std::vector<SweepAxis> &axes,
+                   const std::vector<std::vector<uint32_t>> &points,
+                   const std::vector<SweepResult> &results) {
+    std::ofstream ofile(fname);
+    if (!ofile.is_open()) throw std::runtime_error(fmt::format("Cannot open {}", fname));
+
+    ofile << "point\t";
+    for (auto &axis : axes) ofile << axis.key << "\t";
+    ofile << "status\tcore_cycles\trequests\tgenerated_tokens\ttokens_per_s\trequests_per_s\t"
+             "p50_latency\tp99_latency\twall_s\n";
+    for (size_t p = 0; p < points.size(); p++) {
+        const SweepResult &result = results[p];
+        ofile << p << "\t";
+        for (size_t i = 0; i < axes.size(); i++)
+            ofile << value_to_string(axes[i].values[points[p][i]]) << "\t";
+        ofile << (result.ok ? "ok" : "error: " + result.error) << "\t" << result.core_cycles
+              << "\t" << result.requests << "\t" << result.generated_tokens << "\t"
+              << fmt::format("{:.2f}\t{:.2f}\t", result.token_throughput,
+                             result.request_throughput)
+              << result.p50_latency << "\t" << result.p99_latency << "\t"
+              << fmt::format("{:.1f}", result.wall_seconds) << "\n";
+    }
+    ofile.close();
+}
+
+int main(int argc, char **argv) {
+    CommandLineParser cmd_parser = CommandLineParser();
+    cmd_parser.add_command_line_option<std::string>("config",
+                                                    "Path for hardware configuration file");
+    cmd_parser.add_command_line_option<std::string>("mem_config",
+                                                    "Path for memory configuration file");
+    cmd_parser.add_command_line_option<std::string>("cli_config",
+                                                    "Path for client configuration file");
+    cmd_parser.add_command_line_option<std::string>("model_config",
+                                                    "Path for model configuration file");
+    cmd_parser.add_command_line_option<std::string>("sys_config",
+                                                    "Path for system configuration file");
+    cmd_parser.add_command_line_option<std::string>("grid", "Path for sweep grid file");
+    cmd_parser.add_command_line_option<std::string>(
+        "log_dir", "Path for experiment result log directory, one sub-directory per point");
+    cmd_parser.add_command_line_option<std::string>(
+        "output", "Path for the results table, default = <log_dir>/sweep_results.tsv");
+    cmd_parser.add_command_line_option<std::string>(
+        "threads", "Number of points simulated concurrently, default = hardware threads");
+    cmd_parser.add_command_line_option<std::string>(
+        "log_level", "Set for log level [trace, debug, info, warn], default = warn");
+
+    try {
+        cmd_parser.parse(argc, argv);
+    } catch (const CommandLineParser::ParsingError &e) {
+        spdlog::error("Command line argument parrsing error captured. Error message: {}", e.what());
+        throw(e);
+    }
+    std::string level = "warn";
+    cmd_parser.set_if_defined("log_level", &level);
+    spdlog::set_level(spdlog::level::from_str(level));
+
+    std::map<std::string, std::string> base_paths;
+    for (auto &option : config_file_options) {
+        std::string path;
+        cmd_parser.set_if_defined(option.c_str(), &path);
+        base_paths[option] = path;
+    }
+    std::string grid_path;
+    cmd_parser.set_if_defined("grid", &grid_path);
+    std::string log_dir_path;
+    cmd_parser.set_if_defined("log_dir", &log_dir_path);
+    std::string output_path = log_dir_path + "/sweep_results.tsv";
+    cmd_parser.set_if_defined("output", &output_path);
+    std::string threads = std::to_string(MAX(std::thread::hardware_concurrency(), 1u));
+    cmd_parser.set_if_defined("threads", &threads);
+    uint32_t num_threads = MAX(std::stoi(threads), 1);
+
+    std::vector<SweepAxis> axes = parse_grid(load_config(grid_path));
+    std::vector<std::vector<uint32_t>> points = make_points(axes);
+    SweepInputs inputs = load_inputs(base_paths, axes);
+    fmt::print("Sweep: {} points, {} threads\n", points.size(), num_threads);
+
+    std::vector<SweepResult> results(points.size());
+    std::atomic<size_t> next_point{0};
+    std::atomic<size_t> finished_points{0};
+    std::vector<std::thread> workers;
+    for (uint32_t t = 0; t < MIN(num_threads, (uint32_t)points.size()); t++) {
+        workers.emplace_back([&]() {
+            for (size_t p = next_point++; p < points.size(); p = next_point++) {
+                std::string log_dir = log_dir_path + "/point_" + std::to_string(p);
+                results[p] = run_point(inputs, axes, points[p], log_dir);
+                fmt::print("[{}/{}] point {} {} ({:.1f} s)\n", ++finished_points, points.size(),
+                           p, results[p].ok ? "done" : "failed: " + results[p].error,
+                           results[p].wall_seconds);
+            }
+        });
+    }
+    for (auto &worker : workers) worker.join();
+
+    write_results(output_path, axes, points, results);
+    fmt::print("Sweep results: {}\n", output_path);
+    return 0;
+}
@@ -3,6 +3,7 @@
 #include "../Common.h"
 
 class Operation;
+class SimContext;
 
 class BTensor {
    public:
@@ -26,6 +27,7 @@ class BTensor {
     virtual std::vector<addr_type> get_all_addrs() = 0;
     virtual void add_token() = 0;
 
+    SimContext *_ctx;
     bool _produced;
     uint32_t _id;
     std::string _name;
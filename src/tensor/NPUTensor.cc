@@ -15,15 +15,16 @@
  *      buf_type: NPUTensorBufType::ACT
  *      dimension: 3D (including batch?)
  */
-NPUTensor::NPUTensor(std::string name, std::vector<uint32_t> dims, NPUTensorBufType buf_type,
-                     bool produced) {
+NPUTensor::NPUTensor(SimContext *ctx, std::string name, std::vector<uint32_t> dims,
+                     NPUTensorBufType buf_type, bool produced) {
     ast(buf_type != NPUTensorBufType::KV);
 
-    _id = generate_id();
+    _ctx = ctx;
+    _id = _ctx->generate_id();
     _name = name;
     _dims = dims;
     _produced = produced;
-    _precision = Config::global_config.precision;
+    _precision = _ctx->config.precision;
 
     uint32_t num_inners = 1;
     std::vector<uint32_t> inner_dims = dims;
@@ -32,7 +33,7 @@ NPUTensor::NPUTensor(std::string name, std::vector<uint32_t> dims, NPUTensorBufT
         inner_dims = slice(dims, 1, -1);
     }
     for (int i = 0; i < num_inners; ++i) {
-        _inners.push_back(std::make_shared<NPUTensor2D>(inner_dims, buf_type));
+        _inners.push_back(std::make_shared<NPUTensor2D>(_ctx, inner_dims, buf_type));
     }
 
     _is_transposed = false;
@@ -48,13 +49,14 @@ NPUTensor::NPUTensor(std::string name, std::vector<uint32_t> dims, NPUTensorBufT
  *      kv_type: NPUTensorKVType::Value
  *      dimension: 3D (nh,T,dk)
  */
-NPUTensor::NPUTensor(std::string name, std::vector<uint32_t> dims, NPUTensorKVType kv_type,
-                     bool produced) {
-    _id = generate_id();
+NPUTensor::NPUTensor(SimContext *ctx, std::string name, std::vector<uint32_t> dims,
+                     NPUTensorKVType kv_type, bool produced) {
+    _ctx = ctx;
+    _id = _ctx->generate_id();
     _name = name;
     _dims = dims;
     _produced = produced;
-    _precision = Config::global_config.precision;
+    _precision = _ctx->config.precision;
 
     uint32_t num_inners = 1;
     std::vector<uint32_t> inner_dims = dims;
@@ -68,16 +70,17 @@ NPUTensor::NPUTensor(std::string name, std::vector<uint32_t> dims, NPUTensorKVTy
         inner_dims = slice(dims, 1, -1);
     }
     for (int i = 0; i < num_inners; ++i) {
-        _inners.push_back(std::make_shared<NPUTensorKV>(inner_dims, kv_type));
+        _inners.push_back(std::make_shared<NPUTensorKV>(_ctx, inner_dims, kv_type));
     }
 }
 
 NPUTensor::NPUTensor(std::string name, Ptr<NPUTensor2D> tensor, bool produced) {
-    _id = generate_id();
+    _ctx = tensor->_ctx;
+    _id = _ctx->generate_id();
     _name = name;
     _dims = tensor->_dims;
     _produced = produced;
-    _precision = Config::global_config.precision;
+    _precision = _ctx->config.precision;
     _inners = {tensor};
 }
 
@@ -7,9 +7,10 @@
 class NPUTensor : public BTensor {
    public:
     NPUTensor() = default;
-    NPUTensor(std::string name, std::vector<uint32_t> dims, NPUTensorBufType buf_type,
-              bool produced);
-    NPUTensor(std::string name, std::vector<uint32_t> dims, NPUTensorKVType kv_type, bool produced);
+    NPUTensor(SimContext *ctx, std::string name, std::vector<uint32_t> dims,
+              NPUTensorBufType buf_type, bool produced);
+    NPUTensor(SimContext *ctx, std::string name, std::vector<uint32_t> dims,
+              NPUTensorKVType kv_type, bool produced);
     NPUTensor(std::string name, Ptr<NPUTensor2D> tensor, bool produced);
     ~NPUTensor() = default;
 
@@ -2,17 +2,17 @@
 
 #include "../allocator/AddressAllocator.h"
 
-NPUTensor2D::NPUTensor2D(std::vector<uint32_t> dims, NPUTensorBufType buf_type)
-    : NPUTensorInner(dims, buf_type) {
-    _size = Config::global_config.precision;
+NPUTensor2D::NPUTensor2D(SimContext *ctx, std::vector<uint32_t> dims, NPUTensorBufType buf_type)
+    : NPUTensorInner(ctx, dims, buf_type) {
+    _size = _precision;
     for (auto dim : dims) {
         _size *= dim;
     }
 
     if (buf_type == NPUTensorBufType::WGT)
-        _base_addr = WgtAlloc::GetInstance()->allocate(_size);
+        _base_addr = _ctx->wgt_alloc.allocate(_size);
     else if (buf_type == NPUTensorBufType::ACT)
-        _base_addr = ActAlloc::GetInstance()->allocate(_size);
+        _base_addr = _ctx->act_alloc.allocate(_size);
 }
 
 addr_type NPUTensor2D::get_addr(std::vector<uint32_t> indexes) {
@@ -22,8 +22,8 @@ addr_type NPUTensor2D::get_addr(std::vector<uint32_t> indexes) {
         return _base_addr + indexes[0] * _precision;
 
     // return _base_addr + (indexes[0] * _dims[1] + indexes[1]) * _precision;
-    return AddressConfig::switch_co_ch(_base_addr +
-                                       (indexes[0] * _dims[1] + indexes[1]) * _precision);
+    return _ctx->address.switch_co_ch(_base_addr +
+                                      (indexes[0] * _dims[1] + indexes[1]) * _precision);
 }
 
 std::vector<addr_type> NPUTensor2D::get_all_addrs() {
@@ -63,6 +63,7 @@ std::vector<Ptr<NPUTensor2D>> NPUTensor2D::split_by_row(std::vector<uint32_t> ro
 
     for (auto row_dim : row_dims) {
         auto tensor = std::make_shared<NPUTensor2D>();
+        tensor->_ctx = _ctx;
         tensor->_base_addr = get_addr({base_idx, 0});
         tensor->_dims = {row_dim, column_size};
         tensor->_size = _precision * row_dim * column_size;
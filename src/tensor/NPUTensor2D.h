@@ -5,7 +5,7 @@
 class NPUTensor2D : public NPUTensorInner {
    public:
     NPUTensor2D() = default;
-    NPUTensor2D(std::vector<uint32_t> dims, NPUTensorBufType buf_type);
+    NPUTensor2D(SimContext *ctx, std::vector<uint32_t> dims, NPUTensorBufType buf_type);
     virtual addr_type get_addr(std::vector<uint32_t> indexes);
     virtual std::vector<addr_type> get_all_addrs();
     std::vector<addr_type> get_row_addrs(uint32_t row_idx);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../Common.h"
+#include "../SimContext.h"
 
 // TensorBufType indicates which buffer the tensor is stored in.
 // Weights might also be stored in the ACT (activation) buffer.
@@ -9,11 +10,12 @@ enum class NPUTensorBufType { WGT, ACT, KV };  // weight, activation, key/value
 class NPUTensorInner {
    public:
     NPUTensorInner() = default;
-    NPUTensorInner(std::vector<uint32_t> dims, NPUTensorBufType buf_type)
-        : _dims(dims), _buf_type(buf_type), _precision(Config::global_config.precision) {}
+    NPUTensorInner(SimContext *ctx, std::vector<uint32_t> dims, NPUTensorBufType buf_type)
+        : _ctx(ctx), _dims(dims), _buf_type(buf_type), _precision(ctx->config.precision) {}
     virtual addr_type get_addr(std::vector<uint32_t> indexes) = 0;
     virtual std::vector<addr_type> get_all_addrs() = 0;
 
+    SimContext *_ctx;
     addr_type _base_addr;
     std::vector<uint32_t> _dims;
     uint64_t _size;
@@ -11,9 +11,9 @@
  *      each n in Key and Value is divided into 32.
  *      so, (d_k,n) values become ceil(n,32) of (d_k,32)
  */
-NPUTensorKV::NPUTensorKV(std::vector<uint32_t> dims, NPUTensorKVType kv_type)
-    : NPUTensorInner(dims, NPUTensorBufType::KV), _kv_type(kv_type) {
-    auto alloc = KVCacheAlloc::GetInstance();
+NPUTensorKV::NPUTensorKV(SimContext *ctx, std::vector<uint32_t> dims, NPUTensorKVType kv_type)
+    : NPUTensorInner(ctx, dims, NPUTensorBufType::KV), _kv_type(kv_type) {
+    auto alloc = &_ctx->kv_cache_alloc;
     _kv_cache_entry_size = alloc->_kv_cache_entry_size;
 
     // K: [h, d_k, n], V: [h, n, d_k]
@@ -32,8 +32,6 @@ NPUTensorKV::NPUTensorKV(std::vector<uint32_t> dims, NPUTensorKVType kv_type)
 addr_type NPUTensorKV::get_addr(std::vector<uint32_t> indexes) {
     // key: [dk, seq_len]
     // value: [seq_len, dk]
-    auto alloc = KVCacheAlloc::GetInstance();
-
     uint32_t seq_idx = _kv_type == NPUTensorKVType::KEY ? indexes[1] : indexes[0];
     uint32_t byte_idx = _kv_type == NPUTensorKVType::KEY ? indexes[0] : indexes[1];
     uint32_t dk = _kv_type == NPUTensorKVType::KEY ? _dims[0] : _dims[1];
@@ -41,7 +39,7 @@ addr_type NPUTensorKV::get_addr(std::vector<uint32_t> indexes) {
     uint32_t idx = floor((double)seq_idx / (double)_kv_cache_entry_size);
     addr_type base_addr = _bases[idx];
     uint32_t offset = ((seq_idx % _kv_cache_entry_size) * dk + byte_idx) * _precision;
-    return AddressConfig::switch_co_ch(base_addr + offset);
+    return _ctx->address.switch_co_ch(base_addr + offset);
 }
 
 std::vector<addr_type> NPUTensorKV::get_all_addrs() {
@@ -77,5 +75,5 @@ void NPUTensorKV::add_token() {
 
     if (_seq_len <= get_allocated_seq_len()) return;
 
-    _bases.push_back(KVCacheAlloc::GetInstance()->allocate());
+    _bases.push_back(_ctx->kv_cache_alloc.allocate());
 }
\ No newline at end of file
@@ -7,7 +7,7 @@ enum class NPUTensorKVType { KEY, VALUE };
 class NPUTensorKV : public NPUTensorInner {
    public:
     NPUTensorKV() = default;
-    NPUTensorKV(std::vector<uint32_t> dims, NPUTensorKVType kv_type);
+    NPUTensorKV(SimContext *ctx, std::vector<uint32_t> dims, NPUTensorKVType kv_type);
     virtual addr_type get_addr(std::vector<uint32_t> indexes);
     virtual std::vector<addr_type> get_all_addrs();
     uint32_t get_allocated_seq_len();
@@ -1,21 +1,23 @@
 #include "PIMTensor.h"
 
-#include "../allocator/AddressAllocator.h"
+#include "../SimContext.h"
 
-PIMTensor::PIMTensor(std::string name, uint32_t ch, std::vector<uint32_t> dims,
+PIMTensor::PIMTensor(SimContext *ctx, std::string name, uint32_t ch, std::vector<uint32_t> dims,
                      PIMTensorKVType kv_type, bool produced) {
+    _ctx = ctx;
     _name = name;
     _ch = ch;
     _dims = dims;  // [h, seq_len, d_k] or [h, d_k, seq_len]
-    _precision = Config::global_config.precision;
+    _precision = _ctx->config.precision;
     _produced = produced;
     _kv_type = kv_type;
 
-    auto alloc = KVCacheAlloc::GetInstance();
+    auto alloc = &_ctx->kv_cache_alloc;
     _seq_len = kv_type == PIMTensorKVType::KEY ? dims[2] : dims[1];
     _bank_per_ch = alloc->_bank_per_ch;
     _num_ele_per_row = alloc->_num_ele_per_row;
-    _E = Config::global_config.model_n_embd;
+    // rows hold the heads of this tensor only (device share of KV heads with TP / GQA)
+    _E = kv_type == PIMTensorKVType::KEY ? dims[0] * dims[1] : dims[0] * dims[2];
 
     uint32_t num_alloc_iter = 0;  // calculate # of allocation iterations based on seq_len.
     if (kv_type == PIMTensorKVType::KEY) {
@@ -57,7 +59,7 @@ void PIMTensor::add_token() {
     if (_seq_len <= get_allocated_seq_len()) return;
 
     for (int i = 0; i < _num_rows_per_alloc; ++i)
-        _rows.push_back(KVCacheAlloc::GetInstance()->allocate(_ch));
+        _rows.push_back(_ctx->kv_cache_alloc.allocate(_ch));
 }
 
 uint32_t PIMTensor::get_num_rows() { return _rows.size(); }
@@ -7,8 +7,8 @@ enum class PIMTensorKVType { KEY, VALUE };
 class PIMTensor : public BTensor {
    public:
     PIMTensor() = default;
-    PIMTensor(std::string name, uint32_t ch, std::vector<uint32_t> dims, PIMTensorKVType kv_type,
-              bool produced);
+    PIMTensor(SimContext *ctx, std::string name, uint32_t ch, std::vector<uint32_t> dims,
+              PIMTensorKVType kv_type, bool produced);
     ~PIMTensor() = default;
 
     virtual addr_type get_addr(std::vector<uint32_t> indexes) override;